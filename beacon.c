@@ -40,9 +40,34 @@ module_param(enable_short_bcn_as_dtim_override, int, 0644);
 MODULE_PARM_DESC(enable_short_bcn_as_dtim_override,
 		 "Override enable for short beacon to be the DTIM beacon (experimental)");
 
+static bool enable_beacon_template = true;
+module_param(enable_beacon_template, bool, 0644);
+MODULE_PARM_DESC(enable_beacon_template,
+		 "Reuse the converted S1G beacon while its content is unchanged");
+
 static unsigned long beacon_irqs_enabled;
 static bool enable_short_bcn_as_dtim;
 
+/**
+ * Configuration that affects the converted S1G beacon but is not visible in the beacon
+ * provided by mac80211. Hashed into the template key.
+ */
+struct morse_beacon_template_cfg {
+	u32 op_chan_freq_hz;
+	u32 tsf_upper;
+	u8 op_bw_mhz;
+	u8 pri_bw_mhz;
+	u8 pri_1mhz_chan_idx;
+	u8 s1g_operating_class;
+	u8 sta_type;
+	u8 dtim_period;
+	bool enable_ampdu;
+	bool enable_trav_pilot;
+	bool enable_sgi_rc;
+	bool has_tim;
+	struct ieee80211_s1g_cap s1g_cap;
+};
+
 bool morse_mac_is_s1g_long_beacon(struct morse *mors, struct sk_buff *skb)
 {
 	bool ret = false;
@@ -128,14 +153,223 @@ static void morse_beacon_fill_tx_info(struct morse *mors, struct morse_skb_tx_in
 
 	tx_info->rates[0].morse_ratecode = morse_ratecode_init(bw_idx, nss_index, mcs_index, pream);
 	tx_info->rates[0].count = 1;
-	mors->debug.mcs_stats_tbl.mcs0.tx_beacons++;
-	mors->debug.mcs_stats_tbl.mcs0.tx_success++;
+	MORSE_MCS_STAT_INC(mors, mcs0.tx_beacons);
+	MORSE_MCS_STAT_INC(mors, mcs0.tx_success);
 	tx_info->rates[1].count = 0;
 	/* Enable immediate report flag if fw reports tx completion status */
 	if (mors->firmware_flags & MORSE_FW_FLAGS_REPORTS_TX_BEACON_COMPLETION)
 		tx_info->flags |= cpu_to_le32(MORSE_TX_CONF_FLAGS_IMMEDIATE_REPORT);
 }
 
+void morse_beacon_template_invalidate(struct morse_vif *mors_vif)
+{
+	atomic_inc(&mors_vif->beacon_templates.gen);
+}
+
+static void morse_beacon_template_free(struct morse_vif *mors_vif)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(mors_vif->beacon_templates.tmpl); i++) {
+		struct morse_beacon_template *tmpl = &mors_vif->beacon_templates.tmpl[i];
+
+		kfree(tmpl->frame);
+		tmpl->frame = NULL;
+		tmpl->len = 0;
+		tmpl->valid = false;
+	}
+}
+
+/**
+ * morse_beacon_template_usable() - Check whether the S1G beacon can be served from a template
+ *
+ * Beacons that carry content changing independently of the mac80211 beacon on every TBTT
+ * (mesh beacon timing, page slicing, channel switch counters and MBSSID) are always built in
+ * full.
+ *
+ * @mors_vif:	Beaconing VIF
+ * @ies:	IEs of the mac80211 beacon
+ * @ies_len:	Length of @ies
+ *
+ * Return: true if a template may be used or saved for this beacon
+ */
+static bool morse_beacon_template_usable(struct morse_vif *mors_vif, const u8 *ies, int ies_len)
+{
+	struct ieee80211_vif *vif = morse_vif_to_ieee80211_vif(mors_vif);
+	struct morse *mors = morse_vif_to_morse(mors_vif);
+
+	if (!enable_beacon_template || vif->type != NL80211_IFTYPE_AP || !mors_vif->ap)
+		return false;
+
+	if (mors_vif->ecsa_chan_configured || mors_vif->page_slicing_info.enabled)
+		return false;
+
+	if (morse_mbssid_ie_enabled(mors) && mors_vif->mbssid_info.max_bssid_indicator > 1)
+		return false;
+
+	if (cfg80211_find_ie(WLAN_EID_CHANNEL_SWITCH, ies, ies_len) ||
+	    cfg80211_find_ie(WLAN_EID_EXT_CHANSWITCH_ANN, ies, ies_len))
+		return false;
+
+	return true;
+}
+
+/**
+ * morse_beacon_template_key() - Hash everything the converted S1G beacon is built from
+ *
+ * The TIM and timestamp are excluded as they are patched into every beacon.
+ *
+ * @mors_vif:	Beaconing VIF
+ * @beacon:	Beacon provided by mac80211
+ * @tim_ie:	TIM element within @beacon, or NULL
+ *
+ * Return: template key
+ */
+static u32 morse_beacon_template_key(struct morse_vif *mors_vif, struct sk_buff *beacon,
+				     const u8 *tim_ie)
+{
+	struct ieee80211_vif *vif = morse_vif_to_ieee80211_vif(mors_vif);
+	struct ieee80211_mgmt *mgmt = (struct ieee80211_mgmt *)beacon->data;
+	struct morse_custom_configs *cfgs = mors_vif->custom_configs;
+	struct morse_beacon_template_cfg cfg;
+	const u8 *start = (const u8 *)&mgmt->u.beacon.beacon_int;
+	const u8 *end = beacon->data + beacon->len;
+	u64 now_usecs = jiffies_to_usecs((get_jiffies_64() - mors_vif->epoch));
+	u32 crc;
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.op_chan_freq_hz = cfgs->channel_info.op_chan_freq_hz;
+	cfg.tsf_upper = UPPER_32_BITS(now_usecs);
+	cfg.op_bw_mhz = cfgs->channel_info.op_bw_mhz;
+	cfg.pri_bw_mhz = cfgs->channel_info.pri_bw_mhz;
+	cfg.pri_1mhz_chan_idx = cfgs->channel_info.pri_1mhz_chan_idx;
+	cfg.s1g_operating_class = cfgs->channel_info.s1g_operating_class;
+	cfg.sta_type = cfgs->sta_type;
+	cfg.dtim_period = vif->bss_conf.dtim_period;
+	cfg.enable_ampdu = cfgs->enable_ampdu;
+	cfg.enable_trav_pilot = cfgs->enable_trav_pilot;
+	cfg.enable_sgi_rc = cfgs->enable_sgi_rc;
+	cfg.has_tim = !!tim_ie;
+	cfg.s1g_cap = mors_vif->s1g_cap_ie;
+
+	crc = crc32(~0, (void *)&cfg, sizeof(cfg));
+	crc = crc32(crc, mgmt->bssid, ETH_ALEN);
+	if (tim_ie) {
+		crc = crc32(crc, start, tim_ie - start);
+		start = tim_ie + 2 + tim_ie[1];
+	}
+	crc = crc32(crc, start, end - start);
+
+	return ~crc;
+}
+
+/**
+ * morse_beacon_template_save() - Save a fully built S1G beacon as the template for its type
+ *
+ * @tmpl:	Template to update
+ * @hdr:	S1G beacon header
+ * @hdr_len:	Length of @hdr
+ * @ies:	Ordered S1G IEs, including the TIM
+ * @ies_len:	Length of @ies
+ * @key:	Key the beacon was built from
+ * @gen:	Invalidation generation sampled before the beacon was built
+ */
+static void morse_beacon_template_save(struct morse_beacon_template *tmpl,
+				       const u8 *hdr, int hdr_len,
+				       const u8 *ies, int ies_len, u32 key, u32 gen)
+{
+	const u8 *tim = cfg80211_find_ie(WLAN_EID_TIM, ies, ies_len);
+	int tim_pos = tim ? (tim - ies) : ies_len;
+	int tim_len = tim ? (tim[1] + 2) : 0;
+	int len = hdr_len + ies_len - tim_len;
+
+	tmpl->valid = false;
+
+	if (len > tmpl->len || !tmpl->frame) {
+		kfree(tmpl->frame);
+		tmpl->len = 0;
+		tmpl->frame = kmalloc(len, GFP_ATOMIC);
+		if (!tmpl->frame)
+			return;
+	}
+
+	memcpy(tmpl->frame, hdr, hdr_len);
+	memcpy(tmpl->frame + hdr_len, ies, tim_pos);
+	memcpy(tmpl->frame + hdr_len + tim_pos, ies + tim_pos + tim_len,
+	       ies_len - tim_pos - tim_len);
+
+	tmpl->len = len;
+	tmpl->tim_offset = hdr_len + tim_pos;
+	tmpl->key = key;
+	tmpl->gen = gen;
+	tmpl->valid = true;
+}
+
+/**
+ * morse_beacon_from_template() - Build the S1G beacon from a template
+ *
+ * Only the S1G TIM is converted from the mac80211 beacon, the rest of the frame is copied from
+ * @tmpl. The caller patches the timestamp.
+ *
+ * @mors_vif:	Beaconing VIF
+ * @beacon:	Beacon provided by mac80211, consumed by this function
+ * @tim_ie:	TIM element within @beacon, or NULL
+ * @tmpl:	Valid template for this beacon
+ * @ies_mask:	Empty IEs mask used to convert the TIM
+ *
+ * Return: S1G beacon, or NULL on failure
+ */
+static struct sk_buff *morse_beacon_from_template(struct morse_vif *mors_vif,
+						  struct sk_buff *beacon, const u8 *tim_ie,
+						  const struct morse_beacon_template *tmpl,
+						  struct dot11ah_ies_mask *ies_mask)
+{
+	struct ieee80211_vif *vif = morse_vif_to_ieee80211_vif(mors_vif);
+	struct morse *mors = morse_vif_to_morse(mors_vif);
+	__le16 fc = ((const struct ieee80211_ext *)tmpl->frame)->frame_control;
+	struct ieee80211_ext *s1g_beacon;
+	int tim_len = 0;
+	int len;
+	u8 *pos;
+
+	if (tim_ie) {
+		/* The converted TIM is a copy owned by the IEs mask, independent of the skb */
+		morse_dot11ah_ies_mask_set(ies_mask, WLAN_EID_TIM, (u8 *)tim_ie + 2, tim_ie[1]);
+		morse_dot11ah_insert_s1g_tim(vif, ies_mask, S1G_TIM_PAGE_SLICE_ENTIRE_PAGE, 0);
+		tim_len = morse_dot11_insert_ordered_ies_from_ies_mask(beacon, NULL, ies_mask, fc);
+	}
+
+	len = tmpl->len + tim_len;
+
+	if ((beacon->len + skb_tailroom(beacon)) < len) {
+		struct sk_buff *skb2;
+
+		skb2 = skb_copy_expand(beacon, skb_headroom(beacon), len - beacon->len,
+				       GFP_ATOMIC);
+		if (!skb2) {
+			kfree_skb(beacon);
+			return NULL;
+		}
+
+		/* Just say we transmitted it */
+		MORSE_IEEE80211_TX_STATUS(mors->hw, beacon);
+		beacon = skb2;
+	}
+
+	skb_trim(beacon, 0);
+	pos = skb_put(beacon, len);
+	memcpy(pos, tmpl->frame, tmpl->tim_offset);
+	pos += tmpl->tim_offset;
+	if (tim_len)
+		pos += morse_dot11_insert_ordered_ies_from_ies_mask(beacon, pos, ies_mask, fc);
+	memcpy(pos, tmpl->frame + tmpl->tim_offset, tmpl->len - tmpl->tim_offset);
+
+	s1g_beacon = (struct ieee80211_ext *)beacon->data;
+	s1g_beacon->u.s1g_beacon.change_seq = mors_vif->s1g_bcn_change_seq;
+
+	return beacon;
+}
+
 static void morse_beacon_tasklet(unsigned long data)
 {
 	struct morse_skbq *mq;
@@ -145,6 +379,7 @@ static void morse_beacon_tasklet(unsigned long data)
 	struct ieee80211_vif *vif;
 	struct morse *mors;
 	struct morse_skb_tx_info tx_info = { 0 };
+	const u8 *rps_ie;
 	u8 rps_ie_size;
 	const u8 *tim_ie;
 	bool short_beacon;
@@ -162,6 +397,9 @@ static void morse_beacon_tasklet(unsigned long data)
 	bool fw_reports_tx_beacon_comp;
 	int num_bcn_vifs;
 	uint long_beacon_dtim_count;
+	struct morse_beacon_template *tmpl = NULL;
+	u32 tmpl_key = 0;
+	u32 tmpl_gen = 0;
 
 	if (!mors_vif || !mors_vif->custom_configs)
 		return;
@@ -249,6 +487,20 @@ static void morse_beacon_tasklet(unsigned long data)
 
 	s1g_beacon_ies = morse_mac_get_ie_pos(beacon, &s1g_ies_length, &s1g_hdr_length, false);
 
+	if (morse_beacon_template_usable(mors_vif, s1g_beacon_ies, s1g_ies_length)) {
+		tmpl = &mors_vif->beacon_templates.tmpl[!short_beacon];
+		tmpl_gen = atomic_read(&mors_vif->beacon_templates.gen);
+		tmpl_key = morse_beacon_template_key(mors_vif, beacon, tim_ie);
+
+		if (tmpl->valid && tmpl->key == tmpl_key && tmpl->gen == tmpl_gen) {
+			beacon = morse_beacon_from_template(mors_vif, beacon, tim_ie, tmpl,
+							    ies_mask);
+			if (!beacon)
+				goto exit;
+			goto patch;
+		}
+	}
+
 	/* Parse out the original IEs so we can mess with them */
 	if (morse_dot11ah_parse_ies(s1g_beacon_ies, s1g_ies_length, ies_mask) < 0) {
 		kfree_skb(beacon);
@@ -260,11 +512,9 @@ static void morse_beacon_tasklet(unsigned long data)
 	/* Insert RPS IE if RAW is enabled. We will place it at the end and it
 	 * will be reordered by the 11n to s1g layer.
 	 */
-	rps_ie_size = morse_raw_get_rps_ie_size(mors_vif);
-	if (rps_ie_size != 0)
-		morse_dot11ah_insert_element(ies_mask,
-					     WLAN_EID_S1G_RPS,
-					     morse_raw_get_rps_ie(mors_vif), rps_ie_size);
+	rps_ie = morse_raw_get_rps_ie(mors_vif, &rps_ie_size);
+	if (rps_ie)
+		morse_dot11ah_insert_element(ies_mask, WLAN_EID_S1G_RPS, rps_ie, rps_ie_size);
 
 	morse_cac_insert_ie(ies_mask, vif, beacon_mgmt->frame_control);
 
@@ -317,12 +567,6 @@ static void morse_beacon_tasklet(unsigned long data)
 		goto exit;
 	}
 
-	s1g_beacon = (struct ieee80211_ext *)beacon->data;
-
-	/* Lower 32 bits Get inserted into the timestamp field here */
-	s1g_beacon->u.s1g_beacon.timestamp =
-	    cpu_to_le32(LOWER_32_BITS(morse_mac_generate_timestamp_for_frame(mors_vif)));
-
 	morse_mac_update_custom_s1g_capab(mors_vif, ies_mask, vif->type);
 
 	/* Need to calculate the IEs length from the ies_mask */
@@ -364,6 +608,17 @@ static void morse_beacon_tasklet(unsigned long data)
 
 	spin_unlock_bh(&mors_vif->vendor_ie.lock);
 
+	if (tmpl)
+		morse_beacon_template_save(tmpl, beacon->data, s1g_hdr_length,
+					   s1g_beacon_ies, s1g_ies_length, tmpl_key, tmpl_gen);
+
+patch:
+	s1g_beacon = (struct ieee80211_ext *)beacon->data;
+
+	/* Lower 32 bits Get inserted into the timestamp field here */
+	s1g_beacon->u.s1g_beacon.timestamp =
+	    cpu_to_le32(LOWER_32_BITS(morse_mac_generate_timestamp_for_frame(mors_vif)));
+
 	if (vif->bss_conf.dtim_period)
 		mors_vif->dtim_count = (mors_vif->dtim_count + 1) % vif->bss_conf.dtim_period;
 	else
@@ -458,6 +713,7 @@ int morse_beacon_init(struct morse_vif *mors_vif)
 		enable_short_bcn_as_dtim = mors->cfg->enable_short_bcn_as_dtim;
 	}
 
+	atomic_set(&mors_vif->beacon_templates.gen, 0);
 	tasklet_init(&mors_vif->beacon_tasklet, morse_beacon_tasklet, (unsigned long)mors_vif);
 
 	ret = morse_beacon_irq_enable(mors_vif, true);
@@ -472,5 +728,6 @@ void morse_beacon_finish(struct morse_vif *mors_vif)
 
 	morse_beacon_irq_enable(mors_vif, false);
 	tasklet_kill(&mors_vif->beacon_tasklet);
+	morse_beacon_template_free(mors_vif);
 	atomic_dec(&mors->num_bcn_vifs);
 }
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2024 Morse Micro
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ */
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/scatterlist.h>
+
+#include "morse.h"
+#include "bus.h"
+
+int morse_bus_sg_slice(struct scatterlist *src, int src_nents, u32 skip, u32 len,
+		       struct scatterlist *dst, int dst_nents)
+{
+	struct scatterlist *sg;
+	int used = 0;
+	int i;
+
+	if (!len || dst_nents <= 0)
+		return -EINVAL;
+
+	sg_init_table(dst, dst_nents);
+
+	for_each_sg(src, sg, src_nents, i) {
+		u32 seg_len = sg->length;
+		u32 seg_off = sg->offset;
+
+		if (skip >= seg_len) {
+			skip -= seg_len;
+			continue;
+		}
+
+		seg_off += skip;
+		seg_len = min(seg_len - skip, len);
+		skip = 0;
+
+		if (used == dst_nents)
+			return -E2BIG;
+
+		/* Keep the offset within the first page, as DMA mapping expects */
+		sg_set_page(&dst[used++], nth_page(sg_page(sg), seg_off >> PAGE_SHIFT),
+			    seg_len, offset_in_page(seg_off));
+
+		len -= seg_len;
+		if (!len)
+			break;
+	}
+
+	if (len)
+		return -EINVAL;
+
+	sg_mark_end(&dst[used - 1]);
+	return used;
+}
+
+bool morse_bus_sg_check(struct morse *mors, struct scatterlist *sgl, int nents,
+			unsigned int max_seg_size)
+{
+	struct scatterlist *sg;
+	int i;
+
+	if (nents > MORSE_BUS_SG_MAX_ENTS)
+		return false;
+
+	for_each_sg(sgl, sg, nents, i) {
+		if (!IS_ALIGNED(sg->offset, mors->bus_ops->bulk_alignment) ||
+		    !IS_ALIGNED(sg->length, sizeof(u32)) ||
+		    sg->length > max_seg_size)
+			return false;
+	}
+
+	return true;
+}
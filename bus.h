@@ -8,16 +8,23 @@
  *
  */
 #include <linux/skbuff.h>
+#include <linux/scatterlist.h>
 
 #include "morse.h"
+#include "trace.h"
 
 /**
  * struct morse_bus_ops - bus callback operations.
  *
  * @morse_dm_write: direct memory write.
  * @morse_dm_read: direct memory read.
+ * @dm_write_sg: (optional) direct memory write gathered from a scatterlist. Returns
+ *	-EOPNOTSUPP, without touching the bus, if the list cannot be sent as is so
+ *	the caller can fall back to @dm_write.
  * @morse_req32_write: word memory write.
  * @morse_reg32_read: word memory read.
+ * @set_pipelined: (optional) select between the pipelined and the synchronous bulk
+ *	transfer engines. Returns the previous selection.
  *
  * This structure provides an abstract interface towards the
  * bus specific driver. For control messages to common driver
@@ -27,6 +34,8 @@
 struct morse_bus_ops {
 	int (*dm_read)(struct morse *mors, u32 addr, u8 *data, int len);
 	int (*dm_write)(struct morse *mors, u32 addr, const u8 *data, int len);
+	int (*dm_write_sg)(struct morse *mors, u32 addr, struct scatterlist *sgl, int nents,
+			   int len);
 	int (*reg32_read)(struct morse *mors, u32 addr, u32 *data);
 	int (*reg32_write)(struct morse *mors, u32 addr, u32 data);
 	int (*skb_tx)(struct morse *mors, struct sk_buff *skb, u8 channel);
@@ -35,6 +44,7 @@ struct morse_bus_ops {
 	void (*config_burst_mode)(struct morse *mors, bool enable_burst);
 	void (*claim)(struct morse *mors);
 	void (*set_irq)(struct morse *mors, bool enable);
+	bool (*set_pipelined)(struct morse *mors, bool enable);
 	void (*release)(struct morse *mors);
 	unsigned int bulk_alignment;
 };
@@ -44,25 +54,68 @@ struct morse_bus_ops {
  */
 #define MORSE_DEFAULT_BULK_ALIGNMENT	(2)
 
+/** Maximum number of scatterlist entries accepted by a single dm_write_sg call */
+#define MORSE_BUS_SG_MAX_ENTS		(64)
+
 static inline int morse_dm_write(struct morse *mors, u32 addr, const u8 *data, int len)
 {
-	return mors->bus_ops->dm_write(mors, addr, data, len);
+	ktime_t start = morse_trace_start(morse_bus);
+	int ret = mors->bus_ops->dm_write(mors, addr, data, len);
+
+	trace_morse_bus(MORSE_TRACE_BUS_DM_WRITE, addr, len, start, ret);
+	return ret;
+}
+
+static inline bool morse_bus_has_dm_write_sg(struct morse *mors)
+{
+	return !!mors->bus_ops->dm_write_sg;
+}
+
+/*
+ * morse_dm_write_sg - each entry must be bulk aligned and a multiple of 4 bytes long,
+ * and nents must not exceed MORSE_BUS_SG_MAX_ENTS.
+ */
+static inline int morse_dm_write_sg(struct morse *mors, u32 addr, struct scatterlist *sgl,
+				    int nents, int len)
+{
+	ktime_t start;
+	int ret;
+
+	if (!mors->bus_ops->dm_write_sg)
+		return -EOPNOTSUPP;
+
+	start = morse_trace_start(morse_bus);
+	ret = mors->bus_ops->dm_write_sg(mors, addr, sgl, nents, len);
+	trace_morse_bus(MORSE_TRACE_BUS_DM_WRITE_SG, addr, len, start, ret);
+	return ret;
 }
 
 /* morse_dm_read - len must be rounded up to the nearest 4-byte boundary */
 static inline int morse_dm_read(struct morse *mors, u32 addr, u8 *data, int len)
 {
-	return mors->bus_ops->dm_read(mors, addr, data, len);
+	ktime_t start = morse_trace_start(morse_bus);
+	int ret = mors->bus_ops->dm_read(mors, addr, data, len);
+
+	trace_morse_bus(MORSE_TRACE_BUS_DM_READ, addr, len, start, ret);
+	return ret;
 }
 
 static inline int morse_reg32_write(struct morse *mors, u32 addr, u32 data)
 {
-	return mors->bus_ops->reg32_write(mors, addr, data);
+	ktime_t start = morse_trace_start(morse_bus);
+	int ret = mors->bus_ops->reg32_write(mors, addr, data);
+
+	trace_morse_bus(MORSE_TRACE_BUS_REG32_WRITE, addr, sizeof(data), start, ret);
+	return ret;
 }
 
 static inline int morse_reg32_read(struct morse *mors, u32 addr, u32 *data)
 {
-	return mors->bus_ops->reg32_read(mors, addr, data);
+	ktime_t start = morse_trace_start(morse_bus);
+	int ret = mors->bus_ops->reg32_read(mors, addr, data);
+
+	trace_morse_bus(MORSE_TRACE_BUS_REG32_READ, addr, sizeof(*data), start, ret);
+	return ret;
 }
 
 static inline void morse_set_bus_enable(struct morse *mors, bool enable)
@@ -90,8 +143,37 @@ static inline void morse_bus_set_irq(struct morse *mors, bool enable)
 	mors->bus_ops->set_irq(mors, enable);
 }
 
+/**
+ * morse_bus_sg_slice() - Describe a byte range of a scatterlist with another scatterlist.
+ *
+ * @src: Source scatterlist.
+ * @src_nents: Number of entries in @src.
+ * @skip: Offset in bytes into @src at which the range starts.
+ * @len: Length in bytes of the range.
+ * @dst: Table to populate. Entries reference the memory of @src, no data is copied.
+ * @dst_nents: Number of entries available in @dst.
+ *
+ * Return: number of entries used in @dst, or a negative errno.
+ */
+int morse_bus_sg_slice(struct scatterlist *src, int src_nents, u32 skip, u32 len,
+		       struct scatterlist *dst, int dst_nents);
+
+/**
+ * morse_bus_sg_check() - Check a scatterlist satisfies the requirements of dm_write_sg.
+ *
+ * @mors: Morse chip instance.
+ * @sgl: Scatterlist to check.
+ * @nents: Number of entries in @sgl.
+ * @max_seg_size: Largest segment the bus can transfer in one go.
+ *
+ * Return: true if every entry is bulk aligned, word sized and no larger than @max_seg_size.
+ */
+bool morse_bus_sg_check(struct morse *mors, struct scatterlist *sgl, int nents,
+			unsigned int max_seg_size);
+
 int morse_bus_test(struct morse *mors, const char *bus_name);
 void morse_bus_throughput_profiler(struct morse *mors);
+void morse_bus_engine_profiler(struct morse *mors);
 void morse_bus_interrupt_profiler_irq(struct morse *mors);
 int morse_skb_tx(struct morse *mors, struct sk_buff *skb, u8 channel);
 
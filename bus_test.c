@@ -523,4 +523,94 @@ void morse_bus_throughput_profiler(struct morse *mors)
 	morse_bus_interrupt_profiler(mors);
 }
 
+
+/* Number of bulk transfers timed per engine in the engine profiler */
+#define PROFILER_ENGINE_NUM_LOOPS	(32)
+
+static u64 morse_bus_engine_kbps(struct morse *mors, bool is_read, u8 *buf, u32 size,
+				 u32 *errors)
+{
+	u32 dm_addr = mors->cfg->regs->pager_base_address;
+	ktime_t start;
+	u64 us_elapsed;
+	int i;
+
+	morse_claim_bus(mors);
+	start = ktime_get();
+
+	for (i = 0; i < PROFILER_ENGINE_NUM_LOOPS; i++) {
+		int ret = is_read ? mors->bus_ops->dm_read(mors, dm_addr, buf, size) :
+				    mors->bus_ops->dm_write(mors, dm_addr, buf, size);
+
+		if (ret)
+			(*errors)++;
+	}
+
+	us_elapsed = ktime_to_us(ktime_sub(ktime_get(), start));
+	morse_release_bus(mors);
+
+	if (!us_elapsed)
+		return 0;
+
+	/* bytes per usec -> kbps */
+	return div64_u64((u64)size * PROFILER_ENGINE_NUM_LOOPS * 8 * 1000, us_elapsed);
+}
+
+/**
+ * morse_bus_engine_profiler() - Compare the bulk throughput of the bus transfer engines.
+ *
+ * @mors: Morse chip instance.
+ *
+ * Only meaningful for buses implementing set_pipelined.
+ */
+void morse_bus_engine_profiler(struct morse *mors)
+{
+	const u32 sizes[] = { 2 * 1024, 16 * 1024, BUS_TEST_MAX_BLOCK_SIZE };
+	bool was_pipelined;
+	u32 errors = 0;
+	u8 *buf;
+	int i;
+
+	if (!mors->bus_ops->set_pipelined) {
+		MORSE_ERR(mors, "Bus has a single transfer engine\n");
+		return;
+	}
+
+	buf = kmalloc(BUS_TEST_MAX_BLOCK_SIZE, GFP_KERNEL);
+	if (!buf)
+		return;
+
+	for (i = 0; i < BUS_TEST_MAX_BLOCK_SIZE; i++)
+		buf[i] = i * 0x11;
+
+	dev_info(mors->dev, "Bus engine profiler\n");
+	dev_info(mors->dev, "    rounds:              %u\n", PROFILER_ENGINE_NUM_LOOPS);
+	dev_info(mors->dev, "    %8s %14s %14s %14s %14s\n", "size", "sync wr kbps",
+		 "pipe wr kbps", "sync rd kbps", "pipe rd kbps");
+
+	was_pipelined = mors->bus_ops->set_pipelined(mors, false);
+
+	for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+		u64 sync_wr, pipe_wr, sync_rd, pipe_rd;
+
+		mors->bus_ops->set_pipelined(mors, false);
+		sync_wr = morse_bus_engine_kbps(mors, false, buf, sizes[i], &errors);
+		sync_rd = morse_bus_engine_kbps(mors, true, buf, sizes[i], &errors);
+
+		mors->bus_ops->set_pipelined(mors, true);
+		pipe_wr = morse_bus_engine_kbps(mors, false, buf, sizes[i], &errors);
+		pipe_rd = morse_bus_engine_kbps(mors, true, buf, sizes[i], &errors);
+
+		dev_info(mors->dev, "    %8u %14llu %14llu %14llu %14llu\n", sizes[i],
+			 sync_wr, pipe_wr, sync_rd, pipe_rd);
+	}
+
+	mors->bus_ops->set_pipelined(mors, was_pipelined);
+
+	if (errors)
+		dev_info(mors->dev, "    Errors in IO: %u\n", errors);
+
+	kfree(buf);
+}
+
 #endif
@@ -162,6 +162,7 @@ static void cac_timer_work(struct morse_cac *cac)
 		threshold_change = cac_set_threshold_change(cac, end_of_period);
 		if (threshold_change != 0) {
 			cac_threshold_change(cac, threshold_change);
+			morse_beacon_template_invalidate(container_of(cac, struct morse_vif, cac));
 			MORSE_CAC_INFO(mors, "CAC: Set threshold %u (period=%u)\n",
 				cac->threshold_value, cac->cac_period_used);
 			end_of_period = true;
@@ -231,6 +232,8 @@ int morse_cac_deinit(struct morse_vif *mors_vif)
 	if (!mors_vif->ap)
 		return 0;
 
+	morse_beacon_template_invalidate(mors_vif);
+
 	del_timer_sync(&cac->timer);
 
 	return 0;
@@ -300,6 +303,7 @@ int morse_cac_init(struct morse *mors, struct morse_vif *mors_vif)
 	cac->threshold_value = CAC_THRESHOLD_MAX;
 	morse_cac_cfg_threshold_rules_default(mors, mors_vif);
 	cac->enabled = 1;
+	morse_beacon_template_invalidate(mors_vif);
 
 	return 0;
 }
@@ -28,6 +28,7 @@
 #include "mesh.h"
 #include "morse_commands.h"
 #include "wiphy.h"
+#include "trace.h"
 
 #define MM_BA_TIMEOUT (5000)
 #define MM_MAX_COMMAND_RETRY 2
@@ -55,6 +56,7 @@ struct morse_cmd_resp_cb {
 	int ret;
 	u32 length;
 	struct morse_cmd_resp *dest_resp;
+	struct completion *comp;
 };
 
 /* Set driver to chip command timeout: max to wait (in ms) before failing the command */
@@ -62,6 +64,50 @@ static u32 default_cmd_timeout_ms __read_mostly = MM_CMD_DEFAULT_TIMEOUT_MS;
 module_param(default_cmd_timeout_ms, uint, 0644);
 MODULE_PARM_DESC(default_cmd_timeout_ms, "Default command timeout (in ms)");
 
+/* Number of commands which may await a response at once */
+static uint max_cmds_in_flight __read_mostly = 4;
+module_param(max_cmds_in_flight, uint, 0444);
+MODULE_PARM_DESC(max_cmds_in_flight,
+		 "Maximum number of outstanding commands (1 sends one command at a time)");
+
+void morse_cmd_pipeline_init(struct morse *mors)
+{
+	/* The window must leave sequence numbers unused, to tell late responses apart */
+	sema_init(&mors->cmd_wait, clamp_t(uint, max_cmds_in_flight, 1,
+					   MORSE_CMD_HOST_ID_SEQ_MAX / 2));
+	mutex_init(&mors->cmd_ps_lock);
+	mors->cmd_in_flight = 0;
+}
+
+/*
+ * Power save is held off from the first outstanding command until the last one is responded
+ * to or timed out, so a burst of commands only wakes the chip once. Waking the chip may sleep,
+ * so this is serialised on cmd_ps_lock rather than cmd_lock, which the response path needs.
+ */
+static void morse_cmd_ps_hold(struct morse *mors)
+{
+	mutex_lock(&mors->cmd_ps_lock);
+	if (mors->cmd_in_flight++ == 0)
+		morse_ps_disable(mors);
+	mutex_unlock(&mors->cmd_ps_lock);
+}
+
+static void morse_cmd_ps_release(struct morse *mors)
+{
+	mutex_lock(&mors->cmd_ps_lock);
+	if (--mors->cmd_in_flight == 0)
+		morse_ps_enable(mors);
+	mutex_unlock(&mors->cmd_ps_lock);
+}
+
+/* Request carried by a command skb which has been sent to the chip, skipping the skb header */
+static struct morse_cmd_req *morse_cmd_skb_req(struct sk_buff *skb)
+{
+	struct morse_buff_skb_header *hdr = (struct morse_buff_skb_header *)skb->data;
+
+	return (struct morse_cmd_req *)(skb->data + sizeof(*hdr) + hdr->offset);
+}
+
 static void morse_cmd_init(struct morse *mors, struct morse_cmd_header *hdr,
 			   enum morse_cmd_id cmd, u16 vif_id, u16 len)
 {
@@ -115,6 +161,7 @@ static int morse_cmd_tx(struct morse *mors, struct morse_cmd_resp *resp,
 	u16 host_id;
 	int retry = 0;
 	unsigned long wait_ret = 0;
+	ktime_t start;
 	struct sk_buff *skb;
 	struct morse_skbq *cmd_q = mors->cfg->ops->skbq_cmd_tc_q(mors);
 	struct morse_cmd_resp_cb *resp_cb;
@@ -129,14 +176,18 @@ static int morse_cmd_tx(struct morse *mors, struct morse_cmd_resp *resp,
 	cmd_len = sizeof(*req) + le16_to_cpu(req->hdr.len);
 	req->hdr.flags = cpu_to_le16(MORSE_CMD_TYPE_REQ);
 
-	mutex_lock(&mors->cmd_wait);
+	/* Wait for room in the window of outstanding commands */
+	down(&mors->cmd_wait);
+
+	mutex_lock(&mors->cmd_lock);
 	mors->cmd_seq++;
 	if (mors->cmd_seq > MORSE_CMD_HOST_ID_SEQ_MAX)
 		mors->cmd_seq = 1;
 	host_id = mors->cmd_seq << MORSE_CMD_HOST_ID_SEQ_SHIFT;
+	mutex_unlock(&mors->cmd_lock);
 
 	/* Make sure no one enables PS until the command is responded to or timed out */
-	morse_ps_disable(mors);
+	morse_cmd_ps_hold(mors);
 
 	do {
 		req->hdr.host_id = cpu_to_le16(host_id | retry);
@@ -151,15 +202,16 @@ static int morse_cmd_tx(struct morse *mors, struct morse_cmd_resp *resp,
 		resp_cb = (struct morse_cmd_resp_cb *)IEEE80211_SKB_CB(skb)->driver_data;
 		resp_cb->length = length;
 		resp_cb->dest_resp = resp;
+		resp_cb->comp = &cmd_comp;
 
 		MORSE_DBG(mors, "CMD 0x%04x:%04x\n", le16_to_cpu(req->hdr.message_id),
 			  le16_to_cpu(req->hdr.host_id));
 
 		mutex_lock(&mors->cmd_lock);
-		mors->cmd_comp = &cmd_comp;
 		if (retry > 0)
 			reinit_completion(&cmd_comp);
 		timeout = timeout ? timeout : default_cmd_timeout_ms;
+		start = morse_trace_start(morse_cmd);
 		ret = morse_skbq_skb_tx(cmd_q, &skb, NULL, MORSE_SKB_CHAN_COMMAND);
 		mutex_unlock(&mors->cmd_lock);
 
@@ -170,7 +222,6 @@ static int morse_cmd_tx(struct morse *mors, struct morse_cmd_resp *resp,
 
 		wait_ret = wait_for_completion_timeout(&cmd_comp, msecs_to_jiffies(timeout));
 		mutex_lock(&mors->cmd_lock);
-		mors->cmd_comp = NULL;
 
 		if (!wait_ret) {
 			MORSE_INFO(mors, "Try:%d Command %04x:%04x timeout after %u ms\n",
@@ -188,6 +239,8 @@ static int morse_cmd_tx(struct morse *mors, struct morse_cmd_resp *resp,
 					  le16_to_cpu(req->hdr.message_id),
 					  le16_to_cpu(req->hdr.host_id), ret);
 		}
+		trace_morse_cmd(le16_to_cpu(req->hdr.message_id), le16_to_cpu(req->hdr.host_id),
+				retry, start, ret);
 		/* Free the command request */
 		spin_lock_bh(&cmd_q->lock);
 		morse_skbq_skb_finish(cmd_q, skb, NULL);
@@ -197,8 +250,8 @@ static int morse_cmd_tx(struct morse *mors, struct morse_cmd_resp *resp,
 		retry++;
 	} while ((ret == -ETIMEDOUT) && retry < MM_MAX_COMMAND_RETRY);
 
-	morse_ps_enable(mors);
-	mutex_unlock(&mors->cmd_wait);
+	morse_cmd_ps_release(mors);
+	up(&mors->cmd_wait);
 
 	if (ret == -ETIMEDOUT)
 		MORSE_ERR(mors, "Command %s %02x:%02x timed out\n",
@@ -612,7 +665,8 @@ int morse_cmd_resp_process(struct morse *mors, struct sk_buff *skb)
 	struct morse_skbq *cmd_q = mors->cfg->ops->skbq_cmd_tc_q(mors);
 	struct morse_cmd_resp *src_resp = (struct morse_cmd_resp *)(skb->data);
 	struct sk_buff *cmd_skb = NULL;
-	struct morse_cmd_resp_cb *resp_cb;
+	struct sk_buff *pskb;
+	struct morse_cmd_resp_cb *resp_cb = NULL;
 	struct morse_cmd_resp *dest_resp;
 	struct morse_cmd_req *req;
 	u16 message_id = 0;
@@ -630,16 +684,22 @@ int morse_cmd_resp_process(struct morse *mors, struct sk_buff *skb)
 
 	mutex_lock(&mors->cmd_lock);
 
-	cmd_skb = morse_skbq_tx_pending(cmd_q);
-	if (cmd_skb) {
-		morse_skb_remove_hdr_after_sent_to_chip(cmd_skb);
-		req = (struct morse_cmd_req *)cmd_skb->data;
-		message_id = le16_to_cpu(req->hdr.message_id);
-		host_id = le16_to_cpu(req->hdr.host_id);
+	/* Several commands may be outstanding, find the one with the response's sequence ID */
+	spin_lock_bh(&cmd_q->lock);
+	skb_queue_walk(&cmd_q->pending, pskb) {
+		req = morse_cmd_skb_req(pskb);
+		if ((le16_to_cpu(req->hdr.host_id) & MORSE_CMD_HOST_ID_SEQ_MASK) ==
+		    (resp_host_id & MORSE_CMD_HOST_ID_SEQ_MASK)) {
+			cmd_skb = pskb;
+			message_id = le16_to_cpu(req->hdr.message_id);
+			host_id = le16_to_cpu(req->hdr.host_id);
+			break;
+		}
 	}
+	spin_unlock_bh(&cmd_q->lock);
 
 	/*
-	 * If there is no pending command or the sequence ID does not match, this is a late response
+	 * If there is no matching command or its message ID differs, this is a late response
 	 * for a timed out command which has been cleaned up, so just free up the response.
 	 * If a command was retried, the response may be from the retry or from the original
 	 * command (late response) but not from both because the firmware will silently drop
@@ -674,11 +734,9 @@ int morse_cmd_resp_process(struct morse *mors, struct sk_buff *skb)
 	resp_cb->ret = ret;
 
 exit:
-	if (cmd_skb && !is_late_response) {
-		/* Complete if not already timed out */
-		if (mors->cmd_comp)
-			complete(mors->cmd_comp);
-	}
+	/* Still pending, so the command has not timed out */
+	if (cmd_skb && !is_late_response)
+		complete(resp_cb->comp);
 
 	mutex_unlock(&mors->cmd_lock);
 exit_free:
@@ -76,6 +76,7 @@ int morse_cmd_get_max_txpower(struct morse *mors, s32 *out_power);
 int morse_cmd_add_if(struct morse *mors, u16 *id, const u8 *addr, enum nl80211_iftype type);
 int morse_cmd_rm_if(struct morse *mors, u16 id);
 int morse_cmd_resp_process(struct morse *mors, struct sk_buff *skb);
+void morse_cmd_pipeline_init(struct morse *mors);
 int morse_cmd_cfg_bss(struct morse *mors, u16 id, u16 beacon_int, u16 dtim_period, u32 cssid);
 
 /**
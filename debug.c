@@ -132,37 +132,75 @@ static void print_stat(struct seq_file *file, const char *desc, u32 val)
 	seq_printf(file, "%s: %u\n", desc, val);
 }
 
+int morse_debug_stats_alloc(struct morse *mors)
+{
+	mors->debug.stats = alloc_percpu(struct morse_debug_stats);
+
+	return mors->debug.stats ? 0 : -ENOMEM;
+}
+
+void morse_debug_stats_free(struct morse *mors)
+{
+	free_percpu(mors->debug.stats);
+	mors->debug.stats = NULL;
+}
+
+/* The counter structs are made up of unsigned ints only, so sum them as arrays */
+static void morse_debug_sum_counters(unsigned int *sum, const unsigned int *cpu_stats,
+				     size_t size)
+{
+	size_t i;
+
+	for (i = 0; i < size / sizeof(*sum); i++)
+		sum[i] += cpu_stats[i];
+}
+
+static void morse_debug_page_stats_sum(struct morse *mors, struct morse_page_stats *sum)
+{
+	int cpu;
+
+	BUILD_BUG_ON(sizeof(*sum) % sizeof(unsigned int));
+
+	memset(sum, 0, sizeof(*sum));
+	for_each_possible_cpu(cpu)
+		morse_debug_sum_counters((unsigned int *)sum,
+					 (unsigned int *)&per_cpu_ptr(mors->debug.stats, cpu)->page,
+					 sizeof(*sum));
+}
+
 static int read_page_stats(struct seq_file *file, void *data)
 {
 	struct morse *mors = dev_get_drvdata(file->private);
-
-	print_stat(file, "Command Tx", mors->debug.page_stats.cmd_tx);
-	print_stat(file, "Beacon Tx", mors->debug.page_stats.bcn_tx);
-	print_stat(file, "Management Tx", mors->debug.page_stats.mgmt_tx);
-	print_stat(file, "Data Tx", mors->debug.page_stats.data_tx);
-	print_stat(file, "Page write fail", mors->debug.page_stats.write_fail);
-	print_stat(file, "No page", mors->debug.page_stats.no_page);
-	print_stat(file, "No command page", mors->debug.page_stats.cmd_no_page);
-	print_stat(file, "Command page retry", mors->debug.page_stats.cmd_rsv_page_retry);
-	print_stat(file, "No beacon page", mors->debug.page_stats.bcn_no_page);
-	print_stat(file, "Excessive beacon loss", mors->debug.page_stats.excessive_bcn_loss);
-	print_stat(file, "Queue stop", mors->debug.page_stats.queue_stop);
-	print_stat(file, "Popped page owned by chip", mors->debug.page_stats.page_owned_by_chip);
-	print_stat(file, "Tx aged out", mors->debug.page_stats.tx_aged_out);
-	print_stat(file, "TX ps filtered", mors->debug.page_stats.tx_ps_filtered);
-	print_stat(file, "Stale tx status flushed", mors->debug.page_stats.tx_status_flushed);
-	print_stat(file, "TX status invalid", mors->debug.page_stats.tx_status_page_invalid);
+	struct morse_page_stats stats;
+
+	morse_debug_page_stats_sum(mors, &stats);
+
+	print_stat(file, "Command Tx", stats.cmd_tx);
+	print_stat(file, "Beacon Tx", stats.bcn_tx);
+	print_stat(file, "Management Tx", stats.mgmt_tx);
+	print_stat(file, "Data Tx", stats.data_tx);
+	print_stat(file, "Page write fail", stats.write_fail);
+	print_stat(file, "No page", stats.no_page);
+	print_stat(file, "No command page", stats.cmd_no_page);
+	print_stat(file, "Command page retry", stats.cmd_rsv_page_retry);
+	print_stat(file, "No beacon page", stats.bcn_no_page);
+	print_stat(file, "Excessive beacon loss", stats.excessive_bcn_loss);
+	print_stat(file, "Queue stop", stats.queue_stop);
+	print_stat(file, "Popped page owned by chip", stats.page_owned_by_chip);
+	print_stat(file, "Tx aged out", stats.tx_aged_out);
+	print_stat(file, "TX ps filtered", stats.tx_ps_filtered);
+	print_stat(file, "Stale tx status flushed", stats.tx_status_flushed);
+	print_stat(file, "TX status invalid", stats.tx_status_page_invalid);
 	print_stat(file, "TX dropped due to duty cycle",
-		   mors->debug.page_stats.tx_status_duty_cycle_cant_send);
+		   stats.tx_status_duty_cycle_cant_send);
 	print_stat(file, "TX with retries disabled to duty cycle",
-		   mors->debug.page_stats.tx_duty_cycle_retry_disabled);
-	print_stat(file, "TX status dropped", mors->debug.page_stats.tx_status_dropped);
-	print_stat(file, "RX empty queue", mors->debug.page_stats.rx_empty);
-	print_stat(file, "RX packet split across window", mors->debug.page_stats.rx_split);
-	print_stat(file, "RX invalid byte count", mors->debug.page_stats.rx_invalid_count);
-	print_stat(file, "Invalid checksum", mors->debug.page_stats.invalid_checksum);
-	print_stat(file, "Invalid TX status checksum",
-		mors->debug.page_stats.invalid_tx_status_checksum);
+		   stats.tx_duty_cycle_retry_disabled);
+	print_stat(file, "TX status dropped", stats.tx_status_dropped);
+	print_stat(file, "RX empty queue", stats.rx_empty);
+	print_stat(file, "RX packet split across window", stats.rx_split);
+	print_stat(file, "RX invalid byte count", stats.rx_invalid_count);
+	print_stat(file, "Invalid checksum", stats.invalid_checksum);
+	print_stat(file, "Invalid TX status checksum", stats.invalid_tx_status_checksum);
 
 	return 0;
 }
@@ -195,6 +233,18 @@ static int read_firmware_path(struct seq_file *file, void *data)
 	return 0;
 }
 
+static int read_firmware_load(struct seq_file *file, void *data)
+{
+	struct morse *mors = dev_get_drvdata(file->private);
+	const struct morse_fw_load_stats *stats = &mors->fw_load;
+
+	seq_printf(file, "startup_us: %u\n", stats->startup_us);
+	seq_printf(file, "restart_us: %u\n", stats->restart_us);
+	seq_printf(file, "restarts: %u\n", stats->restarts);
+	seq_printf(file, "bytes_written: %u\n", stats->bytes_written);
+	return 0;
+}
+
 static const char *rc_method_to_string(enum morse_rc_method method)
 {
 	switch (method) {
@@ -400,6 +450,42 @@ static int dump_raw_configs(struct seq_file *file, void *data)
 	return 0;
 }
 
+static int read_page_slicing(struct seq_file *file, void *data)
+{
+	int i;
+	int vif_id;
+	struct morse *mors = dev_get_drvdata(file->private);
+
+	for (vif_id = 0; vif_id < mors->max_vifs; vif_id++) {
+		struct ieee80211_vif *vif = morse_get_vif_from_vif_id(mors, vif_id);
+		struct page_slicing *ps;
+
+		if (!vif)
+			continue;
+
+		ps = &ieee80211_vif_to_morse_vif(vif)->page_slicing_info;
+		seq_printf(file, "%s:\n", morse_vif_name(vif));
+
+		if (!ps->enabled) {
+			seq_puts(file, "  Page slicing disabled\n");
+			continue;
+		}
+
+		seq_printf(file, "  page_period=%u page_index=%u block_offset=%u\n",
+			   ps->page_period, ps->page_index, ps->block_offset);
+		seq_printf(file, "  blocks=%u slice length=%u count=%u next=%u\n",
+			   ps->total_number_of_blocks, ps->page_slice_length,
+			   ps->page_slice_count, ps->page_slice_no);
+
+		/* Per-slice buffered AIDs from the plan of the last DTIM beacon */
+		for (i = 0; i < ps->page_slice_count; i++)
+			seq_printf(file, "  slice %2d: octets [%u, %u) aids=%u\n", i,
+				   ps->slice_start[i], ps->slice_end[i], ps->slice_aids[i]);
+	}
+
+	return 0;
+}
+
 #ifdef CONFIG_MORSE_DEBUGFS
 static int read_file_pagesets(struct seq_file *file, void *data)
 {
@@ -423,6 +509,24 @@ static int read_file_yaps(struct seq_file *file, void *data)
 	return 0;
 }
 
+static int read_file_yaps_tx_batch(struct seq_file *file, void *data)
+{
+	struct morse *mors = dev_get_drvdata(file->private);
+
+	morse_yaps_tx_batch_show(mors->chip_if->yaps, file);
+
+	return 0;
+}
+
+static int read_file_yaps_ctx(struct seq_file *file, void *data)
+{
+	struct morse *mors = dev_get_drvdata(file->private);
+
+	morse_yaps_ctx_show(mors->chip_if->yaps, file);
+
+	return 0;
+}
+
 #ifdef MORSE_YAPS_SUPPORTS_BENCHMARK
 static int read_file_yaps_benchmark(struct seq_file *file, void *data)
 {
@@ -446,30 +550,111 @@ static int read_skbq_mon_tbl(struct seq_file *file, void *data)
 static int read_mcs_stats_tbl(struct seq_file *file, void *data)
 {
 	struct morse *mors = dev_get_drvdata(file->private);
+	struct morse_mcs_stats stats;
+	int cpu;
+
+	BUILD_BUG_ON(sizeof(stats) % sizeof(unsigned int));
+
+	memset(&stats, 0, sizeof(stats));
+	for_each_possible_cpu(cpu) {
+		struct morse_mcs_stats *cpu_stats = &per_cpu_ptr(mors->debug.stats, cpu)->mcs;
+
+		morse_debug_sum_counters((unsigned int *)&stats, (unsigned int *)cpu_stats,
+					 sizeof(stats));
+		/* Resetting this should make it easier to debug for now. */
+		memset(cpu_stats, 0, sizeof(*cpu_stats));
+	}
 
 	seq_puts(file, "MCS Statistics\n");
 	seq_puts(file, "MCS0 TX Beacons\n");
-	seq_printf(file, "%-10u\n", mors->debug.mcs_stats_tbl.mcs0.tx_beacons);
+	seq_printf(file, "%-10u\n", stats.mcs0.tx_beacons);
 	seq_puts(file, "MCS0 TX NDP Probes\n");
-	seq_printf(file, "%-10u\n", mors->debug.mcs_stats_tbl.mcs0.tx_ndpprobes);
+	seq_printf(file, "%-10u\n", stats.mcs0.tx_ndpprobes);
 	seq_puts(file, "MCS0 TX Count       MCS10 TX Count\n");
-	seq_printf(file, "%-10u          %-10u\n",
-		   mors->debug.mcs_stats_tbl.mcs0.tx_count,
-		   mors->debug.mcs_stats_tbl.mcs10.tx_count);
+	seq_printf(file, "%-10u          %-10u\n", stats.mcs0.tx_count, stats.mcs10.tx_count);
 	seq_puts(file, "MCS0 TX Success     MCS10 TX Success\n");
-	seq_printf(file, "%-10u          %-10u\n",
-		   mors->debug.mcs_stats_tbl.mcs0.tx_success,
-		   mors->debug.mcs_stats_tbl.mcs10.tx_success);
+	seq_printf(file, "%-10u          %-10u\n", stats.mcs0.tx_success, stats.mcs10.tx_success);
 	seq_puts(file, "MCS0 TX Fail        MCS10 TX Fail\n");
-	seq_printf(file, "%-10u          %-10u\n",
-		   mors->debug.mcs_stats_tbl.mcs0.tx_fail, mors->debug.mcs_stats_tbl.mcs10.tx_fail);
+	seq_printf(file, "%-10u          %-10u\n", stats.mcs0.tx_fail, stats.mcs10.tx_fail);
 	seq_puts(file, "MCS0 RX             MCS10 RX\n");
-	seq_printf(file, "%-10u          %-10u\n",
-		   mors->debug.mcs_stats_tbl.mcs0.rx_count,
-		   mors->debug.mcs_stats_tbl.mcs10.rx_count);
+	seq_printf(file, "%-10u          %-10u\n", stats.mcs0.rx_count, stats.mcs10.rx_count);
+
+	return 0;
+}
+
+static void morse_lat_hist_add(struct morse_lat_hist __percpu *pcpu_hist, ktime_t start)
+{
+	s64 delta_us = ktime_to_us(ktime_sub(ktime_get(), start));
+	u32 us = clamp_t(s64, delta_us, 0, U32_MAX);
+	unsigned int bucket = min_t(unsigned int, fls(us), MORSE_LAT_HIST_BUCKETS - 1);
+	struct morse_lat_hist *hist = get_cpu_ptr(pcpu_hist);
+
+	hist->bucket[bucket]++;
+	hist->count++;
+	hist->sum_us += us;
+	if (us > hist->max_us)
+		hist->max_us = us;
+
+	put_cpu_ptr(pcpu_hist);
+}
 
-	/* Resetting this should make it easier to debug for now. */
-	memset(&mors->debug.mcs_stats_tbl, 0, sizeof(mors->debug.mcs_stats_tbl));
+void morse_debug_tx_lat_end(struct morse *mors, struct sk_buff *skb)
+{
+	if (!ktime_to_ns(skb->tstamp))
+		return;
+
+	morse_lat_hist_add(&mors->debug.stats->tx_lat, skb->tstamp);
+	/* Don't hand our queue timestamp up the stack */
+	skb->tstamp = ktime_set(0, 0);
+}
+
+void morse_debug_rx_lat_end(struct morse *mors)
+{
+	ktime_t irq_time = READ_ONCE(mors->debug.rx_irq_time);
+
+	if (ktime_to_ns(irq_time))
+		morse_lat_hist_add(&mors->debug.stats->rx_lat, irq_time);
+}
+
+static void print_lat_hist(struct seq_file *file, struct morse *mors, const char *desc,
+			   size_t offset)
+{
+	struct morse_lat_hist sum;
+	int cpu;
+	int i;
+
+	memset(&sum, 0, sizeof(sum));
+	for_each_possible_cpu(cpu) {
+		const struct morse_lat_hist *hist =
+			(void *)per_cpu_ptr(mors->debug.stats, cpu) + offset;
+
+		for (i = 0; i < MORSE_LAT_HIST_BUCKETS; i++)
+			sum.bucket[i] += hist->bucket[i];
+		sum.count += hist->count;
+		sum.sum_us += hist->sum_us;
+		sum.max_us = max(sum.max_us, hist->max_us);
+	}
+
+	seq_printf(file, "%s: count %u, avg %llu us, max %u us\n", desc, sum.count,
+		   sum.count ? div_u64(sum.sum_us, sum.count) : 0, sum.max_us);
+	for (i = 0; i < MORSE_LAT_HIST_BUCKETS; i++) {
+		if (!sum.bucket[i])
+			continue;
+		if (i == MORSE_LAT_HIST_BUCKETS - 1)
+			seq_printf(file, "  >= %7u us: %u\n", 1U << (i - 1), sum.bucket[i]);
+		else
+			seq_printf(file, "  < %8u us: %u\n", 1U << i, sum.bucket[i]);
+	}
+}
+
+static int read_latency_hist(struct seq_file *file, void *data)
+{
+	struct morse *mors = dev_get_drvdata(file->private);
+
+	print_lat_hist(file, mors, "TX queued to status",
+		       offsetof(struct morse_debug_stats, tx_lat));
+	print_lat_hist(file, mors, "RX IRQ to mac80211",
+		       offsetof(struct morse_debug_stats, rx_lat));
 
 	return 0;
 }
@@ -865,7 +1050,7 @@ void morse_debug_fw_hostif_log_record(struct morse *mors, int to_chip,
 	item->channel = hdr->channel;
 	jiffies_to_timespec64(get_jiffies_64(), &time_now);
 	item->timestamp = (time_now.tv_sec * NSEC_PER_SEC) + time_now.tv_nsec;
-	memcpy(item->data, skb->data, skb->len);
+	skb_copy_bits(skb, 0, item->data, skb->len);
 
 	list_add_tail(&item->list, &mors->debug.hostif_log.items);
 
@@ -1083,6 +1268,9 @@ int morse_init_debug(struct morse *mors)
 	debugfs_create_devm_seqfile(mors->dev, "firmware_path",
 				    mors->debug.debugfs_phy, read_firmware_path);
 
+	debugfs_create_devm_seqfile(mors->dev, "firmware_load",
+				    mors->debug.debugfs_phy, read_firmware_load);
+
 	debugfs_create_devm_seqfile(mors->dev, "vendor_info",
 				    mors->debug.debugfs_phy, read_vendor_info_tbl);
 
@@ -1100,6 +1288,9 @@ int morse_init_debug(struct morse *mors)
 	debugfs_create_devm_seqfile(mors->dev, "dump_raw_configs",
 				    mors->debug.debugfs_phy, dump_raw_configs);
 
+	debugfs_create_devm_seqfile(mors->dev, "page_slicing",
+				    mors->debug.debugfs_phy, read_page_slicing);
+
 #ifdef CONFIG_MORSE_DEBUGFS
 	if (mors->chip_if->active_chip_if == MORSE_CHIP_IF_PAGESET)
 		debugfs_create_devm_seqfile(mors->dev, "pagesets",
@@ -1107,6 +1298,10 @@ int morse_init_debug(struct morse *mors)
 	else if (mors->chip_if->active_chip_if == MORSE_CHIP_IF_YAPS) {
 		debugfs_create_devm_seqfile(mors->dev, "yaps",
 					    mors->debug.debugfs_phy, read_file_yaps);
+		debugfs_create_devm_seqfile(mors->dev, "yaps_tx_batch",
+					    mors->debug.debugfs_phy, read_file_yaps_tx_batch);
+		debugfs_create_devm_seqfile(mors->dev, "yaps_contexts",
+					    mors->debug.debugfs_phy, read_file_yaps_ctx);
 #ifdef MORSE_YAPS_SUPPORTS_BENCHMARK
 		debugfs_create_devm_seqfile(mors->dev, "yaps_benchmark",
 					    mors->debug.debugfs_phy, read_file_yaps_benchmark);
@@ -1119,6 +1314,9 @@ int morse_init_debug(struct morse *mors)
 	debugfs_create_devm_seqfile(mors->dev, "mcs_stats",
 				    mors->debug.debugfs_phy, read_mcs_stats_tbl);
 
+	debugfs_create_devm_seqfile(mors->dev, "latency",
+				    mors->debug.debugfs_phy, read_latency_hist);
+
 	debugfs_create_devm_seqfile(mors->dev, "vendor_ies",
 				    mors->debug.debugfs_phy, read_vendor_ies);
 
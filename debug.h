@@ -10,6 +10,8 @@
 #include "skb_header.h"
 
 #include <linux/kern_levels.h>
+#include <linux/ktime.h>
+#include <linux/percpu.h>
 
 /*
  * Map onto standard kernel loglevels, see
@@ -169,6 +171,77 @@ int morse_init_debug(struct morse *mors);
 
 void morse_deinit_debug(struct morse *mors);
 
+/*
+ * Fast path statistics are per-CPU (see struct morse_debug_stats) and must be updated through
+ * these helpers. They are only summed when read.
+ */
+#define MORSE_PAGE_STAT_INC(_mors, _field)	this_cpu_inc((_mors)->debug.stats->page._field)
+#define MORSE_PAGE_STAT_ADD(_mors, _field, _n) \
+	this_cpu_add((_mors)->debug.stats->page._field, (_n))
+#define MORSE_MCS_STAT_INC(_mors, _field)	this_cpu_inc((_mors)->debug.stats->mcs._field)
+#define MORSE_MCS_STAT_DEC(_mors, _field)	this_cpu_dec((_mors)->debug.stats->mcs._field)
+#define MORSE_MCS_STAT_ADD(_mors, _field, _n) \
+	this_cpu_add((_mors)->debug.stats->mcs._field, (_n))
+
+/* Sum a single page statistic over all CPUs */
+#define MORSE_PAGE_STAT_READ(_mors, _field) \
+	({ \
+		unsigned int __sum = 0; \
+		int __cpu; \
+		for_each_possible_cpu(__cpu) \
+			__sum += per_cpu_ptr((_mors)->debug.stats, __cpu)->page._field; \
+		__sum; \
+	})
+
+/**
+ * Allocate the per-CPU statistics. Called once when the device is created.
+ *
+ * @param mors	Morse chip instance
+ *
+ * @returns	0 on success, else -ENOMEM
+ */
+int morse_debug_stats_alloc(struct morse *mors);
+
+/**
+ * Free the per-CPU statistics.
+ *
+ * @param mors	Morse chip instance
+ */
+void morse_debug_stats_free(struct morse *mors);
+
+#ifdef CONFIG_MORSE_DEBUGFS
+/**
+ * Record the latency of a data frame from being queued for the chip to its tx status.
+ * The queue time is taken from skb->tstamp, set by morse_debug_tx_lat_start().
+ *
+ * @param mors	Morse chip instance
+ * @param skb	The frame being completed
+ */
+void morse_debug_tx_lat_end(struct morse *mors, struct sk_buff *skb);
+
+/**
+ * Record the latency from the last RX IRQ to a frame being handed to mac80211.
+ *
+ * @param mors	Morse chip instance
+ */
+void morse_debug_rx_lat_end(struct morse *mors);
+
+static inline void morse_debug_tx_lat_start(struct sk_buff *skb)
+{
+	skb->tstamp = ktime_get();
+}
+
+static inline void morse_debug_rx_irq(struct morse *mors, ktime_t when)
+{
+	WRITE_ONCE(mors->debug.rx_irq_time, when);
+}
+#else
+static inline void morse_debug_tx_lat_start(struct sk_buff *skb) {}
+static inline void morse_debug_tx_lat_end(struct morse *mors, struct sk_buff *skb) {}
+static inline void morse_debug_rx_lat_end(struct morse *mors) {}
+static inline void morse_debug_rx_irq(struct morse *mors, ktime_t when) {}
+#endif
+
 int morse_debug_log_tx_status(struct morse *mors, struct morse_skb_tx_status *tx_sts);
 
 enum morse_fw_hostif_log_channel_enable {
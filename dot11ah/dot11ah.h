@@ -517,6 +517,8 @@ struct ie_element {
  * @ies: Array of IEs, indexed by element ID
  * @more_than_one_ie: bitmask where if bit is set, there are multiple IEs with the same element ID
  *	in the mask
+ * @populated: bitmask of the element IDs that have been set in the mask, so that clearing only
+ *	has to reset those entries
  * @fils_data: FILS Session element and encrypted data, which if present, is always at the end of a
  *	management frame
  * @fils_data_length: Length of the FILS Session element and encrypted data
@@ -525,6 +527,7 @@ struct dot11ah_ies_mask {
 	struct ie_element ies[DOT11AH_MAX_EID];
 	/* makes freeing/clearing easier */
 	DECLARE_BITMAP(more_than_one_ie, DOT11AH_MAX_EID);
+	DECLARE_BITMAP(populated, DOT11AH_MAX_EID);
 	u8 *fils_data;
 	int fils_data_len;
 };
@@ -596,6 +599,24 @@ void morse_dot11ah_mask_ies(struct dot11ah_ies_mask *ies_mask, bool mask_ext_cap
 
 void morse_dot11ah_ies_mask_clear(struct dot11ah_ies_mask *ies_mask);
 
+/**
+ * morse_dot11ah_ies_mask_set() - Point an IE of the mask at data it does not own.
+ * @ies_mask: IE mask to update.
+ * @eid: Element ID of the IE.
+ * @ptr: IE body, which must outlive the mask or be reset before it is freed.
+ * @len: Length of the IE body.
+ *
+ * Entries must be set through this or morse_dot11_ies_create_ie_element(), so that
+ * morse_dot11ah_ies_mask_clear() resets them.
+ */
+static inline void morse_dot11ah_ies_mask_set(struct dot11ah_ies_mask *ies_mask, u8 eid,
+					      u8 *ptr, u8 len)
+{
+	ies_mask->ies[eid].ptr = ptr;
+	ies_mask->ies[eid].len = len;
+	set_bit(eid, ies_mask->populated);
+}
+
 u8 *morse_dot11_insert_ie_from_ies_mask(u8 *pos, const struct dot11ah_ies_mask *ies_mask, u8 eid);
 
 /**
@@ -281,8 +281,8 @@ void morse_dot11_clear_eid_from_ies_mask(struct dot11ah_ies_mask *ies_mask, u8 e
 	free_eid_ies_list(ies_mask->ies[eid].next);
 	if (ies_mask->ies[eid].needs_free)
 		kfree(ies_mask->ies[eid].ptr);
-	ies_mask->ies[eid].ptr = NULL;
-	ies_mask->ies[eid].len = 0;
+	memset(&ies_mask->ies[eid], 0, sizeof(ies_mask->ies[eid]));
+	clear_bit(eid, ies_mask->more_than_one_ie);
 }
 EXPORT_SYMBOL(morse_dot11_clear_eid_from_ies_mask);
 
@@ -304,10 +304,8 @@ void morse_dot11ah_ies_mask_free(struct dot11ah_ies_mask *ies_mask)
 	if (!ies_mask)
 		return;
 
-	for_each_set_bit(pos, ies_mask->more_than_one_ie, DOT11AH_MAX_EID)
+	for_each_set_bit(pos, ies_mask->populated, DOT11AH_MAX_EID) {
 		free_eid_ies_list(ies_mask->ies[pos].next);
-
-	for (pos = 0; pos < ARRAY_SIZE(ies_mask->ies); pos++) {
 		if (ies_mask->ies[pos].needs_free)
 			kfree(ies_mask->ies[pos].ptr);
 	}
@@ -323,17 +321,18 @@ void morse_dot11ah_ies_mask_clear(struct dot11ah_ies_mask *ies_mask)
 	if (!ies_mask)
 		return;
 
-	for_each_set_bit(pos, ies_mask->more_than_one_ie, DOT11AH_MAX_EID) {
+	/* Only reset the entries that were set, rather than the whole mask */
+	for_each_set_bit(pos, ies_mask->populated, DOT11AH_MAX_EID) {
 		free_eid_ies_list(ies_mask->ies[pos].next);
-	}
-
-	for (pos = 0; pos < ARRAY_SIZE(ies_mask->ies); pos++) {
 		if (ies_mask->ies[pos].needs_free)
 			kfree(ies_mask->ies[pos].ptr);
+		memset(&ies_mask->ies[pos], 0, sizeof(ies_mask->ies[pos]));
 	}
 
-	/* clear the ies_mask */
-	memset(ies_mask, 0, sizeof(*ies_mask));
+	bitmap_zero(ies_mask->more_than_one_ie, DOT11AH_MAX_EID);
+	bitmap_zero(ies_mask->populated, DOT11AH_MAX_EID);
+	ies_mask->fils_data = NULL;
+	ies_mask->fils_data_len = 0;
 }
 EXPORT_SYMBOL(morse_dot11ah_ies_mask_clear);
 
@@ -343,6 +342,8 @@ struct ie_element *morse_dot11_ies_create_ie_element(struct dot11ah_ies_mask *ie
 	struct ie_element *cur = &ies_mask->ies[eid];
 	struct ie_element *new;
 
+	set_bit(eid, ies_mask->populated);
+
 	if (cur->ptr) {
 		if (only_one) {
 			morse_dot11_clear_eid_from_ies_mask(ies_mask, eid);
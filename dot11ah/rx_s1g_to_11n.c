@@ -588,8 +588,8 @@ static u8 *morse_dot11ah_insert_required_rx_ie(struct dot11ah_ies_mask *ies_mask
 	int eid = 0;
 
 	/* Supported rate will always be included for all rx management frames */
-	ies_mask->ies[WLAN_EID_SUPP_RATES].ptr = (u8 *)__s1g_supp_rates_ie;
-	ies_mask->ies[WLAN_EID_SUPP_RATES].len = sizeof(__s1g_supp_rates_ie);
+	morse_dot11ah_ies_mask_set(ies_mask, WLAN_EID_SUPP_RATES, (u8 *)__s1g_supp_rates_ie,
+				   sizeof(__s1g_supp_rates_ie));
 
 	for (eid = 0; eid < DOT11AH_MAX_EID; eid++) {
 		if (ies_mask->ies[eid].ptr) {
@@ -1038,8 +1038,9 @@ static void morse_dot11ah_s1g_to_beacon(struct ieee80211_vif *vif, struct sk_buf
 			}
 
 			/* Overwrite history TIM with actual one */
-			ies_mask->ies[WLAN_EID_TIM].ptr = (u8 *)updated_vals.tim_ie;
-			ies_mask->ies[WLAN_EID_TIM].len = updated_vals.tim_len;
+			morse_dot11ah_ies_mask_set(ies_mask, WLAN_EID_TIM,
+						   (u8 *)updated_vals.tim_ie,
+						   updated_vals.tim_len);
 			/* Overwrite capab_info from stored */
 			s1g_bcn_comp = (struct dot11ah_s1g_bcn_compat_ie *)
 						ies_mask->ies[WLAN_EID_S1G_BCN_COMPAT].ptr;
@@ -6,6 +6,8 @@
 
 #include <linux/types.h>
 #include <linux/ieee80211.h>
+#include <linux/moduleparam.h>
+#include <linux/bitops.h>
 
 #include "dot11ah.h"
 #include "tim.h"
@@ -15,6 +17,14 @@
 /* TODO: ADE for AIDs > 7 (not tested in WFA nor advertised in marketing material) */
 #define ADE_AID_LIMIT		(7)
 
+/* Longest OLB encoded block, limited by its one octet Length subfield */
+#define OLB_MAX_SUBBLOCKS	(U8_MAX)
+
+static bool tim_auto_encoding = true;
+module_param(tim_auto_encoding, bool, 0644);
+MODULE_PARM_DESC(tim_auto_encoding,
+		 "Select the smallest TIM encoding per block when block mode is configured");
+
 /**
  * State structure for parsing from 11n TIM to S1G TIM
  */
@@ -857,8 +867,10 @@ int morse_dot11_s1g_to_tim(struct ieee80211_tim_ie *tim, const struct dot11ah_s1
 	 */
 	if (block_info_len == 0) {
 		if (page_slice == S1G_TIM_PAGE_SLICE_ENTIRE_PAGE) {
-			/* Clear all. We have page_slice 31 but nothing is in partial bitmap */
-			tim->bitmap_ctrl = 0;
+			/* Clear the bitmap, as we have page_slice 31 but nothing is in partial
+			 * bitmap. Broadcast traffic is still indicated.
+			 */
+			tim->bitmap_ctrl &= IEEE80211_TIM_BITMAP_TRAFFIC_INDICATION;
 			tim->virtual_map[0] = 0;
 		}
 		return length;
@@ -1027,6 +1039,203 @@ error:
 	return s1g_tim_length;
 }
 
+/**
+ * morse_dot11_tim_enc_block() - Encode a single block in the smaller of block bitmap and single
+ *				 AID mode
+ *
+ * Block mode costs the block control and block bitmap octets plus one octet per non-zero
+ * subblock, single AID mode costs two octets per AID.
+ *
+ * @blk: block to encode, with its subblocks filled in
+ * @block_offset: offset of the block within the page
+ */
+static void morse_dot11_tim_enc_block(struct dot11ah_tim_block_enc *blk, u8 block_offset)
+{
+	u8 block_ctrl = block_offset << IEEE80211_S1G_TIM_BLOCK_CTL_BLOCK_OFFSET_SHIFT;
+	u8 *pos = blk->enc;
+	u8 block_bitmap = 0;
+	u8 num_subblocks = 0;
+	u8 num_aids = 0;
+	int m;
+	int q;
+
+	blk->last_subblock = 0;
+
+	for (m = 0; m < S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK; m++) {
+		if (!blk->subblocks[m])
+			continue;
+
+		block_bitmap |= BIT(m);
+		num_subblocks++;
+		num_aids += hweight8(blk->subblocks[m]);
+		blk->last_subblock = m;
+	}
+
+	if (num_aids * 2 < num_subblocks + 2) {
+		for (m = 0; m < S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK; m++) {
+			for (q = 0; q < S1G_TIM_NUM_AID_PER_SUBBLOCK; q++) {
+				if (!(blk->subblocks[m] & BIT(q)))
+					continue;
+
+				*pos++ = block_ctrl | ENC_MODE_AID;
+				*pos++ = (m * S1G_TIM_NUM_AID_PER_SUBBLOCK) + q;
+			}
+		}
+	} else if (num_subblocks) {
+		*pos++ = block_ctrl | ENC_MODE_BLOCK;
+		*pos++ = block_bitmap;
+
+		for (m = 0; m < S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK; m++) {
+			if (blk->subblocks[m])
+				*pos++ = blk->subblocks[m];
+		}
+	}
+
+	blk->enc_len = pos - blk->enc;
+}
+
+/**
+ * morse_dot11_tim_enc_assemble() - Build the partial virtual bitmap from the cached blocks
+ *
+ * A run of blocks may instead be sent as one OLB encoded block, which saves the per block
+ * overhead at the cost of including every subblock up to the last non-zero one. The cheapest
+ * split is found working back from the last block.
+ *
+ * @enc: encoder state
+ */
+static void morse_dot11_tim_enc_assemble(struct dot11ah_tim_encoder *enc)
+{
+	u16 cost[S1G_TIM_NUM_BLOCKS_PER_PAGE + 1];
+	s8 olb_last[S1G_TIM_NUM_BLOCKS_PER_PAGE];
+	int b;
+	int j;
+
+	cost[S1G_TIM_NUM_BLOCKS_PER_PAGE] = 0;
+
+	for (b = S1G_TIM_NUM_BLOCKS_PER_PAGE - 1; b >= 0; b--) {
+		olb_last[b] = -1;
+
+		if (!enc->blocks[b].enc_len) {
+			cost[b] = cost[b + 1];
+			continue;
+		}
+
+		cost[b] = enc->blocks[b].enc_len + cost[b + 1];
+
+		for (j = b + 1; j < S1G_TIM_NUM_BLOCKS_PER_PAGE; j++) {
+			u16 num_subblocks = ((j - b) * S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK) +
+					    enc->blocks[j].last_subblock + 1;
+			u16 olb_cost = 2 + num_subblocks + cost[j + 1];
+
+			if (num_subblocks > OLB_MAX_SUBBLOCKS)
+				break;
+
+			if (enc->blocks[j].enc_len && olb_cost < cost[b]) {
+				cost[b] = olb_cost;
+				olb_last[b] = j;
+			}
+		}
+	}
+
+	enc->pvb_len = 0;
+
+	for (b = 0; b < S1G_TIM_NUM_BLOCKS_PER_PAGE; b++) {
+		const struct dot11ah_tim_block_enc *blk = &enc->blocks[b];
+		u8 *pos = &enc->pvb[enc->pvb_len];
+		u16 len;
+
+		if (!blk->enc_len)
+			continue;
+
+		if (olb_last[b] < 0) {
+			/* Only whole encoded blocks are included */
+			if (enc->pvb_len + blk->enc_len > sizeof(enc->pvb))
+				break;
+
+			memcpy(pos, blk->enc, blk->enc_len);
+			enc->pvb_len += blk->enc_len;
+			continue;
+		}
+
+		j = olb_last[b];
+		len = ((j - b) * S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK) + enc->blocks[j].last_subblock + 1;
+		if (enc->pvb_len + 2 + len > sizeof(enc->pvb))
+			break;
+
+		*pos++ = ENC_MODE_OLB | (b << IEEE80211_S1G_TIM_BLOCK_CTL_BLOCK_OFFSET_SHIFT);
+		*pos++ = len;
+		for (; b < j; b++) {
+			memcpy(pos, enc->blocks[b].subblocks, S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK);
+			pos += S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK;
+		}
+		memcpy(pos, enc->blocks[j].subblocks, enc->blocks[j].last_subblock + 1);
+		enc->pvb_len += 2 + len;
+	}
+}
+
+int morse_dot11_tim_to_s1g_incremental(struct dot11ah_tim_encoder *enc,
+				       struct dot11ah_s1g_tim_ie *s1g_tim,
+				       const struct ieee80211_tim_ie *tim,
+				       u8 tim_virtual_map_length,
+				       u8 page_slice_no,
+				       u8 page_index)
+{
+	u8 octet_offset = (tim->bitmap_ctrl & IEEE80211_TIM_BITMAP_OFFSET);
+	int map_end = octet_offset + tim_virtual_map_length;
+	int s1g_tim_length;
+	int b;
+
+	s1g_tim_length = sizeof(*s1g_tim)
+			- sizeof(s1g_tim->bitmap_control)
+			- sizeof(s1g_tim->encoded_block_info);
+
+	s1g_tim->dtim_count = tim->dtim_count;
+	s1g_tim->dtim_period = tim->dtim_period;
+	s1g_tim->bitmap_control = (tim->bitmap_ctrl & IEEE80211_TIM_BITMAP_TRAFFIC_INDICATION);
+
+	for (b = 0; b < S1G_TIM_NUM_BLOCKS_PER_PAGE; b++) {
+		struct dot11ah_tim_block_enc *blk = &enc->blocks[b];
+		int first = b * S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK;
+		u8 subblocks[S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK] = { 0 };
+		int i;
+
+		/* Blocks outside the 11n virtual map are empty, skip them if already so */
+		if ((first + S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK <= octet_offset || first >= map_end) &&
+		    !blk->enc_len)
+			continue;
+
+		for (i = max(first, (int)octet_offset);
+		     i < min(first + S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK, map_end); i++)
+			subblocks[i - first] = tim->virtual_map[i - octet_offset];
+
+		if (!memcmp(subblocks, blk->subblocks, sizeof(subblocks)))
+			continue;
+
+		memcpy(blk->subblocks, subblocks, sizeof(subblocks));
+		morse_dot11_tim_enc_block(blk, b);
+		enc->dirty = true;
+	}
+
+	if (enc->dirty) {
+		morse_dot11_tim_enc_assemble(enc);
+		enc->dirty = false;
+	}
+
+	memcpy(s1g_tim->encoded_block_info, enc->pvb, enc->pvb_len);
+
+	/* Only include the tim if we either have BC traffic, or the 11n tim had some bits set. */
+	if (s1g_tim->bitmap_control || enc->pvb_len > 0) {
+		s1g_tim->bitmap_control |= (page_slice_no <<
+					    IEEE80211_S1G_TIM_BITMAP_PAGE_SLICE_SHIFT);
+		s1g_tim->bitmap_control |= (page_index <<
+					   IEEE80211_S1G_TIM_BITMAP_PAGE_INDEX_SHIFT);
+
+		s1g_tim_length = s1g_tim_length + enc->pvb_len + 1;
+	}
+
+	return s1g_tim_length;
+}
+
 void morse_dot11ah_insert_s1g_tim(struct ieee80211_vif *vif, struct dot11ah_ies_mask *ies_mask,
 				  u8 page_slice_no, u8 page_index)
 {
@@ -1037,6 +1246,7 @@ void morse_dot11ah_insert_s1g_tim(struct ieee80211_vif *vif, struct dot11ah_ies_
 	enum dot11ah_tim_encoding_mode enc_mode;
 	u8 tim_virtual_map_len_11n;
 	bool inverse_bitmap;
+	u16 max_aid = AID_LIMIT;
 
 	/* SW-4741: in IBSS, TIM element is not relevant and should not be inserted */
 	if (vif->type == NL80211_IFTYPE_ADHOC)
@@ -1048,6 +1258,9 @@ void morse_dot11ah_insert_s1g_tim(struct ieee80211_vif *vif, struct dot11ah_ies_
 	enc_mode = mors_vif ? (mors_vif->custom_configs->enc_mode & 0x03) : 0;
 	inverse_bitmap = mors_vif ? ((mors_vif->custom_configs->enc_mode & 0x04) >> 2) : 0;
 
+	if (mors_vif && mors_vif->ap)
+		max_aid = mors_vif->ap->largest_aid;
+
 	tim = (const struct ieee80211_tim_ie *)ies_mask->ies[WLAN_EID_TIM].ptr;
 
 	/* 11n TIM is either 2 bytes (with no virtual map), or 3 bytes + virtual map */
@@ -1056,15 +1269,31 @@ void morse_dot11ah_insert_s1g_tim(struct ieee80211_vif *vif, struct dot11ah_ies_
 
 	morse_dot11_clear_eid_from_ies_mask(ies_mask, WLAN_EID_TIM);
 
-	length = morse_dot11_tim_to_s1g(&s1g_tim_ie,
-					tim,
-					tim_virtual_map_len_11n,
-					enc_mode,
-					inverse_bitmap,
-					mors_vif->ap->largest_aid,
-					page_slice_no,
-					page_index);
+	if (tim_auto_encoding && enc_mode == ENC_MODE_BLOCK && !inverse_bitmap &&
+	    mors_vif && mors_vif->ap)
+		length = morse_dot11_tim_to_s1g_incremental(&mors_vif->ap->tim_enc,
+							    &s1g_tim_ie,
+							    tim,
+							    tim_virtual_map_len_11n,
+							    page_slice_no,
+							    page_index);
+	else
+		length = morse_dot11_tim_to_s1g(&s1g_tim_ie,
+						tim,
+						tim_virtual_map_len_11n,
+						enc_mode,
+						inverse_bitmap,
+						max_aid,
+						page_slice_no,
+						page_index);
 
 	morse_dot11ah_insert_element(ies_mask, WLAN_EID_TIM, (u8 *)&s1g_tim_ie, length);
 }
 EXPORT_SYMBOL(morse_dot11ah_insert_s1g_tim);
+
+/* The TIM KUnit tests are built as a module of their own */
+#ifdef CONFIG_MORSE_DOT11AH_KUNIT_TEST
+EXPORT_SYMBOL(morse_dot11_s1g_to_tim);
+EXPORT_SYMBOL(morse_dot11_tim_to_s1g);
+EXPORT_SYMBOL(morse_dot11_tim_to_s1g_incremental);
+#endif
@@ -70,6 +70,44 @@ enum dot11ah_tim_encoding_mode {
 	ENC_MODE_UNKNOWN = 0xFF
 };
 
+/* Number of blocks covering the AIDs representable in an 11n TIM (ie. page 0) */
+#define S1G_TIM_NUM_BLOCKS_PER_PAGE			(32)
+
+/* Block control, block bitmap and every subblock of a block mode encoded block */
+#define S1G_TIM_MAX_ENCODED_BLOCK_LEN			(2 + S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK)
+
+/**
+ * struct dot11ah_tim_block_enc - Cached encoding of a single S1G TIM block
+ *
+ * @subblocks: 11n TIM octets covering the AIDs of the block
+ * @enc: Encoded block(s), including the block control octet
+ * @enc_len: Length of @enc, 0 when no AID in the block has traffic buffered
+ * @last_subblock: Index of the last non-zero entry in @subblocks
+ */
+struct dot11ah_tim_block_enc {
+	u8 subblocks[S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK];
+	u8 enc[S1G_TIM_MAX_ENCODED_BLOCK_LEN];
+	u8 enc_len;
+	u8 last_subblock;
+};
+
+/**
+ * struct dot11ah_tim_encoder - State of the incremental S1G TIM encoder
+ *
+ * Must be zero initialised, which represents a TIM with no traffic buffered.
+ *
+ * @blocks: Cached encoding of each block
+ * @pvb: Partial virtual bitmap assembled from @blocks
+ * @pvb_len: Length of @pvb
+ * @dirty: A block has been re-encoded since @pvb was assembled
+ */
+struct dot11ah_tim_encoder {
+	struct dot11ah_tim_block_enc blocks[S1G_TIM_NUM_BLOCKS_PER_PAGE];
+	u8 pvb[S1G_TIM_MAX_BLOCK_SIZE];
+	u16 pvb_len;
+	bool dirty;
+};
+
 struct dot11ah_s1g_tim_ie {
 	u8 dtim_count;
 	u8 dtim_period;
@@ -101,6 +139,29 @@ int morse_dot11_tim_to_s1g(struct dot11ah_s1g_tim_ie *s1g_tim,
 			   u8 page_slice_no,
 			   u8 page_index);
 
+/**
+ * morse_dot11_tim_to_s1g_incremental() - convert non S1G TIM to S1G TIM, re-encoding only the
+ *					  blocks that changed since the previous call
+ *
+ * Each block is encoded in the smallest of block bitmap and single AID mode. Runs of blocks are
+ * merged into one OLB encoded block where that is smaller. Inverse bitmaps are not used.
+ *
+ * @enc: encoder state, kept between calls.
+ * @s1g_tim: pointer to S1G TIM (after conversion).
+ * @tim: pointer to 11n TIM element data.
+ * @tim_virtual_map_length: length of TIM partial virtual bitmap.
+ * @page_slice_no: Number of page slice belonging to a page included in TIM.
+ * @page_index: Index of the page being included in the TIM.
+ *
+ * Return: The length of the S1G TIM element.
+ */
+int morse_dot11_tim_to_s1g_incremental(struct dot11ah_tim_encoder *enc,
+				       struct dot11ah_s1g_tim_ie *s1g_tim,
+				       const struct ieee80211_tim_ie *tim,
+				       u8 tim_virtual_map_length,
+				       u8 page_slice_no,
+				       u8 page_index);
+
 int morse_dot11_s1g_to_tim(struct ieee80211_tim_ie *tim, const struct dot11ah_s1g_tim_ie *s1g_tim,
 			   size_t total_len);
 
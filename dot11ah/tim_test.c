@@ -0,0 +1,361 @@
+/*
+ * Copyright 2025 Morse Micro
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * KUnit tests for the S1G TIM encoders. Each test builds an 11n TIM the way mac80211 does,
+ * encodes it to an S1G TIM and checks that morse_dot11_s1g_to_tim() gives back exactly the
+ * same AIDs.
+ */
+
+#include <kunit/test.h>
+#include <linux/bitmap.h>
+#include <linux/module.h>
+#include <linux/random.h>
+
+#include "tim.h"
+
+#define TIM_TEST_NUM_AIDS		(IEEE80211_MAX_AID + 1)
+#define TIM_TEST_TIM_LEN		(sizeof(struct ieee80211_tim_ie) + \
+					 DOT11_MAX_TIM_VIRTUAL_MAP_LENGTH)
+#define TIM_TEST_RANDOM_ROUNDS		500
+/* Keeps the partial virtual bitmap within its 256 octets in every encoding mode */
+#define TIM_TEST_RANDOM_MAX_AIDS	40
+
+struct tim_test_ctx {
+	DECLARE_BITMAP(aids, TIM_TEST_NUM_AIDS);
+	DECLARE_BITMAP(decoded, TIM_TEST_NUM_AIDS);
+	DECLARE_BITMAP(diff, TIM_TEST_NUM_AIDS);
+	u8 tim[TIM_TEST_TIM_LEN];
+	u8 tim_decoded[TIM_TEST_TIM_LEN];
+	u8 tim_map_len;
+	bool bc;
+	struct dot11ah_s1g_tim_ie s1g_tim;
+	struct dot11ah_tim_encoder enc;
+	struct rnd_state rnd;
+};
+
+/* Zero terminated AID sets, covering block and subblock boundaries and both ends of page 0 */
+static const u16 tim_test_aid_sets[][9] = {
+	{ 1 },
+	{ 7, 8 },
+	{ 63, 64 },
+	{ 1, 9, 17, 25, 33, 41, 49, 57 },
+	{ 100, 101, 102, 103 },
+	{ 255, 256, 257 },
+	{ 1000, 1001, 1100 },
+	{ 2000, 2007 },
+	{ 1, 2007 },
+	{ 2, 130, 258, 386, 514, 642, 770, 898 },
+};
+
+static int tim_test_init(struct kunit *test)
+{
+	struct tim_test_ctx *ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+
+	if (!ctx)
+		return -ENOMEM;
+
+	prandom_seed_state(&ctx->rnd, 0x7133);
+	test->priv = ctx;
+	return 0;
+}
+
+/* Build the 11n TIM for ctx->aids the way mac80211 does, starting at an even octet */
+static void tim_test_build(struct tim_test_ctx *ctx)
+{
+	struct ieee80211_tim_ie *tim = (struct ieee80211_tim_ie *)ctx->tim;
+	unsigned long first = find_first_bit(ctx->aids, TIM_TEST_NUM_AIDS);
+	unsigned long aid;
+	u8 n1;
+	u8 n2;
+
+	memset(ctx->tim, 0, sizeof(ctx->tim));
+	tim->dtim_count = 1;
+	tim->dtim_period = 3;
+	tim->bitmap_ctrl = ctx->bc ? IEEE80211_TIM_BITMAP_TRAFFIC_INDICATION : 0;
+
+	if (first == TIM_TEST_NUM_AIDS) {
+		ctx->tim_map_len = 1;
+		return;
+	}
+
+	n1 = (first / 8) & IEEE80211_TIM_BITMAP_OFFSET;
+	n2 = find_last_bit(ctx->aids, TIM_TEST_NUM_AIDS) / 8;
+
+	for_each_set_bit(aid, ctx->aids, TIM_TEST_NUM_AIDS)
+		tim->virtual_map[aid / 8 - n1] |= BIT(aid % 8);
+
+	tim->bitmap_ctrl |= n1;
+	ctx->tim_map_len = n2 - n1 + 1;
+}
+
+static void tim_test_set_aids(struct tim_test_ctx *ctx, const u16 *aids, int num_aids)
+{
+	int i;
+
+	bitmap_zero(ctx->aids, TIM_TEST_NUM_AIDS);
+	for (i = 0; i < num_aids && aids[i]; i++)
+		__set_bit(aids[i], ctx->aids);
+}
+
+/* Fill ctx->aids with up to TIM_TEST_RANDOM_MAX_AIDS AIDs, alternately sparse and clustered */
+static void tim_test_random_aids(struct tim_test_ctx *ctx, int round)
+{
+	u32 num_aids = 1 + prandom_u32_state(&ctx->rnd) % TIM_TEST_RANDOM_MAX_AIDS;
+	u32 base = 1 + prandom_u32_state(&ctx->rnd) % IEEE80211_MAX_AID;
+	u32 spread = (round & 1) ? IEEE80211_MAX_AID : 2 * S1G_TIM_NUM_AID_PER_BLOCK;
+
+	bitmap_zero(ctx->aids, TIM_TEST_NUM_AIDS);
+	while (num_aids--) {
+		u32 aid = base + prandom_u32_state(&ctx->rnd) % spread;
+
+		__set_bit(1 + (aid - 1) % IEEE80211_MAX_AID, ctx->aids);
+	}
+	ctx->bc = !(prandom_u32_state(&ctx->rnd) % 4);
+}
+
+/* Walk the partial virtual bitmap, returning a mask of the encoding modes it uses */
+static u8 tim_test_pvb_modes(struct kunit *test, const struct dot11ah_s1g_tim_ie *s1g_tim,
+			     int pvb_len)
+{
+	const u8 *pvb = s1g_tim->encoded_block_info;
+	u8 modes = 0;
+	int i = 0;
+
+	while (i < pvb_len) {
+		u8 enc_mode = pvb[i++] & IEEE80211_S1G_TIM_BLOCK_CTL_ENC_MODE;
+
+		modes |= BIT(enc_mode);
+
+		switch (enc_mode) {
+		case ENC_MODE_BLOCK:
+			i += 1 + hweight8(pvb[i]);
+			break;
+		case ENC_MODE_AID:
+			i += 1;
+			break;
+		case ENC_MODE_OLB:
+			i += 1 + pvb[i];
+			break;
+		default:
+			KUNIT_FAIL(test, "unexpected encoding mode %u", enc_mode);
+			return modes;
+		}
+	}
+
+	KUNIT_EXPECT_EQ(test, i, pvb_len);
+	return modes;
+}
+
+/*
+ * Decode the S1G TIM of s1g_len octets and check it carries exactly ctx->aids and the broadcast
+ * indication. Returns the mask of encoding modes used.
+ */
+static u8 tim_test_check(struct kunit *test, struct tim_test_ctx *ctx, int s1g_len)
+{
+	struct ieee80211_tim_ie *tim = (struct ieee80211_tim_ie *)ctx->tim_decoded;
+	unsigned long last = find_last_bit(ctx->aids, TIM_TEST_NUM_AIDS);
+	u8 n1;
+	int len;
+	int i;
+	u8 modes = 0;
+
+	if (last == TIM_TEST_NUM_AIDS && !ctx->bc) {
+		/* Neither the bitmap control nor the partial virtual bitmap is present */
+		KUNIT_EXPECT_EQ(test, s1g_len, 2);
+		return 0;
+	}
+
+	KUNIT_ASSERT_GE(test, s1g_len, 3);
+	KUNIT_EXPECT_EQ(test, (int)ctx->s1g_tim.dtim_count, 1);
+	KUNIT_EXPECT_EQ(test, (int)ctx->s1g_tim.dtim_period, 3);
+	KUNIT_EXPECT_EQ(test,
+			(int)(ctx->s1g_tim.bitmap_control & IEEE80211_S1G_TIM_BITMAP_PAGE_SLICE),
+			S1G_TIM_PAGE_SLICE_ENTIRE_PAGE << IEEE80211_S1G_TIM_BITMAP_PAGE_SLICE_SHIFT);
+	modes = tim_test_pvb_modes(test, &ctx->s1g_tim, s1g_len - 3);
+
+	memset(ctx->tim_decoded, 0, sizeof(ctx->tim_decoded));
+	len = morse_dot11_s1g_to_tim(tim, &ctx->s1g_tim, s1g_len);
+
+	KUNIT_EXPECT_EQ(test, !!(tim->bitmap_ctrl & IEEE80211_TIM_BITMAP_TRAFFIC_INDICATION),
+			(int)ctx->bc);
+
+	n1 = tim->bitmap_ctrl & IEEE80211_TIM_BITMAP_OFFSET;
+	bitmap_zero(ctx->decoded, TIM_TEST_NUM_AIDS);
+	for (i = 0; n1 + i < DOT11_MAX_TIM_VIRTUAL_MAP_LENGTH; i++) {
+		unsigned long bits = tim->virtual_map[i];
+		unsigned long q;
+
+		for_each_set_bit(q, &bits, 8)
+			__set_bit((n1 + i) * 8 + q, ctx->decoded);
+	}
+
+	bitmap_xor(ctx->diff, ctx->aids, ctx->decoded, TIM_TEST_NUM_AIDS);
+	KUNIT_EXPECT_EQ_MSG(test, find_first_bit(ctx->diff, TIM_TEST_NUM_AIDS),
+			    (unsigned long)TIM_TEST_NUM_AIDS,
+			    "AID %lu did not round trip (first AID %lu, %lu AIDs)",
+			    find_first_bit(ctx->diff, TIM_TEST_NUM_AIDS),
+			    find_first_bit(ctx->aids, TIM_TEST_NUM_AIDS),
+			    (unsigned long)bitmap_weight(ctx->aids, TIM_TEST_NUM_AIDS));
+
+	/* The decoded length covers the virtual map up to the octet of the last AID */
+	if (last != TIM_TEST_NUM_AIDS)
+		KUNIT_EXPECT_EQ(test, len,
+				(int)(sizeof(*tim) + last / 8 - n1));
+
+	return modes;
+}
+
+static int tim_test_encode(struct tim_test_ctx *ctx, enum dot11ah_tim_encoding_mode enc_mode)
+{
+	unsigned long last = find_last_bit(ctx->aids, TIM_TEST_NUM_AIDS);
+
+	tim_test_build(ctx);
+	memset(&ctx->s1g_tim, 0, sizeof(ctx->s1g_tim));
+
+	return morse_dot11_tim_to_s1g(&ctx->s1g_tim, (struct ieee80211_tim_ie *)ctx->tim,
+				      ctx->tim_map_len, enc_mode, false,
+				      last == TIM_TEST_NUM_AIDS ? 0 : last,
+				      S1G_TIM_PAGE_SLICE_ENTIRE_PAGE, 0);
+}
+
+static int tim_test_encode_incremental(struct tim_test_ctx *ctx)
+{
+	tim_test_build(ctx);
+	memset(&ctx->s1g_tim, 0, sizeof(ctx->s1g_tim));
+
+	return morse_dot11_tim_to_s1g_incremental(&ctx->enc, &ctx->s1g_tim,
+						  (struct ieee80211_tim_ie *)ctx->tim,
+						  ctx->tim_map_len,
+						  S1G_TIM_PAGE_SLICE_ENTIRE_PAGE, 0);
+}
+
+/* Round trip the fixed and random AID sets through a single encoding mode */
+static void tim_test_fixed_mode(struct kunit *test, enum dot11ah_tim_encoding_mode enc_mode)
+{
+	struct tim_test_ctx *ctx = test->priv;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(tim_test_aid_sets); i++) {
+		tim_test_set_aids(ctx, tim_test_aid_sets[i], ARRAY_SIZE(tim_test_aid_sets[i]));
+		ctx->bc = i & 1;
+		KUNIT_EXPECT_EQ(test, tim_test_check(test, ctx, tim_test_encode(ctx, enc_mode)),
+				(u8)BIT(enc_mode));
+	}
+
+	for (i = 0; i < TIM_TEST_RANDOM_ROUNDS; i++) {
+		tim_test_random_aids(ctx, i);
+		KUNIT_EXPECT_EQ(test, tim_test_check(test, ctx, tim_test_encode(ctx, enc_mode)),
+				(u8)BIT(enc_mode));
+	}
+}
+
+static void tim_test_block_mode(struct kunit *test)
+{
+	tim_test_fixed_mode(test, ENC_MODE_BLOCK);
+}
+
+static void tim_test_single_aid_mode(struct kunit *test)
+{
+	tim_test_fixed_mode(test, ENC_MODE_AID);
+}
+
+static void tim_test_olb_mode(struct kunit *test)
+{
+	tim_test_fixed_mode(test, ENC_MODE_OLB);
+}
+
+static void tim_test_empty(struct kunit *test)
+{
+	struct tim_test_ctx *ctx = test->priv;
+
+	bitmap_zero(ctx->aids, TIM_TEST_NUM_AIDS);
+	ctx->bc = false;
+	tim_test_check(test, ctx, tim_test_encode(ctx, ENC_MODE_BLOCK));
+	tim_test_check(test, ctx, tim_test_encode_incremental(ctx));
+
+	ctx->bc = true;
+	KUNIT_EXPECT_EQ(test, tim_test_check(test, ctx, tim_test_encode(ctx, ENC_MODE_BLOCK)),
+			(u8)0);
+	KUNIT_EXPECT_EQ(test, tim_test_check(test, ctx, tim_test_encode_incremental(ctx)), (u8)0);
+}
+
+/* The incremental encoder picks the cheapest mode for each block, and runs of blocks */
+static void tim_test_incremental_modes(struct kunit *test)
+{
+	struct tim_test_ctx *ctx = test->priv;
+	u16 aids[3 * S1G_TIM_NUM_AID_PER_BLOCK];
+	int i;
+
+	ctx->bc = false;
+
+	/* A lone AID is cheapest in single AID mode */
+	tim_test_set_aids(ctx, (const u16[]){ 100 }, 1);
+	KUNIT_EXPECT_EQ(test, tim_test_check(test, ctx, tim_test_encode_incremental(ctx)),
+			(u8)BIT(ENC_MODE_AID));
+
+	/* Several subblocks of one block are cheapest in block bitmap mode */
+	tim_test_set_aids(ctx, (const u16[]){ 64, 65, 72, 80, 88 }, 5);
+	KUNIT_EXPECT_EQ(test, tim_test_check(test, ctx, tim_test_encode_incremental(ctx)),
+			(u8)BIT(ENC_MODE_BLOCK));
+
+	/* Three full blocks are cheapest as one OLB encoded block */
+	for (i = 0; i < ARRAY_SIZE(aids); i++)
+		aids[i] = S1G_TIM_NUM_AID_PER_BLOCK + i;
+	tim_test_set_aids(ctx, aids, ARRAY_SIZE(aids));
+	KUNIT_EXPECT_EQ(test, tim_test_check(test, ctx, tim_test_encode_incremental(ctx)),
+			(u8)BIT(ENC_MODE_OLB));
+
+	/* Back to nothing buffered, every cached block must be cleared */
+	bitmap_zero(ctx->aids, TIM_TEST_NUM_AIDS);
+	tim_test_check(test, ctx, tim_test_encode_incremental(ctx));
+}
+
+/*
+ * Change the AID set between beacons, as traffic is buffered and delivered, and check every
+ * incremental encoding round trips and is never longer than block bitmap mode alone.
+ */
+static void tim_test_incremental_random(struct kunit *test)
+{
+	struct tim_test_ctx *ctx = test->priv;
+	int i;
+
+	for (i = 0; i < TIM_TEST_RANDOM_ROUNDS; i++) {
+		int len;
+
+		if (i % 8) {
+			u32 aid = 1 + prandom_u32_state(&ctx->rnd) % IEEE80211_MAX_AID;
+
+			__change_bit(aid, ctx->aids);
+		} else {
+			tim_test_random_aids(ctx, i / 8);
+		}
+
+		len = tim_test_encode_incremental(ctx);
+		tim_test_check(test, ctx, len);
+		KUNIT_EXPECT_LE(test, len, tim_test_encode(ctx, ENC_MODE_BLOCK));
+	}
+}
+
+static struct kunit_case tim_test_cases[] = {
+	KUNIT_CASE(tim_test_block_mode),
+	KUNIT_CASE(tim_test_single_aid_mode),
+	KUNIT_CASE(tim_test_olb_mode),
+	KUNIT_CASE(tim_test_empty),
+	KUNIT_CASE(tim_test_incremental_modes),
+	KUNIT_CASE(tim_test_incremental_random),
+	{}
+};
+
+static struct kunit_suite tim_test_suite = {
+	.name = "morse_dot11ah_tim",
+	.init = tim_test_init,
+	.test_cases = tim_test_cases,
+};
+
+kunit_test_suite(tim_test_suite);
+
+MODULE_AUTHOR("Morse Micro");
+MODULE_DESCRIPTION("KUnit tests for the Morse Micro S1G TIM encoders");
+MODULE_LICENSE("Dual BSD/GPL");
@@ -347,8 +347,8 @@ static void morse_dot11ah_assoc_resp_to_s1g(struct ieee80211_vif *vif,
 		/* Convert to S1G (USF/UI) format */
 		bss_max_idle_period->max_idle_period = cpu_to_le16(s1g_period);
 
-		ies_mask->ies[WLAN_EID_BSS_MAX_IDLE_PERIOD].ptr = (u8 *)bss_max_idle_period;
-		ies_mask->ies[WLAN_EID_BSS_MAX_IDLE_PERIOD].len = sizeof(*bss_max_idle_period);
+		morse_dot11ah_ies_mask_set(ies_mask, WLAN_EID_BSS_MAX_IDLE_PERIOD,
+					   (u8 *)bss_max_idle_period, sizeof(*bss_max_idle_period));
 	}
 
 	ht_cap = (const struct ieee80211_ht_cap *)ies_mask->ies[WLAN_EID_HT_CAPABILITY].ptr;
@@ -13,6 +13,9 @@
 #include <linux/elf.h>
 #include <linux/crc32.h>
 #include <linux/completion.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/scatterlist.h>
 
 #include "morse.h"
 #include "bus.h"
@@ -27,6 +30,21 @@
 /* Maximum wait time (milliseconds) for firmware to boot (for host table pointer to be available) */
 #define MAX_WAIT_FOR_HOST_TABLE_PTR_MS 1200
 
+/* Firmware segments are downloaded in bursts of up to this many bytes */
+#define MORSE_FW_BURST_SIZE (64 * 1024)
+
+/**
+ * struct morse_fw_stream - state for streaming firmware segments to the chip
+ *
+ * @bounce: DMA-safe buffer of MORSE_FW_BURST_SIZE bytes, used when the image can't be
+ *	handed to the bus as is.
+ * @sg: scatterlist describing a burst of the firmware image.
+ */
+struct morse_fw_stream {
+	u8 *bounce;
+	struct scatterlist sg[MORSE_BUS_SG_MAX_ENTS];
+};
+
 struct fw_init_params {
 	bool download_fw;
 	bool get_host_table_ptr;
@@ -153,6 +171,89 @@ static int morse_set_boot_addr(struct morse *mors, uint32_t addr)
 	return status;
 }
 
+/* Describe a burst of the firmware image with a scatterlist, without copying it */
+static int morse_fw_stream_map(struct morse_fw_stream *st, const u8 *src, u32 len)
+{
+	int nents = 0;
+
+	sg_init_table(st->sg, ARRAY_SIZE(st->sg));
+
+	while (len) {
+		u32 chunk = min_t(u32, len, PAGE_SIZE - offset_in_page(src));
+		struct page *page;
+
+		if (is_vmalloc_addr(src))
+			page = vmalloc_to_page(src);
+		else if (virt_addr_valid(src))
+			page = virt_to_page(src);
+		else
+			return -EINVAL;
+
+		if (!page || nents == ARRAY_SIZE(st->sg) || !IS_ALIGNED(chunk, sizeof(u32)))
+			return -EINVAL;
+
+		sg_set_page(&st->sg[nents++], page, chunk, offset_in_page(src));
+		src += chunk;
+		len -= chunk;
+	}
+
+	sg_mark_end(&st->sg[nents - 1]);
+	return nents;
+}
+
+/* Write a word-sized burst of the firmware image, straight from the image where possible */
+static int morse_fw_stream_write(struct morse *mors, struct morse_fw_stream *st, u32 address,
+				 const u8 *src, u32 len)
+{
+	if (morse_bus_has_dm_write_sg(mors)) {
+		int nents = morse_fw_stream_map(st, src, len);
+
+		if (nents > 0) {
+			int ret = morse_dm_write_sg(mors, address, st->sg, nents, len);
+
+			if (ret != -EOPNOTSUPP)
+				return ret;
+		}
+	}
+
+	memcpy(st->bounce, src, len);
+	return morse_dm_write(mors, address, st->bounce, len);
+}
+
+/* Stream one loadable segment to the chip */
+static int morse_fw_stream_segment(struct morse *mors, struct morse_fw_stream *st,
+				   u32 address, const u8 *src, u32 len)
+{
+	u32 tail = len & (sizeof(u32) - 1);
+	u32 offset = 0;
+	int ret;
+
+	len -= tail;
+
+	while (offset < len) {
+		u32 burst = min_t(u32, len - offset, MORSE_FW_BURST_SIZE);
+
+		ret = morse_fw_stream_write(mors, st, address + offset, src + offset, burst);
+		if (ret)
+			return ret;
+
+		mors->fw_load.bytes_written += burst;
+		offset += burst;
+	}
+
+	if (tail) {
+		/* Set padding to 0xff */
+		memset(st->bounce, 0xff, sizeof(u32));
+		memcpy(st->bounce, src + len, tail);
+		ret = morse_dm_write(mors, address + len, st->bounce, sizeof(u32));
+		if (ret)
+			return ret;
+		mors->fw_load.bytes_written += sizeof(u32);
+	}
+
+	return 0;
+}
+
 static int morse_firmware_load(struct morse *mors, const struct firmware *fw)
 {
 	int i;
@@ -162,11 +263,7 @@ static int morse_firmware_load(struct morse *mors, const struct firmware *fw)
 	morse_elf_shdr shdr;
 	morse_elf_shdr sh_strtab;
 	const char *sh_strs;
-
-	u8 *fw_buf = devm_kmalloc(mors->dev, ROUND_BYTES_TO_WORD(fw->size), GFP_KERNEL);
-
-	if (!fw_buf)
-		return -ENOMEM;
+	struct morse_fw_stream *st;
 
 	if (get_file_header(fw->data, &ehdr) != 0) {
 		MORSE_ERR(mors, "Wrong file format\n");
@@ -178,8 +275,23 @@ static int morse_firmware_load(struct morse *mors, const struct firmware *fw)
 		return -1;
 	}
 
+	st = kzalloc(sizeof(*st), GFP_KERNEL);
+	if (!st)
+		return -ENOMEM;
+
+	st->bounce = kmalloc(MORSE_FW_BURST_SIZE, GFP_KERNEL);
+	if (!st->bounce) {
+		kfree(st);
+		return -ENOMEM;
+	}
+
+	mors->fw_load.bytes_written = 0;
+
 	sh_strs = (const char *)fw->data + sh_strtab.sh_offset;
 
+	/* Hold the bus for the whole download rather than per segment */
+	morse_claim_bus(mors);
+
 	for (i = 0; i < ehdr.e_phnum; i++) {
 		int status;
 		int address;
@@ -206,14 +318,8 @@ static int morse_firmware_load(struct morse *mors, const struct firmware *fw)
 
 		if (phdr.p_filesz && phdr.p_offset &&
 					(phdr.p_offset + phdr.p_filesz) < fw->size) {
-			u32 padded_size = ROUND_BYTES_TO_WORD(phdr.p_filesz);
-
-			memcpy(fw_buf, fw->data + phdr.p_offset, padded_size);
-			/* Set padding to 0xff */
-			memset(fw_buf + phdr.p_filesz, 0xff, padded_size - phdr.p_filesz);
-			morse_claim_bus(mors);
-			status = morse_dm_write(mors, address, fw_buf, padded_size);
-			morse_release_bus(mors);
+			status = morse_fw_stream_segment(mors, st, address,
+							 fw->data + phdr.p_offset, phdr.p_filesz);
 			if (status) {
 				ret = -1;
 				break;
@@ -221,6 +327,10 @@ static int morse_firmware_load(struct morse *mors, const struct firmware *fw)
 		}
 	}
 
+	morse_release_bus(mors);
+
+	MORSE_INFO(mors, "Firmware download: %u bytes written\n", mors->fw_load.bytes_written);
+
 	for (i = 0; i < ehdr.e_shnum; i++) {
 		if (get_section_header(fw->data, &ehdr, &shdr, i) != 0)
 			continue;
@@ -233,9 +343,10 @@ static int morse_firmware_load(struct morse *mors, const struct firmware *fw)
 
 	{
 		if (ehdr.e_entry != 0)
-			ret = morse_set_boot_addr(mors, ehdr.e_entry);
+			ret = ret ? ret : morse_set_boot_addr(mors, ehdr.e_entry);
 	}
-	devm_kfree(mors->dev, fw_buf);
+	kfree(st->bounce);
+	kfree(st);
 	return ret;
 }
 
@@ -914,6 +1025,7 @@ int morse_firmware_init(struct morse *mors, enum morse_config_test_mode test_mod
 	int board_id = 0;
 	char *p;
 	bool use_full_path = true;
+	ktime_t start = ktime_get();
 
 #ifdef CONFIG_ANDROID
 	/* Use filenames only - Android sets the path */
@@ -1006,10 +1118,12 @@ exit:
 
 	kfree(fw_path);
 
+	mors->fw_load.startup_us = ktime_to_us(ktime_sub(ktime_get(), start));
+
 	if (ret)
 		MORSE_ERR(mors, "%s failed: %d\n", __func__, ret);
 	else
-		MORSE_INFO(mors, "Firmware initialized\n");
+		MORSE_INFO(mors, "Firmware initialized in %u us\n", mors->fw_load.startup_us);
 
 	return ret;
 }
@@ -1018,6 +1132,7 @@ int morse_firmware_prepare_and_init(struct morse *mors, bool reset_hw, bool reat
 {
 	int ret = 0;
 	bool is_hw_loaded = false;
+	ktime_t start = ktime_get();
 
 	if (morse_test_mode_is_interactive(test_mode) && reattach_hw) {
 		is_hw_loaded = morse_hw_is_already_loaded(mors);
@@ -1060,6 +1175,9 @@ int morse_firmware_prepare_and_init(struct morse *mors, bool reset_hw, bool reat
 
 		if (mors->cfg->post_firmware_ndr)
 			mors->cfg->post_firmware_ndr(mors);
+
+		mors->fw_load.restart_us = ktime_to_us(ktime_sub(ktime_get(), start));
+		mors->fw_load.restarts++;
 	}
 
 	return ret;
@@ -146,6 +146,23 @@ struct extended_host_table {
 	u8 ext_host_table_data_tlvs[];
 } __packed;
 
+/**
+ * struct morse_fw_load_stats - firmware download and boot statistics
+ *
+ * @startup_us: duration of the last firmware initialisation, from requesting the images to
+ *	the firmware being verified.
+ * @restart_us: duration of the last chip restart, including the reset and the parse of the
+ *	extended host table.
+ * @restarts: number of chip restarts.
+ * @bytes_written: bytes downloaded by the last firmware load.
+ */
+struct morse_fw_load_stats {
+	u32 startup_us;
+	u32 restart_us;
+	u32 restarts;
+	u32 bytes_written;
+};
+
 int morse_firmware_init(struct morse *mors, uint test_mode);
 
 /**
@@ -99,14 +99,21 @@ static void morse_hw_attach_done_irq_handle(struct morse *mors)
 int morse_hw_irq_handle(struct morse *mors)
 {
 	u32 status1 = 0;
+	ktime_t irq_time = ktime_get();
 #if defined(CONFIG_MORSE_DEBUG_IRQ)
 	int i;
 #endif
 
 	morse_reg32_read(mors, MORSE_REG_INT1_STS(mors), &status1);
 
-	if (status1 & MORSE_CHIP_IF_IRQ_MASK_ALL)
+	if (status1 & MORSE_CHIP_IF_IRQ_MASK_ALL) {
+		bool rx_pend = test_bit(MORSE_RX_PEND, &mors->chip_if->event_flags);
+
 		mors->cfg->ops->chip_if_handle_irq(mors, status1);
+		/* RX latency is measured from the IRQ that flagged RX pending */
+		if (!rx_pend && test_bit(MORSE_RX_PEND, &mors->chip_if->event_flags))
+			morse_debug_rx_irq(mors, irq_time);
+	}
 	if (status1 & MORSE_INT_BEACON_VIF_MASK_ALL)
 		morse_beacon_irq_handle(mors, status1);
 	if (status1 & MORSE_INT_NDP_PROBE_REQ_PV0_VIF_MASK_ALL)
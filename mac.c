@@ -8,6 +8,7 @@
 #include <linux/slab.h>
 #include <linux/jiffies.h>
 #include <linux/crc32.h>
+#include <linux/percpu.h>
 #include <net/mac80211.h>
 #include <asm/div64.h>
 #include <linux/kernel.h>
@@ -746,7 +747,7 @@ static void morse_mac_apply_mcs10_mode_auto(struct morse *mors, struct morse_skb
 	 */
 	/* Case 3 - replace additional entries. */
 	if (mcs0_last_idx > mcs0_first_idx) {
-		mors->debug.mcs_stats_tbl.mcs0.tx_count += tx_info->rates[mcs0_first_idx].count;
+		MORSE_MCS_STAT_ADD(mors, mcs0.tx_count, tx_info->rates[mcs0_first_idx].count);
 		for (j = mcs0_first_idx + 1; j < i; j++) {
 			enum dot11_bandwidth bw_idx =
 			    morse_ratecode_bw_index_get(tx_info->rates[j].morse_ratecode);
@@ -754,7 +755,7 @@ static void morse_mac_apply_mcs10_mode_auto(struct morse *mors, struct morse_skb
 			    morse_ratecode_mcs_index_get(tx_info->rates[j].morse_ratecode);
 			if (mcs_index == 0 && bw_idx == DOT11_BANDWIDTH_1MHZ) {
 				morse_ratecode_mcs_index_set(&tx_info->rates[j].morse_ratecode, 10);
-				mors->debug.mcs_stats_tbl.mcs10.tx_count += tx_info->rates[j].count;
+				MORSE_MCS_STAT_ADD(mors, mcs10.tx_count, tx_info->rates[j].count);
 			}
 		}
 		/* Case 2 - add additional MCS10 entry. */
@@ -776,8 +777,8 @@ static void morse_mac_apply_mcs10_mode_auto(struct morse *mors, struct morse_skb
 			tx_info->rates[i].count = mcs10_count;
 		}
 		/* Update our statistics. */
-		mors->debug.mcs_stats_tbl.mcs10.tx_count += mcs10_count;
-		mors->debug.mcs_stats_tbl.mcs0.tx_count += pre_mcs10_mcs0_count;
+		MORSE_MCS_STAT_ADD(mors, mcs10.tx_count, mcs10_count);
+		MORSE_MCS_STAT_ADD(mors, mcs0.tx_count, pre_mcs10_mcs0_count);
 		/* Case 1 full table - increment MCS0 count. */
 	} else {
 		for (j = mcs0_first_idx; j < IEEE80211_TX_MAX_RATES; j++) {
@@ -785,7 +786,7 @@ static void morse_mac_apply_mcs10_mode_auto(struct morse *mors, struct morse_skb
 			    morse_ratecode_mcs_index_get(tx_info->rates[i].morse_ratecode);
 
 			if (mcs_index == 0)
-				mors->debug.mcs_stats_tbl.mcs0.tx_count += tx_info->rates[j].count;
+				MORSE_MCS_STAT_ADD(mors, mcs0.tx_count, tx_info->rates[j].count);
 		}
 	}
 }
@@ -803,7 +804,7 @@ static void morse_mac_apply_mcs10(struct morse *mors, struct morse_skb_tx_info *
 			    morse_ratecode_mcs_index_get(tx_info->rates[i].morse_ratecode);
 
 			if (bw_idx == DOT11_BANDWIDTH_1MHZ && mcs_index == 0)
-				mors->debug.mcs_stats_tbl.mcs0.tx_count += tx_info->rates[i].count;
+				MORSE_MCS_STAT_ADD(mors, mcs0.tx_count, tx_info->rates[i].count);
 		}
 		return;
 	case MCS10_MODE_FORCED:
@@ -816,7 +817,7 @@ static void morse_mac_apply_mcs10(struct morse *mors, struct morse_skb_tx_info *
 			if (bw_idx == DOT11_BANDWIDTH_1MHZ && mcs_index == 0) {
 				morse_ratecode_mcs_index_set(&tx_info->rates[i].morse_ratecode, 10);
 				/* Update our statistics. */
-				mors->debug.mcs_stats_tbl.mcs10.tx_count += tx_info->rates[i].count;
+				MORSE_MCS_STAT_ADD(mors, mcs10.tx_count, tx_info->rates[i].count);
 			}
 		}
 		return;
@@ -925,7 +926,7 @@ void morse_mac_fill_tx_info(struct morse *mors,
 	/* Disable probe retries in constrained environments */
 	if (mors->duty_cycle > 0 && mors->duty_cycle <= duty_cycle_probe_retry_threshold) {
 		if (ieee80211_is_probe_req(fc) || ieee80211_is_probe_resp(fc)) {
-			mors->debug.page_stats.tx_duty_cycle_retry_disabled++;
+			MORSE_PAGE_STAT_INC(mors, tx_duty_cycle_retry_disabled);
 			tx_info->rates[0].count = 1;
 			tx_info->rates[1].count = 0;
 		}
@@ -1019,7 +1020,7 @@ static bool morse_mac_tx_ps_filtered_for_sta(struct morse *mors,
 		return false;
 
 	MORSE_DBG(mors, "Frame for sta[%pM] PS filtered\n", mors_sta->addr);
-	mors->debug.page_stats.tx_ps_filtered++;
+	MORSE_PAGE_STAT_INC(mors, tx_ps_filtered);
 
 	info->flags |= IEEE80211_TX_STAT_TX_FILTERED;
 	info->flags &= ~IEEE80211_TX_CTL_AMPDU;
@@ -1643,8 +1644,8 @@ static void morse_mac_update_custom_max_idle_period(struct morse_vif *mors_vif,
 		/* Convert to S1G (USF/UI) format */
 		bss_max_idle_period->max_idle_period = cpu_to_le16(s1g_max_idle_period);
 
-		ies_mask->ies[WLAN_EID_BSS_MAX_IDLE_PERIOD].ptr = (u8 *)bss_max_idle_period;
-		ies_mask->ies[WLAN_EID_BSS_MAX_IDLE_PERIOD].len = sizeof(*bss_max_idle_period);
+		morse_dot11ah_ies_mask_set(ies_mask, WLAN_EID_BSS_MAX_IDLE_PERIOD,
+					   (u8 *)bss_max_idle_period, sizeof(*bss_max_idle_period));
 	}
 }
 
@@ -4358,6 +4359,12 @@ morse_mac_ops_sta_state(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
 	mors_vif = (struct morse_vif *)vif->drv_priv;
 	mors_sta = (struct morse_sta *)sta->drv_priv;
 
+#ifdef CONFIG_MORSE_RC
+	/* Set up per-station rate control state as soon as the record exists */
+	if (old_state == IEEE80211_STA_NOTEXIST && new_state == IEEE80211_STA_NONE)
+		morse_rc_sta_init(mors_sta);
+#endif
+
 	/* Ignore both NOTEXIST to NONE and NONE to NOTEXIST */
 	if ((old_state == IEEE80211_STA_NOTEXIST && new_state == IEEE80211_STA_NONE) ||
 	    (old_state == IEEE80211_STA_NONE && new_state == IEEE80211_STA_NOTEXIST))
@@ -5309,11 +5316,11 @@ morse_mac_rx_status(struct morse *mors,
 	/* If MCS10, convert to MCS0 to keep rate control happy. */
 	if (mcs_index == 10) {
 		rx_status->rate_idx = 0;
-		mors->debug.mcs_stats_tbl.mcs10.rx_count++;
+		MORSE_MCS_STAT_INC(mors, mcs10.rx_count);
 	} else {
 		rx_status->rate_idx = mcs_index;
 		if (mcs_index == 0)
-			mors->debug.mcs_stats_tbl.mcs0.rx_count++;
+			MORSE_MCS_STAT_INC(mors, mcs0.rx_count);
 	}
 
 	if (morse_ratecode_sgi_get(hdr_rx_status->morse_ratecode))
@@ -5968,9 +5975,81 @@ static int morse_mac_process_s1g_mgmt_or_beacon(struct morse *mors,
 	return morse_mac_process_s1g_caps(mors, vif, skb, ies_mask);
 }
 
+/**
+ * morse_mac_rx_ies_mask_get() - Get a cleared IE mask for parsing a received frame.
+ *
+ * Takes the mask cached on this CPU if there is one, otherwise allocates a new one.
+ *
+ * @mors: Global morse struct
+ *
+ * Return: IE mask, or NULL on allocation failure
+ */
+static struct dot11ah_ies_mask *morse_mac_rx_ies_mask_get(struct morse *mors)
+{
+	struct dot11ah_ies_mask *ies_mask = NULL;
+
+	if (mors->rx_ies_mask_cache)
+		ies_mask = this_cpu_xchg(*mors->rx_ies_mask_cache, NULL);
+
+	return ies_mask ? ies_mask : morse_dot11ah_ies_mask_alloc();
+}
+
+/**
+ * morse_mac_rx_ies_mask_put() - Return an IE mask obtained by morse_mac_rx_ies_mask_get().
+ *
+ * The mask is cleared, which only resets the IEs the frame populated, and cached on this CPU
+ * for the next received management frame. A mask already cached on this CPU is freed.
+ *
+ * @mors: Global morse struct
+ * @ies_mask: IE mask to return, may be NULL
+ */
+static void morse_mac_rx_ies_mask_put(struct morse *mors, struct dot11ah_ies_mask *ies_mask)
+{
+	if (!ies_mask)
+		return;
+
+	if (!mors->rx_ies_mask_cache) {
+		morse_dot11ah_ies_mask_free(ies_mask);
+		return;
+	}
+
+	morse_dot11ah_ies_mask_clear(ies_mask);
+	ies_mask = this_cpu_xchg(*mors->rx_ies_mask_cache, ies_mask);
+	morse_dot11ah_ies_mask_free(ies_mask);
+}
+
+static void morse_mac_rx_ies_mask_cache_free(struct morse *mors)
+{
+	int cpu;
+
+	if (!mors->rx_ies_mask_cache)
+		return;
+
+	for_each_possible_cpu(cpu)
+		morse_dot11ah_ies_mask_free(*per_cpu_ptr(mors->rx_ies_mask_cache, cpu));
+
+	free_percpu(mors->rx_ies_mask_cache);
+	mors->rx_ies_mask_cache = NULL;
+}
+
+/* Hand a frame to mac80211, from NAPI poll context if @napi is set */
+static void morse_mac_rx_deliver(struct ieee80211_hw *hw, struct sk_buff *skb,
+				 struct napi_struct *napi)
+{
+	if (napi)
+		ieee80211_rx_napi(hw, NULL, skb, napi);
+	else
+		ieee80211_rx_irqsafe(hw, skb);
+}
+
+/*
+ * @napi is set when called from the NAPI poll, which only passes data frames that are
+ * delivered without sleeping.
+ */
 void morse_mac_skb_recv(struct morse *mors,
 			struct sk_buff *skb,
-			struct morse_skb_rx_status *hdr_rx_status)
+			struct morse_skb_rx_status *hdr_rx_status,
+			struct napi_struct *napi)
 {
 	struct ieee80211_hw *hw = mors->hw;
 	struct dot11ah_ies_mask *ies_mask = NULL;
@@ -5979,6 +6058,7 @@ void morse_mac_skb_recv(struct morse *mors,
 	int length_11n;
 	struct morse_vif *mors_vif;
 	bool skb_needs_free = true;
+	__le16 fc;
 
 	if (!mors->started)
 		goto exit;
@@ -5988,6 +6068,8 @@ void morse_mac_skb_recv(struct morse *mors,
 
 #ifdef CONFIG_MORSE_MONITOR
 	if (mors->monitor_mode) {
+		if (skb_linearize(skb))
+			goto exit;
 		morse_mon_rx(mors, skb, hdr_rx_status);
 		/* If we have a monitor interface, don't bother doing any
 		 * other work on the SKB as we only support a single interface
@@ -5998,10 +6080,6 @@ void morse_mac_skb_recv(struct morse *mors,
 
 	vif = morse_get_vif_from_rx_status(mors, hdr_rx_status);
 
-	ies_mask = morse_dot11ah_ies_mask_alloc();
-	if (!ies_mask)
-		goto exit;
-
 	/* The firmware passes up broadcast mgmt frames such as beacons with a NULL VIF.
 	 * Assign the correct VIF. If no matching VIF was found, the VIF is not yet up.
 	 */
@@ -6023,6 +6101,8 @@ void morse_mac_skb_recv(struct morse *mors,
 	/* Attempt to convert S1G PV1 to S1G PV0 */
 	if (morse_dot11ah_is_pv1_qos_data(le16_to_cpu(((struct ieee80211_hdr *)skb->data)->
 		frame_control))) {
+		if (skb_linearize(skb))
+			goto exit;
 		if (morse_mac_convert_pv1_to_pv0(mors, mors_vif, skb, hdr_rx_status,
 						(struct dot11ah_mac_pv1_hdr *)skb->data))
 			goto exit;
@@ -6032,6 +6112,25 @@ void morse_mac_skb_recv(struct morse *mors,
 	morse_mac_rx_status(mors, hdr_rx_status, &rx_status, skb);
 	memcpy(IEEE80211_SKB_RXCB(skb), &rx_status, sizeof(rx_status));
 
+	/* Data and control frames carry no IEs and need no 11n conversion, so pass them
+	 * straight to mac80211 without parsing.
+	 */
+	fc = ((struct ieee80211_hdr *)skb->data)->frame_control;
+	if (!ieee80211_is_mgmt(fc) && !ieee80211_is_s1g_beacon(fc)) {
+		morse_debug_rx_lat_end(mors);
+		morse_mac_rx_deliver(hw, skb, napi);
+		skb_needs_free = false;
+		goto exit;
+	}
+
+	/* Frames that get parsed and rewritten below must be linear */
+	if (skb_linearize(skb))
+		goto exit;
+
+	ies_mask = morse_mac_rx_ies_mask_get(mors);
+	if (!ies_mask)
+		goto exit;
+
 	/* MGMT and beacon frames need to be inspected by the driver.
 	 * Logic in the following function may dictate that the frame must be
 	 * dropped (ignored) or modified prior to passing through
@@ -6076,7 +6175,8 @@ void morse_mac_skb_recv(struct morse *mors,
 	morse_dot11ah_s1g_to_11n_rx_packet(vif, skb, length_11n, ies_mask);
 
 	if (skb->len > 0) {
-		ieee80211_rx_irqsafe(hw, skb);
+		morse_debug_rx_lat_end(mors);
+		morse_mac_rx_deliver(hw, skb, napi);
 		skb_needs_free = false;
 	}
 
@@ -6084,7 +6184,7 @@ exit:
 	if (skb_needs_free)
 		morse_mac_skb_free(mors, skb);
 
-	morse_dot11ah_ies_mask_free(ies_mask);
+	morse_mac_rx_ies_mask_put(mors, ies_mask);
 }
 
 static void morse_mac_config_ht_cap(struct morse *mors)
@@ -7134,7 +7234,7 @@ struct morse *morse_mac_create(size_t priv_size, struct device *dev)
 	mors->dev = dev;
 	mutex_init(&mors->lock);
 	mutex_init(&mors->cmd_lock);
-	mutex_init(&mors->cmd_wait);
+	morse_cmd_pipeline_init(mors);
 	spin_lock_init(&mors->vif_list_lock);
 
 	/* Initialise coredump structures */
@@ -7168,6 +7268,14 @@ struct morse *morse_mac_create(size_t priv_size, struct device *dev)
 	/* Initialise pre-association station structure (shared between VIFs) */
 	morse_pre_assoc_peer_list_init(mors);
 
+	/* Not fatal if this fails, RX then allocates an IE mask per management frame */
+	mors->rx_ies_mask_cache = alloc_percpu(struct dot11ah_ies_mask *);
+
+	if (morse_debug_stats_alloc(mors)) {
+		morse_mac_destroy(mors);
+		return NULL;
+	}
+
 	return mors;
 }
 
@@ -7246,6 +7354,8 @@ void morse_mac_destroy(struct morse *mors)
 		morse_watchdog_cleanup(mors);
 
 	morse_coredump_destroy(mors);
+	morse_mac_rx_ies_mask_cache_free(mors);
+	morse_debug_stats_free(mors);
 
 	if (enable_wiphy)
 		morse_wiphy_destroy(mors);
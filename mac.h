@@ -46,7 +46,7 @@ void morse_mac_send_buffered_bc(struct ieee80211_vif *vif);
 struct morse *morse_mac_create(size_t priv_size, struct device *dev);
 void morse_mac_destroy(struct morse *mors);
 void morse_mac_skb_recv(struct morse *mors, struct sk_buff *skb,
-		       struct morse_skb_rx_status *hdr_rx_status);
+		       struct morse_skb_rx_status *hdr_rx_status, struct napi_struct *napi);
 int morse_mac_event_recv(struct morse *mors, struct sk_buff *skb);
 int morse_mac_register(struct morse *mors);
 void morse_mac_unregister(struct morse *mors);
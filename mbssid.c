@@ -250,8 +250,8 @@ int morse_process_beacon_from_mbssid_ie(struct morse *mors, struct sk_buff *skb,
 		int mbssid_index;
 
 		if (sub->id == WLAN_EID_SSID) {
-			ies_mask->ies[WLAN_EID_SSID].ptr = (u8 *)sub->data;
-			ies_mask->ies[WLAN_EID_SSID].len = (u8)sub->datalen;
+			morse_dot11ah_ies_mask_set(ies_mask, WLAN_EID_SSID, (u8 *)sub->data,
+						   (u8)sub->datalen);
 		}
 
 		if (sub->id != WLAN_EID_MULTI_BSSID_IDX ||
@@ -17,10 +17,19 @@
  */
 #define DEFAULT_PACKET_SIZE_BYTES 1200
 
-/* The sample frequencies at different stages */
+/*
+ * The sample frequencies at different stages. These and the other tuning values
+ * guarded by #ifndef may be overridden at build time, e.g. by the simulator.
+ */
+#ifndef LOOKAROUND_RATE_INIT
 #define LOOKAROUND_RATE_INIT		5
+#endif
+#ifndef LOOKAROUND_RATE_NORMAL
 #define LOOKAROUND_RATE_NORMAL		50
+#endif
+#ifndef LOOKAROUND_RATE_STABLE
 #define LOOKAROUND_RATE_STABLE		100
+#endif
 
 /* The thresholds for stability stages */
 #define STABILITY_CNT_THRESHOLD_INIT	20
@@ -45,13 +54,17 @@
 /**
  * Force a look around if there haven't been any for this number of cycles
  */
+#ifndef LOOKAROUND_MAX_RC_CYCLES
 #define LOOKAROUND_MAX_RC_CYCLES 5
+#endif
 
 /**
  * Number of attempts for each lookaround rate within at most two RC cycles
  * if there are enough packets
  */
+#ifndef LOOKAROUND_RATE_ATTEMPTS
 #define LOOKAROUND_RATE_ATTEMPTS 4
+#endif
 
 /**
  * Limit the number of times we try to pick a theoretically better rate to sample.
@@ -91,7 +104,9 @@
 /**
  * The time window for all rates in rate table
  */
+#ifndef RATE_WINDOW_MICROSECONDS
 #define RATE_WINDOW_MICROSECONDS 24000
+#endif
 
 /**
  * The overhead value of a single transmission.
@@ -114,7 +129,9 @@
  *			   100
  *
  */
+#ifndef EWMA
 #define EWMA 75
+#endif
 
 /**
  * Evidence scaling to allow for one decimal place. Needed for low
@@ -508,24 +525,24 @@ u32 mmrc_calculate_theoretical_throughput(struct mmrc_rate rate)
  * @param index The index in the table of the rate to calculate throughput for
  * @return u32 The expected throughput for the given rate
  */
-static u32 calculate_throughput(struct mmrc_table *tb, u8 index)
+static u32 calculate_throughput(struct mmrc_table *tb, u16 index)
 {
-	struct mmrc_rate rate = get_rate_row(tb, index);
+	const struct mmrc_rate_info *info = &tb->table[index].info;
+	u16 row = info->rate.index;
 
 	/**
 	 * Avoid the overflow (observed for 8MHz MCS9 rate: 43333) by dividing first before
 	 * multiplying. Should not experience any loss of precision as the throughput is already
 	 * multiplied by 1000 in mmrc_calculate_theoretical_throughput (returned as bits/sec)
 	 */
-	if (tb->table[rate.index].prob < 10)
+	if (tb->table[row].prob < 10)
 		return 0;
-	else if (rate.index == tb->best_tp.index && tb->interference_likely)
+	else if (row == tb->best_tp.index && tb->interference_likely)
 		/* Assist the best rate by increasing the probability by the averaged variation */
-		return (mmrc_calculate_theoretical_throughput(rate) / 100) *
-				(tb->table[rate.index].prob + tb->probability_variation);
+		return (info->theoretical_tp / 100) *
+				(tb->table[row].prob + tb->probability_variation);
 	else
-		return (mmrc_calculate_theoretical_throughput(rate) / 100) *
-						tb->table[rate.index].prob;
+		return (info->theoretical_tp / 100) * tb->table[row].prob;
 }
 
 bool validate_rate(struct mmrc_table *tb, struct mmrc_rate *rate)
@@ -581,23 +598,23 @@ static u16 find_baseline_index(struct mmrc_table *tb)
 	u32 i, theoretical_tp, min_theoretical_tp;
 	u16 row_count = rows_from_sta_caps(&tb->caps);
 	u16 min_theoretical_tp_index = 0;
-	struct mmrc_rate rate;
+	const struct mmrc_rate_info *info;
 
 #if MMRC_MODE == MMRC_MODE_80211AH
 	if (tb->caps.rates & MMRC_MASK(MMRC_MCS10))
 		return 0;
 #endif
 
-	min_theoretical_tp = mmrc_calculate_theoretical_throughput(get_rate_row(tb, 0));
+	min_theoretical_tp = tb->table[0].info.theoretical_tp;
 	for (i = 0; i < row_count; i++)	{
-		rate = get_rate_row(tb, i);
-		if (!validate_rate(tb, &rate))
+		info = &tb->table[i].info;
+		if (!info->valid)
 			continue;
 
-		theoretical_tp = mmrc_calculate_theoretical_throughput(rate);
+		theoretical_tp = info->theoretical_tp;
 		if (min_theoretical_tp > theoretical_tp) {
 			min_theoretical_tp = theoretical_tp;
-			min_theoretical_tp_index = rate.index;
+			min_theoretical_tp_index = info->rate.index;
 		}
 	}
 
@@ -658,7 +675,8 @@ static void generate_table_priority(struct mmrc_table *tb, u32 new_stats)
 	u32 best_tp = calculate_throughput(tb, best_row);
 	u32 second_best_tp = calculate_throughput(tb, second_best_row);
 	u32 last_nonzero_prob = 0;
-	struct mmrc_rate tmp;
+	u16 row_count = rows_from_sta_caps(&tb->caps);
+	u16 row;
 	u32 tmp_tp;
 
 	/* Use fixed rate if set */
@@ -669,12 +687,13 @@ static void generate_table_priority(struct mmrc_table *tb, u32 new_stats)
 		return;
 	}
 
-	for (i = 0; i < rows_from_sta_caps(&tb->caps); i++) {
-		tmp = get_rate_row(tb, i);
-		if (!validate_rate(tb, &tmp))
+	for (i = 0; i < row_count; i++) {
+		if (!tb->table[i].info.valid)
 			continue;
 
-		if (tb->table[tmp.index].evidence == 0)
+		row = tb->table[i].info.rate.index;
+
+		if (tb->table[row].evidence == 0)
 			continue;
 
 		/**
@@ -682,40 +701,40 @@ static void generate_table_priority(struct mmrc_table *tb, u32 new_stats)
 		 * had worse probability. That indicates the rate itself is not the problem.
 		 * Only do the probability check for rates up to the previous best rate.
 		 */
-		tmp_tp = calculate_throughput(tb, tmp.index);
+		tmp_tp = calculate_throughput(tb, row);
 
 		if (tmp_tp > best_tp ||
-		    (tb->table[tmp.index].max_throughput <=
+		    (tb->table[row].max_throughput <=
 						tb->table[prev_best_row].max_throughput &&
-		     tb->table[tmp.index].prob >= PROBABILITY_DIP_RECOVERY_MIN &&
-		     tb->table[tmp.index].prob > tb->table[last_nonzero_prob].prob)) {
+		     tb->table[row].prob >= PROBABILITY_DIP_RECOVERY_MIN &&
+		     tb->table[row].prob > tb->table[last_nonzero_prob].prob)) {
 			second_best_row = best_row;
 			second_best_tp = best_tp;
 
 			best_tp = tmp_tp;
-			best_row = tmp.index;
-		} else if (tmp_tp > second_best_tp && best_row != tmp.index) {
+			best_row = row;
+		} else if (tmp_tp > second_best_tp && best_row != row) {
 			second_best_tp = tmp_tp;
-			second_best_row = tmp.index;
+			second_best_row = row;
 		}
 
-		if (tb->table[tmp.index].prob >= PROBABILITY_DIP_MIN &&
-		    tb->table[tmp.index].max_throughput >=
+		if (tb->table[row].prob >= PROBABILITY_DIP_MIN &&
+		    tb->table[row].max_throughput >=
 						tb->table[last_nonzero_prob].max_throughput)
-			last_nonzero_prob = tmp.index;
+			last_nonzero_prob = row;
 	}
 
 	/* Only update rates and stability when there are new statistics */
 	if (!new_stats)
 		return;
 
-	tb->best_tp = get_rate_row(tb, best_row);
+	tb->best_tp = tb->table[best_row].info.rate;
 	if (best_tp == 0 && tb->best_tp.rate > MMRC_MCS0) {
 		/* Drop one rate, as the best throughput is zero */
 		tb->best_tp.rate--;
 		rate_update_index(tb, &tb->best_tp);
 	}
-	tb->second_tp = get_rate_row(tb, second_best_row);
+	tb->second_tp = tb->table[second_best_row].info.rate;
 	mmrc_fill_retry_rates(tb);
 
 	if (tb->best_tp.rate > MMRC_MCS1 && prev_best_row == best_row) {
@@ -771,11 +790,30 @@ static void generate_table_priority(struct mmrc_table *tb, u32 new_stats)
 		tb->newly_unconverged = false;
 }
 
-static u32 calculate_attempt_time(struct mmrc_rate *rate, size_t size)
+/**
+ * Look up the airtime of a default sized packet for a rate. Rates which match their
+ * table row use the value cached by mmrc_sta_init(), anything else (e.g. a retry rate
+ * outside the capabilities) is computed directly.
+ */
+static u32 mmrc_rate_tx_time(struct mmrc_table *tb, struct mmrc_rate *rate)
+{
+	const struct mmrc_rate_info *info;
+
+	if (rate->index < rows_from_sta_caps(&tb->caps)) {
+		info = &tb->table[rate->index].info;
+		if (info->rate.rate == rate->rate && info->rate.bw == rate->bw &&
+		    info->rate.ss == rate->ss && info->rate.guard == rate->guard)
+			return info->tx_time;
+	}
+
+	return get_tx_time(rate);
+}
+
+static u32 calculate_attempt_time(struct mmrc_table *tb, struct mmrc_rate *rate, size_t size)
 {
 	u32 time;
 
-	time = get_tx_time(rate);
+	time = mmrc_rate_tx_time(tb, rate);
 
 	if (size > DEFAULT_PACKET_SIZE_BYTES)
 		time = (time * ((size * 1000) / DEFAULT_PACKET_SIZE_BYTES)) / 1000;
@@ -814,7 +852,7 @@ static void calculate_remaining_attempts(struct mmrc_table *tb,
 			calculate_throughput(tb, tb->best_prob.index)))
 			continue;
 
-		attempt_time = calculate_attempt_time(&rate->rates[i], size);
+		attempt_time = calculate_attempt_time(tb, &rate->rates[i], size);
 		if (!attempt_time)
 			continue;
 
@@ -830,7 +868,8 @@ static void calculate_remaining_attempts(struct mmrc_table *tb,
 /**
  * Allocate initial attempts to all rates in a rate table
  */
-static void allocate_initial_attempts(struct mmrc_rate_table *rate, s32 *rem_time, size_t size)
+static void allocate_initial_attempts(struct mmrc_table *tb, struct mmrc_rate_table *rate,
+				      s32 *rem_time, size_t size)
 {
 	u32 i;
 
@@ -840,7 +879,7 @@ static void allocate_initial_attempts(struct mmrc_rate_table *rate, s32 *rem_tim
 		if (rate->rates[i].rate == MMRC_MCS_UNUSED)
 			break;
 
-		attempt_time = calculate_attempt_time(&rate->rates[i], size);
+		attempt_time = calculate_attempt_time(tb, &rate->rates[i], size);
 
 		/* if the time for a single attempt is very long, lets just try once */
 		if (attempt_time > MAX_WINDOW_ATTEMPT_TIME) {
@@ -859,6 +898,8 @@ void mmrc_get_rates(struct mmrc_table *tb,
 {
 	u8 i;
 	u16 random_index;
+	u16 row_count = rows_from_sta_caps(&tb->caps);
+	const struct mmrc_rate_info *info;
 	struct mmrc_rate random;
 	struct mmrc_rate lookaround0 = tb->best_tp;
 	struct mmrc_rate lookaround1 = tb->second_tp;
@@ -923,13 +964,14 @@ void mmrc_get_rates(struct mmrc_table *tb,
 				random_index = tb->current_lookaround_rate_index;
 				try_current_lookaround = false;
 			} else {
-				random_index = osal_mmrc_random_u32(rows_from_sta_caps(&tb->caps));
+				random_index = osal_mmrc_random_u32(row_count);
 			}
-			random = get_rate_row(tb, random_index);
-
-			if (!validate_rate(tb, &random))
+			info = &tb->table[random_index].info;
+			if (!info->valid)
 				continue;
 
+			random = info->rate;
+
 #if MMRC_MODE == MMRC_MODE_80211AH
 			if (random.rate == MMRC_MCS10)
 				continue;
@@ -937,7 +979,7 @@ void mmrc_get_rates(struct mmrc_table *tb,
 			if (tb->table[random_index].evidence > 0)
 				random_tp = calculate_throughput(tb, random_index);
 			else
-				random_tp = mmrc_calculate_theoretical_throughput(random);
+				random_tp = info->theoretical_tp;
 
 			/* Skip rates that can only be worse than the current best */
 			if (random_tp <= best_tp)
@@ -1001,7 +1043,7 @@ void mmrc_get_rates(struct mmrc_table *tb,
 		out->rates[i].flags |= MMRC_MASK(MMRC_FLAGS_CTS_RTS);
 
 	/* Allocate initial attempts for rate */
-	allocate_initial_attempts(out, &rem_time, size);
+	allocate_initial_attempts(tb, out, &rem_time, size);
 
 	/* Calculate and allocate remaining attempts */
 	calculate_remaining_attempts(tb, out, &rem_time, size);
@@ -1360,11 +1402,19 @@ void mmrc_sta_init(struct mmrc_table *tb, struct mmrc_sta_capabilities *caps, s8
 	memcpy(&tb->caps, caps, sizeof(tb->caps));
 
 	for (i = 0; i < row_count; i++) {
+		struct mmrc_rate_info *info = &tb->table[i].info;
+
 		tb->table[i].prob = RATE_INIT_PROBABILITY;
 		tb->table[i].evidence = 0;
 		tb->table[i].sum_throughput = 0;
 		tb->table[i].avg_throughput_counter = 0;
 		tb->table[i].max_throughput = 0;
+
+		/* Build the constant per-row lookups once for this capability set */
+		info->rate = get_rate_row(tb, i);
+		info->valid = validate_rate(tb, &info->rate);
+		info->tx_time = get_tx_time(&info->rate);
+		info->theoretical_tp = mmrc_calculate_theoretical_throughput(info->rate);
 	}
 
 	tb->fixed_rate.rate = MMRC_MCS_UNUSED;
@@ -1375,7 +1425,7 @@ void mmrc_sta_init(struct mmrc_table *tb, struct mmrc_sta_capabilities *caps, s8
 	tb->unconverged = true;
 	tb->newly_unconverged = true;
 	tb->stability_cnt_threshold = STABILITY_CNT_THRESHOLD_INIT;
-	tb->baseline = get_rate_row(tb, find_baseline_index(tb));
+	tb->baseline = tb->table[find_baseline_index(tb)].info.rate;
 	mmrc_init_rates(tb, rssi);
 
 	MMRC_OSAL_ASSERT(tb->caps.max_rates);
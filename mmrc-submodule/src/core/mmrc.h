@@ -208,6 +208,25 @@ struct mmrc_sta_capabilities {
 	u8 sgi_per_bw	: 5;
 };
 
+/**
+ * Constant description of a row in the statistics table. These are derived
+ * once from the STA capabilities so the update and lookup paths do not have
+ * to decode the row index or recompute airtimes.
+ */
+struct mmrc_rate_info {
+	/** The rate described by this row, as returned by get_rate_row() */
+	struct mmrc_rate rate;
+
+	/** Whether the rate is valid for the STA capabilities, see validate_rate() */
+	bool valid;
+
+	/** Airtime in microseconds of a default sized packet at this rate */
+	u32 tx_time;
+
+	/** The theoretical throughput of this rate in bps */
+	u32 theoretical_tp;
+};
+
 /**
  * Statistics table of a STA
  */
@@ -255,6 +274,9 @@ struct mmrc_stats_table {
 
 	/** Have we sent aggregates at this rate since the last update */
 	bool have_sent_ampdus;
+
+	/** Constant rate information for this row, filled by mmrc_sta_init() */
+	struct mmrc_rate_info info;
 };
 
 /**
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2025 Morse Micro
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR LicenseRef-MorseMicroCommercial
+ *
+ */
+
+/*
+ * Userspace OSAL shim, allowing the MMRC core to be built outside the kernel
+ * for the simulator. Mirrors the interface of the driver's mmrc/mmrc_osal.h.
+ */
+
+#ifndef MMRC_OSAL_H__
+#define MMRC_OSAL_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+
+#define BIT_COUNT(_x) ((u32)__builtin_popcountl(_x))
+
+#ifndef min
+#define min(_a, _b) ((_a) < (_b) ? (_a) : (_b))
+#endif
+
+#ifndef max
+#define max(_a, _b) ((_a) > (_b) ? (_a) : (_b))
+#endif
+
+#ifndef MMRC_OSAL_ASSERT
+#define MMRC_OSAL_ASSERT(_x) \
+	do { \
+		if (!(_x)) \
+			fprintf(stderr, "%s:%d: assertion '%s' failed\n", \
+				__FILE__, __LINE__, #_x); \
+	} while (0)
+#endif
+
+#ifndef MMRC_OSAL_PR_ERR
+#define MMRC_OSAL_PR_ERR(...) fprintf(stderr, __VA_ARGS__)
+#endif
+
+void osal_mmrc_seed_random(void);
+
+/**
+ * Function to retrieve a random 32bit number between 0 and @c max.
+ *
+ * @param max Maximum value (exclusive)
+ *
+ * @returns A randomly generated integer (0 <= i < max).
+ */
+u32 osal_mmrc_random_u32(u32 max);
+
+#endif /* MMRC_OSAL_H__ */
@@ -0,0 +1,555 @@
+/*
+ * Copyright 2025 Morse Micro
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR LicenseRef-MorseMicroCommercial
+ *
+ */
+
+/*
+ * Userspace simulator for the MMRC core.
+ *
+ * Drives mmrc_get_rates(), mmrc_feedback() and mmrc_update() against a
+ * synthetic channel with saturated single-MPDU traffic, and reports the
+ * convergence time, achieved goodput and CPU cost of the rate control calls.
+ * The tuning values in mmrc.c may be overridden at build time, see the
+ * Makefile in this directory.
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <time.h>
+
+#include "mmrc.h"
+
+/** Fixed per-attempt overhead: preamble, SIFS and ACK, in microseconds */
+#define SIM_ATTEMPT_OVERHEAD_US		600
+
+/** Granularity at which the channel state is advanced, in microseconds */
+#define SIM_CHANNEL_STEP_US		1000
+
+/** Slope of the PER curve around the required SNR, per dB */
+#define SIM_PER_SLOPE			1.5
+
+/** Fraction of the best achievable goodput that is regarded as converged */
+#define SIM_CONVERGED_RATIO		0.9
+
+/** Number of consecutive updates that must be converged */
+#define SIM_CONVERGED_UPDATES		10
+
+/**
+ * Approximate SNR in dB needed for a 10% PER on a 1 MHz, single stream, long
+ * guard channel, for MCS0-MCS10
+ */
+static const double sim_req_snr_db[] = {
+	2, 5, 9, 11, 15, 18, 20, 25, 29, 31, -1,
+};
+
+enum sim_model {
+	SIM_MODEL_FIXED,
+	SIM_MODEL_FADING,
+	SIM_MODEL_INTERFERENCE,
+};
+
+static const char * const sim_model_names[] = {
+	[SIM_MODEL_FIXED] = "fixed",
+	[SIM_MODEL_FADING] = "fading",
+	[SIM_MODEL_INTERFERENCE] = "interference",
+};
+
+struct sim_channel {
+	enum sim_model model;
+
+	/** Mean SNR of the link in dB */
+	double snr_db;
+
+	/** Current fading offset from the mean SNR in dB */
+	double fade_db;
+
+	/** Standard deviation of the fading offset in dB */
+	double fade_sigma_db;
+
+	/** Coherence time of the fading process in milliseconds */
+	double coherence_ms;
+
+	/** Optional fixed PER per MCS, overriding the SNR model when set */
+	bool fixed_per;
+	double per[MMRC_MCS_UNUSED];
+
+	/** Mean interval between interference bursts in milliseconds */
+	double burst_interval_ms;
+
+	/** Length of each interference burst in milliseconds */
+	double burst_len_ms;
+
+	/** PER added by interference while a burst is active */
+	double burst_per;
+
+	/** Time the current burst ends and the next one starts, in microseconds */
+	u64 burst_end_us;
+	u64 next_burst_us;
+
+	/** Time up to which the channel state has been advanced */
+	u64 now_us;
+};
+
+struct sim_stats {
+	u64 packets;
+	u64 delivered;
+	u64 attempts;
+	u64 delivered_bytes;
+
+	u32 updates;
+	u64 update_ns;
+	u64 update_max_ns;
+	u64 get_rates_ns;
+
+	u32 converged_streak;
+	s64 converged_ms;
+	u32 updates_converged;
+};
+
+static u64 sim_rng_state = 1;
+static u64 mmrc_rng_state = 2;
+
+static u64 sim_rng_next(u64 *state)
+{
+	/* xorshift64* */
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545F4914F6CDD1DULL;
+}
+
+static double sim_rand_unit(void)
+{
+	return (sim_rng_next(&sim_rng_state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double sim_rand_normal(void)
+{
+	double u1 = sim_rand_unit();
+	double u2 = sim_rand_unit();
+
+	if (u1 < 1e-12)
+		u1 = 1e-12;
+
+	return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+static double sim_rand_exp(double mean)
+{
+	return -mean * log(1.0 - sim_rand_unit());
+}
+
+void osal_mmrc_seed_random(void)
+{
+	/* Runs must be reproducible for a given seed, so never reseed */
+}
+
+u32 osal_mmrc_random_u32(u32 max)
+{
+	if (!max)
+		return 0;
+
+	return (u32)(sim_rng_next(&mmrc_rng_state) % max);
+}
+
+static u64 sim_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static u32 sim_bw_mhz(const struct mmrc_rate *rate)
+{
+	return 1u << rate->bw;
+}
+
+static u32 sim_rate_kbps(const struct mmrc_rate *rate)
+{
+	return mmrc_calculate_theoretical_throughput(*rate) / 1000;
+}
+
+static void sim_channel_init(struct sim_channel *ch)
+{
+	ch->fade_db = ch->model == SIM_MODEL_FADING ? sim_rand_normal() * ch->fade_sigma_db : 0;
+	ch->burst_end_us = 0;
+	ch->next_burst_us = ch->model == SIM_MODEL_INTERFERENCE ?
+		(u64)(sim_rand_exp(ch->burst_interval_ms) * 1000) : UINT64_MAX;
+	ch->now_us = 0;
+}
+
+/** Advance the fading and interference processes up to @now_us */
+static void sim_channel_advance(struct sim_channel *ch, u64 now_us)
+{
+	double a = exp(-(double)SIM_CHANNEL_STEP_US / (ch->coherence_ms * 1000));
+
+	while (ch->now_us + SIM_CHANNEL_STEP_US <= now_us) {
+		ch->now_us += SIM_CHANNEL_STEP_US;
+
+		/* First order Gauss-Markov process for the fading offset */
+		if (ch->model == SIM_MODEL_FADING)
+			ch->fade_db = a * ch->fade_db +
+				sqrt(1 - a * a) * ch->fade_sigma_db * sim_rand_normal();
+
+		if (ch->now_us >= ch->next_burst_us) {
+			ch->burst_end_us = ch->now_us + (u64)(ch->burst_len_ms * 1000);
+			ch->next_burst_us = ch->burst_end_us +
+				(u64)(sim_rand_exp(ch->burst_interval_ms) * 1000);
+		}
+	}
+}
+
+static double sim_channel_per(const struct sim_channel *ch, const struct mmrc_rate *rate)
+{
+	double per;
+
+	if (ch->fixed_per) {
+		per = ch->per[rate->rate];
+	} else {
+		double req = sim_req_snr_db[rate->rate];
+
+		/* Noise grows with bandwidth, each extra stream costs about 3 dB */
+		req += 10 * log10(sim_bw_mhz(rate));
+		req += 3 * rate->ss;
+		if (rate->guard == MMRC_GUARD_SHORT)
+			req += 1;
+
+		/* Shift the curve so PER is 10% at the required SNR */
+		per = 1 / (1 + exp(SIM_PER_SLOPE * (ch->snr_db + ch->fade_db - req) + log(9)));
+	}
+
+	if (ch->now_us < ch->burst_end_us)
+		per = 1 - (1 - per) * (1 - ch->burst_per);
+
+	return per;
+}
+
+static double sim_attempt_us(const struct mmrc_rate *rate, size_t len)
+{
+	u32 tp = mmrc_calculate_theoretical_throughput(*rate);
+
+	if (!tp)
+		return 1e9;
+
+	return SIM_ATTEMPT_OVERHEAD_US + (len * 8 * 1e6) / tp;
+}
+
+/** Expected goodput in kbps when sending single attempts at @rate */
+static double sim_expected_kbps(const struct sim_channel *ch, const struct mmrc_rate *rate,
+				size_t len)
+{
+	return (1 - sim_channel_per(ch, rate)) * len * 8 * 1000 / sim_attempt_us(rate, len);
+}
+
+/** The best expected goodput over all valid rates in the table */
+static double sim_oracle_kbps(struct mmrc_table *tb, const struct sim_channel *ch, size_t len)
+{
+	u16 rows = rows_from_sta_caps(&tb->caps);
+	double best = 0;
+	u16 i;
+
+	for (i = 0; i < rows; i++) {
+		struct mmrc_rate rate = get_rate_row(tb, i);
+		double kbps;
+
+		if (!validate_rate(tb, &rate))
+			continue;
+
+		kbps = sim_expected_kbps(ch, &rate, len);
+		if (kbps > best)
+			best = kbps;
+	}
+
+	return best;
+}
+
+/**
+ * Send one packet through the retry chain, returning the airtime used and
+ * giving MMRC feedback in the same form as the driver.
+ */
+static double sim_send_packet(struct mmrc_table *tb, struct sim_channel *ch,
+			      struct sim_stats *stats, size_t len)
+{
+	struct mmrc_rate_table chain;
+	double airtime = 0;
+	s32 retry_count = 0;
+	bool delivered = false;
+	u64 t0;
+	int i, a;
+
+	t0 = sim_time_ns();
+	mmrc_get_rates(tb, &chain, len);
+	stats->get_rates_ns += sim_time_ns() - t0;
+
+	for (i = 0; i < MMRC_MAX_CHAIN_LENGTH && !delivered; i++) {
+		struct mmrc_rate *rate = &chain.rates[i];
+
+		if (rate->rate == MMRC_MCS_UNUSED)
+			break;
+
+		for (a = 0; a < rate->attempts; a++) {
+			airtime += sim_attempt_us(rate, len);
+			retry_count++;
+			if (sim_rand_unit() >= sim_channel_per(ch, rate)) {
+				delivered = true;
+				break;
+			}
+		}
+	}
+
+	stats->packets++;
+	stats->attempts += retry_count;
+	if (delivered) {
+		stats->delivered++;
+		stats->delivered_bytes += len;
+	} else {
+		/* MMRC expects the count to go past the chain when every attempt failed */
+		retry_count++;
+	}
+
+	mmrc_feedback(tb, &chain, retry_count);
+
+	return airtime;
+}
+
+static void sim_track_convergence(struct sim_stats *stats, double ratio, u64 now_us)
+{
+	if (ratio < SIM_CONVERGED_RATIO) {
+		stats->converged_streak = 0;
+		return;
+	}
+
+	stats->updates_converged++;
+	if (++stats->converged_streak == SIM_CONVERGED_UPDATES && stats->converged_ms < 0)
+		stats->converged_ms = now_us / 1000 -
+			(SIM_CONVERGED_UPDATES - 1) * MMRC_UPDATE_FREQUENCY_MS;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -m MODEL    channel model: fixed, fading or interference (default fixed)\n"
+		"  -s SNR      mean SNR in dB (default 20)\n"
+		"  -p LIST     fixed PER percentages per MCS, comma separated, for the fixed model\n"
+		"  -f SIGMA    fading standard deviation in dB (default 6)\n"
+		"  -t MS       fading coherence time in ms (default 200)\n"
+		"  -i MS       mean interval between interference bursts in ms (default 500)\n"
+		"  -b MS       interference burst length in ms (default 50)\n"
+		"  -P PERCENT  PER added during an interference burst (default 80)\n"
+		"  -w MHZ      maximum bandwidth: 1, 2, 4 or 8 (default 8)\n"
+		"  -l BYTES    packet length (default 1500)\n"
+		"  -r RSSI     RSSI in dBm given to mmrc_sta_init (default -80)\n"
+		"  -d SECONDS  simulated duration (default 30)\n"
+		"  -S SEED     random seed (default 1)\n"
+		"  -c          print a CSV line per rate control update\n",
+		prog);
+}
+
+static int parse_per_list(struct sim_channel *ch, char *list)
+{
+	char *tok = strtok(list, ",");
+	int i = 0;
+
+	while (tok && i < MMRC_MCS_UNUSED) {
+		ch->per[i++] = atof(tok) / 100;
+		tok = strtok(NULL, ",");
+	}
+
+	if (!i)
+		return -1;
+
+	/* Unlisted MCSs are as bad as the last one given */
+	for (; i < MMRC_MCS_UNUSED; i++)
+		ch->per[i] = ch->per[i - 1];
+
+	ch->fixed_per = true;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct sim_channel ch = {
+		.model = SIM_MODEL_FIXED,
+		.snr_db = 20,
+		.fade_sigma_db = 6,
+		.coherence_ms = 200,
+		.burst_interval_ms = 500,
+		.burst_len_ms = 50,
+		.burst_per = 0.8,
+	};
+	struct sim_stats stats = { .converged_ms = -1 };
+	struct mmrc_sta_capabilities caps = { 0 };
+	struct mmrc_table *tb;
+	u32 max_bw_mhz = 8;
+	size_t len = 1500;
+	s8 rssi = -80;
+	double duration_s = 30;
+	u64 seed = 1;
+	bool csv = false;
+	u64 now_us = 0;
+	u64 next_update_us = MMRC_UPDATE_FREQUENCY_MS * 1000;
+	u64 interval_bytes = 0;
+	int opt;
+	u32 bw;
+
+	while ((opt = getopt(argc, argv, "m:s:p:f:t:i:b:P:w:l:r:d:S:ch")) != -1) {
+		switch (opt) {
+		case 'm':
+			for (ch.model = 0; ch.model <= SIM_MODEL_INTERFERENCE; ch.model++)
+				if (!strcmp(optarg, sim_model_names[ch.model]))
+					break;
+			if (ch.model > SIM_MODEL_INTERFERENCE) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 's':
+			ch.snr_db = atof(optarg);
+			break;
+		case 'p':
+			if (parse_per_list(&ch, optarg)) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'f':
+			ch.fade_sigma_db = atof(optarg);
+			break;
+		case 't':
+			ch.coherence_ms = atof(optarg);
+			break;
+		case 'i':
+			ch.burst_interval_ms = atof(optarg);
+			break;
+		case 'b':
+			ch.burst_len_ms = atof(optarg);
+			break;
+		case 'P':
+			ch.burst_per = atof(optarg) / 100;
+			break;
+		case 'w':
+			max_bw_mhz = atoi(optarg);
+			break;
+		case 'l':
+			len = atoi(optarg);
+			break;
+		case 'r':
+			rssi = atoi(optarg);
+			break;
+		case 'd':
+			duration_s = atof(optarg);
+			break;
+		case 'S':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'c':
+			csv = true;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (!len || ch.coherence_ms <= 0 || ch.burst_interval_ms <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	sim_rng_state = seed * 0x9E3779B97F4A7C15ULL + 1;
+	mmrc_rng_state = seed * 0xBF58476D1CE4E5B9ULL + 2;
+
+	/* 1 MHz up to the requested bandwidth, both guards, one stream, MCS0-7 and MCS10 */
+	for (bw = MMRC_BW_1MHZ; bw <= MMRC_BW_8MHZ && (1u << bw) <= max_bw_mhz; bw++)
+		caps.bandwidth |= MMRC_MASK(bw);
+	caps.spatial_streams = MMRC_MASK(MMRC_SPATIAL_STREAM_1);
+	caps.rates = MMRC_MASK(MMRC_MCS10) | (MMRC_MASK(MMRC_MCS7 + 1) - 1);
+	caps.guard = MMRC_MASK(MMRC_GUARD_LONG) | MMRC_MASK(MMRC_GUARD_SHORT);
+	caps.sgi_per_bw = caps.bandwidth;
+	caps.max_rates = MMRC_MAX_CHAIN_LENGTH;
+	caps.max_retries = MMRC_MAX_CHAIN_ATTEMPTS;
+
+	tb = calloc(1, mmrc_memory_required_for_caps(&caps));
+	if (!tb)
+		return 1;
+
+	mmrc_sta_init(tb, &caps, rssi);
+	sim_channel_init(&ch);
+
+	if (csv)
+		printf("time_ms,snr_db,mcs,bw_mhz,sgi,selected_kbps,oracle_kbps,goodput_kbps,update_ns\n");
+
+	while (now_us < (u64)(duration_s * 1e6)) {
+		u64 before = stats.delivered_bytes;
+
+		now_us += (u64)sim_send_packet(tb, &ch, &stats, len);
+		interval_bytes += stats.delivered_bytes - before;
+		sim_channel_advance(&ch, now_us);
+
+		while (now_us >= next_update_us) {
+			struct mmrc_rate best;
+			double oracle, selected;
+			u64 t0, dt;
+
+			t0 = sim_time_ns();
+			mmrc_update(tb);
+			dt = sim_time_ns() - t0;
+
+			stats.updates++;
+			stats.update_ns += dt;
+			if (dt > stats.update_max_ns)
+				stats.update_max_ns = dt;
+
+			best = mmrc_sta_get_best_rate(tb);
+			oracle = sim_oracle_kbps(tb, &ch, len);
+			selected = sim_expected_kbps(&ch, &best, len);
+			sim_track_convergence(&stats, oracle > 0 ? selected / oracle : 1,
+					      next_update_us);
+
+			if (csv)
+				printf("%llu,%.1f,%u,%u,%u,%.0f,%.0f,%llu,%llu\n",
+				       (unsigned long long)(next_update_us / 1000),
+				       ch.snr_db + ch.fade_db, best.rate, sim_bw_mhz(&best),
+				       best.guard, selected, oracle,
+				       (unsigned long long)(interval_bytes * 8 /
+							    MMRC_UPDATE_FREQUENCY_MS),
+				       (unsigned long long)dt);
+
+			interval_bytes = 0;
+			next_update_us += MMRC_UPDATE_FREQUENCY_MS * 1000;
+		}
+	}
+
+	if (!csv) {
+		struct mmrc_rate best = mmrc_sta_get_best_rate(tb);
+
+		printf("model:            %s\n", sim_model_names[ch.model]);
+		printf("duration:         %.1f s, %u updates\n", duration_s, stats.updates);
+		if (stats.converged_ms >= 0)
+			printf("convergence:      %lld ms\n", (long long)stats.converged_ms);
+		else
+			printf("convergence:      not converged\n");
+		printf("time converged:   %.1f%%\n",
+		       stats.updates ? 100.0 * stats.updates_converged / stats.updates : 0);
+		printf("goodput:          %.0f kbps\n",
+		       stats.delivered_bytes * 8 / (duration_s * 1000));
+		printf("delivery:         %.1f%% of %llu packets, %.2f attempts/packet\n",
+		       stats.packets ? 100.0 * stats.delivered / stats.packets : 0,
+		       (unsigned long long)stats.packets,
+		       stats.packets ? (double)stats.attempts / stats.packets : 0);
+		printf("final best rate:  MCS%u %u MHz %s, %u kbps\n", best.rate,
+		       sim_bw_mhz(&best), best.guard ? "SGI" : "LGI", sim_rate_kbps(&best));
+		printf("mmrc_update:      %.0f ns avg, %llu ns max\n",
+		       stats.updates ? (double)stats.update_ns / stats.updates : 0,
+		       (unsigned long long)stats.update_max_ns);
+		printf("mmrc_get_rates:   %.0f ns avg\n",
+		       stats.packets ? (double)stats.get_rates_ns / stats.packets : 0);
+	}
+
+	free(tb);
+	return 0;
+}
@@ -122,6 +122,7 @@ static int stats_read(struct seq_file *file, void *data)
 		struct morse_rc_sta *mrc_sta = container_of(pos, struct morse_rc_sta, list);
 		struct morse_sta *sta = container_of(mrc_sta, struct morse_sta, rc);
 
+		spin_lock(&mrc_sta->lock);
 		tb = mrc_sta->tb;
 		caps_size = rows_from_sta_caps(&tb->caps);
 
@@ -203,6 +204,7 @@ static int stats_read(struct seq_file *file, void *data)
 		seq_printf(file,
 			   "\n Amount of packets sent: %u including: %u look-around packets\n\n",
 			   total_sent_packets - tb->total_lookaround, tb->total_lookaround);
+		spin_unlock(&mrc_sta->lock);
 	}
 
 	spin_unlock_bh(&mors->mrc.lock);
@@ -231,6 +233,7 @@ static int stats_csv_read(struct seq_file *file, void *data)
 		struct morse_rc_sta *mrc_sta = container_of(pos, struct morse_rc_sta, list);
 		struct morse_sta *sta = container_of(mrc_sta, struct morse_sta, rc);
 
+		spin_lock(&mrc_sta->lock);
 		tb = mrc_sta->tb;
 		caps_size = rows_from_sta_caps(&tb->caps);
 
@@ -284,6 +287,7 @@ static int stats_csv_read(struct seq_file *file, void *data)
 			seq_printf(file, ",%u", rate_stats->back_mpdu_failure);
 			seq_printf(file, ",%pM\n", sta->addr);
 		}
+		spin_unlock(&mrc_sta->lock);
 	}
 
 	spin_unlock_bh(&mors->mrc.lock);
@@ -291,6 +295,25 @@ static int stats_csv_read(struct seq_file *file, void *data)
 	return 0;
 }
 
+static int update_stats_read(struct seq_file *file, void *data)
+{
+	struct morse *mors = dev_get_drvdata(file->private);
+	struct morse_rc_update_stats stats;
+
+	spin_lock_bh(&mors->mrc.lock);
+	stats = mors->mrc.stats;
+	spin_unlock_bh(&mors->mrc.lock);
+
+	seq_printf(file, "ticks: %u\n", stats.ticks);
+	seq_printf(file, "updates: %u\n", stats.updates);
+	seq_printf(file, "max updates per tick: %u\n", stats.max_per_tick);
+	seq_printf(file, "backlogged ticks: %u\n", stats.backlogged_ticks);
+	seq_printf(file, "max list lock hold (ns): %llu\n", stats.max_list_hold_ns);
+	seq_printf(file, "max station lock hold (ns): %llu\n", stats.max_sta_hold_ns);
+
+	return 0;
+}
+
 static ssize_t set_fixed_rate(struct file *file, const char __user *user_buf,
 			      size_t count, loff_t *ppos)
 {
@@ -306,8 +329,10 @@ static ssize_t set_fixed_rate(struct file *file, const char __user *user_buf,
 	list_for_each(pos, &mors->mrc.stas) {
 		struct morse_rc_sta *mrc_sta = container_of(pos, struct morse_rc_sta, list);
 
+		spin_lock(&mrc_sta->lock);
 		fixed_rate = get_rate_row(mrc_sta->tb, value);
 		mmrc_set_fixed_rate(mrc_sta->tb, fixed_rate);
+		spin_unlock(&mrc_sta->lock);
 	}
 	spin_unlock_bh(&mors->mrc.lock);
 	return count;
@@ -332,6 +357,8 @@ void mmrc_s1g_add_sta_debugfs(struct morse *mors)
 	debugfs_create_devm_seqfile(mors->dev, "mmrc_table", mors->debug.debugfs_phy, stats_read);
 	debugfs_create_devm_seqfile(mors->dev, "mmrc_table_csv", mors->debug.debugfs_phy,
 				    stats_csv_read);
+	debugfs_create_devm_seqfile(mors->dev, "mmrc_update_stats", mors->debug.debugfs_phy,
+				    update_stats_read);
 
 	debugfs_create_file("fixed_rate", 0600, mors->debug.debugfs_phy, mors, &mmrc_fixed_rate);
 }
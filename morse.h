@@ -16,6 +16,7 @@
 #include <linux/version.h>
 #include <linux/crc32.h>
 #include <linux/notifier.h>
+#include <linux/semaphore.h>
 #if KERNEL_VERSION(4, 9, 81) < LINUX_VERSION_CODE
 #include <linux/nospec.h>
 #endif
@@ -231,6 +232,10 @@ struct morse_twt {
 	u8 dialog_token;
 	/* STA VIF specific data */
 	struct morse_twt_sta_vif sta_vif;
+	/* AP VIF: service period occupancy, folded onto the wake interval being scheduled */
+	u64 *timeline;
+	/* AP VIF: number of agreements that could only be placed overlapping others */
+	u32 num_overlapped;
 };
 
 struct morse_mbssid_info {
@@ -447,6 +452,8 @@ struct morse_ap {
 	struct morse_raw raw;
 	/** BSS statistics */
 	struct morse_bss_stats_context bss_stats;
+	/** Incremental S1G TIM encoder state, only accessed from the beacon tasklet */
+	struct dot11ah_tim_encoder tim_enc;
 	/**
 	 * Bitmap of AIDs currently in use. Bit position corresponds to the AID.
 	 */
@@ -545,6 +552,36 @@ struct morse_mesh_config_list {
 	spinlock_t lock;
 };
 
+/**
+ * struct morse_beacon_template - Converted S1G beacon reused between beacon intervals
+ *
+ * @frame:	S1G beacon header followed by the ordered IEs, excluding the TIM
+ * @len:	Length of @frame
+ * @tim_offset:	Offset in @frame at which the S1G TIM is spliced for each beacon
+ * @key:	CRC of the mac80211 beacon (less its TIM) and configuration @frame was built from
+ * @gen:	Value of &morse_beacon_templates.gen when @frame was built
+ * @valid:	@frame may be used for the next beacon of the same type
+ */
+struct morse_beacon_template {
+	u8 *frame;
+	u16 len;
+	u16 tim_offset;
+	u32 key;
+	u32 gen;
+	bool valid;
+};
+
+/**
+ * struct morse_beacon_templates - Cached short and long S1G beacons of a VIF
+ *
+ * @tmpl:	Templates, indexed by whether the beacon is a long beacon
+ * @gen:	Bumped by morse_beacon_template_invalidate() to mark the templates stale
+ */
+struct morse_beacon_templates {
+	struct morse_beacon_template tmpl[2];
+	atomic_t gen;
+};
+
 /**
  * enum morse_scan_state_flags - Scan state flags in fullmac mode.
  */
@@ -674,6 +711,11 @@ struct morse_vif {
 	 */
 	struct tasklet_struct beacon_tasklet;
 
+	/**
+	 * S1G beacons cached by the beacon tasklet, only accessed from the tasklet
+	 */
+	struct morse_beacon_templates beacon_templates;
+
 	/** Tasklet for responding to NDP probe requests received by chip */
 	struct tasklet_struct ndp_probe_req_resp;
 
@@ -888,53 +930,99 @@ struct morse_vif {
 #endif
 };
 
+/** Counters of transmitted and received frames at the MCS0/MCS10 rates */
+struct morse_mcs_stats {
+	struct {
+		unsigned int tx_beacons;
+		unsigned int tx_ndpprobes;
+		unsigned int tx_count;
+		unsigned int tx_success;
+		unsigned int tx_fail;
+		unsigned int rx_count;
+	} mcs0;
+	struct {
+		unsigned int tx_count;
+		unsigned int tx_success;
+		unsigned int tx_fail;
+		unsigned int rx_count;
+	} mcs10;
+};
+
+/** Counters of the chip interface (pageset/YAPS) and skbq fast paths */
+struct morse_page_stats {
+	unsigned int cmd_tx;
+	unsigned int bcn_tx;
+	unsigned int mgmt_tx;
+	unsigned int data_tx;
+	unsigned int write_fail;
+	unsigned int no_page;
+	unsigned int cmd_no_page;
+	unsigned int cmd_rsv_page_retry;
+	unsigned int bcn_no_page;
+	unsigned int excessive_bcn_loss;
+	unsigned int queue_stop;
+	unsigned int page_owned_by_chip;
+	unsigned int tx_aged_out;
+	unsigned int tx_ps_filtered;
+	unsigned int tx_status_flushed;
+	unsigned int tx_status_page_invalid;
+	unsigned int tx_status_duty_cycle_cant_send;
+	unsigned int tx_duty_cycle_retry_disabled;
+	unsigned int tx_status_dropped;
+	unsigned int rx_empty;
+	unsigned int rx_split;
+	unsigned int rx_invalid_count;
+	unsigned int invalid_checksum;
+	unsigned int invalid_tx_status_checksum;
+};
+
+/* Latency histogram buckets: bucket n counts samples in [2^(n-1), 2^n) us, the last is open */
+#define MORSE_LAT_HIST_BUCKETS		(20)
+
+/**
+ * struct morse_lat_hist - log2 latency histogram
+ * @bucket: sample counts per bucket
+ * @count: number of samples
+ * @sum_us: sum of all samples, in microseconds
+ * @max_us: largest sample, in microseconds
+ */
+struct morse_lat_hist {
+	unsigned int bucket[MORSE_LAT_HIST_BUCKETS];
+	unsigned int count;
+	u64 sum_us;
+	u32 max_us;
+};
+
+/**
+ * struct morse_debug_stats - fast path statistics, kept per-CPU
+ * @page: chip interface and skbq counters
+ * @mcs: MCS0/MCS10 frame counters
+ * @tx_lat: time from a frame being queued to the chip until its tx status
+ * @rx_lat: time from the RX IRQ to the frame being handed to mac80211
+ *
+ * Each CPU only updates its own copy so the fast paths neither lose updates nor share
+ * cache lines. The copies are summed when read through debugfs.
+ */
+struct morse_debug_stats {
+	struct morse_page_stats page;
+	struct morse_mcs_stats mcs;
+#ifdef CONFIG_MORSE_DEBUGFS
+	struct morse_lat_hist tx_lat;
+	struct morse_lat_hist rx_lat;
+#endif
+};
+
 struct morse_debug {
 	struct dentry *debugfs_phy;
 #ifdef CONFIG_MORSE_DEBUG_TXSTATUS
 	 DECLARE_KFIFO(tx_status_entries, struct morse_skb_tx_status, 1024);
 #endif
-	struct {
-		struct {
-			unsigned int tx_beacons;
-			unsigned int tx_ndpprobes;
-			unsigned int tx_count;
-			unsigned int tx_success;
-			unsigned int tx_fail;
-			unsigned int rx_count;
-		} mcs0;
-		struct {
-			unsigned int tx_count;
-			unsigned int tx_success;
-			unsigned int tx_fail;
-			unsigned int rx_count;
-		} mcs10;
-	} mcs_stats_tbl;
-	struct {
-		unsigned int cmd_tx;
-		unsigned int bcn_tx;
-		unsigned int mgmt_tx;
-		unsigned int data_tx;
-		unsigned int write_fail;
-		unsigned int no_page;
-		unsigned int cmd_no_page;
-		unsigned int cmd_rsv_page_retry;
-		unsigned int bcn_no_page;
-		unsigned int excessive_bcn_loss;
-		unsigned int queue_stop;
-		unsigned int page_owned_by_chip;
-		unsigned int tx_aged_out;
-		unsigned int tx_ps_filtered;
-		unsigned int tx_status_flushed;
-		unsigned int tx_status_page_invalid;
-		unsigned int tx_status_duty_cycle_cant_send;
-		unsigned int tx_duty_cycle_retry_disabled;
-		unsigned int tx_status_dropped;
-		unsigned int rx_empty;
-		unsigned int rx_split;
-		unsigned int rx_invalid_count;
-		unsigned int invalid_checksum;
-		unsigned int invalid_tx_status_checksum;
-	} page_stats;
+	/* Per-CPU fast path statistics, see MORSE_PAGE_STAT_INC() and friends */
+	struct morse_debug_stats __percpu *stats;
+#ifdef CONFIG_MORSE_DEBUGFS
+	/* Time of the IRQ that last flagged RX pending, for the RX latency histogram */
+	ktime_t rx_irq_time;
+#endif
 #if defined(CONFIG_MORSE_DEBUG_IRQ)
 	struct {
 		unsigned int irq;
@@ -1055,6 +1143,7 @@ struct morse {
 	bool in_scan;
 	bool reset_required;
 	bool chip_was_reset;
+	struct morse_fw_load_stats fw_load;
 
 	/* wiphy device registered with cfg80211 */
 	struct wiphy *wiphy;
@@ -1111,11 +1200,14 @@ struct morse {
 
 	/* Command sequence counter */
 	u16 cmd_seq;
-	struct completion *cmd_comp;
 	/* Mutex to martial command completion and retries */
 	struct mutex cmd_lock;
-	/* Allow only one command at a time */
-	struct mutex cmd_wait;
+	/* Limits the number of commands awaiting a response, see morse_cmd_pipeline_init() */
+	struct semaphore cmd_wait;
+	/* Serialises power save transitions for outstanding commands */
+	struct mutex cmd_ps_lock;
+	/* Commands awaiting a response, power save is held off while non-zero. cmd_ps_lock */
+	u16 cmd_in_flight;
 
 	/** User-initiated coredump complete signal mechanism */
 	struct completion *user_coredump_comp;
@@ -1275,6 +1367,9 @@ struct morse {
 	/* Used to wait for firmware attach */
 	struct completion *attach_done;
 
+	/** Per-CPU cached IE mask, reused for parsing received management frames */
+	struct dot11ah_ies_mask * __percpu *rx_ies_mask_cache;
+
 	/* must be last */
 	u8 drv_priv[] __aligned(sizeof(void *));
 
@@ -1408,6 +1503,16 @@ static inline bool is_assoc_frame(__le16 frame_control)
 
 int morse_beacon_init(struct morse_vif *mors_vif);
 void morse_beacon_finish(struct morse_vif *mors_vif);
+
+/**
+ * morse_beacon_template_invalidate - Mark the cached S1G beacons of a VIF as stale
+ *
+ * @note: Must be called whenever driver-inserted beacon content (RPS, CAC or vendor IEs)
+ * changes, as the cached beacons are only rebuilt when the mac80211 beacon changes.
+ *
+ * @mors_vif:	VIF whose beacon content has changed
+ */
+void morse_beacon_template_invalidate(struct morse_vif *mors_vif);
 void morse_beacon_irq_handle(struct morse *mors, u32 status);
 
 /**
@@ -31,8 +31,8 @@ void morse_fill_tx_info(struct morse *mors,
 		pream = MORSE_RATE_PREAMBLE_S1G_1M;
 	morse_ratecode_preamble_set(&tx_info->rates[0].morse_ratecode, pream);
 	tx_info->rates[0].count = 1;
-	mors->debug.mcs_stats_tbl.mcs0.tx_ndpprobes++;
-	mors->debug.mcs_stats_tbl.mcs0.tx_success++;
+	MORSE_MCS_STAT_INC(mors, mcs0.tx_ndpprobes);
+	MORSE_MCS_STAT_INC(mors, mcs0.tx_success);
 	tx_info->rates[1].count = 0;
 }
 
@@ -50,6 +50,7 @@ int morse_ocs_cmd_post_process(struct morse_vif *mors_vif,
 		config->end_aid_idx = -1;
 		config->slot_definition.num_slots = 1;
 		config->slot_definition.slot_duration_us = MORSE_OCS_DURATION;
+		morse_raw_cfg_invalidate(config);
 	}
 	/* Set the dynamic beacon index value to default to identify PRAW config as static */
 	config->dynamic.insert_at_idx = U16_MAX;
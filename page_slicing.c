@@ -6,6 +6,7 @@
 
 #include "morse.h"
 #include <linux/ieee80211.h>
+#include <linux/moduleparam.h>
 #include "debug.h"
 
 /**
@@ -68,6 +69,105 @@ static inline void morse_page_slice_control_set_tim_offset(u8 *control, u8 val)
 					BMSET(val, PAGE_SLICE_CONTROL_TIM_OFFSET));
 }
 
+static uint page_slice_max_aids = 128;
+module_param(page_slice_max_aids, uint, 0644);
+MODULE_PARM_DESC(page_slice_max_aids,
+		 "Target number of buffered AIDs indicated in each TIM page slice");
+
+/**
+ * morse_page_slicing_plan() - Summarise the saved TIM PVB and split it into page slices.
+ *
+ * Block occupancy and the number of buffered AIDs per block are computed once per page
+ * period, so that each TIM beacon only has to copy out its precomputed slice.
+ *
+ * All slices hold the same number of occupied blocks (except the last one), as signalled in
+ * the page slice element. The largest slice length that keeps every slice within
+ * page_slice_max_aids buffered AIDs is used, so that lightly loaded page periods are delivered
+ * in fewer beacons and sleeping stations wait less after the DTIM beacon. Heavily loaded
+ * periods spread the blocks over up to page period slices.
+ *
+ * @page_slicing_data: page slicing state, with the PVB of the DTIM beacon saved
+ */
+static void morse_page_slicing_plan(struct page_slicing *page_slicing_data)
+{
+	u16 prefix_aids[NUMBER_OF_BLOCKS_PER_PAGE + 1];
+	int first_octet = page_slicing_data->tim_bitmap_ctrl_offset;
+	int end_octet = first_octet + page_slicing_data->tim_virtual_map_len;
+	int page_period = max_t(int, page_slicing_data->page_period, 1);
+	int no_of_blocks = 0;
+	int min_len;
+	int len;
+	int slice;
+	int block;
+	int i;
+
+	page_slicing_data->block_occupancy = 0;
+	prefix_aids[0] = 0;
+
+	for (block = first_octet / S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK;
+	     block < NUMBER_OF_BLOCKS_PER_PAGE &&
+	     block * S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK < end_octet; block++) {
+		int start = max(block * S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK, first_octet);
+		int end = min((block + 1) * S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK, end_octet);
+		u16 aids = 0;
+
+		for (i = start; i < end; i++)
+			aids += hweight8(page_slicing_data->tim_virtual_map[i - first_octet]);
+
+		if (!aids)
+			continue;
+
+		page_slicing_data->block_occupancy |= BIT(block);
+		page_slicing_data->occupied_block[no_of_blocks] = block;
+		prefix_aids[no_of_blocks + 1] = prefix_aids[no_of_blocks] + aids;
+		no_of_blocks++;
+	}
+
+	page_slicing_data->total_number_of_blocks = no_of_blocks;
+	if (!no_of_blocks) {
+		page_slicing_data->page_slice_length = 0;
+		page_slicing_data->page_slice_count = 0;
+		return;
+	}
+
+	/* Pick the longest slice that keeps every slice within the AID target, bounded by the
+	 * width of the Page Slice Length subfield and by the slices fitting in the page period.
+	 */
+	min_len = max(DIV_ROUND_UP(no_of_blocks, page_period),
+		      DIV_ROUND_UP(no_of_blocks, PAGE_SLICE_COUNT_MAX));
+	len = min_t(int, no_of_blocks, PAGE_SLICE_LENGTH_MAX);
+	for (; len > min_len; len--) {
+		bool fits = true;
+
+		for (i = 0; i < no_of_blocks && fits; i += len) {
+			u32 slice_aids = prefix_aids[min(i + len, no_of_blocks)] - prefix_aids[i];
+
+			fits = slice_aids <= page_slice_max_aids;
+		}
+
+		if (fits)
+			break;
+	}
+	len = max(len, min_len);
+
+	page_slicing_data->page_slice_length = len;
+	page_slicing_data->page_slice_count = DIV_ROUND_UP(no_of_blocks, len);
+
+	for (slice = 0; slice < page_slicing_data->page_slice_count; slice++) {
+		int first = slice * len;
+		int last = min(first + len, no_of_blocks) - 1;
+		int first_block = page_slicing_data->occupied_block[first];
+		int last_block = page_slicing_data->occupied_block[last];
+
+		page_slicing_data->slice_start[slice] =
+			max(first_block * S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK, first_octet) - first_octet;
+		page_slicing_data->slice_end[slice] =
+			min((last_block + 1) * S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK, end_octet) -
+			first_octet;
+		page_slicing_data->slice_aids[slice] = prefix_aids[last + 1] - prefix_aids[first];
+	}
+}
+
 /**
  * morse_insert_page_slice_element() - Inserts page slicing element into ies_mask.
  *
@@ -81,75 +181,25 @@ static void morse_insert_page_slice_element(struct morse_vif *mors_vif,
 	u32 element_size;
 	struct page_slice_element *page_slice_elem;
 	struct page_slicing *page_slicing_data = &mors_vif->page_slicing_info;
-	u32 page_bitmap = 0;
+	u32 page_bitmap;
 	u32 page_bitmap_size;
-	bool update_bitmap = false;
 	u8 block_idx = page_slicing_data->tim_bitmap_ctrl_offset / S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK;
-	u8 offset = 0;
 	u8 last_block_idx;
-	u8 no_of_blocks = 0;
 	u8 page_period = page_slicing_data->page_period;
 	u8 page_bitmap_byte_offset = block_idx / PAGE_BITMAP_NUMBER_OF_BLOCKS_PER_BYTE;
 	u8 page_bitmap_first_block = page_bitmap_byte_offset *
 						PAGE_BITMAP_NUMBER_OF_BLOCKS_PER_BYTE;
 
-	last_block_idx = (page_slicing_data->tim_bitmap_ctrl_offset +
-		page_slicing_data->tim_virtual_map_len - 1) / S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK;
+	morse_page_slicing_plan(page_slicing_data);
 
-	/* Update page bitmap by going through the every block i.e, 64 AIDs
-	 * (8 sub blocks - 8 octets).
-	 */
-	for (; block_idx <= last_block_idx; block_idx++) {
-		/* First & last octet(i.e., 1st and last block) of TIM PVB will have traffic
-		 * buffered for atleast one STA. So set the corresponding bit for these two
-		 * blocks in page bitmap.
-		 */
-		if (block_idx == page_slicing_data->block_offset ||
-			block_idx == last_block_idx) {
-			update_bitmap = true;
-			/* mac80211's TIM PVB may not have all 8 octets (subblocks) of 1st block.
-			 * So increase offset based on the bitmap offset.
-			 */
-			if (block_idx == page_slicing_data->block_offset)
-				offset = (block_idx + 1) * S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK -
-							page_slicing_data->tim_bitmap_ctrl_offset;
-		} else {
-			/* set the block in the page bitmap even if one AID (belonging to the block)
-			 * is set.
-			 */
-			if (*(u64 *)(page_slicing_data->tim_virtual_map + offset))
-				update_bitmap = true;
-
-			/* Move to next block */
-			offset += S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK;
-		}
-		if (update_bitmap) {
-			page_bitmap |= 1 << (block_idx - page_bitmap_first_block);
-			no_of_blocks++;
-		}
-		/* Reset update flag */
-		update_bitmap = false;
+	if (!page_slicing_data->total_number_of_blocks) {
+		page_slicing_data->tim_virtual_map_len = 0;
+		return;
 	}
 
-	/* Store the number of blocks to be scheduled during the page period */
-	page_slicing_data->total_number_of_blocks = no_of_blocks;
-
-	/* Calculate how many page slices(count) would be required in this page period
-	 * based on the number of octets in TIM partial virtual bitmap.
-	 * 1 Page contains 32 blocks,
-	 * 1 Block contains 8 subblocks,
-	 * 1 subblock represents 8 AIDs (8 bits) i.e, one octet in TIM partial virtual
-	 * bitmap.
-	 * Page slice length indicates number of blocks inlcuded in each TIM/Page slice.
-	 */
-	page_slicing_data->page_slice_length = no_of_blocks / page_period;
-	if (!page_slicing_data->page_slice_length) {
-		/* Schedule 1 block per slice if number blocks are less than page period */
-		page_slicing_data->page_slice_length = 1;
-		page_slicing_data->page_slice_count = no_of_blocks;
-	} else {
-		page_slicing_data->page_slice_count = page_period;
-	}
+	last_block_idx = page_slicing_data->occupied_block[
+				page_slicing_data->total_number_of_blocks - 1];
+	page_bitmap = page_slicing_data->block_occupancy >> page_bitmap_first_block;
 
 	/* Calculate the page bitmap size based on the number of blocks to indicate in the
 	 * page slice element.
@@ -194,36 +244,6 @@ static void morse_insert_page_slice_element(struct morse_vif *mors_vif,
 	}
 }
 
-static u8 morse_page_slicing_find_next_block(struct page_slicing *page_slicing_data,
-										u8 no_of_blocks)
-{
-	u64 block_bitmap = *(u64 *)(page_slicing_data->tim_virtual_map +
-							page_slicing_data->tim_virtual_map_index);
-	u8 len_in_octets = 0;
-
-	while (!block_bitmap) {
-		/* when searching for 1st block, ignore blocks without any AID set*/
-		if (!no_of_blocks)
-			page_slicing_data->tim_virtual_map_index += S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK;
-		else /* Move to next block */
-			len_in_octets += S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK;
-
-		block_bitmap = *(u64 *)(page_slicing_data->tim_virtual_map +
-					page_slicing_data->tim_virtual_map_index + len_in_octets);
-
-		if (page_slicing_data->tim_virtual_map_index + len_in_octets >
-				page_slicing_data->tim_virtual_map_len)
-			break;
-	}
-
-	/* Update length for first block as we ignore all blocks without any aid set */
-	if (!no_of_blocks)
-		len_in_octets = S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK;
-	else
-		len_in_octets += S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK;
-	return len_in_octets;
-}
-
 void morse_page_slicing_process_tim_element(struct ieee80211_vif *vif,
 					    struct dot11ah_ies_mask *ies_mask,
 					    u8 *page_slice_no,
@@ -237,18 +257,12 @@ void morse_page_slicing_process_tim_element(struct ieee80211_vif *vif,
 	u8 dtim_period = tim_ie->dtim_period;
 	u8 bitmap_ctrl = tim_ie->bitmap_ctrl;
 	u8 bitmap_offset = (bitmap_ctrl & IEEE80211_TIM_BITMAP_OFFSET);
-	u8 first_aid_in_block = bitmap_offset * 8;
 	u8 virtual_map_len;
 	struct morse *mors = morse_vif_to_morse(mors_vif);
-	u8 len_in_octets;
-	u8 no_of_blocks;
-	u8 tim_len = 0;
 	u8 *tim_pvb = page_slicing_data->tim_virtual_map;
-	u8 page_slice_count;
-	u8 tim_virtual_map_len;
-	u8 tim_bitmap_ctrl_offset;
+	u8 slice;
+	u8 slice_len;
 	struct ie_element *element;
-	u8 remaining_tim_map_len;
 
 	/* Calculate partial virtual bitmap length. 11n TIM contains minimum of 4 octets
 	 * i.e dtim count(1 octet), dtim period(1 octet), bitmap ctrl(1 octet) and PVB[1].
@@ -278,11 +292,9 @@ void morse_page_slicing_process_tim_element(struct ieee80211_vif *vif,
 		page_slicing_data->tim_virtual_map_len = virtual_map_len;
 		page_slicing_data->tim_bitmap_ctrl_offset = bitmap_offset;
 		page_slicing_data->page_slice_no = 0;
-		page_slicing_data->tim_virtual_map_index = 0;
 
-		/* Derive block offset based on the starting/first AID in the block */
-		page_slicing_data->block_offset =
-			S1G_TIM_AID_TO_BLOCK_OFFSET(first_aid_in_block);
+		/* Derive block offset from the first octet of the PVB */
+		page_slicing_data->block_offset = bitmap_offset / S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK;
 
 		/* TIM in DTIM beacon contains the first page slice of page being scheduled */
 		page_slicing_data->tim_offset = 0;
@@ -299,103 +311,43 @@ void morse_page_slicing_process_tim_element(struct ieee80211_vif *vif,
 		return;
 	}
 
-	bitmap_offset = 0;
-	tim_virtual_map_len = page_slicing_data->tim_virtual_map_len;
-	page_slice_count = page_slicing_data->page_slice_count;
-	tim_bitmap_ctrl_offset = page_slicing_data->tim_bitmap_ctrl_offset;
-	remaining_tim_map_len = (tim_virtual_map_len - page_slicing_data->tim_virtual_map_index);
+	slice = page_slicing_data->page_slice_no;
+	slice_len = page_slicing_data->slice_end[slice] - page_slicing_data->slice_start[slice];
 
 	/* reallocate TIM if mac80211's TIM buffer doesn't have enough room  */
-	if (virtual_map_len < remaining_tim_map_len) {
-		virtual_map_len = remaining_tim_map_len;
-		/* Add TIM IE size to allocate */
-		remaining_tim_map_len += offsetof(struct ieee80211_tim_ie, virtual_map);
+	if (virtual_map_len < slice_len) {
 		morse_dot11_clear_eid_from_ies_mask(ies_mask, WLAN_EID_TIM);
 		element = morse_dot11_ies_create_ie_element(ies_mask, WLAN_EID_TIM,
-							remaining_tim_map_len, true, true);
+							    offsetof(struct ieee80211_tim_ie,
+								     virtual_map) + slice_len,
+							    true, true);
 		if (!element) {
 			MORSE_ERR(mors, "Failed to allocate memory for TIM IE, len=%u\n",
-								tim_virtual_map_len);
+				  slice_len);
 			return;
 		}
 		tim_ie = (struct ieee80211_tim_ie *)element->ptr;
 		tim_ie->dtim_count = dtim_count;
 		tim_ie->dtim_period = dtim_period;
-	} else {
-		/* Reset the pvb & bitmap control offset for page slice TIM */
-		memset(tim_ie->virtual_map, 0, virtual_map_len);
-		tim_ie->bitmap_ctrl = 0;
 	}
+	tim_ie->bitmap_ctrl = 0;
 
 	/* Update TIM element with page slice information that is being scheduled in the beacon
 	 * going to be transmitted.
 	 */
 	*page_slice_no = page_slicing_data->page_slice_no++;
 
-	for (no_of_blocks = 0; no_of_blocks < page_slicing_data->page_slice_length;
-									no_of_blocks++) {
-		/* Reset the length */
-		len_in_octets = 0;
-
-		/* First page slice - starting block will have atleast one AID set and
-		 * TIM PVB may not have all sub blocks of starting block. So, calculate
-		 * the number of subblocks to copy based on the bitmap offset.
-		 */
-		if (page_slicing_data->page_slice_no == 1 && !no_of_blocks) {
-			len_in_octets = (page_slicing_data->block_offset + 1) *
-				S1G_TIM_NUM_SUBBLOCKS_PER_BLOCK - tim_bitmap_ctrl_offset;
-			/* Copy only vmap_len of bytes if whole block is not present */
-			if (len_in_octets > tim_virtual_map_len)
-				len_in_octets = tim_virtual_map_len;
-		} else if (page_slicing_data->page_slice_no == page_slice_count) {
-			/* Copy remaining bitmap in last slice */
-			len_in_octets = tim_virtual_map_len -
-						page_slicing_data->tim_virtual_map_index;
-		} else {
-			/* Go through the bitmap until we find a block with atleast 1 AID
-			 * set.
-			 */
-			len_in_octets =
-				morse_page_slicing_find_next_block(page_slicing_data,
-									no_of_blocks);
-		}
-
-		if ((tim_len + len_in_octets) > virtual_map_len) {
-			/* Reset the virtual map len and index */
-			page_slicing_data->tim_virtual_map_len = 0;
-			page_slicing_data->tim_virtual_map_index = 0;
-			break;
-		}
+	memcpy(tim_ie->virtual_map, tim_pvb + page_slicing_data->slice_start[slice], slice_len);
+	bitmap_offset = page_slicing_data->tim_bitmap_ctrl_offset +
+			page_slicing_data->slice_start[slice];
 
-		/* Copy the TIM Slice information into TIM partial virtual bitmap */
-		memcpy(tim_ie->virtual_map + tim_len,
-			tim_pvb + page_slicing_data->tim_virtual_map_index,
-			len_in_octets);
-
-		/* Update bitmap(byte) offset of first block */
-		if (!no_of_blocks)
-			bitmap_offset = page_slicing_data->tim_virtual_map_index +
-							tim_bitmap_ctrl_offset;
-
-		/* Update copied bitmap length */
-		tim_len += len_in_octets;
-
-		if (page_slicing_data->page_slice_no < page_slice_count) {
-			/* Move to next block of bitmap */
-			page_slicing_data->tim_virtual_map_index += len_in_octets;
-		} else {
-			/* Reset the virtual map len and index */
-			page_slicing_data->tim_virtual_map_len = 0;
-			page_slicing_data->tim_virtual_map_index = 0;
-			/* Since we are pushing whole remaining bitmap in last page lice.
-			 * Exit the loop after copy.
-			 */
-			break;
-		}
+	if (page_slicing_data->page_slice_no >= page_slicing_data->page_slice_count) {
+		/* Last slice of the page period has been scheduled */
+		page_slicing_data->tim_virtual_map_len = 0;
 	}
 
 	ies_mask->ies[WLAN_EID_TIM].len = offsetof(struct ieee80211_tim_ie, virtual_map) +
-										tim_len;
+										slice_len;
 
 	if (!dtim_count)
 		tim_ie->bitmap_ctrl = bitmap_ctrl & IEEE80211_TIM_BITMAP_TRAFFIC_INDICATION;
@@ -29,6 +29,16 @@
 #define PAGE_SLICE_CONTROL_BLOCK_OFFSET GENMASK(8, 4)
 #define PAGE_SLICE_CONTROL_TIM_OFFSET GENMASK(4, 1)
 
+/**
+ * Largest value of the Page Slice Length subfield.
+ */
+#define PAGE_SLICE_LENGTH_MAX (31)
+
+/**
+ * Largest value of the Page Slice Count subfield.
+ */
+#define PAGE_SLICE_COUNT_MAX (31)
+
 struct page_slicing {
     /**
      * Page slicing enabled or not.
@@ -52,11 +62,6 @@ struct page_slicing {
      */
 	u8 tim_bitmap_ctrl_offset;
 
-    /**
-     * It points to the index of tim virtual bitmap for current TIM page slice.
-     */
-	u8 tim_virtual_map_index;
-
     /**
      * Indicates number of beacon intervals between successive beacons that carry
      * the page slice element for the associated page.
@@ -108,6 +113,33 @@ struct page_slicing {
      * Indicates blocks that are scheduled in the page period
      */
 	u32 page_bitmap;
+
+    /**
+     * Blocks of the page with at least one AID set in the saved TIM, bit position
+     * corresponds to the block index.
+     */
+	u32 block_occupancy;
+
+    /**
+     * Index of each occupied block in ascending order. Only the first
+     * total_number_of_blocks entries are valid.
+     */
+	u8 occupied_block[NUMBER_OF_BLOCKS_PER_PAGE];
+
+    /**
+     * First octet of tim_virtual_map included in each page slice.
+     */
+	u8 slice_start[NUMBER_OF_BLOCKS_PER_PAGE];
+
+    /**
+     * Octet of tim_virtual_map following the last one included in each page slice.
+     */
+	u8 slice_end[NUMBER_OF_BLOCKS_PER_PAGE];
+
+    /**
+     * Number of AIDs with traffic buffered in each page slice.
+     */
+	u16 slice_aids[NUMBER_OF_BLOCKS_PER_PAGE];
 };
 
 /* Page slice element - fields format is specified in section 9.4.2.192 Page Slice element
@@ -135,3 +135,18 @@ int morse_pager_init(struct morse *mors, struct morse_pager *pager, int page_siz
 void morse_pager_finish(struct morse_pager *pager)
 {
 }
+
+int morse_pager_pop_bulk(struct morse_pager *pager, struct morse_page *pages, int max)
+{
+	int count;
+
+	if (pager->ops->pop_bulk)
+		return pager->ops->pop_bulk(pager, pages, max);
+
+	for (count = 0; count < max; count++) {
+		if (pager->ops->pop(pager, &pages[count]))
+			break;
+	}
+
+	return count;
+}
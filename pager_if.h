@@ -87,6 +87,18 @@ struct morse_pager_ops {
 	 */
 	int (*pop)(struct morse_pager *pager, struct morse_page *page);
 
+	/**
+	 * (Optional) Pops up to @max pages from the given pager, using as few
+	 * bus accesses as the implementation allows.
+	 *
+	 * @pager: Pointer to pager instance to take pages from
+	 * @pages: Array to place popped pages in
+	 * @max: Maximum number of pages to pop
+	 *
+	 * @return: Number of pages popped
+	 */
+	int (*pop_bulk)(struct morse_pager *pager, struct morse_page *pages, int max);
+
 	/**
 	 * Notify the pager that there are pages available.
 	 *
@@ -147,6 +159,18 @@ struct morse_pager_ops {
  */
 int morse_pager_init(struct morse *mors, struct morse_pager *pager, int page_size, u8 flags, u8 id);
 
+/**
+ * Pops up to @max pages from the given pager, in bulk where the pager
+ * implementation supports it.
+ *
+ * @pager: Pointer to pager instance to take pages from
+ * @pages: Array to place popped pages in
+ * @max: Maximum number of pages to pop
+ *
+ * @return: Number of pages popped
+ */
+int morse_pager_pop_bulk(struct morse_pager *pager, struct morse_page *pages, int max);
+
 /**
  * Prints info about the pager instance to a file.
  *
@@ -9,7 +9,7 @@
 #include "bus.h"
 #include "debug.h"
 #include "chip_if.h"
-#include "pageset_trace.h"
+#include "trace.h"
 
 /**
  * Set this #define to control whether or not the pager hardware IRQ
@@ -98,8 +98,8 @@ static void morse_pager_hw_cache_pages(struct morse_pager *pager,
 
 	aux_data->cache.bitmap[block] = page->addr & ~BIT(MORSE_PAGER_BITS_BITMAP_LEN);
 
-	pageset_trace_log(pager, PAGESET_TRACE_EVENT_ID_CACHE_PUT_PAGES,
-		hweight32(aux_data->cache.bitmap[block]));
+	trace_morse_page(pager, MORSE_TRACE_PAGE_CACHE_PUT,
+			 hweight32(aux_data->cache.bitmap[block]));
 }
 
 static int morse_pager_hw_get_page_from_cache(struct morse_pager *pager,
@@ -134,7 +134,7 @@ static int morse_pager_hw_get_page_from_cache(struct morse_pager *pager,
 		(block * MORSE_PAGER_BITS_BITMAP_LEN) + index, page);
 
 exit:
-	pageset_trace_log(pager, PAGESET_TRACE_EVENT_ID_CACHE_GET, (ret) ? 0 : page->addr);
+	trace_morse_page(pager, MORSE_TRACE_PAGE_CACHE_GET, (ret) ? 0 : page->addr);
 	return ret;
 }
 
@@ -160,7 +160,7 @@ static int _morse_pager_hw_pop(struct morse_pager *pager,
 	}
 
 exit:
-	pageset_trace_log(pager, PAGESET_TRACE_EVENT_ID_POP_PAGE, (ret) ? 0 : page->addr);
+	trace_morse_page(pager, MORSE_TRACE_PAGE_POP, (ret) ? 0 : page->addr);
 	return ret;
 }
 
@@ -198,7 +198,7 @@ static int _morse_pager_hw_put(struct morse_pager *pager,
 	    (struct morse_pager_hw_aux_data *)pager->aux_data;
 	int ret;
 
-	pageset_trace_log(pager, PAGESET_TRACE_EVENT_ID_PUT_PAGE, page->addr);
+	trace_morse_page(pager, MORSE_TRACE_PAGE_PUT, page->addr);
 	ret = morse_reg32_write(pager->mors, aux_data->put_addr, page->addr);
 
 	if (!ret) {
@@ -228,8 +228,8 @@ static int morse_pager_hw_put(struct morse_pager *pager,
 
 	block = index / MORSE_PAGER_BITS_BITMAP_LEN;
 	aux_data->cache.bitmap[block] |= BIT(index - (block * MORSE_PAGER_BITS_BITMAP_LEN));
-	pageset_trace_log(pager, PAGESET_TRACE_EVENT_ID_STORE_PAGE_BULK,
-			  BIT(index - (block * MORSE_PAGER_BITS_BITMAP_LEN)));
+	trace_morse_page(pager, MORSE_TRACE_PAGE_STORE_BULK,
+			 BIT(index - (block * MORSE_PAGER_BITS_BITMAP_LEN)));
 	return 0;
 }
 
@@ -248,8 +248,8 @@ static void _morse_pager_hw_notify_pager(const struct morse_pager *pager)
 
 		page.addr = (block << MORSE_PAGER_BITS_BITMAP_LEN) | aux_data->cache.bitmap[block];
 
-		pageset_trace_log(pager, PAGESET_TRACE_EVENT_ID_NOTIFY,
-				  hweight32(aux_data->cache.bitmap[block]));
+		trace_morse_page(pager, MORSE_TRACE_PAGE_NOTIFY,
+				 hweight32(aux_data->cache.bitmap[block]));
 		_morse_pager_hw_put((struct morse_pager *)pager, &page);
 		aux_data->cache.bitmap[block] = 0;
 	}
@@ -292,7 +292,7 @@ static int morse_pager_hw_page_write(struct morse_pager *pager,
 	if (page->addr == 0)
 		return -EFAULT;
 
-	pageset_trace_log(pager, PAGESET_TRACE_EVENT_ID_WRITE_PAGE, page->addr + offset);
+	trace_morse_page(pager, MORSE_TRACE_PAGE_WRITE, page->addr + offset);
 	return morse_dm_write(pager->mors, page->addr + offset, buff, num_bytes);
 }
 
@@ -308,7 +308,7 @@ static int morse_pager_hw_page_read(struct morse_pager *pager,
 	if (page->addr == 0)
 		return -EFAULT;
 
-	pageset_trace_log(pager, PAGESET_TRACE_EVENT_ID_READ_PAGE, page->addr + offset);
+	trace_morse_page(pager, MORSE_TRACE_PAGE_READ, page->addr + offset);
 	return morse_dm_read(pager->mors, page->addr + offset, buff, num_bytes);
 }
 
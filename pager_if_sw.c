@@ -60,6 +60,11 @@ struct morse_pager_sw_aux_data {
 
 	/** We use a cache to do bulk writes/reads of the pages. */
 	 DECLARE_KFIFO(cache, u32, MAX_PAGER_PAGE_LEN);
+	/**
+	 * Bounce buffer for moving the cache to and from the ring. It is a separate allocation
+	 * so it is DMA safe. Accessed under the same serialisation as the cache.
+	 */
+	u32 *xfer_buf;
 	/**
 	 *  Set to TRUE when there are pages in the cache that need to be
 	 * written back.
@@ -186,7 +191,11 @@ static int morse_pager_sw_data_write(struct morse_pager *pager, u8 *data, u32 le
 	struct morse_pager_sw_aux_data *aux_data =
 	    (struct morse_pager_sw_aux_data *)pager->aux_data;
 
-	morse_pager_sw_rb_read_tail(pager);
+	/* The chip only ever frees space in the ring, so the cached tail gives a lower bound on
+	 * the space available. Only go to the bus for a fresh copy if that is not enough.
+	 */
+	if (len > __morse_pager_sw_space(pager))
+		morse_pager_sw_rb_read_tail(pager);
 
 	spc2end = morse_pager_sw_space_to_end(pager);
 
@@ -253,23 +262,14 @@ static int morse_pager_sw_notify_pager(const struct morse_pager *pager)
 	    (struct morse_pager_sw_aux_data *)pager->aux_data;
 
 	if (aux_data->pages_need_put) {
-		u32 page_addr;
-		size_t to_write = kfifo_len(&MORSE_AUX_DATA_CACHE(pager)) * sizeof(u32);
+		size_t to_write = kfifo_out(&MORSE_AUX_DATA_CACHE(pager), aux_data->xfer_buf,
+					    MAX_PAGER_PAGE_LEN) * sizeof(u32);
 
+		/* All cached pages go to the ring in a single write */
 		if (to_write > 0) {
-			int i = 0;
-			u32 *buffer = kzalloc(to_write, GFP_KERNEL);
-
-			WARN_ON(!buffer);
-			while (kfifo_get(&MORSE_AUX_DATA_CACHE(pager), &page_addr)) {
-				buffer[i] = page_addr;
-				i++;
-			}
-
-			ret = morse_pager_sw_data_write((struct morse_pager *)pager, (u8 *)buffer,
-							to_write);
+			ret = morse_pager_sw_data_write((struct morse_pager *)pager,
+							(u8 *)aux_data->xfer_buf, to_write);
 			WARN_ON(ret);
-			kfree(buffer);
 			aux_data->pages_need_put = false;
 		}
 	}
@@ -296,52 +296,83 @@ static int morse_pager_sw_notify_pager(const struct morse_pager *pager)
 	return 0;
 }
 
-static int morse_pager_sw_pop(struct morse_pager *pager, struct morse_page *page)
+/*
+ * Fill the cache with as many ring entries as it can hold, using one read of the head
+ * pointer and one (two if wrapping) reads of the ring. Returns the number of entries added.
+ */
+static int morse_pager_sw_cache_refill(struct morse_pager *pager)
+{
+	int ret;
+	u32 to_read;
+	struct morse_pager_sw_aux_data *aux_data =
+	    (struct morse_pager_sw_aux_data *)pager->aux_data;
+
+	morse_pager_sw_rb_read_head(pager);
+	to_read = min_t(u32, __morse_pager_sw_count(pager),
+			kfifo_avail(&MORSE_AUX_DATA_CACHE(pager)) * sizeof(u32));
+	to_read = round_down(to_read, sizeof(u32));
+	if (!to_read)
+		return -EAGAIN;
+
+	ret = morse_pager_sw_data_read(pager, (u8 *)aux_data->xfer_buf, to_read);
+	if (ret)
+		return ret;
+
+	return kfifo_in(&MORSE_AUX_DATA_CACHE(pager), aux_data->xfer_buf,
+			to_read / sizeof(u32));
+}
+
+static void morse_pager_sw_cache_get(struct morse_pager *pager, struct morse_page *page)
 {
-	int ret = 0;
 	__le32 page_addr = 0;
+	int ret;
+
+	ret = kfifo_get(&MORSE_AUX_DATA_CACHE(pager), (__force u32 *)&page_addr);
+	WARN_ON(ret == 0);
+
+	page->size_bytes = pager->page_size_bytes;
+	page->addr = le32_to_cpu(page_addr);
+}
+
+static int morse_pager_sw_pop(struct morse_pager *pager, struct morse_page *page)
+{
+	int ret;
 
 	if (kfifo_is_empty(&MORSE_AUX_DATA_CACHE(pager))) {
-		int i;
-		u32 to_read;
-		u32 *buffer;
-
-		/**
-		 * If the cache is empty, time to fill it again,
-		 * read the head pointer to see how many pages might be available.
-		 */
-		morse_pager_sw_rb_read_head(pager);
-		to_read = __morse_pager_sw_count(pager);
-		if (!to_read)
-			return -EAGAIN;
-
-		buffer = kzalloc(to_read, GFP_KERNEL);
-		if (!buffer)
-			return -ENOMEM;
-
-		ret = morse_pager_sw_data_read(pager, (u8 *)buffer, to_read);
-		if (ret) {
-			kfree(buffer);
+		ret = morse_pager_sw_cache_refill(pager);
+		if (ret < 0)
 			return ret;
-		}
+	}
 
-		for (i = 0; i < (to_read / sizeof(u32)); i++) {
-			ret = kfifo_put(&MORSE_AUX_DATA_CACHE(pager), buffer[i]);
-			WARN_ON(!ret);
+	morse_pager_sw_cache_get(pager, page);
+	return 0;
+}
+
+static int morse_pager_sw_pop_bulk(struct morse_pager *pager, struct morse_page *pages, int max)
+{
+	int count = 0;
+	bool drained = false;
+
+	while (count < max) {
+		if (kfifo_is_empty(&MORSE_AUX_DATA_CACHE(pager))) {
+			int added;
+
+			/* A refill that could not fill the cache emptied the ring, so don't go
+			 * back to the bus just to find that out.
+			 */
+			if (drained)
+				break;
+
+			added = morse_pager_sw_cache_refill(pager);
+			if (added <= 0)
+				break;
+			drained = added < kfifo_size(&MORSE_AUX_DATA_CACHE(pager));
 		}
 
-		kfree(buffer);
+		morse_pager_sw_cache_get(pager, &pages[count++]);
 	}
 
-	ret = kfifo_get(&MORSE_AUX_DATA_CACHE(pager), (__force u32 *)&page_addr);
-	WARN_ON(ret == 0);
-	ret = 0;
-
-	if (!ret) {
-		page->size_bytes = pager->page_size_bytes;
-		page->addr = le32_to_cpu(page_addr);
-	}
-	return ret;
+	return count;
 }
 
 static int morse_pager_sw_put(struct morse_pager *pager, struct morse_page *page)
@@ -405,6 +436,7 @@ static int morse_pager_sw_page_read(struct morse_pager *pager,
 const struct morse_pager_ops morse_pager_sw_ops = {
 	.put = morse_pager_sw_put,
 	.pop = morse_pager_sw_pop,
+	.pop_bulk = morse_pager_sw_pop_bulk,
 	.write_page = morse_pager_sw_page_write,
 	.read_page = morse_pager_sw_page_read,
 	.notify = morse_pager_sw_notify_pager,
@@ -421,6 +453,14 @@ int morse_pager_sw_init(struct morse *mors, struct morse_pager *pager,
 		return -ENOMEM;
 
 	aux_data = (struct morse_pager_sw_aux_data *)pager->aux_data;
+	aux_data->xfer_buf = kcalloc(MAX_PAGER_PAGE_LEN, sizeof(*aux_data->xfer_buf),
+				     GFP_KERNEL);
+	if (!aux_data->xfer_buf) {
+		kfree(pager->aux_data);
+		pager->aux_data = NULL;
+		return -ENOMEM;
+	}
+
 	aux_data->size = size;
 	aux_data->base = base;
 	aux_data->head = head;
@@ -437,6 +477,11 @@ int morse_pager_sw_init(struct morse *mors, struct morse_pager *pager,
 
 void morse_pager_sw_finish(struct morse *mors, struct morse_pager *pager)
 {
+	struct morse_pager_sw_aux_data *aux_data =
+	    (struct morse_pager_sw_aux_data *)pager->aux_data;
+
+	if (aux_data)
+		kfree(aux_data->xfer_buf);
 	kfree(pager->aux_data);
 	pager->aux_data = NULL;
 	pager->ops = NULL;
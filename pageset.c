@@ -14,7 +14,9 @@
 #include "hw.h"
 #include "bus.h"
 #include "ipmon.h"
+#include "trace.h"
 #include <linux/gpio.h>
+#include <linux/mm.h>
 #include "pager_if_hw.h"
 #include "pager_if_sw.h"
 
@@ -113,6 +115,96 @@ static int morse_pageset_get_rx_buffered_count(struct morse *mors)
 	return skbq->skbq.qlen;
 }
 
+/*
+ * Returns the page block the next RX page of up to len bytes is read into, at
+ * rx_page_offset, or NULL if none can be allocated. A block is only reused once no skb
+ * references it any more. Otherwise it is handed over to the skbs still using it and a fresh
+ * block is allocated.
+ */
+static struct page *morse_pageset_get_rx_page(struct morse_pageset *pageset, int len)
+{
+	struct page *page = pageset->rx_pages[pageset->rx_page_idx];
+	int idx;
+	int i;
+
+	if (len > PAGESET_RX_PAGE_BLOCK_BYTES)
+		return NULL;
+
+	if (page && pageset->rx_page_offset + len <= PAGESET_RX_PAGE_BLOCK_BYTES)
+		return page;
+
+	for (i = 1; i <= PAGESET_RX_PAGE_POOL_SIZE; i++) {
+		idx = (pageset->rx_page_idx + i) % PAGESET_RX_PAGE_POOL_SIZE;
+		page = pageset->rx_pages[idx];
+
+		if (page && page_ref_count(page) == 1) {
+			pageset->rx_page_idx = idx;
+			pageset->rx_page_offset = 0;
+			return page;
+		}
+	}
+
+	idx = (pageset->rx_page_idx + 1) % PAGESET_RX_PAGE_POOL_SIZE;
+	if (pageset->rx_pages[idx])
+		put_page(pageset->rx_pages[idx]);
+
+	pageset->rx_pages[idx] = alloc_pages(GFP_KERNEL | __GFP_COMP | __GFP_NOWARN,
+					     get_order(PAGESET_RX_PAGE_BLOCK_BYTES));
+	pageset->rx_page_idx = idx;
+	pageset->rx_page_offset = 0;
+
+	return pageset->rx_pages[idx];
+}
+
+static void morse_pageset_free_rx_pages(struct morse_pageset *pageset)
+{
+	int i;
+
+	for (i = 0; i < PAGESET_RX_PAGE_POOL_SIZE; i++) {
+		if (pageset->rx_pages[i])
+			put_page(pageset->rx_pages[i]);
+		pageset->rx_pages[i] = NULL;
+	}
+}
+
+/*
+ * Build the skb for page data read into a page block. Large data frames only have their
+ * headers copied; the payload is attached as a fragment of the block and the block slot
+ * passes to the skb. Everything else is copied into a linear skb.
+ */
+static struct sk_buff *morse_pageset_rx_page_skb(struct morse_pageset *pageset,
+						 struct page *rx_page, u8 *data, int len)
+{
+	struct morse_buff_skb_header *hdr = (struct morse_buff_skb_header *)data;
+	int slot_len = ALIGN(len, SMP_CACHE_BYTES);
+	int copy_len = len;
+	struct sk_buff *skb;
+
+	if (hdr->channel == MORSE_SKB_CHAN_DATA && len >= PAGESET_RX_FRAG_MIN_BYTES &&
+	    len > (int)(sizeof(*hdr) + hdr->offset + PAGESET_RX_COPYBREAK_BYTES))
+		copy_len = sizeof(*hdr) + hdr->offset + PAGESET_RX_COPYBREAK_BYTES;
+
+	skb = dev_alloc_skb(copy_len);
+	if (!skb)
+		return NULL;
+
+	memcpy(skb_put(skb, copy_len), data, copy_len);
+
+	if (copy_len < len) {
+		/* The block is only reused once every skb in it is freed, so charge the skb its
+		 * share of the block rather than just the bytes it holds.
+		 */
+		get_page(rx_page);
+		skb_add_rx_frag(skb, 0, rx_page, pageset->rx_page_offset + copy_len,
+				len - copy_len,
+				PAGESET_RX_PAGE_BLOCK_BYTES /
+				(PAGESET_RX_PAGE_BLOCK_BYTES / slot_len));
+		pageset->rx_page_offset += slot_len;
+	}
+
+	return skb;
+}
+
 const struct chip_if_ops morse_pageset_hw_ops = {
 	.init = morse_pager_hw_pagesets_init,
 	.hw_restarted = morse_pager_hw_pagesets_init,
@@ -125,7 +217,7 @@ const struct chip_if_ops morse_pageset_hw_ops = {
 	.skbq_mgmt_tc_q = skbq_pageset_mgmt_tc_q,
 	.skbq_cmd_tc_q = skbq_pageset_cmd_tc_q,
 	.skbq_tc_q_from_aci = skbq_pageset_tc_q_from_aci,
-	.chip_if_handle_irq = morse_pager_irq_handler
+	.chip_if_handle_irq = morse_pager_irq_handler,
 };
 
 const struct chip_if_ops morse_pageset_sw_ops = {
@@ -139,7 +231,7 @@ const struct chip_if_ops morse_pageset_sw_ops = {
 	.skbq_mgmt_tc_q = skbq_pageset_mgmt_tc_q,
 	.skbq_cmd_tc_q = skbq_pageset_cmd_tc_q,
 	.skbq_tc_q_from_aci = skbq_pageset_tc_q_from_aci,
-	.chip_if_handle_irq = morse_pager_irq_handler
+	.chip_if_handle_irq = morse_pager_irq_handler,
 };
 
 static bool morse_pageset_page_is_cached(struct morse_pageset *pageset, struct morse_page *page)
@@ -172,9 +264,11 @@ static void morse_pageset_to_chip_return_handler_no_lock(struct morse *mors)
 {
 	struct morse_pageset *pageset = mors->chip_if->to_chip_pageset;
 	struct morse_pager *pager = pageset->return_pager;
-	struct morse_page page;
+	struct morse_page pages[CACHED_PAGES_MAX];
 	int ret;
-	bool pager_empty = false;
+	int i;
+	int count;
+	int want;
 	unsigned int popped = 0;
 	/* Continue to pop until either the pager is exhausted or more than
 	 * double the amount of possible cache entries have been popped.
@@ -184,38 +278,26 @@ static void morse_pageset_to_chip_return_handler_no_lock(struct morse *mors)
 
 	MORSE_WARN_ON(FEATURE_ID_PAGER, !is_pageset_locked(pageset));
 
-	while (kfifo_len(&pageset->reserved_pages) < CMD_RSVED_PAGES_MAX) {
-		if (pager->ops->pop(pager, &page)) {
-			pager_empty = true;
-			break;
+	/* Prefetch free pages in batches, topping up the reserved pages before the cache */
+	do {
+		want = min_t(int, ARRAY_SIZE(pages), max_expected_pops - popped);
+		count = morse_pager_pop_bulk(pager, pages, want);
+		popped += count;
+
+		for (i = 0; i < count; i++) {
+			if (morse_pageset_page_is_cached(pageset, &pages[i]))
+				continue;
+
+			if (kfifo_len(&pageset->reserved_pages) < CMD_RSVED_PAGES_MAX)
+				ret = kfifo_put(&pageset->reserved_pages, pages[i]);
+			else
+				ret = kfifo_put(&pageset->cached_pages, pages[i]);
+			MORSE_WARN_ON(FEATURE_ID_PAGER, !ret);
 		}
-
-		popped++;
-		if (morse_pageset_page_is_cached(pageset, &page))
-			continue;
-
-		ret = kfifo_put(&pageset->reserved_pages, page);
-		MORSE_WARN_ON(FEATURE_ID_PAGER, !ret);
-	}
-
-	if (pager_empty)
-		goto exit;
-
-	while (popped < max_expected_pops) {
-		if (pager->ops->pop(pager, &page))
-			break;
-
-		popped++;
-		if (morse_pageset_page_is_cached(pageset, &page))
-			continue;
-
-		ret = kfifo_put(&pageset->cached_pages, page);
-		MORSE_WARN_ON(FEATURE_ID_PAGER, !ret);
-	}
+	} while (count == want && popped < max_expected_pops);
 
 	MORSE_WARN_ON(FEATURE_ID_PAGER, popped >= max_expected_pops);
 
-exit:
 	if (popped)
 		pager->ops->notify(pager);
 }
@@ -252,7 +334,7 @@ static unsigned int bcn_page_fail;
 static void morse_pageset_bcn_loss_monitor(struct morse *mors)
 {
 	if (bcn_page_fail > BCN_LOSS_THRESHOLD) {
-		mors->debug.page_stats.excessive_bcn_loss++;
+		MORSE_PAGE_STAT_INC(mors, excessive_bcn_loss);
 		MORSE_WARN(mors, "%s failed to send %d of %d beacons\n",
 			   __func__, bcn_page_fail, bcn_page_get);
 	}
@@ -273,7 +355,7 @@ static bool morse_pageset_rsved_page_is_avail(struct morse_pageset *pageset, u8
 		/* Always hold at least one reserved page for commands */
 		if (kfifo_len(&pageset->reserved_pages) <= 1) {
 			bcn_page_fail++;
-			mors->debug.page_stats.bcn_no_page++;
+			MORSE_PAGE_STAT_INC(mors, bcn_no_page);
 			MORSE_DBG(mors, "%s no page available for beacon\n", __func__);
 			return false;
 		}
@@ -287,11 +369,11 @@ static bool morse_pageset_rsved_page_is_avail(struct morse_pageset *pageset, u8
 		if (kfifo_is_empty(&pageset->reserved_pages)) {
 			morse_pageset_to_chip_return_handler(mors, have_lock);
 			if (kfifo_is_empty(&pageset->reserved_pages)) {
-				mors->debug.page_stats.cmd_no_page++;
+				MORSE_PAGE_STAT_INC(mors, cmd_no_page);
 				MORSE_ERR(mors, "%s unexpected command page exhaustion\n",
 					  __func__);
 			} else {
-				mors->debug.page_stats.cmd_rsv_page_retry++;
+				MORSE_PAGE_STAT_INC(mors, cmd_rsv_page_retry);
 				MORSE_DBG(mors, "%s got command page on second attempt\n",
 					  __func__);
 			}
@@ -394,6 +476,9 @@ static int morse_pageset_read(struct morse_pageset *pageset)
 	struct morse_chip_if_state *chip_if = mors->chip_if;
 	struct morse_page page = { .addr = 0, .size_bytes = 0 };
 	struct morse_buff_skb_header *hdr;
+	struct page *rx_page;
+	u8 *data;
+	int read_len;
 	int skb_len;
 	int max_checksum_rounds = 2;
 	int count = 0;
@@ -421,19 +506,26 @@ static int morse_pageset_read(struct morse_pageset *pageset)
 		}
 	}
 
-	skb_len = round_up(page.addr >> 20, 4);
+	read_len = round_up(page.addr >> 20, 4);
 	page.addr = ((page.addr & 0xFFFFF) | mors->cfg->regs->pager_base_address);
 
-	/* Allocate an skb for the page data, copy header to it */
-	skb = dev_alloc_skb(skb_len);
-	if (!skb) {
-		ret = -ENOMEM;
-		goto exit;
+	/* Read into a page block so a data payload can be passed on without a copy. Fall back to
+	 * reading straight into an skb if no block can be allocated.
+	 */
+	rx_page = morse_pageset_get_rx_page(pageset, read_len);
+	if (rx_page) {
+		data = (u8 *)page_address(rx_page) + pageset->rx_page_offset;
+	} else {
+		skb = dev_alloc_skb(read_len);
+		if (!skb) {
+			ret = -ENOMEM;
+			goto exit;
+		}
+		data = skb_put(skb, read_len);
 	}
-	skb_put(skb, skb_len);
 
 	/* Read page data */
-	ret = populated_pager->ops->read_page(populated_pager, &page, 0, skb->data, skb_len);
+	ret = populated_pager->ops->read_page(populated_pager, &page, 0, data, read_len);
 
 	if (ret) {
 		MORSE_ERR(mors, "%s failed to read page: %d\n", __func__, ret);
@@ -443,9 +535,7 @@ static int morse_pageset_read(struct morse_pageset *pageset)
 		goto exit;
 	}
 
-	hdr = (struct morse_buff_skb_header *)skb->data;
-
-	morse_debug_fw_hostif_log_record(mors, false, skb, hdr);
+	hdr = (struct morse_buff_skb_header *)data;
 
 	/* Validate header */
 	if (hdr->sync != MORSE_SKB_HEADER_SYNC) {
@@ -458,7 +548,7 @@ static int morse_pageset_read(struct morse_pageset *pageset)
 			/* Chip already owns the page, clear page address
 			 * to indicate that it should not be returned
 			 */
-			mors->debug.page_stats.page_owned_by_chip++;
+			MORSE_PAGE_STAT_INC(mors, page_owned_by_chip);
 			page.addr = 0;
 		}
 
@@ -470,18 +560,17 @@ static int morse_pageset_read(struct morse_pageset *pageset)
 	}
 
 	while (!checksum_valid && count < max_checksum_rounds) {
-		checksum_valid = morse_validate_skb_checksum(skb->data);
+		checksum_valid = morse_validate_skb_checksum(data);
 		if (checksum_valid)
 			break;
 
-		mors->debug.page_stats.invalid_checksum++;
+		MORSE_PAGE_STAT_INC(mors, invalid_checksum);
 		/* Read tx status again if the first read is corrupted. There is a tput degradation
 		 * if continue to read pages from the pager.
 		 */
 		if (hdr->channel != MORSE_SKB_CHAN_TX_STATUS)
 			break;
-		ret =
-		    populated_pager->ops->read_page(populated_pager, &page, 0, skb->data, skb_len);
+		ret = populated_pager->ops->read_page(populated_pager, &page, 0, data, read_len);
 		if (ret)
 			break;
 		count++;
@@ -490,9 +579,9 @@ static int morse_pageset_read(struct morse_pageset *pageset)
 	if (!checksum_valid) {
 		MORSE_DBG(mors,
 			  "%s: SKB checksum is invalid, page:[a:0x%08x len:%d] hdr:[c:%02X s:%02X]",
-			  __func__, page.addr, skb_len, hdr->channel, hdr->sync);
+			  __func__, page.addr, read_len, hdr->channel, hdr->sync);
 		if (hdr->channel == MORSE_SKB_CHAN_TX_STATUS)
-			mors->debug.page_stats.invalid_tx_status_checksum++;
+			MORSE_PAGE_STAT_INC(mors, invalid_tx_status_checksum);
 		goto exit;
 	}
 
@@ -539,11 +628,22 @@ static int morse_pageset_read(struct morse_pageset *pageset)
 	}
 
 	/* Read of page can be greater than actual size of data - so trim */
-	skb_len = sizeof(*hdr) + hdr->offset + le16_to_cpu(hdr->len);
-	skb_trim(skb, skb_len);
+	skb_len = min_t(int, read_len, sizeof(*hdr) + hdr->offset + le16_to_cpu(hdr->len));
+	if (rx_page) {
+		skb = morse_pageset_rx_page_skb(pageset, rx_page, data, skb_len);
+		if (!skb) {
+			ret = -ENOMEM;
+			goto exit;
+		}
+	} else {
+		skb_trim(skb, skb_len);
+	}
+
+	morse_debug_fw_hostif_log_record(mors, false, skb, hdr);
 
 #ifdef CONFIG_MORSE_IPMON
-	if (hdr->channel == MORSE_SKB_CHAN_DATA) {
+	/* IPMON rewrites the payload in place, so it needs it in the linear area */
+	if (hdr->channel == MORSE_SKB_CHAN_DATA && !skb_linearize(skb)) {
 		static u64 time_start;
 
 		morse_ipmon(&time_start, skb, skb->data + sizeof(*hdr),
@@ -553,11 +653,11 @@ static int morse_pageset_read(struct morse_pageset *pageset)
 
 	ret = morse_skbq_put(mq, skb);
 
-	/* Unconditionally queue network work to process RX page. Either
+	/* Unconditionally schedule delivery of the RX page. Either
 	 * insertion into the mq was successful, or the mq is currently full
 	 * and requires processing anyway.
 	 */
-	queue_work(mors->net_wq, &mq->dispatch_work);
+	morse_skbq_rx_schedule(mq);
 
 	if (ret) {
 		MORSE_ERR(mors, "%s: Failed to insert skb into mq[channel:%d]\n", __func__,
@@ -577,7 +677,8 @@ static int morse_pageset_read(struct morse_pageset *pageset)
 
 exit:
 	/* If the SKB did not successfully make it into an MQ, it must be freed */
-	dev_kfree_skb(skb);
+	if (skb)
+		dev_kfree_skb(skb);
 
 	if (page.addr) {
 		/* Put the emptied page to send it back to the chip */
@@ -641,10 +742,11 @@ static void morse_pageset_tx(struct morse_pageset *pageset, struct morse_skbq *m
 	__skb_queue_head_init(&skbq_sent);
 	__skb_queue_head_init(&skbq_failed);
 
-	if (mq == &pageset->cmd_q)
-		/* Purge timed-out commands (this should not happen) */
-		morse_skbq_purge(mq, &mq->pending);
-	else if (mq == &pageset->mgmt_q && mq->skbq.qlen > 0)
+	/*
+	 * Commands left on the pending queue belong to other outstanding requests, which
+	 * morse_cmd_tx() finishes itself on response or timeout, so they are not purged here.
+	 */
+	if (mq == &pageset->mgmt_q && mq->skbq.qlen > 0)
 		/* Purge old mgmt frames that have not been sent due to congestion */
 		morse_skbq_purge_aged(mors, mq);
 
@@ -655,7 +757,7 @@ static void morse_pageset_tx(struct morse_pageset *pageset, struct morse_skbq *m
 		if (num_pages) {
 			ret = morse_pageset_write(pageset, pfirst);
 		} else {
-			mors->debug.page_stats.no_page++;
+			MORSE_PAGE_STAT_INC(mors, no_page);
 			MORSE_ERR(mors, "%s no pages available\n", __func__);
 			ret = -ENOSPC;
 		}
@@ -663,16 +765,16 @@ static void morse_pageset_tx(struct morse_pageset *pageset, struct morse_skbq *m
 			hdr = (struct morse_buff_skb_header *)pfirst->data;
 			switch (hdr->channel) {
 			case MORSE_SKB_CHAN_COMMAND:
-				mors->debug.page_stats.cmd_tx++;
+				MORSE_PAGE_STAT_INC(mors, cmd_tx);
 				break;
 			case MORSE_SKB_CHAN_BEACON:
-				mors->debug.page_stats.bcn_tx++;
+				MORSE_PAGE_STAT_INC(mors, bcn_tx);
 				break;
 			case MORSE_SKB_CHAN_MGMT:
-				mors->debug.page_stats.mgmt_tx++;
+				MORSE_PAGE_STAT_INC(mors, mgmt_tx);
 				break;
 			default:
-				mors->debug.page_stats.data_tx++;
+				MORSE_PAGE_STAT_INC(mors, data_tx);
 				break;
 			}
 			num_pages--;
@@ -685,7 +787,7 @@ static void morse_pageset_tx(struct morse_pageset *pageset, struct morse_skbq *m
 	}
 
 	if (skbq_failed.qlen > 0) {
-		mors->debug.page_stats.write_fail += skbq_failed.qlen;
+		MORSE_PAGE_STAT_ADD(mors, write_fail, skbq_failed.qlen);
 		MORSE_ERR(mors, "%s could not write %d pkts - rc=%d items=%d pages=%d",
 			  __func__, skbq_failed.qlen, ret, num_items, num_pages);
 		morse_skbq_purge(NULL, &skbq_failed);
@@ -815,6 +917,7 @@ static bool morse_pageset_rx_handler(struct morse_pageset *pageset,
 
 	pageset->populated_pager->ops->notify(pageset->populated_pager);
 
+
 	if (ret == -ENOMEM || count == MAX_PAGES_PER_RX_TXN ||
 	    (do_beacon_irq_check && *is_beacon_pending))
 		return true;
@@ -1002,6 +1105,7 @@ int morse_pageset_init(struct morse *mors, struct morse_pageset *pageset,
 		       struct morse_pager *populated_pager, struct morse_pager *return_pager)
 {
 	int i;
+	int ret;
 	u16 chip_if_direction_flag;
 
 	pageset->mors = mors;
@@ -1030,6 +1134,11 @@ int morse_pageset_init(struct morse *mors, struct morse_pageset *pageset,
 			morse_skbq_init(mors,
 					&pageset->data_qs[i],
 					MORSE_CHIP_IF_FLAGS_DATA | chip_if_direction_flag);
+
+		/* Received frames all land on the first data queue */
+		ret = morse_skbq_napi_init(&pageset->data_qs[0]);
+		if (ret)
+			return ret;
 	}
 
 	if (pageset->flags & MORSE_CHIP_IF_FLAGS_COMMAND)
@@ -1040,9 +1149,8 @@ int morse_pageset_init(struct morse *mors, struct morse_pageset *pageset,
 	populated_pager->parent = pageset;
 	return_pager->parent = pageset;
 
-	pageset_trace_init(pageset);
-	pageset_trace_log(populated_pager, PAGESET_TRACE_EVENT_ID_INIT, 0);
-	pageset_trace_log(return_pager, PAGESET_TRACE_EVENT_ID_INIT, 0);
+	trace_morse_page(populated_pager, MORSE_TRACE_PAGE_INIT, 0);
+	trace_morse_page(return_pager, MORSE_TRACE_PAGE_INIT, 0);
 	return 0;
 }
 
@@ -1053,6 +1161,8 @@ void morse_pageset_finish(struct morse_pageset *pageset)
 	pageset->return_pager = NULL;
 	pageset->populated_pager = NULL;
 
+	morse_pageset_free_rx_pages(pageset);
+
 	if (pageset->flags & MORSE_CHIP_IF_FLAGS_DATA) {
 		morse_skbq_finish(&pageset->beacon_q);
 		morse_skbq_finish(&pageset->mgmt_q);
@@ -16,7 +16,6 @@
 #include "skbq.h"
 #include "pager_if.h"
 #include "chip_if.h"
-#include "pageset_trace.h"
 
 /*
  * A pageset uses a pair of pagers to implement the paging system
@@ -58,6 +57,24 @@
  */
 #define PAGESET_TX_SKBQ_MAX			4
 
+/** Number of page blocks CHIP->HOST pages are read into, recycled once their skbs are freed */
+#define PAGESET_RX_PAGE_POOL_SIZE		4
+
+/** Size of each RX page block, holding several pages of page data */
+#define PAGESET_RX_PAGE_BLOCK_BYTES		16384
+
+/**
+ * Bytes past the skb header copied into the linear area of a data frame read into a page
+ * block. Covers the largest 802.11 header plus CCMP and LLC/SNAP headers.
+ */
+#define PAGESET_RX_COPYBREAK_BYTES		128
+
+/**
+ * Smallest data frame whose payload is passed on as a fragment of a page block. Smaller frames
+ * are copied, which bounds how many skbs can keep one block from being reused.
+ */
+#define PAGESET_RX_FRAG_MIN_BYTES		(PAGESET_RX_PAGE_BLOCK_BYTES / 16)
+
 extern const struct chip_if_ops morse_pageset_hw_ops;
 extern const struct chip_if_ops morse_pageset_sw_ops;
 
@@ -90,9 +107,12 @@ struct morse_pageset {
 	DECLARE_KFIFO(reserved_pages, struct morse_page, CMD_RSVED_KFIFO_LEN);
 	DECLARE_KFIFO(cached_pages, struct morse_page, CACHED_PAGES_KFIFO_LEN);
 
-#ifdef CONFIG_MORSE_PAGESET_TRACE
-	struct pageset_trace trace;
-#endif
+	/* Page blocks RX pages are read into. The payload of a data frame is attached to its skb
+	 * as a fragment of the block, so a block is only reused once no skb references it.
+	 */
+	struct page *rx_pages[PAGESET_RX_PAGE_POOL_SIZE];
+	u8 rx_page_idx;
+	u32 rx_page_offset;
 };
 
 /**
@@ -192,8 +192,8 @@ int morse_pre_assoc_peer_update_rx_info(struct morse *mors, const u8 *addr, mors
 	}
 	spin_unlock_bh(&mors->pre_assoc_peers.lock);
 
-	/* Allocate memory for a new peer */
-	peer = kzalloc(sizeof(*peer), GFP_KERNEL);
+	/* Allocate memory for a new peer, without sleeping as this is reached from the NAPI poll */
+	peer = kzalloc(sizeof(*peer), GFP_ATOMIC);
 	if (!peer) {
 		MORSE_PEER_ERR(mors, "%s: no memory for peer %pM", __func__, addr);
 		return -ENOMEM;
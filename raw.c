@@ -233,41 +233,140 @@ struct morse_raw_periodic_t {
 	u8 start_offset;
 } __packed;
 
+/* Initial number of AIDs allocated for in the AID list, doubled whenever it fills up */
+#define MORSE_RAW_AID_LIST_MIN_AIDS			(16)
+
 /**
- * morse_raw_build_aid_list() - Generate an ordered AID array from a station bitmap.
+ * morse_raw_aid_list_find() - Find the index of the first AID in the list not less than @aid
  *
- * @aid_bitmap: Pointer to bitmap where bit position indicates an AID
- * @num_aids: The number of AIDs
- * @max_aid: the largest AID in the bitmap
- * @gfp: allocation flags
+ * @aid_list: AID list to search
+ * @aid: AID to find
  *
- * @return: allocated AID list
+ * Return: index of @aid if present, otherwise the index it would be inserted at
  */
-static struct morse_aid_list *morse_generate_aid_list(unsigned long *aid_bitmap, int num_aids,
-	int max_aid, gfp_t gfp)
+static int morse_raw_aid_list_find(const struct morse_aid_list *aid_list, u16 aid)
 {
-	int aid;
-	int idx = 0;
-	struct morse_aid_list *list;
+	int lo = 0;
+	int hi = aid_list->num_aids;
 
-	/* Bitops search up to but not including 'size'. +1 so we include the 'last' AID in our
-	 * search.
-	 */
-	const int num_bits = max_aid + 1;
+	while (lo < hi) {
+		int mid = lo + ((hi - lo) / 2);
 
-	list = kmalloc(sizeof(list) + (num_aids * sizeof(list->aids[0])), gfp);
-	if (!list)
-		return NULL;
+		if (aid_list->aids[mid] < aid)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
 
-	list->num_aids = num_aids;
+	return lo;
+}
 
-	for_each_set_bit(aid, aid_bitmap, num_bits) {
-		list->aids[idx++] = aid;
-		if (unlikely(idx >= num_aids))
-			break;
+/**
+ * morse_raw_aid_list_insert() - Insert an AID into the ordered AID list, growing it if required
+ *
+ * @raw: RAW context
+ * @aid: AID to insert
+ *
+ * Return: 0 on success, -ENOMEM if the list could not be grown
+ */
+static int morse_raw_aid_list_insert(struct morse_raw *raw, u16 aid)
+{
+	struct morse_aid_list *aid_list = raw->aid_list;
+	int idx;
+
+	if (aid_list->num_aids == aid_list->max_aids) {
+		u16 max_aids = min_t(u16, aid_list->max_aids * 2, MORSE_AP_AID_BITMAP_SIZE);
+
+		aid_list = krealloc(aid_list,
+				    sizeof(*aid_list) + (max_aids * sizeof(aid_list->aids[0])),
+				    GFP_KERNEL);
+		if (!aid_list)
+			return -ENOMEM;
+
+		aid_list->max_aids = max_aids;
+		raw->aid_list = aid_list;
+	}
+
+	idx = morse_raw_aid_list_find(aid_list, aid);
+	if (idx < aid_list->num_aids && aid_list->aids[idx] == aid)
+		return 0;
+
+	memmove(&aid_list->aids[idx + 1], &aid_list->aids[idx],
+		(aid_list->num_aids - idx) * sizeof(aid_list->aids[0]));
+	aid_list->aids[idx] = aid;
+	aid_list->num_aids++;
+
+	return 0;
+}
+
+/**
+ * morse_raw_aid_list_delete() - Remove an AID from the ordered AID list
+ *
+ * @aid_list: AID list to remove from
+ * @aid: AID to remove
+ */
+static void morse_raw_aid_list_delete(struct morse_aid_list *aid_list, u16 aid)
+{
+	int idx = morse_raw_aid_list_find(aid_list, aid);
+
+	if (idx >= aid_list->num_aids || aid_list->aids[idx] != aid)
+		return;
+
+	aid_list->num_aids--;
+	memmove(&aid_list->aids[idx], &aid_list->aids[idx + 1],
+		(aid_list->num_aids - idx) * sizeof(aid_list->aids[0]));
+}
+
+/**
+ * morse_raw_sync_aid_list() - Bring the ordered AID list in line with the AP AID bitmap.
+ *
+ * @ap: AP context
+ * @raw: RAW context
+ *
+ * Only the AIDs that changed since the last call are inserted or removed, found by comparing
+ * the AP AID bitmap against the copy taken at that time.
+ */
+static void morse_raw_sync_aid_list(struct morse_ap *ap, struct morse_raw *raw)
+{
+	const int num_longs = BITS_TO_LONGS(MORSE_AP_AID_BITMAP_SIZE);
+	int i;
+
+	if (!raw->aid_list) {
+		raw->aid_bitmap = kcalloc(num_longs, sizeof(*raw->aid_bitmap), GFP_KERNEL);
+		raw->aid_list = kzalloc(sizeof(*raw->aid_list) +
+					(MORSE_RAW_AID_LIST_MIN_AIDS * sizeof(raw->aid_list->aids[0])),
+					GFP_KERNEL);
+		if (!raw->aid_bitmap || !raw->aid_list) {
+			kfree(raw->aid_bitmap);
+			kfree(raw->aid_list);
+			raw->aid_bitmap = NULL;
+			raw->aid_list = NULL;
+			return;
+		}
+
+		raw->aid_list->max_aids = MORSE_RAW_AID_LIST_MIN_AIDS;
 	}
 
-	return list;
+	for (i = 0; i < num_longs; i++) {
+		unsigned long cur = READ_ONCE(ap->aid_bitmap[i]);
+		unsigned long diff = cur ^ raw->aid_bitmap[i];
+
+		while (diff) {
+			unsigned int pos = __ffs(diff);
+			unsigned long bit = BIT(pos);
+			u16 aid = (i * BITS_PER_LONG) + pos;
+
+			diff &= ~bit;
+
+			if (!(cur & bit))
+				morse_raw_aid_list_delete(raw->aid_list, aid);
+			else if (morse_raw_aid_list_insert(raw, aid))
+				/* Leave it out of the copy so it is retried on the next refresh */
+				cur &= ~bit;
+		}
+
+		raw->aid_bitmap[i] = cur;
+	}
 }
 
 /**
@@ -355,16 +454,6 @@ static __le16 morse_raw_generate_slot_definition(struct morse *mors,
 	return slot_def;
 }
 
-u8 morse_raw_get_rps_ie_size(struct morse_vif *mors_vif)
-{
-	struct morse_ap *ap = mors_vif->ap;
-
-	if (!ap || !ap->raw.rps_ie || !morse_raw_is_enabled(mors_vif))
-		return 0;
-
-	return ap->raw.rps_ie_len;
-}
-
 /**
  * morse_raw_calc_rps_ie_size() -	Calculates the RPS IE size required for the provided RAW
  *									configurations
@@ -416,9 +505,48 @@ static int morse_raw_calc_rps_ie_size(const struct morse_raw_config *const *conf
 	return size;
 }
 
-u8 *morse_raw_get_rps_ie(struct morse_vif *mors_vif)
+const u8 *morse_raw_get_rps_ie(struct morse_vif *mors_vif, u8 *len)
 {
-	return mors_vif->ap->raw.rps_ie;
+	struct morse_raw *raw;
+	u8 idx;
+
+	*len = 0;
+
+	if (!morse_raw_is_enabled(mors_vif))
+		return NULL;
+
+	raw = &mors_vif->ap->raw;
+
+	/* Pairs with smp_store_release() in morse_raw_publish_rps_ie() */
+	idx = smp_load_acquire(&raw->rps_ie_idx);
+	*len = raw->rps_ie[idx].len;
+
+	return *len ? raw->rps_ie[idx].data : NULL;
+}
+
+/**
+ * morse_raw_publish_rps_ie() - Publish the RPS IE written to the unpublished buffer
+ *
+ * @mors_vif: Morse interface
+ * @len: Length of the RPS IE written, 0 to stop including an RPS IE in beacons
+ *
+ * Nothing is published if the new RPS IE is the same as the current one, which keeps the
+ * cached beacon valid.
+ */
+static void morse_raw_publish_rps_ie(struct morse_vif *mors_vif, u8 len)
+{
+	struct morse_raw *raw = &mors_vif->ap->raw;
+	u8 cur = raw->rps_ie_idx;
+	u8 next = !cur;
+
+	if (raw->rps_ie[cur].len == len &&
+	    !memcmp(raw->rps_ie[cur].data, raw->rps_ie[next].data, len))
+		return;
+
+	raw->rps_ie[next].len = len;
+	/* Pairs with smp_load_acquire() in morse_raw_get_rps_ie() */
+	smp_store_release(&raw->rps_ie_idx, next);
+	morse_beacon_template_invalidate(mors_vif);
 }
 
 static u8 *morse_raw_generate_assignment_with_aid_range(struct morse_vif *mors_vif,
@@ -548,13 +676,10 @@ static u8 *morse_raw_generate_assignment(struct morse_vif *mors_vif,
 
 		/* Find where we should start the AID range for this beacon from. */
 		MORSE_RAW_DBG(mors, "Last spread AID: %u\n", config->beacon_spreading.last_aid);
-		for (i = config->start_aid_idx;
-		     (i <= config->end_aid_idx) && (i < aid_list->num_aids); i++) {
-			if (aid_list->aids[i] > config->beacon_spreading.last_aid) {
-				current_beacon_start_aid_idx = i;
-				break;
-			}
-		}
+		i = morse_raw_aid_list_find(aid_list, config->beacon_spreading.last_aid + 1);
+		i = max_t(u32, i, config->start_aid_idx);
+		if (i <= config->end_aid_idx && i < aid_list->num_aids)
+			current_beacon_start_aid_idx = i;
 
 		/* If the last end AID was the last of the connected STAs then start the cycle from
 		 * the beginning.
@@ -570,12 +695,9 @@ static u8 *morse_raw_generate_assignment(struct morse_vif *mors_vif,
 			sta_per_beacon++;
 
 		/* Find the end AID for this beacon. */
-		for (i = current_beacon_start_aid_idx;
-		     (i <= config->end_aid_idx) &&
-		     (i < (current_beacon_start_aid_idx + sta_per_beacon)) &&
-		     (i < aid_list->num_aids); i++) {
-			current_beacon_end_aid_idx = i;
-		}
+		current_beacon_end_aid_idx = min3(config->end_aid_idx,
+						  current_beacon_start_aid_idx + sta_per_beacon - 1,
+						  aid_list->num_aids - 1);
 
 		if (current_beacon_end_aid_idx < current_beacon_start_aid_idx) {
 			/* This should never happen */
@@ -598,8 +720,28 @@ static u8 *morse_raw_generate_assignment(struct morse_vif *mors_vif,
 		config->beacon_spreading.last_aid = config->end_aid;
 	}
 
-	return morse_raw_generate_assignment_with_aid_range(mors_vif, config, rps_ie_start,
-		current_beacon_start_aid, current_beacon_end_aid);
+	/* Only re-encode the assignment if its inputs have changed since it was last encoded. */
+	if (!config->encoded.len ||
+	    config->encoded.start_aid != current_beacon_start_aid ||
+	    config->encoded.end_aid != current_beacon_end_aid ||
+	    config->encoded.cur_validity != config->periodic.cur_validity ||
+	    config->encoded.cur_start_offset != config->periodic.cur_start_offset) {
+		u8 *end;
+
+		memset(config->encoded.data, 0, sizeof(config->encoded.data));
+		end = morse_raw_generate_assignment_with_aid_range(mors_vif, config,
+			config->encoded.data, current_beacon_start_aid, current_beacon_end_aid);
+
+		config->encoded.len = end - config->encoded.data;
+		config->encoded.start_aid = current_beacon_start_aid;
+		config->encoded.end_aid = current_beacon_end_aid;
+		config->encoded.cur_validity = config->periodic.cur_validity;
+		config->encoded.cur_start_offset = config->periodic.cur_start_offset;
+	}
+
+	memcpy(rps_ie_start, config->encoded.data, config->encoded.len);
+
+	return rps_ie_start + config->encoded.len;
 }
 
 /**
@@ -618,11 +760,12 @@ static int morse_raw_generate_rps_ie(struct morse_vif *mors_vif,
 {
 	int i;
 	u8 *head;
-	u8 old_rps_ie_len;
 	struct morse *mors = morse_vif_to_morse(mors_vif);
 	struct morse_raw *raw = &mors_vif->ap->raw;
+	/* Beacons may be reading the published buffer, so build into the other one. */
+	u8 *rps_ie = raw->rps_ie[!raw->rps_ie_idx].data;
 
-	/* Calculate the size so we can allocate memory */
+	/* Calculate the size so we can check it fits */
 	int size =
 	    morse_raw_calc_rps_ie_size((const struct morse_raw_config * const *)config_list,
 				       num_configs);
@@ -630,42 +773,22 @@ static int morse_raw_generate_rps_ie(struct morse_vif *mors_vif,
 	MORSE_RAW_DBG(mors, "Number of RAWs: %u\n", num_configs);
 	MORSE_RAW_DBG(mors, "RPS IE size: %d\n", size);
 
-	WARN_ON((size <= 0) || (size > __UINT8_MAX__));
-
-	/* Invalidate current raw until we are finished by setting to 0. */
-	old_rps_ie_len = raw->rps_ie_len;
-	raw->rps_ie_len = 0;
-
-	if (raw->rps_ie) {
-		/* Adjust size of allocated memory if necessary. */
-		if (old_rps_ie_len != size) {
-			kfree(raw->rps_ie);
-			raw->rps_ie = kmalloc(size, GFP_KERNEL);
-		}
-	} else {
-		/* Allocate memory for the RPS IE. */
-		MORSE_RAW_DBG(mors, "Allocate RAW RPS IE\n");
-		raw->rps_ie = kmalloc(size, GFP_KERNEL);
-	}
-	/* Check we got our allocated memory. */
-	if (!raw->rps_ie) {
-		MORSE_RAW_DBG(mors, "Failed to allocate RAW RPS IE\n");
-		return -ENOMEM;
+	if (WARN_ON((size <= 0) || (size > MORSE_RAW_RPS_IE_MAX_LEN))) {
+		morse_raw_publish_rps_ie(mors_vif, 0);
+		return -EINVAL;
 	}
 
-	/* Keep everything neat and zero the memory. */
-	memset(raw->rps_ie, 0, size);
-	head = raw->rps_ie;
+	head = rps_ie;
 
 	/* Populate RPS IE using config settings. */
 	for (i = 0; i < num_configs; i++) {
 		head = morse_raw_generate_assignment(mors_vif, config_list[i], head);
-		WARN_ON(head > (raw->rps_ie + size));
+		WARN_ON(head > (rps_ie + size));
 	}
 
 	/* Validate RPS IE by giving its size. */
-	WARN_ON(head != (raw->rps_ie + size));
-	raw->rps_ie_len = size;
+	WARN_ON(head != (rps_ie + size));
+	morse_raw_publish_rps_ie(mors_vif, size);
 
 	return 0;
 }
@@ -836,24 +959,14 @@ static void raw_update_aid_indexes(struct morse_raw_config *cfg,
  */
 static void morse_raw_refresh_aids(struct morse_ap *ap, struct morse_raw *raw)
 {
-	struct morse_aid_list *aid_list;
 	struct morse_raw_config *config_ptr;
 
 	lockdep_assert_held(&raw->lock);
 
-	aid_list =
-		morse_generate_aid_list(ap->aid_bitmap, ap->num_stas, ap->largest_aid, GFP_KERNEL);
-
-	if (!aid_list)
+	morse_raw_sync_aid_list(ap, raw);
+	if (!raw->aid_list)
 		return;
 
-	/* reset aid list */
-	kfree(raw->aid_list);
-
-	raw->aid_list = aid_list;
-
-	WARN_ON(aid_list->num_aids > 0 && !(u16 *)aid_list->aids);
-
 	list_for_each_entry(config_ptr, &raw->active_raws, active_list) {
 		/* only care about AID indexes for active beacon spreading RAWs */
 		if (config_ptr->beacon_spreading.nominal_sta_per_beacon) {
@@ -861,7 +974,7 @@ static void morse_raw_refresh_aids(struct morse_ap *ap, struct morse_raw *raw)
 			config_ptr->start_aid_idx = INVALID_AID_VALUE;
 			config_ptr->end_aid_idx = INVALID_AID_VALUE;
 
-			raw_update_aid_indexes(config_ptr, aid_list);
+			raw_update_aid_indexes(config_ptr, raw->aid_list);
 		}
 	}
 }
@@ -925,14 +1038,14 @@ static void morse_raw_do_update(struct morse_vif *mors_vif)
 	struct morse *mors = morse_vif_to_morse(mors_vif);
 	bool include_praws = false;
 
+	mutex_lock(&raw->lock);
+
 	/* RPS IE should only be regenerated if RAW is enabled. */
 	if (!test_bit(RAW_STATE_ENABLED, &raw->flags)) {
 		MORSE_WARN_ON(FEATURE_ID_RAW, true);
 		goto cleanup;
 	}
 
-	mutex_lock(&raw->lock);
-
 	/* STAs have been added or removed, update AID list */
 	if (test_and_clear_bit(RAW_STATE_REFRESH_AIDS, &raw->flags)) {
 		morse_raw_refresh_aids(ap, raw);
@@ -1020,9 +1133,7 @@ static void morse_raw_do_update(struct morse_vif *mors_vif)
 		return;
 	}
 cleanup:
-	raw->rps_ie_len = 0;
-	kfree(raw->rps_ie);
-	raw->rps_ie = NULL;
+	morse_raw_publish_rps_ie(mors_vif, 0);
 	mutex_unlock(&raw->lock);
 }
 
@@ -1064,6 +1175,7 @@ static bool morse_raw_cmd_to_config(u8 *head, int len, struct morse_raw_config *
 
 	/* only support generic RAWs at the moment */
 	cfg->type = IEEE80211_S1G_RPS_RAW_TYPE_GENERIC;
+	morse_raw_cfg_invalidate(cfg);
 
 	tail = head + len;
 
@@ -1142,8 +1254,12 @@ void morse_raw_enable(struct morse_raw *raw)
  */
 static void morse_raw_disable(struct morse_raw *raw)
 {
+	struct morse_ap *ap = container_of(raw, struct morse_ap, raw);
+
 	clear_bit(RAW_STATE_ENABLED, &raw->flags);
 	cancel_work_sync(&raw->update_work);
+	if (ap->mors_vif)
+		morse_beacon_template_invalidate(ap->mors_vif);
 }
 
 struct morse_raw_config *morse_raw_find_config_by_id(struct morse_raw *raw, u16 id)
@@ -1656,9 +1772,11 @@ void morse_raw_finish(struct morse_vif *mors_vif)
 	morse_raw_disable(raw);
 
 	/* Free RAW and clean up */
-	raw->rps_ie_len = 0;
-	kfree(raw->rps_ie);
-	raw->rps_ie = NULL;
+	morse_raw_publish_rps_ie(mors_vif, 0);
+	kfree(raw->aid_list);
+	raw->aid_list = NULL;
+	kfree(raw->aid_bitmap);
+	raw->aid_bitmap = NULL;
 
 	list_for_each_entry_safe(config, tmp, &raw->raw_config_list, list)
 		morse_raw_delete_config(raw, config);
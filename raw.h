@@ -25,6 +25,13 @@
 	((x) & ~MORSE_RAW_AID_PRIO_MASK)
 #define MORSE_RAW_AID_DEVICE_MASK		GENMASK(7, 0)
 
+/* RAW control, slot definition and the largest set of optional fields (start time, group and
+ * periodic) of a single RAW assignment.
+ */
+#define MORSE_RAW_ASSIGNMENT_MAX_LEN		(12)
+/* The RPS IE length is carried in the one byte element length field */
+#define MORSE_RAW_RPS_IE_MAX_LEN		(U8_MAX)
+
 /* EMA smoothing factor: 1/8 */
 #define EMA_SHIFT       3
 #define EMA_ALPHA       BIT(EMA_SHIFT)
@@ -115,6 +122,8 @@ struct morse_raw_config_triggering_t {
 struct morse_aid_list {
 	/** Number of AIDs */
 	u16 num_aids;
+	/** Number of AIDs the list has been allocated for */
+	u16 max_aids;
 	/** Array of AIDs of stations */
 	u16 aids[];
 };
@@ -219,6 +228,19 @@ struct morse_raw_config {
 		u16 insert_at_idx;
 	} dynamic;
 
+	/**
+	 * Cached encoding of this config's RAW assignment. It is reused for as long as the
+	 * config, its AID range and its PRAW counters are unchanged. A zero length marks it stale.
+	 */
+	struct {
+		u8 data[MORSE_RAW_ASSIGNMENT_MAX_LEN];
+		u8 len;
+		u16 start_aid;
+		u16 end_aid;
+		u8 cur_validity;
+		u8 cur_start_offset;
+	} encoded;
+
 	/** RAW type specific configuration information. */
 	union {
 		/** Generic RAW specific configuration information. */
@@ -251,10 +273,16 @@ struct morse_raw {
 	unsigned long flags;
 	/** Number of beacons left to send PRAWs */
 	u8 praw_tx_count;
-	/** The currently generated RPS IE */
-	u8 *rps_ie;
-	/** The size of the currently generated RPS IE */
-	u8 rps_ie_len;
+	/**
+	 * Double-buffered RPS IE. The update work writes the buffer that is not published and
+	 * then publishes it, so beacon generation can copy the published one without the lock.
+	 */
+	struct {
+		u8 data[MORSE_RAW_RPS_IE_MAX_LEN];
+		u8 len;
+	} rps_ie[2];
+	/** Index of the published RPS IE buffer */
+	u8 rps_ie_idx;
 	struct {
 		/**
 		 * Number of static configurations active across active_raws and active_praws.
@@ -281,6 +309,8 @@ struct morse_raw {
 
 	/** An ordered list of AIDs, for use in generating the RPS IE */
 	struct morse_aid_list *aid_list;
+	/** The AP AID bitmap as of the last AID list update, used to find joined / left STAs */
+	unsigned long *aid_bitmap;
 	/** All RAW configs */
 	struct list_head raw_config_list;
 	/** List for active PRAWs */
@@ -337,6 +367,18 @@ static inline bool morse_raw_cfg_has_bcn_idx(const struct morse_raw_config *cfg)
 	return cfg->dynamic.insert_at_idx != U16_MAX;
 }
 
+/**
+ * morse_raw_cfg_invalidate() - Mark the cached encoding of a RAW config stale, so its RAW
+ *				assignment is re-encoded for the next beacon. Must be called
+ *				whenever the config is rewritten.
+ *
+ * @cfg: config being changed
+ */
+static inline void morse_raw_cfg_invalidate(struct morse_raw_config *cfg)
+{
+	cfg->encoded.len = 0;
+}
+
 /**
  * morse_raw_process_rx_mgmt() - Process management frames in RAW module
  *
@@ -352,23 +394,17 @@ int morse_raw_process_rx_mgmt(struct morse *mors, struct ieee80211_vif *vif,
 			struct ieee80211_sta *sta, const struct sk_buff *skb,
 			struct dot11ah_ies_mask *ies_mask);
 
-/**
- * morse_raw_get_rps_ie_size() - Gets the size of the RPS IE for current RAW settings.
- * @mors_vif: Morse VIF structure
- *
- * Return: Size of the RPS IE or 0 on error / RAW disabled.
- */
-u8 morse_raw_get_rps_ie_size(struct morse_vif *mors_vif);
-
 /**
  * morse_raw_get_rps_ie() - Gets the current RPS IE for current RAW settings.
  * @mors_vif: Morse VIF structure
+ * @len: Set to the size of the RPS IE, or 0 on error / RAW disabled
  *
- * Use morse_raw_get_rps_ie_size() to calculate the size to allocate for &rps_ie.
+ * Does not take the RAW lock. The returned buffer is not rewritten until the RPS IE has been
+ * regenerated twice, so it should be copied out straight away (e.g. into a beacon).
  *
- * Return: a pointer to the RPS IE or NULL on error.
+ * Return: a pointer to the RPS IE or NULL on error / RAW disabled.
  */
-u8 *morse_raw_get_rps_ie(struct morse_vif *mors_vif);
+const u8 *morse_raw_get_rps_ie(struct morse_vif *mors_vif, u8 *len);
 
 /**
  * morse_raw_process_cmd() - Execute command to enable/disable/configure RAW
@@ -63,25 +63,105 @@ MODULE_PARM_DESC(fixed_guard, "Fixed guard interval (only used when enable_fixed
 #define MORSE_RC_WARN_RATELIMITED(_m, _f, _a...)		\
 	morse_warn_ratelimited(FEATURE_ID_RATECONTROL, _m, _f, ##_a)
 
+/* Each station's MMRC table is updated once per interval */
+#define MORSE_RC_UPDATE_INTERVAL_MS	(100)
+
+/*
+ * The interval is covered by several ticks, each updating the stations that have become due
+ * since the last one, so the cost of a sweep is spread across the interval.
+ */
+#define MORSE_RC_TICK_MS		(10)
+
+/*
+ * Station tables updated per tick when few stations are connected. With more, the budget grows
+ * so that every station is still updated once per interval.
+ */
+#define MORSE_RC_UPDATES_PER_TICK	(16)
+
+/* Most station tables a tick may update, keeping every station on its update interval */
+static u32 morse_rc_tick_budget(struct morse_rc *mrc)
+{
+	return max_t(u32, MORSE_RC_UPDATES_PER_TICK,
+		     DIV_ROUND_UP(mrc->num_stas * MORSE_RC_TICK_MS, MORSE_RC_UPDATE_INTERVAL_MS));
+}
+
+/*
+ * Run the next tick when the least recently updated station becomes due, or on the next tick if
+ * stations are already due. Does nothing with no stations; morse_rc_sta_add_table() arms the
+ * timer for the first one. Called with mrc->lock held.
+ */
+static void morse_rc_arm_timer(struct morse_rc *mrc, bool backlogged)
+{
+	unsigned long next_tick = jiffies + msecs_to_jiffies(MORSE_RC_TICK_MS);
+	struct morse_rc_sta *mrc_sta;
+	unsigned long due;
+
+	if (list_empty(&mrc->stas))
+		return;
+
+	mrc_sta = list_first_entry(&mrc->stas, struct morse_rc_sta, list);
+	due = mrc_sta->last_update + msecs_to_jiffies(MORSE_RC_UPDATE_INTERVAL_MS);
+
+	mod_timer(&mrc->timer, (backlogged || time_before(due, next_tick)) ? next_tick : due);
+}
+
 static void morse_rc_work(struct work_struct *work)
 {
 	struct morse_rc *mrc = container_of(work, struct morse_rc, work);
-	struct list_head *pos;
-
+	struct morse_rc_update_stats *stats = &mrc->stats;
+	unsigned long interval = msecs_to_jiffies(MORSE_RC_UPDATE_INTERVAL_MS);
+	unsigned long now = jiffies;
+	bool backlogged = false;
+	u32 updated = 0;
+	ktime_t list_start;
+	u32 budget;
+	u64 hold_ns;
+
+	/*
+	 * The list lock is held with bottom halves disabled for the whole tick, which holds off
+	 * the TX path on this CPU. The budget bounds that, at the cost of more updates per tick as
+	 * stations are added; max_list_hold_ns in the update stats shows what it comes to.
+	 */
 	spin_lock_bh(&mrc->lock);
+	list_start = ktime_get();
+	budget = morse_rc_tick_budget(mrc);
 
-	list_for_each(pos, &mrc->stas) {
-		struct morse_rc_sta *mrc_sta = container_of(pos, struct morse_rc_sta, list);
-		unsigned long now = jiffies;
+	while (!list_empty(&mrc->stas)) {
+		struct morse_rc_sta *mrc_sta =
+			list_first_entry(&mrc->stas, struct morse_rc_sta, list);
+		ktime_t sta_start;
+
+		/* The list is in update order, so no later station is due either */
+		if (time_before(now, mrc_sta->last_update + interval))
+			break;
+
+		if (updated == budget) {
+			stats->backlogged_ticks++;
+			backlogged = true;
+			break;
+		}
 
 		mrc_sta->last_update = now;
+		list_move_tail(&mrc_sta->list, &mrc->stas);
 
+		spin_lock(&mrc_sta->lock);
+		sta_start = ktime_get();
 		mmrc_update(mrc_sta->tb);
+		hold_ns = ktime_to_ns(ktime_sub(ktime_get(), sta_start));
+		spin_unlock(&mrc_sta->lock);
+
+		stats->max_sta_hold_ns = max(stats->max_sta_hold_ns, hold_ns);
+		updated++;
 	}
 
-	spin_unlock_bh(&mrc->lock);
+	hold_ns = ktime_to_ns(ktime_sub(ktime_get(), list_start));
+	stats->max_list_hold_ns = max(stats->max_list_hold_ns, hold_ns);
+	stats->max_per_tick = max(stats->max_per_tick, updated);
+	stats->updates += updated;
+	stats->ticks++;
 
-	mod_timer(&mrc->timer, jiffies + msecs_to_jiffies(100));
+	morse_rc_arm_timer(mrc, backlogged);
+	spin_unlock_bh(&mrc->lock);
 }
 
 #if KERNEL_VERSION(4, 14, 0) > LINUX_VERSION_CODE
@@ -117,7 +197,8 @@ int morse_rc_init(struct morse *mors)
 #endif
 
 	mors->mrc.mors = mors;
-	mod_timer(&mors->mrc.timer, jiffies + msecs_to_jiffies(100));
+	mors->mrc.num_stas = 0;
+	memset(&mors->mrc.stats, 0, sizeof(mors->mrc.stats));
 	return 0;
 }
 
@@ -249,6 +330,53 @@ static bool morse_rc_sta_vht_caps_available(struct morse *mors,
 	return true;
 }
 
+void morse_rc_sta_init(struct morse_sta *msta)
+{
+	spin_lock_init(&msta->rc.lock);
+	INIT_LIST_HEAD(&msta->rc.list);
+	msta->rc.tb = NULL;
+}
+
+/* Build the MMRC table of a station and add it to the list of stations to update */
+static int morse_rc_sta_add_table(struct morse *mors, struct morse_sta *msta,
+				  struct mmrc_sta_capabilities *caps)
+{
+	size_t table_mem_size;
+	struct mmrc_table *tb;
+
+	MORSE_WARN_ON(FEATURE_ID_RATECONTROL, msta->rc.tb);
+	table_mem_size = mmrc_memory_required_for_caps(caps);
+	MORSE_RC_DBG(mors, "%s: Mem for table: %zd", __func__, table_mem_size);
+	tb = kzalloc(table_mem_size, GFP_KERNEL);
+	if (!tb)
+		return -ENOMEM;
+
+	/* Initialise the STA rate control table */
+	mmrc_sta_init(tb, caps, msta->avg_rssi);
+
+	spin_lock_bh(&mors->mrc.lock);
+	spin_lock(&msta->rc.lock);
+
+	/* Newest update last, keeping the list in update order */
+	if (msta->rc.tb) {
+		list_move_tail(&msta->rc.list, &mors->mrc.stas);
+	} else {
+		list_add_tail(&msta->rc.list, &mors->mrc.stas);
+		mors->mrc.num_stas++;
+	}
+	kfree(msta->rc.tb);
+	msta->rc.tb = tb;
+	msta->rc.last_update = jiffies;
+
+	if (!timer_pending(&mors->mrc.timer))
+		morse_rc_arm_timer(&mors->mrc, false);
+
+	spin_unlock(&msta->rc.lock);
+	spin_unlock_bh(&mors->mrc.lock);
+
+	return 0;
+}
+
 int morse_rc_sta_add(struct morse *mors, struct ieee80211_vif *vif, struct ieee80211_sta *sta)
 {
 	struct ieee80211_sta_vht_cap *vht_cap = morse_mac_sta_vht_cap(sta);
@@ -256,8 +384,6 @@ int morse_rc_sta_add(struct morse *mors, struct ieee80211_vif *vif, struct ieee8
 	struct morse_sta *msta = (struct morse_sta *)sta->drv_priv;
 	struct mmrc_sta_capabilities caps;
 	int oper_bw_mhz = mors->custom_configs.channel_info.op_bw_mhz;
-	size_t table_mem_size;
-	struct mmrc_table *tb;
 
 	memset(&caps, 0, sizeof(caps));
 
@@ -306,24 +432,7 @@ int morse_rc_sta_add(struct morse *mors, struct ieee80211_vif *vif, struct ieee8
 	else
 		caps.max_retries = MMRC_MAX_CHAIN_ATTEMPTS;
 
-	MORSE_WARN_ON(FEATURE_ID_RATECONTROL, msta->rc.tb);
-	table_mem_size = mmrc_memory_required_for_caps(&caps);
-	MORSE_RC_DBG(mors, "%s: Mem for table: %zd", __func__, table_mem_size);
-	tb = kzalloc(table_mem_size, GFP_KERNEL);
-
-	/* Initialise the STA rate control table */
-	mmrc_sta_init(tb, &caps, msta->avg_rssi);
-
-	spin_lock_bh(&mors->mrc.lock);
-
-	kfree(msta->rc.tb);
-	msta->rc.tb = tb;
-	list_add(&msta->rc.list, &mors->mrc.stas);
-	msta->rc.last_update = jiffies;
-
-	spin_unlock_bh(&mors->mrc.lock);
-
-	return 0;
+	return morse_rc_sta_add_table(mors, msta, &caps);
 }
 
 static void rc_reinit_sta(void *data, struct ieee80211_sta *sta)
@@ -379,7 +488,6 @@ bool _morse_rc_set_fixed_rate(struct morse *mors,
 			      int mcs, int bw, int ss, int guard, const char *caller)
 {
 	struct morse_sta *msta = (struct morse_sta *)sta->drv_priv;
-	struct list_head *pos;
 	struct mmrc_rate fixed_rate;
 	bool ret_val = true;
 
@@ -394,16 +502,10 @@ bool _morse_rc_set_fixed_rate(struct morse *mors,
 	fixed_rate.ss = (ss - 1);
 	fixed_rate.guard = guard;
 
-	spin_lock_bh(&mors->mrc.lock);
-	list_for_each(pos, &mors->mrc.stas) {
-		struct morse_rc_sta *mrc_sta = list_entry(pos, struct morse_rc_sta, list);
-
-		if (&msta->rc == mrc_sta) {
-			ret_val = mmrc_set_fixed_rate(msta->rc.tb, fixed_rate);
-			break;
-		}
-	}
-	spin_unlock_bh(&mors->mrc.lock);
+	spin_lock_bh(&msta->rc.lock);
+	if (msta->rc.tb)
+		ret_val = mmrc_set_fixed_rate(msta->rc.tb, fixed_rate);
+	spin_unlock_bh(&msta->rc.lock);
 
 	if (!ret_val)
 		MORSE_RC_ERR(mors, "%s failed, caller %s ss %d bw %d mcs %d guard %d\n",
@@ -412,19 +514,25 @@ bool _morse_rc_set_fixed_rate(struct morse *mors,
 	return ret_val;
 }
 
-void morse_rc_sta_remove(struct morse *mors, struct ieee80211_sta *sta)
+static void morse_rc_sta_remove_table(struct morse *mors, struct morse_sta *msta)
 {
-	struct morse_sta *msta = (struct morse_sta *)sta->drv_priv;
-
 	spin_lock_bh(&mors->mrc.lock);
+	spin_lock(&msta->rc.lock);
 	if (msta->rc.tb) {
 		list_del_init(&msta->rc.list);
+		mors->mrc.num_stas--;
 		kfree(msta->rc.tb);
 		msta->rc.tb = NULL;
 	}
+	spin_unlock(&msta->rc.lock);
 	spin_unlock_bh(&mors->mrc.lock);
 }
 
+void morse_rc_sta_remove(struct morse *mors, struct ieee80211_sta *sta)
+{
+	morse_rc_sta_remove_table(mors, (struct morse_sta *)sta->drv_priv);
+}
+
 static void morse_rc_sta_fill_basic_rates(struct morse_skb_tx_info *tx_info,
 					  struct ieee80211_tx_info *info, int tx_bw)
 {
@@ -454,23 +562,42 @@ static int morse_rc_sta_get_rates(struct morse *mors,
 				  struct mmrc_rate_table *rates, size_t size)
 {
 	int ret = -ENOENT;
-	struct list_head *pos;
 
-	spin_lock_bh(&mors->mrc.lock);
-	list_for_each(pos, &mors->mrc.stas) {
-		struct morse_rc_sta *mrc_sta = list_entry(pos, struct morse_rc_sta, list);
-
-		if (&msta->rc == mrc_sta) {
-			ret = 0;
-			mmrc_get_rates(msta->rc.tb, rates, size);
-			break;
-		}
+	/* The table hangs directly off the station, so only its own lock is needed */
+	spin_lock_bh(&msta->rc.lock);
+	if (msta->rc.tb) {
+		ret = 0;
+		mmrc_get_rates(msta->rc.tb, rates, size);
 	}
-	spin_unlock_bh(&mors->mrc.lock);
+	spin_unlock_bh(&msta->rc.lock);
 
 	return ret;
 }
 
+/* The rate control KUnit tests are built as a module of their own */
+#ifdef CONFIG_MORSE_RC_KUNIT_TEST
+int morse_rc_test_sta_add(struct morse *mors, struct morse_sta *msta,
+			  struct mmrc_sta_capabilities *caps)
+{
+	morse_rc_sta_init(msta);
+	return morse_rc_sta_add_table(mors, msta, caps);
+}
+EXPORT_SYMBOL(morse_rc_test_sta_add);
+
+void morse_rc_test_sta_remove(struct morse *mors, struct morse_sta *msta)
+{
+	morse_rc_sta_remove_table(mors, msta);
+}
+EXPORT_SYMBOL(morse_rc_test_sta_remove);
+
+int morse_rc_test_get_rates(struct morse *mors, struct morse_sta *msta,
+			    struct mmrc_rate_table *rates, size_t size)
+{
+	return morse_rc_sta_get_rates(mors, msta, rates, size);
+}
+EXPORT_SYMBOL(morse_rc_test_get_rates);
+#endif
+
 struct lowest_mcast_rate_iter {
 	const struct ieee80211_vif *on_vif;
 	bool is_set;
@@ -646,21 +773,14 @@ static void morse_rc_sta_set_rates(struct morse *mors,
 				   int attempts,
 				   bool is_agg_mode, u32 success, u32 failure)
 {
-	struct list_head *pos;
-
-	spin_lock_bh(&mors->mrc.lock);
-	list_for_each(pos, &mors->mrc.stas) {
-		struct morse_rc_sta *mrc_sta = list_entry(pos, struct morse_rc_sta, list);
-
-		if (&msta->rc == mrc_sta) {
-			if (is_agg_mode)
-				mmrc_feedback_agg(msta->rc.tb, rates, attempts, success, failure);
-			else
-				mmrc_feedback(msta->rc.tb, rates, attempts);
-			break;
-		}
+	spin_lock_bh(&msta->rc.lock);
+	if (msta->rc.tb) {
+		if (is_agg_mode)
+			mmrc_feedback_agg(msta->rc.tb, rates, attempts, success, failure);
+		else
+			mmrc_feedback(msta->rc.tb, rates, attempts);
 	}
-	spin_unlock_bh(&mors->mrc.lock);
+	spin_unlock_bh(&msta->rc.lock);
 }
 
 void morse_rc_sta_feedback_rates(struct morse *mors, struct sk_buff *skb,
@@ -744,7 +864,7 @@ exit:
 		txi->flags |= IEEE80211_TX_STAT_ACK;
 
 	if (le32_to_cpu(tx_sts->flags) & MORSE_TX_STATUS_FLAGS_PS_FILTERED) {
-		mors->debug.page_stats.tx_ps_filtered++;
+		MORSE_PAGE_STAT_INC(mors, tx_ps_filtered);
 		txi->flags |= IEEE80211_TX_STAT_TX_FILTERED;
 
 		/* Clear TX CTL AMPDU flag so that this frame gets rescheduled in
@@ -824,7 +944,7 @@ void morse_rc_sta_state_check(struct morse *mors,
 		morse_rc_sta_remove(mors, sta);
 	} else if (old_state < new_state &&
 		   old_state == IEEE80211_STA_NONE &&
-		   msta->rc.list.prev) {
+		   !list_empty(&msta->rc.list)) {
 		/* Special case for driver warning issue causing a sta to be left on the list */
 		MORSE_RC_INFO(mors, "Remove stale sta from rc list\n");
 		morse_rc_sta_remove(mors, sta);
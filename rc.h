@@ -16,16 +16,45 @@
 /* This initial value is for MMRC, and there is another in minstrel_rc.h for Minstrel */
 #define INIT_MAX_RATES_NUM 4
 
+/**
+ * struct morse_rc_update_stats - statistics of the periodic MMRC table updates
+ *
+ * @ticks: number of update ticks run.
+ * @updates: number of station tables updated.
+ * @max_per_tick: most station tables updated in a single tick.
+ * @backlogged_ticks: ticks that hit the per tick update budget while stations were still due,
+ *	leaving them for the next tick.
+ * @max_list_hold_ns: longest time the station list lock was held by a tick.
+ * @max_sta_hold_ns: longest time a station's lock was held for its table update, i.e. the
+ *	longest the TX path could have waited for rate control.
+ */
+struct morse_rc_update_stats {
+	u32 ticks;
+	u32 updates;
+	u32 max_per_tick;
+	u32 backlogged_ticks;
+	u64 max_list_hold_ns;
+	u64 max_sta_hold_ns;
+};
+
 struct morse_rc {
-	/* Serialise rate control queue manipulation and timer functions */
+	/*
+	 * Serialise manipulation of the stas list; nests outside morse_rc_sta::lock.
+	 * The list is kept in order of last update, least recent first.
+	 */
 	spinlock_t lock;
 	struct list_head stas;
+	/* Number of stations on the stas list, which sets the per tick update budget */
+	u32 num_stas;
 	struct timer_list timer;
 	struct work_struct work;
 	struct morse *mors;
+	struct morse_rc_update_stats stats;
 };
 
 struct morse_rc_sta {
+	/* Serialise access to the MMRC table of this station */
+	spinlock_t lock;
 	struct mmrc_table *tb;
 	struct list_head list;
 
@@ -36,6 +65,16 @@ int morse_rc_init(struct morse *mors);
 
 int morse_rc_deinit(struct morse *mors);
 
+/**
+ * morse_rc_sta_init() - Initialise the per-station rate control state.
+ *
+ * Must be called once when the station record is created, before any other
+ * rate control function is invoked on it.
+ *
+ * @msta: The morse station record
+ */
+void morse_rc_sta_init(struct morse_sta *msta);
+
 int morse_rc_sta_add(struct morse *mors, struct ieee80211_vif *vif, struct ieee80211_sta *sta);
 
 #define morse_rc_set_fixed_rate(mors, sta, mcs, bw, ss, guard) \
@@ -52,6 +91,42 @@ int morse_rc_get_fixed_guard(void);
 
 void morse_rc_sta_remove(struct morse *mors, struct ieee80211_sta *sta);
 
+#ifdef CONFIG_MORSE_RC_KUNIT_TEST
+/**
+ * morse_rc_test_sta_add() - Initialise a station and add its MMRC table, for the KUnit tests
+ *
+ * @mors: The morse chip struct, with an initialised mrc lock and station list
+ * @msta: The station record
+ * @caps: Capabilities to build the MMRC table for
+ *
+ * Return: 0 on success, else error code
+ */
+int morse_rc_test_sta_add(struct morse *mors, struct morse_sta *msta,
+			  struct mmrc_sta_capabilities *caps);
+
+/**
+ * morse_rc_test_sta_remove() - Remove the MMRC table of a station, for the KUnit tests
+ *
+ * @mors: The morse chip struct
+ * @msta: The station record
+ */
+void morse_rc_test_sta_remove(struct morse *mors, struct morse_sta *msta);
+
+/**
+ * morse_rc_test_get_rates() - Look up the rates of a station as the TX path does, for the
+ * KUnit tests
+ *
+ * @mors: The morse chip struct
+ * @msta: The station record
+ * @rates: Filled with the rate chain
+ * @size: Length of the frame to be sent
+ *
+ * Return: 0 on success, -ENOENT if the station has no MMRC table
+ */
+int morse_rc_test_get_rates(struct morse *mors, struct morse_sta *msta,
+			    struct mmrc_rate_table *rates, size_t size);
+#endif
+
 void morse_rc_sta_fill_tx_rates(struct morse *mors,
 				struct morse_skb_tx_info *tx_info,
 				struct sk_buff *skb,
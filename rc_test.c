@@ -0,0 +1,236 @@
+/*
+ * Copyright 2025 Morse Micro
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * KUnit tests for the MMRC station lookup. The TX path reaches a station's MMRC table through
+ * the station record and its own lock. These tests check that lookup as stations come and go,
+ * and report its cost against the walk of the station list, under the list lock, that it
+ * replaced.
+ */
+
+#include <kunit/test.h>
+#include <linux/device.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/random.h>
+#include <linux/timer.h>
+
+#include "rc.h"
+
+#define RC_TEST_MAX_STAS	(512)
+#define RC_TEST_LOOKUPS		(20000)
+/* Length of the frames the rates are chosen for */
+#define RC_TEST_FRAME_LEN	(1500)
+
+static const u32 rc_test_bench_stas[] = { 1, 16, 128, RC_TEST_MAX_STAS };
+
+struct rc_test_ctx {
+	struct device *dev;
+	struct morse *mors;
+	struct morse_sta *stas;
+	u32 num_stas;
+	struct rnd_state rnd;
+};
+
+/* Adding a station arms the update timer. The tests update no tables, so it does nothing */
+static void rc_test_timer(struct timer_list *t)
+{
+}
+
+static int rc_test_init(struct kunit *test)
+{
+	struct rc_test_ctx *ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+	struct device *dev;
+
+	if (!ctx)
+		return -ENOMEM;
+
+	ctx->mors = kunit_kzalloc(test, sizeof(*ctx->mors), GFP_KERNEL);
+	ctx->stas = kunit_kcalloc(test, RC_TEST_MAX_STAS, sizeof(*ctx->stas), GFP_KERNEL);
+	if (!ctx->mors || !ctx->stas)
+		return -ENOMEM;
+
+	/* Rate control logs against the device */
+	dev = root_device_register("morse_rc_test");
+	if (IS_ERR(dev))
+		return PTR_ERR(dev);
+	ctx->dev = dev;
+	ctx->mors->dev = dev;
+
+	INIT_LIST_HEAD(&ctx->mors->mrc.stas);
+	spin_lock_init(&ctx->mors->mrc.lock);
+	timer_setup(&ctx->mors->mrc.timer, rc_test_timer, 0);
+	ctx->mors->mrc.mors = ctx->mors;
+
+	prandom_seed_state(&ctx->rnd, 0x3c);
+	test->priv = ctx;
+	return 0;
+}
+
+static void rc_test_remove_all(struct rc_test_ctx *ctx)
+{
+	u32 i;
+
+	for (i = 0; i < ctx->num_stas; i++)
+		morse_rc_test_sta_remove(ctx->mors, &ctx->stas[i]);
+	ctx->num_stas = 0;
+}
+
+static void rc_test_exit(struct kunit *test)
+{
+	struct rc_test_ctx *ctx = test->priv;
+
+	if (!ctx)
+		return;
+
+	/* The MMRC tables are not managed by KUnit */
+	rc_test_remove_all(ctx);
+	del_timer_sync(&ctx->mors->mrc.timer);
+	root_device_unregister(ctx->dev);
+}
+
+/* A 2 MHz, single stream station supporting MCS 0 to 7 */
+static void rc_test_add_stas(struct kunit *test, u32 num_stas)
+{
+	struct rc_test_ctx *ctx = test->priv;
+	struct mmrc_sta_capabilities caps = {
+		.max_rates = IEEE80211_TX_MAX_RATES,
+		.max_retries = MMRC_MAX_CHAIN_ATTEMPTS,
+		.bandwidth = MMRC_MASK(MMRC_BW_1MHZ) | MMRC_MASK(MMRC_BW_2MHZ),
+		.spatial_streams = MMRC_MASK(0),
+		.rates = MMRC_MASK(MMRC_SUPP_NUM_MCS) - 1,
+		.guard = MMRC_MASK(MMRC_GUARD_LONG),
+	};
+
+	while (ctx->num_stas < num_stas)
+		KUNIT_ASSERT_EQ(test, morse_rc_test_sta_add(ctx->mors, &ctx->stas[ctx->num_stas++],
+							    &caps), 0);
+}
+
+/* The lookup as it was before the per-station lock: confirm membership of the list first */
+static int rc_test_get_rates_walk(struct morse *mors, struct morse_sta *msta,
+				  struct mmrc_rate_table *rates)
+{
+	struct morse_rc_sta *mrc_sta;
+	int ret = -ENOENT;
+
+	spin_lock_bh(&mors->mrc.lock);
+	list_for_each_entry(mrc_sta, &mors->mrc.stas, list) {
+		if (mrc_sta == &msta->rc) {
+			ret = morse_rc_test_get_rates(mors, msta, rates, RC_TEST_FRAME_LEN);
+			break;
+		}
+	}
+	spin_unlock_bh(&mors->mrc.lock);
+
+	return ret;
+}
+
+static u32 rc_test_list_len(struct morse *mors)
+{
+	struct morse_rc_sta *mrc_sta;
+	u32 len = 0;
+
+	spin_lock_bh(&mors->mrc.lock);
+	list_for_each_entry(mrc_sta, &mors->mrc.stas, list)
+		len++;
+	spin_unlock_bh(&mors->mrc.lock);
+
+	return len;
+}
+
+static void rc_test_add_remove(struct kunit *test)
+{
+	struct rc_test_ctx *ctx = test->priv;
+	struct mmrc_rate_table rates;
+	u32 i;
+
+	rc_test_add_stas(test, 64);
+	KUNIT_EXPECT_EQ(test, rc_test_list_len(ctx->mors), (u32)64);
+
+	for (i = 0; i < ctx->num_stas; i++)
+		KUNIT_EXPECT_EQ(test, morse_rc_test_get_rates(ctx->mors, &ctx->stas[i], &rates,
+							      RC_TEST_FRAME_LEN), 0);
+
+	/* Removing a station leaves the others reachable, and its own lookup fails cleanly */
+	for (i = 0; i < ctx->num_stas; i += 2)
+		morse_rc_test_sta_remove(ctx->mors, &ctx->stas[i]);
+	KUNIT_EXPECT_EQ(test, rc_test_list_len(ctx->mors), (u32)32);
+
+	for (i = 0; i < ctx->num_stas; i++) {
+		int expected = (i % 2) ? 0 : -ENOENT;
+
+		KUNIT_EXPECT_EQ(test, morse_rc_test_get_rates(ctx->mors, &ctx->stas[i], &rates,
+							      RC_TEST_FRAME_LEN), expected);
+		KUNIT_EXPECT_EQ(test, rc_test_get_rates_walk(ctx->mors, &ctx->stas[i], &rates),
+				expected);
+	}
+
+	/* Removing twice is harmless */
+	morse_rc_test_sta_remove(ctx->mors, &ctx->stas[0]);
+	KUNIT_EXPECT_EQ(test, rc_test_list_len(ctx->mors), (u32)32);
+}
+
+/* Time RC_TEST_LOOKUPS lookups of random stations, returning the mean in ns */
+static u64 rc_test_time_lookups(struct kunit *test, bool walk)
+{
+	struct rc_test_ctx *ctx = test->priv;
+	struct mmrc_rate_table rates;
+	u32 failures = 0;
+	u64 start_ns;
+	u32 i;
+
+	start_ns = ktime_get_ns();
+	for (i = 0; i < RC_TEST_LOOKUPS; i++) {
+		struct morse_sta *msta = &ctx->stas[prandom_u32_state(&ctx->rnd) % ctx->num_stas];
+		int ret;
+
+		if (walk)
+			ret = rc_test_get_rates_walk(ctx->mors, msta, &rates);
+		else
+			ret = morse_rc_test_get_rates(ctx->mors, msta, &rates, RC_TEST_FRAME_LEN);
+		if (ret)
+			failures++;
+	}
+	KUNIT_EXPECT_EQ(test, failures, (u32)0);
+
+	return div64_u64(ktime_get_ns() - start_ns, RC_TEST_LOOKUPS);
+}
+
+static void rc_test_lookup_bench(struct kunit *test)
+{
+	u32 i;
+
+	for (i = 0; i < ARRAY_SIZE(rc_test_bench_stas); i++) {
+		u64 direct_ns;
+		u64 walk_ns;
+
+		rc_test_add_stas(test, rc_test_bench_stas[i]);
+		direct_ns = rc_test_time_lookups(test, false);
+		walk_ns = rc_test_time_lookups(test, true);
+
+		kunit_info(test, "%u stations: %llu ns per lookup, %llu ns walking the list\n",
+			   rc_test_bench_stas[i], direct_ns, walk_ns);
+	}
+}
+
+static struct kunit_case rc_test_cases[] = {
+	KUNIT_CASE(rc_test_add_remove),
+	KUNIT_CASE(rc_test_lookup_bench),
+	{}
+};
+
+static struct kunit_suite rc_test_suite = {
+	.name = "morse_rc_lookup",
+	.init = rc_test_init,
+	.exit = rc_test_exit,
+	.test_cases = rc_test_cases,
+};
+
+kunit_test_suite(rc_test_suite);
+
+MODULE_AUTHOR("Morse Micro");
+MODULE_DESCRIPTION("KUnit tests for the Morse Micro MMRC station lookup");
+MODULE_LICENSE("Dual BSD/GPL");
@@ -25,7 +25,7 @@
 #include "firmware.h"
 #include "debug.h"
 #include "of.h"
-#include "bus_trace.h"
+#include "trace.h"
 
 #ifdef CONFIG_MORSE_USER_ACCESS
 #include "uaccess.h"
@@ -80,7 +80,8 @@ struct morse_sdio {
 	u32 register_addr_base;
 	struct sdio_func *func;
 	const struct sdio_device_id *id;
-	struct bus_trace trace;
+	/* Scratch table describing the portion of a gathered write sent by one CMD53 */
+	struct scatterlist sg_slice[MORSE_BUS_SG_MAX_ENTS];
 };
 
 #ifdef CONFIG_MORSE_USER_ACCESS
@@ -107,17 +108,14 @@ static void irq_handler(struct sdio_func *func1)
 	int handled;
 	struct sdio_func *func = func1->card->sdio_func[1];
 	struct morse *mors = sdio_get_drvdata(func);
-	struct morse_sdio *sdio = (struct morse_sdio *)mors->drv_priv;
 
 	MORSE_WARN_ON(FEATURE_ID_SDIO, !mors);
 
-	(void)sdio;
-
 	handled = morse_hw_irq_handle(mors);
 	if (!handled)
 		MORSE_SDIO_WARN(mors, "%s: nothing was handled\n", __func__);
 
-	bus_trace_log(&sdio->trace, BUS_TRACE_EVENT_ID_HANDLE_IRQ, func->num, 0, handled);
+	trace_morse_sdio(MORSE_TRACE_SDIO_HANDLE_IRQ, func->num, handled);
 }
 
 static int morse_sdio_enable_irq(struct morse_sdio *sdio)
@@ -132,7 +130,7 @@ static int morse_sdio_enable_irq(struct morse_sdio *sdio)
 	ret = sdio_claim_irq(func1, irq_handler);
 	if (ret)
 		MORSE_SDIO_ERR(mors, "Failed to enable sdio irq: %d\n", ret);
-	bus_trace_log(&sdio->trace, BUS_TRACE_EVENT_ID_EN_IRQ, func1->num, 0, (ret) ? 0 : 1);
+	trace_morse_sdio(MORSE_TRACE_SDIO_EN_IRQ, func1->num, (ret) ? 0 : 1);
 	sdio_release_host(func);
 	return ret;
 }
@@ -144,7 +142,7 @@ static void morse_sdio_disable_irq(struct morse_sdio *sdio)
 
 	sdio_claim_host(func);
 	sdio_release_irq(func1);
-	bus_trace_log(&sdio->trace, BUS_TRACE_EVENT_ID_EN_IRQ, func1->num, 0, 0);
+	trace_morse_sdio(MORSE_TRACE_SDIO_EN_IRQ, func1->num, 0);
 	sdio_release_host(func);
 }
 
@@ -167,7 +165,7 @@ static void morse_sdio_reset_base_address(struct morse_sdio *sdio)
 {
 	sdio->bulk_addr_base = MORSE_SDIO_BASE_ADDR_UNSET;
 	sdio->register_addr_base = MORSE_SDIO_BASE_ADDR_UNSET;
-	bus_trace_log(&sdio->trace, BUS_TRACE_EVENT_ID_RESET_BASE_ADDRESSES, 0, 0, 0);
+	trace_morse_sdio(MORSE_TRACE_SDIO_RESET_BASE, 0, 0);
 }
 
 static int morse_sdio_set_func_address_base(struct morse_sdio *sdio,
@@ -253,9 +251,8 @@ retry:
 	if (retries)
 		MORSE_SDIO_INFO(mors, "%s succeeded after %d retries\n", __func__, retries);
 
-	bus_trace_log(&sdio->trace, (bulk) ? BUS_TRACE_EVENT_ID_SET_BULK_BASE_ADDRESS :
-		      BUS_TRACE_EVENT_ID_SET_REG_BASE_ADDRESS,
-		      func_to_use->num, *current_addr_base, 4);
+	trace_morse_sdio((bulk) ? MORSE_TRACE_SDIO_SET_BULK_BASE : MORSE_TRACE_SDIO_SET_REG_BASE,
+			 func_to_use->num, *current_addr_base);
 	return ret;
 err:
 	retries++;
@@ -266,9 +263,8 @@ err:
 	}
 
 	*current_addr_base = MORSE_SDIO_BASE_ADDR_UNSET;
-	bus_trace_log(&sdio->trace, (bulk) ? BUS_TRACE_EVENT_ID_SET_BULK_BASE_ADDRESS :
-		      BUS_TRACE_EVENT_ID_SET_REG_BASE_ADDRESS,
-		      func_to_use->num, *current_addr_base, 4);
+	trace_morse_sdio((bulk) ? MORSE_TRACE_SDIO_SET_BULK_BASE : MORSE_TRACE_SDIO_SET_REG_BASE,
+			 func_to_use->num, *current_addr_base);
 	return ret;
 }
 
@@ -323,7 +319,6 @@ static int morse_sdio_regl_write(struct morse_sdio *sdio, u32 address, u32 value
 		goto exit;
 	}
 
-	bus_trace_log(&sdio->trace, BUS_TRACE_EVENT_ID_REG_WRITE, func_to_use->num, address, 4);
 	address &= 0x0000FFFF;	/* remove base and keep offset */
 	sdio_writel(func_to_use, (__force u32)cpu_to_le32(value),
 				(__force u32)cpu_to_le32(address), (int *)&ret);
@@ -359,7 +354,6 @@ static int morse_sdio_regl_read(struct morse_sdio *sdio, u32 address, u32 *value
 		goto exit;
 	}
 
-	bus_trace_log(&sdio->trace, BUS_TRACE_EVENT_ID_REG_READ, func_to_use->num, address, 4);
 	address &= 0x0000FFFF;	/* remove base and keep offset */
 	*value = sdio_readl(func_to_use,  (__force u32)cpu_to_le32(address), (int *)&ret);
 	/* return read size */
@@ -389,7 +383,6 @@ static int morse_sdio_mem_write(struct morse_sdio *sdio, u32 address, u8 *data,
 		goto exit;
 	}
 
-	bus_trace_log(&sdio->trace, BUS_TRACE_EVENT_ID_BULK_WRITE, func_to_use->num, address, size);
 	address &= 0x0000FFFF;	/* remove base and keep offset */
 	if (access == MORSE_CONFIG_ACCESS_4BYTE) {
 		if (unlikely(!IS_ALIGNED((uintptr_t)data, mors->bus_ops->bulk_alignment))) {
@@ -457,7 +450,6 @@ static int morse_sdio_mem_read(struct morse_sdio *sdio, u32 address, u8 *data, s
 		goto exit;
 	}
 
-	bus_trace_log(&sdio->trace, BUS_TRACE_EVENT_ID_BULK_READ, func_to_use->num, address, size);
 	address &= 0x0000FFFF;	/* remove base and keep offset */
 	if (access == MORSE_CONFIG_ACCESS_4BYTE) {
 		if (unlikely(!IS_ALIGNED((uintptr_t)data, mors->bus_ops->bulk_alignment))) {
@@ -533,6 +525,159 @@ err:
 	return -EIO;
 }
 
+/* Largest transfer which can be made with a byte mode CMD53 */
+static unsigned int morse_sdio_max_byte_size(struct sdio_func *func)
+{
+	return min3(func->card->host->max_blk_size, (unsigned int)func->cur_blksize, 512U);
+}
+
+/*
+ * Issue a single CMD53 write sourcing its data from a scatterlist. This mirrors what
+ * sdio_memcpy_toio() does internally for a linear buffer. A blocks value of 0 selects
+ * byte mode, in which case blksz is the transfer length.
+ */
+static int morse_sdio_cmd53_write_sg(struct sdio_func *func, u32 address,
+				     struct scatterlist *sgl, int nents,
+				     unsigned int blksz, unsigned int blocks)
+{
+	struct mmc_card *card = func->card;
+	struct mmc_request mrq = {};
+	struct mmc_command cmd = {};
+	struct mmc_data data = {};
+
+	cmd.opcode = SD_IO_RW_EXTENDED;
+	cmd.arg = 0x80000000;			/* write */
+	cmd.arg |= func->num << 28;
+	cmd.arg |= 0x04000000;			/* incrementing address */
+	cmd.arg |= (address & 0x1FFFF) << 9;
+	if (blocks)
+		cmd.arg |= 0x08000000 | blocks;	/* block mode */
+	else
+		cmd.arg |= (blksz == 512) ? 0 : blksz;
+	cmd.flags = MMC_RSP_SPI_R5 | MMC_RSP_R5 | MMC_CMD_ADTC;
+
+	data.blksz = blksz;
+	data.blocks = blocks ? blocks : 1;
+	data.flags = MMC_DATA_WRITE;
+	data.sg = sgl;
+	data.sg_len = nents;
+	mmc_set_data_timeout(&data, card);
+
+	mrq.cmd = &cmd;
+	mrq.data = &data;
+	mmc_wait_for_req(card->host, &mrq);
+
+	if (cmd.error)
+		return cmd.error;
+	if (data.error)
+		return data.error;
+	if (cmd.resp[0] & R5_ERROR)
+		return -EIO;
+	if (cmd.resp[0] & R5_FUNCTION_NUMBER)
+		return -EINVAL;
+	if (cmd.resp[0] & R5_OUT_OF_RANGE)
+		return -ERANGE;
+
+	return 0;
+}
+
+static int morse_sdio_mem_write_sg(struct morse_sdio *sdio, u32 address,
+				   struct scatterlist *sgl, int nents, u32 skip, u32 size)
+{
+	int ret;
+	struct sdio_func *func_to_use;
+	struct mmc_host *host;
+	unsigned int max_byte_size;
+	u32 done = 0;
+
+	func_to_use = morse_sdio_get_func(sdio, address, size, MORSE_CONFIG_ACCESS_4BYTE);
+	if (!func_to_use)
+		return -EIO;
+
+	address &= 0x0000FFFF;	/* remove base and keep offset */
+	host = func_to_use->card->host;
+	max_byte_size = morse_sdio_max_byte_size(func_to_use);
+
+	if (func_to_use->card->cccr.multi_block && size > max_byte_size) {
+		unsigned int blksz = func_to_use->cur_blksize;
+		unsigned int max_blocks = min3(host->max_blk_count, 511U,
+					       host->max_req_size / blksz);
+
+		while (size - done >= blksz) {
+			unsigned int blocks = min((size - done) / blksz, max_blocks);
+			int n = morse_bus_sg_slice(sgl, nents, skip + done, blocks * blksz,
+						   sdio->sg_slice, ARRAY_SIZE(sdio->sg_slice));
+
+			if (n < 0)
+				return n;
+
+			ret = morse_sdio_cmd53_write_sg(func_to_use, address + done,
+							sdio->sg_slice, n, blksz, blocks);
+			if (ret) {
+				sdio_log_err(sdio, "cmd53_write_sg", func_to_use->num,
+					     address + done, blocks * blksz, ret);
+				return ret;
+			}
+			done += blocks * blksz;
+		}
+	}
+
+	while (done < size) {
+		unsigned int len = min(size - done, max_byte_size);
+		int n = morse_bus_sg_slice(sgl, nents, skip + done, len,
+					   sdio->sg_slice, ARRAY_SIZE(sdio->sg_slice));
+
+		if (n < 0)
+			return n;
+
+		ret = morse_sdio_cmd53_write_sg(func_to_use, address + done,
+						sdio->sg_slice, n, len, 0);
+		if (ret) {
+			sdio_log_err(sdio, "cmd53_write_sg", func_to_use->num,
+				     address + done, len, ret);
+			return ret;
+		}
+		done += len;
+	}
+
+	return 0;
+}
+
+static int morse_sdio_dm_write_sg(struct morse *mors, u32 address, struct scatterlist *sgl,
+				  int nents, int len)
+{
+	int ret;
+	struct morse_sdio *sdio = (struct morse_sdio *)mors->drv_priv;
+	struct mmc_host *host = sdio->func->card->host;
+	int remaining = len;
+	int offset = 0;
+
+	if (WARN_ON(len < 0) || len % 4)
+		return -EINVAL;
+
+	/* Let the caller bounce the data if the host controller can't take the list as is */
+	if (nents > host->max_segs || !morse_bus_sg_check(mors, sgl, nents, host->max_seg_size))
+		return -EOPNOTSUPP;
+
+	while (remaining > 0) {
+		/*
+		 * We can only write up to the end of a single window in
+		 * each write operation.
+		 */
+		u32 window_end = (address + offset) | ~MORSE_SDIO_RW_ADDR_BOUNDARY_MASK;
+
+		len = min(remaining, (int)(window_end + 1 - address - offset));
+		ret = morse_sdio_mem_write_sg(sdio, address + offset, sgl, nents, offset, len);
+		if (ret)
+			return -EIO;
+
+		offset += len;
+		remaining -= len;
+	}
+
+	return 0;
+}
+
 static int morse_sdio_dm_read(struct morse *mors, u32 address, u8 *data, int len)
 {
 	int ret = 0;
@@ -632,7 +777,7 @@ static void morse_sdio_bus_enable(struct morse *mors, bool enable)
 	struct mmc_host *host = func->card->host;
 
 	sdio_claim_host(func);
-	bus_trace_log(&sdio->trace, BUS_TRACE_EVENT_ID_BUS_EN, func->num, 0, enable);
+	trace_morse_sdio(MORSE_TRACE_SDIO_BUS_EN, func->num, enable);
 
 	if (enable) {
 		/* No need to do anything special to re-enable the sdio bus. This will happen
@@ -709,6 +854,7 @@ static void morse_sdio_config_burst_mode(struct morse *mors, bool enable_burst)
 static const struct morse_bus_ops morse_sdio_ops = {
 	.dm_read = morse_sdio_dm_read,
 	.dm_write = morse_sdio_dm_write,
+	.dm_write_sg = morse_sdio_dm_write_sg,
 	.reg32_read = morse_sdio_reg32_read,
 	.reg32_write = morse_sdio_reg32_write,
 	.set_bus_enable = morse_sdio_bus_enable,
@@ -791,7 +937,6 @@ static int morse_sdio_probe(struct sdio_func *func, const struct sdio_device_id
 	sdio->func = func;
 	sdio->id = id;
 	sdio->enabled = true;
-	bus_trace_init(&sdio->trace);
 	morse_sdio_reset_base_address(sdio);
 
 	mors->bus_ops = &morse_sdio_ops;
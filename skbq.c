@@ -11,6 +11,12 @@
 #include <linux/ktime.h>
 #include <linux/skbuff.h>
 #include <linux/jiffies.h>
+#include <linux/version.h>
+#if KERNEL_VERSION(6, 12, 0) <= LINUX_VERSION_CODE
+#include <linux/unaligned.h>
+#else
+#include <asm/unaligned.h>
+#endif
 
 #include "morse.h"
 #include "debug.h"
@@ -21,6 +27,7 @@
 #include "ipmon.h"
 #include "wiphy.h"
 #include "bus.h"
+#include "trace.h"
 
 /* Enable/Disable avoid buffer bloating */
 static uint max_txq_len __read_mostly = 32;
@@ -37,6 +44,10 @@ module_param(tx_status_lifetime_ms, uint, 0644);
 MODULE_PARM_DESC(tx_status_lifetime_ms,
 		 "Maximum lifetime (ms) for pending Tx packets before considered dropped");
 
+static bool enable_rx_napi __read_mostly = true;
+module_param(enable_rx_napi, bool, 0444);
+MODULE_PARM_DESC(enable_rx_napi, "Deliver received data frames to mac80211 through NAPI");
+
 #define MORSE_SKB_DBG(_m, _f, _a...)		morse_dbg(FEATURE_ID_SKB, _m, _f, ##_a)
 #define MORSE_SKB_INFO(_m, _f, _a...)		morse_info(FEATURE_ID_SKB, _m, _f, ##_a)
 #define MORSE_SKB_WARN(_m, _f, _a...)		morse_warn(FEATURE_ID_SKB, _m, _f, ##_a)
@@ -93,7 +104,7 @@ morse_skb_tx_status_to_tx_control(struct morse *mors, struct sk_buff *skb,
 			txi->flags |= IEEE80211_TX_STAT_ACK;
 
 	if (tx_sts->flags & MORSE_TX_STATUS_FLAGS_PS_FILTERED) {
-		mors->debug.page_stats.tx_ps_filtered++;
+		MORSE_PAGE_STAT_INC(mors, tx_ps_filtered);
 		txi->flags |= IEEE80211_TX_STAT_TX_FILTERED;
 
 		MORSE_SKB_DBG(mors, "from_chip ps filtered [sn:%d]%s\n",
@@ -131,9 +142,9 @@ morse_skb_tx_status_to_tx_control(struct morse *mors, struct sk_buff *skb,
 
 			/* Update MCS0/10 failure stats. */
 			if (mcs_index == 0)
-				mors->debug.mcs_stats_tbl.mcs0.tx_fail += tx_sts->rates[i].count;
+				MORSE_MCS_STAT_ADD(mors, mcs0.tx_fail, tx_sts->rates[i].count);
 			if (mcs_index == 10)
-				mors->debug.mcs_stats_tbl.mcs10.tx_fail += tx_sts->rates[i].count;
+				MORSE_MCS_STAT_ADD(mors, mcs10.tx_fail, tx_sts->rates[i].count);
 		} else {
 			r[i].idx = -1;
 		}
@@ -144,11 +155,11 @@ morse_skb_tx_status_to_tx_control(struct morse *mors, struct sk_buff *skb,
 		u8 mcs_index = morse_ratecode_mcs_index_get(tx_sts->rates[i].morse_ratecode);
 
 		if (mcs_index == 0) {
-			mors->debug.mcs_stats_tbl.mcs0.tx_success++;
-			mors->debug.mcs_stats_tbl.mcs0.tx_fail--;
+			MORSE_MCS_STAT_INC(mors, mcs0.tx_success);
+			MORSE_MCS_STAT_DEC(mors, mcs0.tx_fail);
 		} else if (mcs_index == 10) {
-			mors->debug.mcs_stats_tbl.mcs10.tx_success++;
-			mors->debug.mcs_stats_tbl.mcs10.tx_fail--;
+			MORSE_MCS_STAT_INC(mors, mcs10.tx_success);
+			MORSE_MCS_STAT_DEC(mors, mcs10.tx_fail);
 		}
 	}
 }
@@ -236,6 +247,38 @@ static int __morse_skbq_put(struct morse_skbq *mq, struct sk_buff_head *queue,
 	return 0;
 }
 
+static inline struct sk_buff **__skbq_pending_idx_slot(struct morse_skbq *mq, u32 pkt_id)
+{
+	return &mq->pending_idx[pkt_id & (MORSE_SKBQ_PENDING_IDX_SIZE - 1)];
+}
+
+/*
+ * Index a pending SKB by its packet ID. If the slot is already taken by an older packet
+ * (more than MORSE_SKBQ_PENDING_IDX_SIZE outstanding) the SKB is left unindexed and will be
+ * found by walking the pending list instead.
+ */
+static void __skbq_pending_idx_add(struct morse_skbq *mq, struct sk_buff *skb)
+{
+	struct morse_buff_skb_header *hdr = (struct morse_buff_skb_header *)skb->data;
+	struct sk_buff **slot = __skbq_pending_idx_slot(mq, le32_to_cpu(hdr->tx_info.pkt_id));
+
+	if (!*slot)
+		*slot = skb;
+}
+
+static void __skbq_pending_idx_del(struct morse_skbq *mq, struct sk_buff *skb, u32 pkt_id)
+{
+	struct sk_buff **slot = __skbq_pending_idx_slot(mq, pkt_id);
+
+	if (*slot == skb)
+		*slot = NULL;
+}
+
+static inline void __skbq_pending_idx_reset(struct morse_skbq *mq)
+{
+	memset(mq->pending_idx, 0, sizeof(mq->pending_idx));
+}
+
 static void __morse_skbq_pkt_id(struct morse_skbq *mq, struct sk_buff *skb)
 {
 	struct morse_buff_skb_header *hdr = (struct morse_buff_skb_header *)skb->data;
@@ -353,10 +396,9 @@ static void morse_skbq_sta_eosp(struct morse *mors, struct sk_buff *skb)
 	}
 }
 
-static void __skbq_drop_pending_skb(struct morse_skbq *mq, struct sk_buff *skb)
+/* Report a frame which has been taken off the pending queue as dropped, and free it */
+static void __skbq_drop_tx_skb(struct morse_skbq *mq, struct sk_buff *skb)
 {
-	__morse_skbq_unlink(mq, &mq->pending, skb);
-
 	if (is_fullmac_mode()) {
 		struct morse_vif *mors_vif = morse_wiphy_get_sta_vif(mq->mors);
 		struct wireless_dev *wdev = &mors_vif->wdev;
@@ -373,7 +415,16 @@ static void __skbq_drop_pending_skb(struct morse_skbq *mq, struct sk_buff *skb)
 	}
 
 	morse_flush_txskb(mq->mors, skb);
-	mq->mors->debug.page_stats.tx_status_dropped++;
+	MORSE_PAGE_STAT_INC(mq->mors, tx_status_dropped);
+}
+
+static void __skbq_drop_pending_skb(struct morse_skbq *mq, struct sk_buff *skb)
+{
+	struct morse_buff_skb_header *mhdr = (struct morse_buff_skb_header *)skb->data;
+
+	__skbq_pending_idx_del(mq, skb, le32_to_cpu(mhdr->tx_info.pkt_id));
+	__morse_skbq_unlink(mq, &mq->pending, skb);
+	__skbq_drop_tx_skb(mq, skb);
 }
 
 static bool tx_skb_is_ps_filtered(struct morse_skbq *mq, struct sk_buff *skb,
@@ -421,7 +472,14 @@ static void morse_skbq_tx_status_process(struct morse *mors, struct sk_buff *skb
 	int i;
 	struct morse_skb_tx_status *tx_sts = (struct morse_skb_tx_status *)skb->data;
 	int count = skb->len / sizeof(*tx_sts);
+	int unmatched = 0;
+	struct morse_skbq *locked_mq = NULL;
+	ktime_t start = morse_trace_start(morse_tx_status_batch);
 
+	/*
+	 * Statuses in a batch usually belong to the same queue, so hold the queue lock across
+	 * consecutive statuses and only cycle it when the queue changes.
+	 */
 	for (i = 0; i < count; tx_sts++, i++) {
 		struct sk_buff *tx_skb;
 		struct morse_skbq *mq = __morse_skbq_match_tx_status_to_skbq(mors, tx_sts);
@@ -431,39 +489,42 @@ static void morse_skbq_tx_status_process(struct morse *mors, struct sk_buff *skb
 		if (!mq) {
 			MORSE_SKB_DBG(mors, "No pending skbq match found [pktid:%d chan:%d]\n",
 				      tx_sts->pkt_id, tx_sts->channel);
+			unmatched++;
 			continue;
 		}
 
-		spin_lock_bh(&mq->lock);
+		if (mq != locked_mq) {
+			if (locked_mq)
+				spin_unlock_bh(&locked_mq->lock);
+			spin_lock_bh(&mq->lock);
+			locked_mq = mq;
+		}
+
 		tx_skb = __skbq_get_pending_by_id(mors, mq, le32_to_cpu(tx_sts->pkt_id));
 		if (!tx_skb) {
 			MORSE_SKB_DBG(mors, "No pending pkt match found [pktid:%d chan:%d]\n",
 				      tx_sts->pkt_id, tx_sts->channel);
-			spin_unlock_bh(&mq->lock);
+			unmatched++;
 			continue;
 		}
 
 		if (le32_to_cpu(tx_sts->flags) & MORSE_TX_STATUS_PAGE_INVALID) {
 			/* Drop invalid SKBs */
-			mors->debug.page_stats.tx_status_page_invalid++;
+			MORSE_PAGE_STAT_INC(mors, tx_status_page_invalid);
 			__skbq_drop_pending_skb(mq, tx_skb);
-			spin_unlock_bh(&mq->lock);
 			continue;
 		}
 
 		if (le32_to_cpu(tx_sts->flags) & MORSE_TX_STATUS_DUTY_CYCLE_CANT_SEND) {
 			/* Drop SKBs that can't be sent due to duty cycle restrictions  */
-			mors->debug.page_stats.tx_status_duty_cycle_cant_send++;
+			MORSE_PAGE_STAT_INC(mors, tx_status_duty_cycle_cant_send);
 			__skbq_drop_pending_skb(mq, tx_skb);
-			spin_unlock_bh(&mq->lock);
 			continue;
 		}
 
-		if (is_ps_filtered && tx_skb_is_ps_filtered(mq, tx_skb, tx_sts)) {
+		if (is_ps_filtered && tx_skb_is_ps_filtered(mq, tx_skb, tx_sts))
 			/* Has been consumed by tx_skb_is_ps_filtered */
-			spin_unlock_bh(&mq->lock);
 			continue;
-		}
 
 		morse_skb_remove_hdr_after_sent_to_chip(tx_skb);
 
@@ -471,10 +532,13 @@ static void morse_skbq_tx_status_process(struct morse *mors, struct sk_buff *skb
 			morse_skbq_skb_finish_fullmac(mq, tx_skb, tx_sts);
 		else
 			morse_skbq_skb_finish(mq, tx_skb, tx_sts);
-
-		spin_unlock_bh(&mq->lock);
 	}
 
+	if (locked_mq)
+		spin_unlock_bh(&locked_mq->lock);
+
+	trace_morse_tx_status_batch(count, unmatched, start);
+
 	if (mors->ps.enable &&
 	    !mors->ps.suspended && (mors->cfg->ops->skbq_get_tx_buffered_count(mors) == 0)) {
 		/* Evaluate ps to check if it was gated on a pending tx status */
@@ -494,7 +558,14 @@ static void morse_skbq_dispatch_work(struct work_struct *dispatch_work)
 
 	__skb_queue_head_init(&skbq);
 
-	morse_skbq_deq_num_items(mq, &skbq, morse_skbq_count(mq));
+	/* With NAPI the poll owns the queue, only the frames it deferred are handled here */
+	if (mq->napi) {
+		spin_lock_bh(&mq->napi->deferred.lock);
+		skb_queue_splice_tail_init(&mq->napi->deferred, &skbq);
+		spin_unlock_bh(&mq->napi->deferred.lock);
+	} else {
+		morse_skbq_deq_num_items(mq, &skbq, morse_skbq_count(mq));
+	}
 
 	skb_queue_walk_safe(&skbq, pfirst, pnext) {
 		__skb_unlink(pfirst, &skbq);
@@ -525,16 +596,194 @@ static void morse_skbq_dispatch_work(struct work_struct *dispatch_work)
 			}
 			fallthrough;
 		default:
-			morse_mac_skb_recv(mors, pfirst, &hdr->rx_status);
+			morse_mac_skb_recv(mors, pfirst, &hdr->rx_status, NULL);
 			break;
 		}
 	}
 
+	/*
+	 * The poll defers nothing more while deferring is set, so everything it handed over
+	 * has been delivered. Give delivery back to it, and it reruns recv once drained.
+	 */
+	if (mq->napi) {
+		spin_lock_bh(&mq->napi->deferred.lock);
+		mq->napi->deferring = false;
+		spin_unlock_bh(&mq->napi->deferred.lock);
+		morse_skbq_rx_schedule(mq);
+		return;
+	}
+
 	/* rerun recv in case skbq was full and we couldn't copy data */
 	set_bit(MORSE_RX_PEND, &mors->chip_if->event_flags);
 	queue_work(mors->chip_wq, &mors->chip_if_work);
 }
 
+/*
+ * Only plain data frames are delivered from the poll. Everything else may sleep on the way to
+ * mac80211 (management frame rewriting, PV1 conversion, monitor mode), so is left to the
+ * dispatch work along with the frames received after it.
+ */
+static bool morse_skbq_napi_can_deliver(struct morse *mors, struct sk_buff *skb)
+{
+	const struct morse_buff_skb_header *hdr = (const struct morse_buff_skb_header *)skb->data;
+	const struct ieee80211_hdr *wlan_hdr;
+	int hdr_len = sizeof(*hdr) + hdr->offset;
+
+	if (hdr->channel != MORSE_SKB_CHAN_DATA && hdr->channel != MORSE_SKB_CHAN_DATA_NOACK)
+		return false;
+
+#ifdef CONFIG_MORSE_MONITOR
+	if (mors->monitor_mode)
+		return false;
+#endif
+
+	if (skb_headlen(skb) < hdr_len + sizeof(wlan_hdr->frame_control))
+		return false;
+
+	wlan_hdr = (const struct ieee80211_hdr *)(skb->data + hdr_len);
+
+	return !morse_dot11ah_is_pv1_qos_data(le16_to_cpu(wlan_hdr->frame_control)) &&
+	       ieee80211_is_data(wlan_hdr->frame_control);
+}
+
+static int morse_skbq_napi_poll(struct napi_struct *napi, int budget)
+{
+	struct morse_skbq_napi *mq_napi = container_of(napi, struct morse_skbq_napi, napi);
+	struct morse_skbq *mq = mq_napi->mq;
+	struct morse *mors = mq->mors;
+	struct morse_buff_skb_header *hdr;
+	struct sk_buff_head skbq;
+	struct sk_buff *pfirst, *pnext;
+	bool deferring;
+	int done = 0;
+
+	__skb_queue_head_init(&skbq);
+
+	/*
+	 * Once a frame is deferred, the dispatch work delivers everything after it too and
+	 * reschedules the poll when it is done, keeping a single ordered path to mac80211.
+	 */
+	spin_lock(&mq_napi->deferred.lock);
+	deferring = mq_napi->deferring;
+	spin_unlock(&mq_napi->deferred.lock);
+	if (deferring) {
+		napi_complete_done(napi, 0);
+		return 0;
+	}
+
+	morse_skbq_deq_num_items(mq, &skbq, budget);
+
+	skb_queue_walk_safe(&skbq, pfirst, pnext) {
+		if (!morse_skbq_napi_can_deliver(mors, pfirst)) {
+			deferring = true;
+			break;
+		}
+
+		__skb_unlink(pfirst, &skbq);
+		hdr = (struct morse_buff_skb_header *)pfirst->data;
+		__skb_pull(pfirst, sizeof(*hdr) + hdr->offset);
+		morse_mac_skb_recv(mors, pfirst, &hdr->rx_status, napi);
+		done++;
+	}
+
+	if (deferring) {
+		spin_lock(&mq_napi->deferred.lock);
+		skb_queue_splice_tail_init(&skbq, &mq_napi->deferred);
+		mq_napi->deferring = true;
+		spin_unlock(&mq_napi->deferred.lock);
+		queue_work(mors->net_wq, &mq->dispatch_work);
+
+		/* At least one frame was deferred, so done is below budget */
+		napi_complete_done(napi, done);
+		return done;
+	}
+
+	if (done == budget)
+		return budget;
+
+	/* The queue is drained. Rerun recv in case it was full and we couldn't copy data. */
+#if KERNEL_VERSION(4, 10, 0) <= LINUX_VERSION_CODE
+	if (!napi_complete_done(napi, done))
+		return done;
+#else
+	napi_complete_done(napi, done);
+#endif
+	set_bit(MORSE_RX_PEND, &mors->chip_if->event_flags);
+	queue_work(mors->chip_wq, &mors->chip_if_work);
+
+	return done;
+}
+
+int morse_skbq_napi_init(struct morse_skbq *mq)
+{
+	struct morse_skbq_napi *mq_napi;
+	struct net_device *dev;
+
+	if (!enable_rx_napi || !(mq->flags & MORSE_CHIP_IF_FLAGS_DIR_TO_HOST))
+		return 0;
+
+	mq_napi = kzalloc(sizeof(*mq_napi), GFP_KERNEL);
+	if (!mq_napi)
+		return -ENOMEM;
+
+#if KERNEL_VERSION(6, 9, 0) <= LINUX_VERSION_CODE
+	dev = alloc_netdev_dummy(0);
+#else
+	dev = kzalloc(sizeof(*dev), GFP_KERNEL);
+	if (dev)
+		init_dummy_netdev(dev);
+#endif
+	if (!dev) {
+		kfree(mq_napi);
+		return -ENOMEM;
+	}
+
+	mq_napi->dev = dev;
+	mq_napi->mq = mq;
+	skb_queue_head_init(&mq_napi->deferred);
+
+#if KERNEL_VERSION(6, 1, 0) <= LINUX_VERSION_CODE
+	netif_napi_add(dev, &mq_napi->napi, morse_skbq_napi_poll);
+#else
+	netif_napi_add(dev, &mq_napi->napi, morse_skbq_napi_poll, NAPI_POLL_WEIGHT);
+#endif
+	napi_enable(&mq_napi->napi);
+
+	mq->napi = mq_napi;
+	return 0;
+}
+
+static void morse_skbq_napi_finish(struct morse_skbq *mq)
+{
+	struct morse_skbq_napi *mq_napi = mq->napi;
+
+	napi_disable(&mq_napi->napi);
+	netif_napi_del(&mq_napi->napi);
+	cancel_work_sync(&mq->dispatch_work);
+	skb_queue_purge(&mq_napi->deferred);
+
+#if KERNEL_VERSION(6, 9, 0) <= LINUX_VERSION_CODE
+	free_netdev(mq_napi->dev);
+#else
+	kfree(mq_napi->dev);
+#endif
+	kfree(mq_napi);
+	mq->napi = NULL;
+}
+
+void morse_skbq_rx_schedule(struct morse_skbq *mq)
+{
+	if (!mq->napi) {
+		queue_work(mq->mors->net_wq, &mq->dispatch_work);
+		return;
+	}
+
+	/* Called from process context, so let the softirq run as soon as bh are enabled */
+	local_bh_disable();
+	napi_schedule(&mq->napi->napi);
+	local_bh_enable();
+}
+
 void morse_skb_remove_hdr_after_sent_to_chip(struct sk_buff *skb)
 {
 	skb_pull(skb, sizeof(struct morse_buff_skb_header) +
@@ -611,7 +860,7 @@ void morse_skbq_purge_aged(struct morse *mors, struct morse_skbq *mq)
 
 	spin_unlock_bh(&mq->lock);
 
-	mors->debug.page_stats.tx_aged_out += dropped;
+	MORSE_PAGE_STAT_ADD(mors, tx_aged_out, dropped);
 }
 
 int morse_skbq_purge(struct morse_skbq *mq, struct sk_buff_head *skbq)
@@ -627,6 +876,9 @@ int morse_skbq_purge(struct morse_skbq *mq, struct sk_buff_head *skbq)
 		dev_kfree_skb_any(skb);
 	}
 
+	if (mq && skbq == &mq->pending)
+		__skbq_pending_idx_reset(mq);
+
 	if (mq)
 		spin_unlock_bh(&mq->lock);
 
@@ -715,7 +967,7 @@ void morse_skbq_stop_tx_queues(struct morse *mors)
 	if (mors->custom_configs.enable_airtime_fairness)
 		return;
 
-	mors->debug.page_stats.queue_stop++;
+	MORSE_PAGE_STAT_INC(mors, queue_stop);
 	for (queue = IEEE80211_AC_VO; queue <= IEEE80211_AC_BK; queue++)
 		ieee80211_stop_queue(mors->hw, queue);
 
@@ -801,7 +1053,7 @@ static int morse_skbq_tx(struct morse_skbq *mq, struct sk_buff *skb, u8 channel)
 		if (channel == MORSE_SKB_CHAN_DATA)
 			morse_ipmon(&time_start, skb, skb->data + sizeof(*hdr),
 				    le16_to_cpu(hdr->len), IPMON_LOC_CLIENT_DRV2,
-				    mors->debug.page_stats.queue_stop);
+				    MORSE_PAGE_STAT_READ(mors, queue_stop));
 	}
 #endif
 
@@ -860,6 +1112,10 @@ static inline void __skbq_tx_move_to_pending(struct morse_skbq *mq, struct sk_bu
 	 */
 	pend_info->tx_status_expiry = jiffies + msecs_to_jiffies(tx_status_lifetime_ms);
 	__morse_skbq_put(mq, &mq->pending, skb, false, NULL);
+
+	/* Commands are matched on their response, not by tx_status */
+	if (!(mq->flags & MORSE_CHIP_IF_FLAGS_COMMAND))
+		__skbq_pending_idx_add(mq, skb);
 }
 
 /**
@@ -952,39 +1208,114 @@ struct sk_buff *morse_skbq_tx_pending(struct morse_skbq *mq)
 	return pfirst;
 }
 
-/* Get a pending frame by its ID. This will also drop frames with
- * older packet ids that are in the list
+/*
+ * Find a pending frame by its ID, taking it out of the pkt_id index. Frames with older packet
+ * ids which have timed out are moved to @aged for the caller to drop. Older frames which have
+ * not timed out are kept, as returned TX statuses may appear out-of-order during AMPDU.
+ *
+ * An indexed frame is found without walking the whole pending list, but the frames ahead of
+ * it are still aged. Frames join the list in packet id order, so that walk stops at the frame
+ * itself or at the first newer one, and in the steady state only visits the head. Timed out
+ * frames queued out of order behind it are left to morse_skbq_check_for_stale_tx(). A frame
+ * which is not indexed is searched for over the whole list, aging as it goes.
  */
-static struct sk_buff *__skbq_get_pending_by_id(struct morse *mors,
-						struct morse_skbq *mq,
-						u32 pkt_id)
+static struct sk_buff *__skbq_find_pending_by_id(struct morse_skbq *mq, u32 pkt_id,
+						 struct sk_buff_head *aged)
 {
+	struct sk_buff **slot = __skbq_pending_idx_slot(mq, pkt_id);
 	struct sk_buff *pfirst, *pnext;
 	struct sk_buff *ret = NULL;
 
-	/* Move sent packets to pending list waiting for feedback */
-	skb_queue_walk_safe(&mq->pending, pfirst, pnext) {
-		struct morse_buff_skb_header *hdr;
+	if (*slot) {
+		struct morse_buff_skb_header *hdr = (struct morse_buff_skb_header *)(*slot)->data;
 
-		hdr = (struct morse_buff_skb_header *)pfirst->data;
 		if (le32_to_cpu(hdr->tx_info.pkt_id) == pkt_id) {
+			ret = *slot;
+			*slot = NULL;
+		}
+	}
+
+	skb_queue_walk_safe(&mq->pending, pfirst, pnext) {
+		struct morse_buff_skb_header *hdr = (struct morse_buff_skb_header *)pfirst->data;
+		u32 id = le32_to_cpu(hdr->tx_info.pkt_id);
+
+		if (id == pkt_id) {
 			ret = pfirst;
 			break;
+		}
 
-		} else if (le32_to_cpu(hdr->tx_info.pkt_id) < pkt_id &&
-					__has_pending_tx_skb_timed_out(pfirst)) {
-			/* Returned TX statuses may appear out-of-order during AMPDU */
-			MORSE_SKB_DBG(mors,
-				      "%s: pending TX SKB timed out [id:%d,chan:%d] (curr:%d)\n",
-				      __func__, hdr->tx_info.pkt_id, hdr->channel, pkt_id);
-			__skbq_drop_pending_skb(mq, pfirst);
-			mq->mors->debug.page_stats.tx_status_flushed++;
+		if (id > pkt_id) {
+			if (ret)
+				break;
+			continue;
+		}
+
+		if (__has_pending_tx_skb_timed_out(pfirst)) {
+			__skbq_pending_idx_del(mq, pfirst, id);
+			__morse_skbq_unlink(mq, &mq->pending, pfirst);
+			__skb_queue_tail(aged, pfirst);
 		}
 	}
 
 	return ret;
 }
 
+/* Get a pending frame by its ID, dropping frames with older packet ids that have timed out */
+static struct sk_buff *__skbq_get_pending_by_id(struct morse *mors,
+						struct morse_skbq *mq,
+						u32 pkt_id)
+{
+	struct sk_buff_head aged;
+	struct sk_buff *skb;
+	struct sk_buff *ret;
+
+	__skb_queue_head_init(&aged);
+	ret = __skbq_find_pending_by_id(mq, pkt_id, &aged);
+
+	while ((skb = __skb_dequeue(&aged))) {
+		struct morse_buff_skb_header *hdr = (struct morse_buff_skb_header *)skb->data;
+
+		MORSE_SKB_DBG(mors, "%s: pending TX SKB timed out [id:%d,chan:%d] (curr:%d)\n",
+			      __func__, hdr->tx_info.pkt_id, hdr->channel, pkt_id);
+		__skbq_drop_tx_skb(mq, skb);
+		MORSE_PAGE_STAT_INC(mq->mors, tx_status_flushed);
+	}
+
+	return ret;
+}
+
+/* The skbq KUnit tests are built as a module of their own */
+#ifdef CONFIG_MORSE_SKBQ_KUNIT_TEST
+void morse_skbq_test_init(struct morse *mors, struct morse_skbq *mq, u16 flags)
+{
+	morse_skbq_init(mors, mq, flags);
+}
+EXPORT_SYMBOL(morse_skbq_test_init);
+
+void morse_skbq_test_add_pending(struct morse_skbq *mq, struct sk_buff *skb,
+				 unsigned long expiry)
+{
+	spin_lock_bh(&mq->lock);
+	__skbq_tx_move_to_pending(mq, skb);
+	__get_tx_status_driver_data(skb)->tx_status_expiry = expiry;
+	spin_unlock_bh(&mq->lock);
+}
+EXPORT_SYMBOL(morse_skbq_test_add_pending);
+
+struct sk_buff *morse_skbq_test_find_pending(struct morse_skbq *mq, u32 pkt_id,
+					     struct sk_buff_head *aged)
+{
+	struct sk_buff *skb;
+
+	spin_lock_bh(&mq->lock);
+	skb = __skbq_find_pending_by_id(mq, pkt_id, aged);
+	spin_unlock_bh(&mq->lock);
+
+	return skb;
+}
+EXPORT_SYMBOL(morse_skbq_test_find_pending);
+#endif
+
 int morse_skbq_check_for_stale_tx(struct morse *mors, struct morse_skbq *mq)
 {
 	int flushed = 0;
@@ -1004,7 +1335,7 @@ int morse_skbq_check_for_stale_tx(struct morse *mors, struct morse_skbq *mq)
 				      __func__, hdr->tx_info.pkt_id, hdr->channel);
 
 			__skbq_drop_pending_skb(mq, pfirst);
-			mq->mors->debug.page_stats.tx_status_flushed++;
+			MORSE_PAGE_STAT_INC(mq->mors, tx_status_flushed);
 			flushed++;
 		}
 	}
@@ -1259,6 +1590,7 @@ static int __skbq_data_tx_finish(struct morse_skbq *mq, struct sk_buff *skb,
 		txi = IEEE80211_SKB_CB(skb);
 		hdr = (struct ieee80211_hdr *)skb->data;
 		tx_attempts = morse_mac_get_tx_attempts(mors, tx_sts);
+		morse_debug_tx_lat_end(mors, skb);
 
 		/* Must be held while finding and dereferencing sta */
 		rcu_read_lock();
@@ -1309,6 +1641,7 @@ int morse_skbq_tx_flush(struct morse_skbq *mq)
 		__morse_skbq_unlink(mq, &mq->pending, pfirst);
 		morse_flush_txskb(mq->mors, pfirst);
 	}
+	__skbq_pending_idx_reset(mq);
 
 	skb_queue_walk_safe(&mq->skbq, pfirst, pnext) {
 		cnt++;
@@ -1326,10 +1659,12 @@ void morse_skbq_init(struct morse *mors, struct morse_skbq *mq, u16 flags)
 	spin_lock_init(&mq->lock);
 	__skb_queue_head_init(&mq->skbq);
 	__skb_queue_head_init(&mq->pending);
+	__skbq_pending_idx_reset(mq);
 	mq->mors = mors;
 	mq->skbq_size = 0;
 	mq->flags = flags;
 	mq->pkt_seq = 0;
+	mq->napi = NULL;
 	if (flags & MORSE_CHIP_IF_FLAGS_DIR_TO_HOST)
 		INIT_WORK(&mq->dispatch_work, morse_skbq_dispatch_work);
 }
@@ -1340,6 +1675,8 @@ void morse_skbq_finish(struct morse_skbq *mq)
 		MORSE_SKB_INFO(mq->mors, "Purging a non empty MorseQ. Dropping data!");
 
 	/* Clean up link to chip_if */
+	if (mq->napi)
+		morse_skbq_napi_finish(mq);
 	if (mq->flags & MORSE_CHIP_IF_FLAGS_DIR_TO_HOST)
 		cancel_work_sync(&mq->dispatch_work);
 	morse_skbq_purge(mq, &mq->skbq);
@@ -1459,6 +1796,8 @@ int morse_skbq_skb_tx(struct morse_skbq *mq, struct sk_buff **skb_orig,
 	}
 
 	set_queued_tx_skb_expiry(skb);
+	if (channel != MORSE_SKB_CHAN_COMMAND)
+		morse_debug_tx_lat_start(skb);
 
 	if (morse_skbq_mon)
 		morse_skbq_mon_adjust(mors, skb, 1);
@@ -1513,7 +1852,7 @@ void morse_skbq_data_traffic_resume(struct morse *mors)
 	set_bit(MORSE_TX_DATA_PEND, &mors->chip_if->event_flags);
 }
 
-bool morse_validate_skb_checksum(u8 *data)
+bool morse_validate_skb_checksum_ref(u8 *data)
 {
 	struct morse_buff_skb_header *skb_hdr = (struct morse_buff_skb_header *)data;
 	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)(data + sizeof(*skb_hdr));
@@ -1549,3 +1888,148 @@ bool morse_validate_skb_checksum(u8 *data)
 
 	return xor == header_xor;
 }
+
+/* Number of words covered by the checksum of the packet starting at @data */
+static int morse_skb_checksum_words(const u8 *data)
+{
+	const struct morse_buff_skb_header *skb_hdr = (const struct morse_buff_skb_header *)data;
+	const struct ieee80211_hdr *hdr = (const struct ieee80211_hdr *)(data + sizeof(*skb_hdr));
+	u16 len = le16_to_cpu(skb_hdr->len) + sizeof(*skb_hdr);
+
+	/* As for morse_validate_skb_checksum_ref(), data frames only cover their headers */
+	if (skb_hdr->channel == MORSE_SKB_CHAN_DATA &&
+	    (ieee80211_is_data(hdr->frame_control) ||
+		 ieee80211_is_data_qos(hdr->frame_control) ||
+		 morse_dot11ah_is_pv1_qos_data(le16_to_cpu(hdr->frame_control)))) {
+		u16 data_len = sizeof(*skb_hdr) + QOS_HDR_SIZE + IEEE80211_CCMP_HDR_LEN;
+
+		len = min(len, data_len);
+		len = ROUND_DOWN_TO_WORD(len);
+	}
+
+	return DIV_ROUND_UP(len, sizeof(u32));
+}
+
+/* Take the checksum out of the header, leaving zeroes in its place as the firmware did */
+static u32 morse_skb_checksum_take(struct morse_buff_skb_header *skb_hdr)
+{
+	u32 header_xor = (le16_to_cpu(skb_hdr->checksum_upper) << 8) | (skb_hdr->checksum_lower);
+
+	skb_hdr->checksum_upper = 0;
+	skb_hdr->checksum_lower = 0;
+
+	return header_xor;
+}
+
+static inline u32 morse_skb_checksum_fold(u64 xor)
+{
+	return (u32)xor ^ (u32)(xor >> 32);
+}
+
+/*
+ * XOR of @words 32-bit words, folded from 64-bit loads. XOR is associative, so folding the two
+ * halves of each u64 gives the same result as the word at a time loop on either endianness.
+ */
+static u32 morse_skb_checksum_xor(const u8 *data, int words)
+{
+	u64 xor0 = 0;
+	u64 xor1 = 0;
+	u32 xor;
+	int i = 0;
+
+	/* Two independent accumulators to keep the loads in flight */
+	for (; i + 4 <= words; i += 4) {
+		xor0 ^= get_unaligned((const u64 *)(data + i * sizeof(u32)));
+		xor1 ^= get_unaligned((const u64 *)(data + (i + 2) * sizeof(u32)));
+	}
+	if (i + 2 <= words) {
+		xor0 ^= get_unaligned((const u64 *)(data + i * sizeof(u32)));
+		i += 2;
+	}
+
+	xor = morse_skb_checksum_fold(xor0 ^ xor1);
+	if (i < words)
+		xor ^= get_unaligned((const u32 *)(data + i * sizeof(u32)));
+
+	return xor;
+}
+
+/* Copy @words 32-bit words from @src to @dst, returning their XOR */
+static u32 morse_skb_checksum_copy_xor(u8 *dst, const u8 *src, int words)
+{
+	u64 xor64 = 0;
+	u32 xor;
+	int i = 0;
+
+	for (; i + 2 <= words; i += 2) {
+		u64 val = get_unaligned((const u64 *)(src + i * sizeof(u32)));
+
+		put_unaligned(val, (u64 *)(dst + i * sizeof(u32)));
+		xor64 ^= val;
+	}
+
+	xor = morse_skb_checksum_fold(xor64);
+	if (i < words) {
+		u32 val = get_unaligned((const u32 *)(src + i * sizeof(u32)));
+
+		put_unaligned(val, (u32 *)(dst + i * sizeof(u32)));
+		xor ^= val;
+	}
+
+	return xor;
+}
+
+bool morse_validate_skb_checksum(u8 *data)
+{
+	u32 header_xor = morse_skb_checksum_take((struct morse_buff_skb_header *)data);
+	u32 xor = morse_skb_checksum_xor(data, morse_skb_checksum_words(data));
+
+	return (xor & 0x00FFFFFF) == header_xor;
+}
+
+bool morse_copy_and_validate_skb_checksum(u8 *dst, const u8 *src, int len)
+{
+	/* The checksum fields sit in the first two words, which are copied and zeroed first */
+	const int hdr_words = 2;
+	int words = morse_skb_checksum_words(src);
+	int full_words;
+	int copied;
+	u32 header_xor;
+	u32 xor;
+
+	BUILD_BUG_ON(offsetofend(struct morse_buff_skb_header, checksum_upper) !=
+		     hdr_words * sizeof(u32));
+
+	if (len < hdr_words * sizeof(u32)) {
+		memcpy(dst, src, len);
+		return false;
+	}
+
+	memcpy(dst, src, hdr_words * sizeof(u32));
+	header_xor = morse_skb_checksum_take((struct morse_buff_skb_header *)dst);
+	xor = morse_skb_checksum_xor(dst, hdr_words);
+
+	/* Copy and fold the rest of the whole checksummed words in one pass */
+	full_words = clamp_t(int, words, hdr_words, len / sizeof(u32));
+	xor ^= morse_skb_checksum_copy_xor(dst + hdr_words * sizeof(u32),
+					   src + hdr_words * sizeof(u32), full_words - hdr_words);
+
+	copied = full_words * sizeof(u32);
+	memcpy(dst + copied, src + copied, len - copied);
+
+	/* Like the firmware, a trailing partial word is checked along with its padding */
+	if (words > full_words) {
+		if (words > DIV_ROUND_UP(len, sizeof(u32)))
+			return false;
+		xor ^= get_unaligned((const u32 *)(src + copied));
+	}
+
+	return (xor & 0x00FFFFFF) == header_xor;
+}
+
+/* The KUnit tests check the optimised checksum routines against the reference */
+#ifdef CONFIG_MORSE_SKBQ_KUNIT_TEST
+EXPORT_SYMBOL(morse_validate_skb_checksum_ref);
+EXPORT_SYMBOL(morse_validate_skb_checksum);
+EXPORT_SYMBOL(morse_copy_and_validate_skb_checksum);
+#endif
@@ -9,6 +9,7 @@
  */
 #include <linux/skbuff.h>
 #include <linux/workqueue.h>
+#include <linux/netdevice.h>
 
 #include "skb_header.h"
 
@@ -17,8 +18,23 @@
 #define MORSE_SKBQ_SIZE			(4 * 128 * 1024)
 #endif
 
+/* Number of slots in the pkt_id index of pending packets (must be a power of 2) */
+#define MORSE_SKBQ_PENDING_IDX_SIZE	(256)
+
 struct morse;
 
+/* NAPI context delivering the frames of a to host queue from softirq context */
+struct morse_skbq_napi {
+	/* Dummy netdev the NAPI context is registered against */
+	struct net_device *dev;
+	struct napi_struct napi;
+	struct morse_skbq *mq;
+	/* Frames the poll can not handle, and any received after them, left to dispatch_work */
+	struct sk_buff_head deferred;
+	/* Set while dispatch_work owns delivery, so that frames are not reordered. deferred.lock */
+	bool deferring;
+};
+
 struct morse_skbq {
 	u32 pkt_seq;		/* SKB sequence used in tx_status */
 	u16 flags;
@@ -27,7 +43,11 @@ struct morse_skbq {
 	struct morse *mors;	/* mainly for debugging */
 	struct sk_buff_head skbq;
 	struct sk_buff_head pending;	/* packets sent pending feedback */
+	/* pending packets indexed by pkt_id, for matching tx_status in O(1) */
+	struct sk_buff *pending_idx[MORSE_SKBQ_PENDING_IDX_SIZE];
 	struct work_struct dispatch_work;
+	/* Set if frames are delivered by NAPI rather than dispatch_work */
+	struct morse_skbq_napi *napi;
 };
 
 /**
@@ -96,6 +116,25 @@ void morse_set_max_skb_txq_len(int new_max_txq_len);
 int morse_skbq_skb_finish(struct morse_skbq *mq, struct sk_buff *skb,
 			  struct morse_skb_tx_status *tx_sts);
 
+/**
+ * @brief Deliver the frames of a to host queue through NAPI. Data frames are passed to
+ *        mac80211 from the poll, under its budget. Anything that needs process context
+ *        is handed to the queue's dispatch work. Torn down by morse_skbq_finish().
+ *
+ * @param mq The to host queue
+ *
+ * @return 0 on success (or if NAPI is disabled by module parameter), else an error code
+ */
+int morse_skbq_napi_init(struct morse_skbq *mq);
+
+/**
+ * @brief Kick delivery of frames added to a to host queue, either by scheduling its NAPI
+ *        context or by queueing its dispatch work.
+ *
+ * @param mq The to host queue
+ */
+void morse_skbq_rx_schedule(struct morse_skbq *mq);
+
 /**
  * @brief Flush pending and in-flight tx SKBs from the queue.
  *
@@ -185,4 +224,61 @@ void morse_skbq_data_traffic_resume(struct morse *mors);
  */
 bool morse_validate_skb_checksum(u8 *data);
 
+/**
+ * @brief Word at a time implementation of morse_validate_skb_checksum(). Not used on
+ *        the data path, the KUnit tests check the optimised routines against it.
+ *
+ * @param data The page containing the skb to verify the checksum
+ *
+ * @return true if the check matches the fw calculated checksum
+ */
+bool morse_validate_skb_checksum_ref(u8 *data);
+
+/**
+ * @brief Copy a received packet and verify its checksum in the same pass over the data.
+ *        Leaves the checksum fields of the copy zeroed, as morse_validate_skb_checksum()
+ *        does. The source is not modified.
+ *
+ * @param dst Buffer to copy the packet to, at least len bytes long
+ * @param src The packet, starting with its skb header, padded to a whole word
+ * @param len Number of bytes to copy, covering the whole packet
+ *
+ * @return true if the check matches the fw calculated checksum
+ */
+bool morse_copy_and_validate_skb_checksum(u8 *dst, const u8 *src, int len);
+
+#ifdef CONFIG_MORSE_SKBQ_KUNIT_TEST
+/**
+ * @brief Initialise a queue, for the KUnit tests.
+ *
+ * @param mors Morse context
+ * @param mq SKB queue
+ * @param flags MORSE_CHIP_IF_FLAGS_* of the queue
+ */
+void morse_skbq_test_init(struct morse *mors, struct morse_skbq *mq, u16 flags);
+
+/**
+ * @brief Put a frame on the pending queue as if it had been sent, for the KUnit tests.
+ *
+ * @param mq SKB queue
+ * @param skb The frame, starting with its skb header
+ * @param expiry Time (jiffies) at which its tx_status is considered lost
+ */
+void morse_skbq_test_add_pending(struct morse_skbq *mq, struct sk_buff *skb,
+				 unsigned long expiry);
+
+/**
+ * @brief Match a tx_status to its pending frame, for the KUnit tests. Timed out frames are
+ *        not dropped but handed back in @aged, unlinked from the queue.
+ *
+ * @param mq SKB queue
+ * @param pkt_id Packet ID of the tx_status
+ * @param aged Receives the older frames that have timed out
+ *
+ * @return the pending frame, still on the pending queue, or NULL if not found
+ */
+struct sk_buff *morse_skbq_test_find_pending(struct morse_skbq *mq, u32 pkt_id,
+					     struct sk_buff_head *aged);
+#endif
+
 #endif /* !_MORSE_SKBQ_H_ */
@@ -0,0 +1,409 @@
+/*
+ * Copyright 2025 Morse Micro
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * KUnit tests for the skbq pending queue and RX checksum validation.
+ *
+ * A tx_status is matched to its pending frame through the pkt_id index, falling back to a walk
+ * of the pending list, and in both cases frames with older packet ids whose tx_status has timed
+ * out are given up on.
+ *
+ * The optimised checksum routines must agree with morse_validate_skb_checksum_ref() on every
+ * packet, valid or corrupted, and their throughput is reported against it.
+ */
+
+#include <kunit/test.h>
+#include <linux/ieee80211.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/random.h>
+#include <linux/skbuff.h>
+
+#include "morse.h"
+#include "skbq.h"
+#include "ipmon.h"
+#include "misc.h"
+
+#define SKBQ_TEST_EXPIRED	(jiffies - 1)
+#define SKBQ_TEST_LIVE		(jiffies + 60 * HZ)
+
+#define SKBQ_TEST_CSUM_PACKETS		(4000)
+#define SKBQ_TEST_CSUM_MAX_LEN		(1600)
+#define SKBQ_TEST_CSUM_BENCH_LEN	(1500)
+#define SKBQ_TEST_CSUM_BENCH_ROUNDS	(20000)
+
+struct skbq_test_ctx {
+	struct morse *mors;
+	struct morse_skbq mq;
+	struct sk_buff_head aged;
+};
+
+static int skbq_test_init(struct kunit *test)
+{
+	struct skbq_test_ctx *ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+
+	if (!ctx)
+		return -ENOMEM;
+
+	ctx->mors = kunit_kzalloc(test, sizeof(*ctx->mors), GFP_KERNEL);
+	if (!ctx->mors)
+		return -ENOMEM;
+
+	morse_skbq_test_init(ctx->mors, &ctx->mq,
+			     MORSE_CHIP_IF_FLAGS_DATA | MORSE_CHIP_IF_FLAGS_DIR_TO_CHIP);
+	__skb_queue_head_init(&ctx->aged);
+
+	test->priv = ctx;
+	return 0;
+}
+
+static void skbq_test_exit(struct kunit *test)
+{
+	struct skbq_test_ctx *ctx = test->priv;
+
+	if (!ctx)
+		return;
+
+	/* The frames were never handed to mac80211, so are freed directly */
+	__skb_queue_purge(&ctx->mq.pending);
+	__skb_queue_purge(&ctx->aged);
+}
+
+static struct sk_buff *skbq_test_add(struct kunit *test, u32 pkt_id, unsigned long expiry)
+{
+	struct skbq_test_ctx *ctx = test->priv;
+	struct morse_buff_skb_header *hdr;
+	struct sk_buff *skb = alloc_skb(sizeof(*hdr), GFP_KERNEL);
+
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, skb);
+	hdr = skb_put_zero(skb, sizeof(*hdr));
+	hdr->channel = MORSE_SKB_CHAN_DATA;
+	hdr->tx_info.pkt_id = cpu_to_le32(pkt_id);
+
+	morse_skbq_test_add_pending(&ctx->mq, skb, expiry);
+	return skb;
+}
+
+/* Match a tx_status, then take the frame off the pending queue as its completion does */
+static struct sk_buff *skbq_test_status(struct kunit *test, u32 pkt_id)
+{
+	struct skbq_test_ctx *ctx = test->priv;
+	struct sk_buff *skb = morse_skbq_test_find_pending(&ctx->mq, pkt_id, &ctx->aged);
+
+	if (skb)
+		__skb_unlink(skb, &ctx->mq.pending);
+
+	return skb;
+}
+
+static bool skbq_test_is_aged(struct kunit *test, struct sk_buff *skb)
+{
+	struct skbq_test_ctx *ctx = test->priv;
+	struct sk_buff *aged;
+
+	skb_queue_walk(&ctx->aged, aged)
+		if (aged == skb)
+			return true;
+
+	return false;
+}
+
+static void skbq_test_in_order(struct kunit *test)
+{
+	struct skbq_test_ctx *ctx = test->priv;
+	struct sk_buff *skbs[64];
+	struct sk_buff *skb;
+	u32 i;
+
+	for (i = 0; i < ARRAY_SIZE(skbs); i++)
+		skbs[i] = skbq_test_add(test, i, SKBQ_TEST_LIVE);
+
+	for (i = 0; i < ARRAY_SIZE(skbs); i++) {
+		skb = skbq_test_status(test, i);
+		KUNIT_EXPECT_PTR_EQ(test, skb, skbs[i]);
+		kfree_skb(skb);
+	}
+
+	KUNIT_EXPECT_TRUE(test, skb_queue_empty(&ctx->mq.pending));
+	KUNIT_EXPECT_TRUE(test, skb_queue_empty(&ctx->aged));
+}
+
+/* A tx_status found through the index still gives up on the older frames that timed out */
+static void skbq_test_indexed_ages(struct kunit *test)
+{
+	struct skbq_test_ctx *ctx = test->priv;
+	struct sk_buff *skbs[8];
+	struct sk_buff *skb;
+	u32 i;
+
+	for (i = 0; i < ARRAY_SIZE(skbs); i++)
+		skbs[i] = skbq_test_add(test, i, (i < 4 && i != 2) ? SKBQ_TEST_EXPIRED :
+					SKBQ_TEST_LIVE);
+
+	skb = skbq_test_status(test, 5);
+	KUNIT_EXPECT_PTR_EQ(test, skb, skbs[5]);
+	kfree_skb(skb);
+
+	KUNIT_EXPECT_EQ(test, skb_queue_len(&ctx->aged), (u32)3);
+	KUNIT_EXPECT_TRUE(test, skbq_test_is_aged(test, skbs[0]));
+	KUNIT_EXPECT_TRUE(test, skbq_test_is_aged(test, skbs[1]));
+	KUNIT_EXPECT_TRUE(test, skbq_test_is_aged(test, skbs[3]));
+
+	/* Older frames which have not timed out may still get a late tx_status */
+	KUNIT_EXPECT_EQ(test, skb_queue_len(&ctx->mq.pending), (u32)4);
+	skb = skbq_test_status(test, 2);
+	KUNIT_EXPECT_PTR_EQ(test, skb, skbs[2]);
+	kfree_skb(skb);
+
+	/* The aged frames are gone from the index as well as the list */
+	KUNIT_EXPECT_PTR_EQ(test, skbq_test_status(test, 0), (struct sk_buff *)NULL);
+	KUNIT_EXPECT_PTR_EQ(test, skbq_test_status(test, 3), (struct sk_buff *)NULL);
+}
+
+/* A frame whose index slot was taken by an older one is found by walking the list */
+static void skbq_test_unindexed(struct kunit *test)
+{
+	struct skbq_test_ctx *ctx = test->priv;
+	const u32 pkt_id = 1 + MORSE_SKBQ_PENDING_IDX_SIZE;
+	struct morse_buff_skb_header *hdr;
+	struct sk_buff *old_skb;
+	struct sk_buff *live_skb;
+	struct sk_buff *skb;
+
+	old_skb = skbq_test_add(test, 1, SKBQ_TEST_EXPIRED);
+	live_skb = skbq_test_add(test, 2, SKBQ_TEST_LIVE);
+	skbq_test_add(test, pkt_id, SKBQ_TEST_LIVE);
+
+	skb = skbq_test_status(test, pkt_id);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, skb);
+	hdr = (struct morse_buff_skb_header *)skb->data;
+	KUNIT_EXPECT_EQ(test, le32_to_cpu(hdr->tx_info.pkt_id), pkt_id);
+	kfree_skb(skb);
+
+	KUNIT_EXPECT_EQ(test, skb_queue_len(&ctx->aged), (u32)1);
+	KUNIT_EXPECT_TRUE(test, skbq_test_is_aged(test, old_skb));
+
+	skb = skbq_test_status(test, 2);
+	KUNIT_EXPECT_PTR_EQ(test, skb, live_skb);
+	kfree_skb(skb);
+	KUNIT_EXPECT_TRUE(test, skb_queue_empty(&ctx->mq.pending));
+}
+
+/* A packet of @len bytes in a buffer padded to whole words, as the chip hands them over */
+struct skbq_test_csum_pkt {
+	u8 buf[SKBQ_TEST_CSUM_MAX_LEN + sizeof(struct morse_buff_skb_header) + sizeof(u32)];
+	int len;
+	/* Bytes covered by the checksum */
+	int covered;
+};
+
+static void skbq_test_csum_fill(struct skbq_test_csum_pkt *pkt, struct rnd_state *rnd,
+				u8 channel, __le16 fc, u16 payload_len)
+{
+	struct morse_buff_skb_header *skb_hdr = (struct morse_buff_skb_header *)pkt->buf;
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)(pkt->buf + sizeof(*skb_hdr));
+	const u32 *words = (const u32 *)pkt->buf;
+	u32 xor = 0;
+	int i;
+
+	prandom_bytes_state(rnd, pkt->buf, sizeof(pkt->buf));
+	skb_hdr->channel = channel;
+	skb_hdr->len = cpu_to_le16(payload_len);
+	skb_hdr->offset = 0;
+	skb_hdr->checksum_lower = 0;
+	skb_hdr->checksum_upper = 0;
+	hdr->frame_control = fc;
+	pkt->len = sizeof(*skb_hdr) + payload_len;
+
+	/* Data frames only have their headers covered */
+	pkt->covered = pkt->len;
+	if (channel == MORSE_SKB_CHAN_DATA && ieee80211_is_data(fc)) {
+		int hdrs_len = min_t(int, pkt->len, sizeof(*skb_hdr) + QOS_HDR_SIZE +
+				     IEEE80211_CCMP_HDR_LEN);
+
+		pkt->covered = ROUND_DOWN_TO_WORD(hdrs_len);
+	}
+
+	for (i = 0; i < DIV_ROUND_UP(pkt->covered, sizeof(u32)); i++)
+		xor ^= words[i];
+	xor &= 0x00FFFFFF;
+
+	skb_hdr->checksum_lower = xor & 0xFF;
+	skb_hdr->checksum_upper = cpu_to_le16(xor >> 8);
+}
+
+/*
+ * Check a packet with each routine, which all zero the checksum fields of what they validate,
+ * returning the verdict they agree on.
+ */
+static bool skbq_test_csum_agree(struct kunit *test, const struct skbq_test_csum_pkt *pkt)
+{
+	struct skbq_test_csum_pkt *ref = kunit_kmalloc(test, sizeof(*ref), GFP_KERNEL);
+	struct skbq_test_csum_pkt *fast = kunit_kmalloc(test, sizeof(*fast), GFP_KERNEL);
+	u8 *copy = kunit_kzalloc(test, sizeof(pkt->buf), GFP_KERNEL);
+	bool ref_valid = false;
+
+	if (!ref || !fast || !copy) {
+		KUNIT_FAIL(test, "out of memory");
+		goto exit;
+	}
+	memcpy(ref, pkt, sizeof(*pkt));
+	memcpy(fast, pkt, sizeof(*pkt));
+
+	ref_valid = morse_validate_skb_checksum_ref(ref->buf);
+	KUNIT_EXPECT_EQ(test, morse_validate_skb_checksum(fast->buf), ref_valid);
+	KUNIT_EXPECT_EQ(test, morse_copy_and_validate_skb_checksum(copy, pkt->buf, pkt->len),
+			ref_valid);
+
+	KUNIT_EXPECT_EQ(test, memcmp(fast->buf, ref->buf, pkt->len), 0);
+	KUNIT_EXPECT_EQ(test, memcmp(copy, ref->buf, pkt->len), 0);
+
+exit:
+	kunit_kfree(test, ref);
+	kunit_kfree(test, fast);
+	kunit_kfree(test, copy);
+	return ref_valid;
+}
+
+static void skbq_test_csum_equivalence(struct kunit *test)
+{
+	static const u8 channels[] = {
+		MORSE_SKB_CHAN_DATA, MORSE_SKB_CHAN_MGMT, MORSE_SKB_CHAN_COMMAND,
+	};
+	static const u16 stypes[] = {
+		IEEE80211_FTYPE_DATA | IEEE80211_STYPE_QOS_DATA,
+		IEEE80211_FTYPE_DATA | IEEE80211_STYPE_DATA,
+		IEEE80211_FTYPE_MGMT | IEEE80211_STYPE_ACTION,
+	};
+	struct skbq_test_csum_pkt *pkt = kunit_kmalloc(test, sizeof(*pkt), GFP_KERNEL);
+	struct rnd_state rnd;
+	u32 i;
+
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, pkt);
+	prandom_seed_state(&rnd, 0xc5c5);
+
+	for (i = 0; i < SKBQ_TEST_CSUM_PACKETS; i++) {
+		const int fc_end = sizeof(struct morse_buff_skb_header) + sizeof(__le16);
+		u8 channel = channels[prandom_u32_state(&rnd) % ARRAY_SIZE(channels)];
+		u16 stype = stypes[prandom_u32_state(&rnd) % ARRAY_SIZE(stypes)];
+		u32 mode = prandom_u32_state(&rnd) % 3;
+		int byte;
+
+		skbq_test_csum_fill(pkt, &rnd, channel, cpu_to_le16(stype),
+				    prandom_u32_state(&rnd) % (SKBQ_TEST_CSUM_MAX_LEN + 1));
+
+		if (mode == 0) {
+			KUNIT_EXPECT_TRUE(test, skbq_test_csum_agree(test, pkt));
+			continue;
+		}
+
+		/*
+		 * A single bit error in the covered bytes, past the checksum and frame control. The
+		 * checksum is 24 bits wide, so the top byte of each word is not covered.
+		 */
+		if (mode == 1 && pkt->covered > fc_end) {
+			do {
+				byte = fc_end + prandom_u32_state(&rnd) % (pkt->covered - fc_end);
+			} while (byte % sizeof(u32) == sizeof(u32) - 1);
+			pkt->buf[byte] ^= BIT(prandom_u32_state(&rnd) % 8);
+			KUNIT_EXPECT_FALSE(test, skbq_test_csum_agree(test, pkt));
+			continue;
+		}
+
+		/* An error anywhere, which may or may not be covered, only has to be agreed on */
+		byte = prandom_u32_state(&rnd) % pkt->len;
+		pkt->buf[byte] ^= BIT(prandom_u32_state(&rnd) % 8);
+		skbq_test_csum_agree(test, pkt);
+	}
+}
+
+static u64 skbq_test_csum_time(struct skbq_test_csum_pkt *pkt, u8 *copy, int routine)
+{
+	struct morse_buff_skb_header *skb_hdr = (struct morse_buff_skb_header *)pkt->buf;
+	const u8 lower = skb_hdr->checksum_lower;
+	const __le16 upper = skb_hdr->checksum_upper;
+	u32 valid = 0;
+	u64 start_ns;
+	u32 i;
+
+	start_ns = ktime_get_ns();
+	for (i = 0; i < SKBQ_TEST_CSUM_BENCH_ROUNDS; i++) {
+		skb_hdr->checksum_lower = lower;
+		skb_hdr->checksum_upper = upper;
+
+		if (routine == 0)
+			valid += morse_validate_skb_checksum_ref(pkt->buf);
+		else if (routine == 1)
+			valid += morse_validate_skb_checksum(pkt->buf);
+		else
+			valid += morse_copy_and_validate_skb_checksum(copy, pkt->buf, pkt->len);
+	}
+	skb_hdr->checksum_lower = lower;
+	skb_hdr->checksum_upper = upper;
+
+	return (valid == SKBQ_TEST_CSUM_BENCH_ROUNDS) ? ktime_get_ns() - start_ns : 0;
+}
+
+static void skbq_test_csum_throughput(struct kunit *test)
+{
+	static const char * const names[] = { "reference", "validate", "copy and validate" };
+	struct skbq_test_csum_pkt *pkt = kunit_kmalloc(test, sizeof(*pkt), GFP_KERNEL);
+	u8 *copy = kunit_kmalloc(test, sizeof(pkt->buf), GFP_KERNEL);
+	struct rnd_state rnd;
+	int routine;
+
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, pkt);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, copy);
+	prandom_seed_state(&rnd, 0x5c5c);
+	skbq_test_csum_fill(pkt, &rnd, MORSE_SKB_CHAN_MGMT,
+			    cpu_to_le16(IEEE80211_FTYPE_MGMT | IEEE80211_STYPE_ACTION),
+			    SKBQ_TEST_CSUM_BENCH_LEN);
+
+	for (routine = 0; routine < ARRAY_SIZE(names); routine++) {
+		u64 elapsed_ns = skbq_test_csum_time(pkt, copy, routine);
+
+		/* Zero if any round failed to validate */
+		KUNIT_EXPECT_NE(test, elapsed_ns, (u64)0);
+		if (!elapsed_ns)
+			continue;
+
+		kunit_info(test, "%s: %llu ns per %d byte packet, %llu MB/s\n", names[routine],
+			   div64_u64(elapsed_ns, SKBQ_TEST_CSUM_BENCH_ROUNDS), pkt->len,
+			   div64_u64((u64)pkt->len * SKBQ_TEST_CSUM_BENCH_ROUNDS * 1000,
+				     elapsed_ns));
+	}
+}
+
+static struct kunit_case skbq_test_cases[] = {
+	KUNIT_CASE(skbq_test_in_order),
+	KUNIT_CASE(skbq_test_indexed_ages),
+	KUNIT_CASE(skbq_test_unindexed),
+	{}
+};
+
+static struct kunit_suite skbq_test_suite = {
+	.name = "morse_skbq_pending",
+	.init = skbq_test_init,
+	.exit = skbq_test_exit,
+	.test_cases = skbq_test_cases,
+};
+
+static struct kunit_case skbq_test_csum_cases[] = {
+	KUNIT_CASE(skbq_test_csum_equivalence),
+	KUNIT_CASE(skbq_test_csum_throughput),
+	{}
+};
+
+static struct kunit_suite skbq_test_csum_suite = {
+	.name = "morse_skbq_checksum",
+	.test_cases = skbq_test_csum_cases,
+};
+
+kunit_test_suites(&skbq_test_suite, &skbq_test_csum_suite);
+
+MODULE_AUTHOR("Morse Micro");
+MODULE_DESCRIPTION("KUnit tests for the Morse Micro skbq pending queue and RX checksums");
+MODULE_LICENSE("Dual BSD/GPL");
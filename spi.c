@@ -13,6 +13,7 @@
 #include <linux/mmc/sdio.h>	/* for SD_IO_XX commands */
 #include <linux/crc-itu-t.h>
 #include <linux/spi/spi.h>
+#include <linux/scatterlist.h>
 #include <linux/gpio.h>
 
 #include "morse.h"
@@ -32,18 +33,51 @@
 #define MORSE_SPI_WARN(_m, _f, _a...)		morse_warn(FEATURE_ID_SPI, _m, _f, ##_a)
 #define MORSE_SPI_ERR(_m, _f, _a...)		morse_err(FEATURE_ID_SPI, _m, _f, ##_a)
 
+/* Number of transfer buffers, one is prepared while the other is on the bus */
+#define MORSE_SPI_NUM_BUFS		(2)
+
+/**
+ * struct morse_spi_buf - a DMA-safe transfer buffer and the CMD53 it carries
+ *
+ * @data: transfer buffer, clocked out and overwritten with the bytes received.
+ * @t: transfer covering @data.
+ * @m: message holding @t.
+ * @done: completed when an asynchronous message finishes.
+ * @pending: the message has been submitted but not yet waited for.
+ * @len: number of bytes to transfer.
+ * @resp: offset in @data from which to search for the R1 response.
+ * @ack: offset in @data from which to search for the first data ack (writes only).
+ * @count: number of blocks (block mode) or bytes (byte mode) of the CMD53.
+ * @block: whether the CMD53 is in block mode.
+ * @address: address argument of the CMD53, for logging.
+ * @dest: where to copy the data read (reads only).
+ */
+struct morse_spi_buf {
+	u8 *data;
+	struct spi_transfer t;
+	struct spi_message m;
+	struct completion done;
+	bool pending;
+	u32 len;
+	u32 resp;
+	u32 ack;
+	u16 count;
+	bool block;
+	u32 address;
+	u8 *dest;
+};
+
 struct morse_spi {
 	bool enabled;
 	u32 bulk_addr_base;
 	u32 register_addr_base;
 	struct spi_device *spi;
 
-	/* Memory for command/response transfers */
-	u8 *data;
-
-	/* for bulk data transfers */
-	struct spi_transfer t;
-	struct spi_message m;
+	/*
+	 * Transfer buffers. Commands and single CMD53s use the first, bulk transfers
+	 * alternate between them.
+	 */
+	struct morse_spi_buf bufs[MORSE_SPI_NUM_BUFS];
 
 	/* protects concurrent access */
 	struct mutex lock;
@@ -57,6 +91,31 @@ struct morse_spi {
 	u8 max_block_count;
 };
 
+/**
+ * struct morse_spi_wr_src - source of the payload of a CMD53 write
+ *
+ * @data: linear buffer, used when @sgl is NULL.
+ * @sgl: scatterlist to gather the payload from.
+ * @nents: number of entries in @sgl.
+ *
+ * The payload is always staged into the command buffer alongside the tokens and CRCs,
+ * so gathering from a scatterlist costs no more than copying from a linear buffer.
+ */
+struct morse_spi_wr_src {
+	const u8 *data;
+	struct scatterlist *sgl;
+	unsigned int nents;
+};
+
+static void morse_spi_wr_src_copy(const struct morse_spi_wr_src *src, u32 offset,
+				  u8 *dst, u32 len)
+{
+	if (src->sgl)
+		sg_pcopy_to_buffer(src->sgl, src->nents, dst, len, offset);
+	else
+		memcpy(dst, src->data + offset, len);
+}
+
 #ifdef CONFIG_MORSE_USER_ACCESS
 struct uaccess *morse_spi_uaccess;
 #endif
@@ -225,6 +284,7 @@ static void morse_shift_buffer(u8 *data, unsigned int len, u8 right_shift_bits)
 
 static int morse_spi_xfer(struct morse_spi *mspi, unsigned int len)
 {
+	struct morse_spi_buf *buf = &mspi->bufs[0];
 	int ret = 0;
 
 	if (!len)
@@ -235,15 +295,58 @@ static int morse_spi_xfer(struct morse_spi *mspi, unsigned int len)
 		return -EIO;
 	}
 
-	mspi->t.len = len;
-	ret = spi_sync_locked(mspi->spi, &mspi->m);
+	buf->t.len = len;
+	ret = spi_sync_locked(mspi->spi, &buf->m);
 
 	if (is_rk3288)
-		morse_shift_buffer(mspi->data, len, 1);
+		morse_shift_buffer(buf->data, len, 1);
 
 	return ret;
 }
 
+static void morse_spi_xfer_complete(void *context)
+{
+	struct morse_spi_buf *buf = context;
+
+	complete(&buf->done);
+}
+
+/* Start clocking out a prepared buffer, use morse_spi_xfer_wait() to collect it */
+static int morse_spi_xfer_async(struct morse_spi *mspi, struct morse_spi_buf *buf)
+{
+	int ret;
+
+	if (!buf->len || buf->len > SPI_MAX_TRANSACTION_SIZE) {
+		WARN_ON(1);
+		return -EIO;
+	}
+
+	buf->t.len = buf->len;
+	buf->m.complete = morse_spi_xfer_complete;
+	buf->m.context = buf;
+	reinit_completion(&buf->done);
+
+	ret = spi_async(mspi->spi, &buf->m);
+	if (!ret)
+		buf->pending = true;
+
+	return ret;
+}
+
+static int morse_spi_xfer_wait(struct morse_spi *mspi, struct morse_spi_buf *buf)
+{
+	if (!buf->pending)
+		return 0;
+
+	wait_for_completion(&buf->done);
+	buf->pending = false;
+
+	if (is_rk3288)
+		morse_shift_buffer(buf->data, buf->len, 1);
+
+	return buf->m.status;
+}
+
 /**
  * morse_spi_initsequence() - Initialisation sequence to bring up the chip in SPI mode.
  * @mspi: Morse SPI structure
@@ -270,7 +373,7 @@ static void morse_spi_initsequence(struct morse_spi *mspi)
 		spi->mode &= ~SPI_CS_HIGH;
 	} else {
 		/* We will send only 0xFF for training */
-		memset(mspi->data, 0xFF, MM610X_BUF_SIZE);
+		memset(mspi->bufs[0].data, 0xFF, 18);
 		morse_spi_xfer(mspi, 18);
 
 		spi->mode &= ~SPI_CS_HIGH;
@@ -283,17 +386,55 @@ static void morse_spi_initsequence(struct morse_spi *mspi)
 
 static void morse_spi_xfer_init(struct morse_spi *mspi)
 {
-	/* setup message from a single data buffer */
-	spi_message_init(&mspi->m);
+	int i;
+
+	for (i = 0; i < MORSE_SPI_NUM_BUFS; i++) {
+		struct morse_spi_buf *buf = &mspi->bufs[i];
+
+		/* setup message from a single data buffer */
+		spi_message_init(&buf->m);
 
 #if KERNEL_VERSION(6, 10, 0) > LINUX_VERSION_CODE
-	mspi->m.is_dma_mapped = false;
+		buf->m.is_dma_mapped = false;
 #endif
-	mspi->t.tx_buf = mspi->data;
-	mspi->t.rx_buf = mspi->data;
-	mspi->t.cs_change = 0;
+		buf->t.tx_buf = buf->data;
+		buf->t.rx_buf = buf->data;
+		buf->t.cs_change = 0;
+
+		spi_message_add_tail(&buf->t, &buf->m);
+		init_completion(&buf->done);
+		buf->pending = false;
+	}
+}
+
+static void morse_spi_free_bufs(struct morse_spi *mspi)
+{
+	int i;
+
+	for (i = 0; i < MORSE_SPI_NUM_BUFS; i++) {
+		kfree(mspi->bufs[i].data);
+		mspi->bufs[i].data = NULL;
+	}
+}
+
+/*
+ * Skip the idle (0xFF) bytes clocked in while the chip was busy. Responses are usually
+ * preceded by long idle runs, so compare a word at a time once aligned.
+ */
+static u8 *morse_spi_skip_idle(u8 *cp, u8 *end)
+{
+	while (cp < end && *cp == 0xff && !IS_ALIGNED((unsigned long)cp, sizeof(unsigned long)))
+		cp++;
 
-	spi_message_add_tail(&mspi->t, &mspi->m);
+	if (IS_ALIGNED((unsigned long)cp, sizeof(unsigned long))) {
+		while (end - cp >= sizeof(unsigned long) && *(unsigned long *)cp == ULONG_MAX)
+			cp += sizeof(unsigned long);
+	}
+
+	while (cp < end && *cp == 0xff)
+		cp++;
+
+	return cp;
 }
 
 /* Search for R1 response */
@@ -303,11 +444,10 @@ static int morse_spi_find_response(struct morse_spi *mspi, u8 *data, u8 *end, u8
 	struct spi_device *spi = mspi->spi;
 	struct morse *mors = spi_get_drvdata(spi);
 
-	while (cp < end && (*cp == 0xff))
-		cp++;
+	cp = morse_spi_skip_idle(cp, end);
 
 	/* Data block reads (R1 response types) may need more data... */
-	if (cp == end) {
+	if (cp >= end) {
 		MORSE_SPI_DBG(mors, "%s: SPI response missing\n", __func__);
 		if (resp)
 			*resp = NULL;
@@ -345,7 +485,7 @@ static int morse_spi_find_response(struct morse_spi *mspi, u8 *data, u8 *end, u8
 static int morse_spi_cmd(struct morse_spi *mspi, u8 cmd, u32 arg)
 {
 	int ret;
-	u8 *cp = mspi->data;
+	u8 *cp = mspi->bufs[0].data;
 	unsigned int buffer_size = SPI_COMMAND_BUF_SIZE;
 
 	/*
@@ -388,8 +528,8 @@ static int morse_spi_cmd(struct morse_spi *mspi, u8 cmd, u32 arg)
 	 * first byte.  After STOP_TRANSMISSION command it may include
 	 * two data bits, but otherwise it's all ones.
 	 */
-	return morse_spi_find_response(mspi, mspi->data + SPI_RESP_OFFSET,
-				       mspi->data + buffer_size, NULL);
+	return morse_spi_find_response(mspi, mspi->bufs[0].data + SPI_RESP_OFFSET,
+				       mspi->bufs[0].data + buffer_size, NULL);
 }
 
 static int morse_spi_cmd52(struct morse_spi *mspi, u8 fn, u8 data, u32 address)
@@ -430,12 +570,9 @@ static int morse_spi_cmd52(struct morse_spi *mspi, u8 fn, u8 data, u32 address)
 /* Search for block start token response */
 static u8 *morse_spi_find_token(struct morse_spi *mspi, u8 *data, u8 *end)
 {
-	u8 *cp = data;
+	u8 *cp = morse_spi_skip_idle(data, end);
 
-	while (cp < end && *cp == 0xff)
-		cp++;
-
-	if (cp == end)
+	if (cp >= end)
 		goto exit;
 
 	if ((*cp != SPI_TOKEN_SINGLE) && (*cp != SPI_TOKEN_MULTI_WRITE))
@@ -454,12 +591,9 @@ exit:
 /* Search for data block response */
 static u8 *morse_spi_find_data_ack(struct morse_spi *mspi, u8 *data, u8 *end)
 {
-	u8 *cp = data;
+	u8 *cp = morse_spi_skip_idle(data, end);
 
-	while (cp < end && *cp == 0xff)
-		cp++;
-
-	if (cp == end)
+	if (cp >= end)
 		goto exit;
 
 	if (SPI_MMC_RESPONSE_CODE(*cp) != SPI_RESPONSE_ACCEPTED)
@@ -526,22 +660,21 @@ static int morse_spi_put_cmd53(u8 fn, u32 address, u8 *data, u16 count, u8 write
 	return SPI_COMMAND_SIZE;
 }
 
-/* if block flags is set, count is the number of blocks to send, else it's the number of bytes */
-static int morse_spi_cmd53_read(struct morse_spi *mspi, u8 fn, u32 address, u8 *data, u16 count,
-				bool block)
+/*
+ * Prepare a CMD53 read in @buf. If block flags is set, count is the number of blocks to read,
+ * else it's the number of bytes.
+ */
+static void morse_spi_cmd53_read_prep(struct morse_spi *mspi, struct morse_spi_buf *buf,
+				      u8 fn, u32 address, u8 *data, u16 count, bool block)
 {
-	u8 *cp = mspi->data;
-	u8 *resp;
-	u8 *end;
+	u8 *cp = buf->data;
 	u32 data_size;
-	int i;
-
-	memset(mspi->data, 0xFF, MM610X_BUF_SIZE);
 
 	/* Insert command and argument */
+	cp[0] = 0xff;
 	cp += morse_spi_put_cmd53(fn, address, cp, count, 0, block);
 
-	resp = cp;
+	buf->resp = cp - buf->data;
 
 	/*
 	 * Calculate number of clock cycles needed to get data.
@@ -575,18 +708,34 @@ static int morse_spi_cmd53_read(struct morse_spi *mspi, u8 fn, u32 address, u8 *
 			    (MMC_SPI_BLOCKSIZE + (2 * mspi->inter_block_delay_bytes) + 2);
 	}
 
-	if (data_size > (MM610X_BUF_SIZE - (cp - mspi->data))) {
+	if (data_size > (MM610X_BUF_SIZE - (cp - buf->data))) {
 		struct spi_device *spi = mspi->spi;
 		struct morse *mors = spi_get_drvdata(spi);
 
 		MORSE_SPI_INFO(mors, "%s: data buffer too big, truncating: %u",
 			       __func__, data_size);
 	}
-	data_size = min(data_size, (u32)(MM610X_BUF_SIZE - (cp - mspi->data)));
+	data_size = min(data_size, (u32)(MM610X_BUF_SIZE - (cp - buf->data)));
 	cp += data_size;
-	end = cp;
 
-	morse_spi_xfer(mspi, end - mspi->data);
+	buf->len = cp - buf->data;
+	buf->count = count;
+	buf->block = block;
+	buf->address = address;
+	buf->dest = data;
+
+	/* Everything after the command is idle while the response and data are clocked in */
+	memset(buf->data + buf->resp, 0xff, buf->len - buf->resp);
+}
+
+/* Verify and unpack a completed CMD53 read */
+static int morse_spi_cmd53_read_parse(struct morse_spi *mspi, struct morse_spi_buf *buf)
+{
+	u8 *end = buf->data + buf->len;
+	u8 *data = buf->dest;
+	u8 *cp;
+	u32 data_size;
+	int i;
 
 	/*
 	 * Response will already be stored in the data buffer.  It's
@@ -595,11 +744,11 @@ static int morse_spi_cmd53_read(struct morse_spi *mspi, u8 fn, u32 address, u8 *
 	 */
 
 	/* Time to verify */
-	if (morse_spi_find_response(mspi, resp, end, &cp))
+	if (morse_spi_find_response(mspi, buf->data + buf->resp, end, &cp))
 		goto exit;
 
-	data_size = block ? MMC_SPI_BLOCKSIZE : count;
-	for (i = 0; i < (block ? count : 1); i++, data += data_size) {
+	data_size = buf->block ? MMC_SPI_BLOCKSIZE : buf->count;
+	for (i = 0; i < (buf->block ? buf->count : 1); i++, data += data_size) {
 		cp = morse_spi_find_token(mspi, cp, end);
 		if (!cp)
 			goto exit;
@@ -611,46 +760,65 @@ static int morse_spi_cmd53_read(struct morse_spi *mspi, u8 fn, u32 address, u8 *
 		cp += data_size + 4;
 	}
 
-	return count;
+	return buf->count;
 
 exit:
 	MORSE_PR_ERR(FEATURE_ID_SPI, "%s failed\n", __func__);
 	return -EPROTO;
 }
 
-static int morse_spi_cmd53_write(struct morse_spi *mspi, u8 fn, u32 address, u8 *data, u16 count,
-				 u8 block)
+/* if block flags is set, count is the number of blocks to send, else it's the number of bytes */
+static int morse_spi_cmd53_read(struct morse_spi *mspi, u8 fn, u32 address, u8 *data, u16 count,
+				bool block)
+{
+	struct morse_spi_buf *buf = &mspi->bufs[0];
+	int ret;
+
+	morse_spi_cmd53_read_prep(mspi, buf, fn, address, data, count, block);
+
+	ret = morse_spi_xfer(mspi, buf->len);
+	if (ret)
+		return ret;
+
+	return morse_spi_cmd53_read_parse(mspi, buf);
+}
+
+/*
+ * Prepare a CMD53 write in @buf. Only the regions clocked out as idle bytes are filled with
+ * 0xFF, the rest of the buffer is overwritten with the command, tokens, data and CRCs.
+ */
+static int morse_spi_cmd53_write_prep(struct morse_spi *mspi, struct morse_spi_buf *buf,
+				      u8 fn, u32 address, const struct morse_spi_wr_src *src,
+				      u32 src_offset, u16 count, u8 block)
 {
-	u8 *cp = mspi->data;
-	u8 *resp;
-	u8 *end;
-	u8 *ack = cp;
+	u8 *cp = buf->data;
+	u8 *buf_end = buf->data + MM610X_BUF_SIZE;
 	u32 data_size;
+	u32 pad;
 	int i;
 
-	memset(mspi->data, 0xFF, MM610X_BUF_SIZE);
 	/* Insert command and argument */
+	cp[0] = 0xff;
 	cp += morse_spi_put_cmd53(fn, address, cp, count, 1, block);
 
 	/* Mark response point */
-	resp = cp;
+	buf->resp = cp - buf->data;
+	buf->ack = buf->resp;
 
 	/* Calculate number of clock cycles needed to get data.
 	 * Transactions are either one block of few bytes (i.e less than
 	 * MMC_SPI_BLOCKSIZE) or multiple blocks of MMC_SPI_BLOCKSIZE.
 	 */
 	/* Allow 4 bytes to get R1 response (usually comes in 2) */
-	cp += 4;
-
 	/* Allow 4 bytes to get 0xFF (i.e MISO ready) */
-	cp += 4;
+	memset(cp, 0xff, 4 + 4);
+	cp += 4 + 4;
 
 	data_size = block ? MMC_SPI_BLOCKSIZE : count;
-	for (i = 0; i < (block ? count : 1); i++, data += MMC_SPI_BLOCKSIZE) {
-		/*
-		 * Calculate the CRC 8 bytes at a time to minimize overhead and increase throughput
-		 */
-		u16 crc = crc16xmodem_word(0, data, data_size);
+	/* Allow more bytes for status and chip processing (depends on CLK) */
+	pad = block ? mspi->inter_block_delay_bytes : 4;
+	for (i = 0; i < (block ? count : 1); i++, src_offset += MMC_SPI_BLOCKSIZE) {
+		u16 crc;
 
 		/* WR: ACK should be set below (after sending the block). However for
 		 * seems the chip is providing the ACKs (some times) a bit too early.
@@ -658,23 +826,29 @@ static int morse_spi_cmd53_write(struct morse_spi *mspi, u8 fn, u32 address, u8
 		 */
 		/* Mark data ack point */
 		if (i == 0)
-			ack = cp;
+			buf->ack = cp - buf->data;
 
-		/* tx token */
-		*cp = block ? SPI_TOKEN_MULTI_WRITE : SPI_TOKEN_SINGLE;
-		cp++;
-
-		/* data */
-		if (cp + data_size > mspi->data + MM610X_BUF_SIZE) {
+		if (cp + 1 + data_size + sizeof(crc) + pad > buf_end) {
 			struct spi_device *spi = mspi->spi;
 			struct morse *mors = spi_get_drvdata(spi);
 
-			MORSE_SPI_INFO(mors, "%s: data buffer too big (%u)",
-				       __func__, (u32)((cp + data_size) - mspi->data));
+			MORSE_SPI_INFO(mors, "%s: data buffer too big (%u)", __func__,
+				       (u32)((cp + 1 + data_size + sizeof(crc) + pad) - buf->data));
 
 			return -ENOMEM;
 		}
-		memcpy(cp, data, data_size);
+
+		/* tx token */
+		*cp = block ? SPI_TOKEN_MULTI_WRITE : SPI_TOKEN_SINGLE;
+		cp++;
+
+		/* data */
+		morse_spi_wr_src_copy(src, src_offset, cp, data_size);
+
+		/*
+		 * Calculate the CRC 8 bytes at a time to minimize overhead and increase throughput
+		 */
+		crc = crc16xmodem_word(0, cp, data_size);
 		cp += data_size;
 
 		/* crc */
@@ -682,41 +856,55 @@ static int morse_spi_cmd53_write(struct morse_spi *mspi, u8 fn, u32 address, u8
 		*(cp + 1) = (crc & 0xFF);
 		cp += sizeof(crc);
 
-		/* Allow more bytes for status and chip processing (depends on CLK) */
-		cp += block ? mspi->inter_block_delay_bytes : 4;
+		memset(cp, 0xff, pad);
+		cp += pad;
 	}
 
 	if (enable_ext_xtal_init) {
 		struct morse *mors = spi_get_drvdata(mspi->spi);
 
-		if (mors->cfg->xtal_init_bus_trans_delay_ms)
-			cp += XTAL_TRANSFER_DELAY_BYTES;
+		if (mors->cfg->xtal_init_bus_trans_delay_ms) {
+			pad = min_t(u32, XTAL_TRANSFER_DELAY_BYTES, buf_end - cp);
+			memset(cp, 0xff, pad);
+			cp += pad;
+		}
 	}
 
-	/* Do the actual transfer */
-	end = cp;
+	buf->len = cp - buf->data;
+	buf->count = count;
+	buf->block = block;
+	buf->address = address;
 
-	morse_spi_xfer(mspi, end - mspi->data);
+	return 0;
+}
+
+/* Verify the R1 response and data acks of a completed CMD53 write */
+static int morse_spi_cmd53_write_verify(struct morse_spi *mspi, struct morse_spi_buf *buf)
+{
+	u8 *end = buf->data + buf->len;
+	u8 *ack = buf->data + buf->ack;
+	u8 *cp;
+	u32 stride;
+	int i;
 
 	/* Time to verify */
-	if (morse_spi_find_response(mspi, resp, end, &cp))
+	if (morse_spi_find_response(mspi, buf->data + buf->resp, end, &cp))
 		goto exit;
 
 	/* If in block mode, start searching for the data ack exactly where it is expected.
 	 * This will improve the throughput. For 14 * 512 Bytes of data transfer, the time
 	 * it takes to find the response is reduced from 33 uS to 1 uS
 	 */
-	ack += block ? (1 /* TOKEN */  + MMC_SPI_BLOCKSIZE /* data size */  + 2 /* crc */) : 0;
-	data_size =
-	    1 /* TOKEN */  + MMC_SPI_BLOCKSIZE + 2 /* crc */  + mspi->inter_block_delay_bytes;
-	for (i = 0; i < (block ? count : 1); i++, ack += data_size) {
-		cp = ack;
-		cp = morse_spi_find_data_ack(mspi, cp, end);
+	ack += buf->block ?
+		(1 /* TOKEN */  + MMC_SPI_BLOCKSIZE /* data size */  + 2 /* crc */) : 0;
+	stride = 1 /* TOKEN */  + MMC_SPI_BLOCKSIZE + 2 /* crc */  + mspi->inter_block_delay_bytes;
+	for (i = 0; i < (buf->block ? buf->count : 1); i++, ack += stride) {
+		cp = morse_spi_find_data_ack(mspi, ack, end);
 		if (!cp)
 			goto exit;
 	}
 
-	return count;
+	return buf->count;
 
 exit:
 	MORSE_PR_ERR(FEATURE_ID_SPI, "%s failed\n", __func__);
@@ -830,14 +1018,85 @@ static void morse_spi_reset_base_address(struct morse_spi *mspi)
 	mspi->register_addr_base = MORSE_SPI_BASE_ADDR_UNSET;
 }
 
+/* Collect a pipelined CMD53 and check its outcome */
+static int morse_spi_cmd53_finish(struct morse_spi *mspi, struct morse_spi_buf *buf, u8 fn,
+				  bool write)
+{
+	int ret = morse_spi_xfer_wait(mspi, buf);
+
+	if (!ret)
+		ret = write ? morse_spi_cmd53_write_verify(mspi, buf) :
+			      morse_spi_cmd53_read_parse(mspi, buf);
+	if (ret < 0)
+		spi_log_err(mspi, write ? "cmd53_write" : "cmd53_read", fn, buf->address,
+			    buf->count, ret);
+
+	return ret;
+}
+
+/*
+ * Transfer @size bytes as a sequence of CMD53s, reading into @data or writing from @src.
+ * The buffers are used in turn so the next CMD53 is prepared, and the previous one verified,
+ * while the current one is on the bus.
+ */
+static int morse_spi_cmd53_pipeline(struct morse_spi *mspi, u8 fn, u32 address, u8 *data,
+				    const struct morse_spi_wr_src *src, u32 src_offset, u32 size)
+{
+	struct morse_spi_buf *prev = NULL;
+	bool write = !!src;
+	unsigned int n = 0;
+	u32 done = 0;
+	int ret = 0;
+	int i;
+
+	while (done < size) {
+		struct morse_spi_buf *buf = &mspi->bufs[n++ % MORSE_SPI_NUM_BUFS];
+		bool block = (size - done) >= MMC_SPI_BLOCKSIZE;
+		/* we only have SPI_MAX_TRANSACTION_SIZE per SPI transaction */
+		u16 count = block ? min_t(u32, mspi->max_block_count,
+					  (size - done) / MMC_SPI_BLOCKSIZE) : size - done;
+
+		if (write) {
+			ret = morse_spi_cmd53_write_prep(mspi, buf, fn, address + done, src,
+							 src_offset + done, count, block);
+			if (ret < 0) {
+				spi_log_err(mspi, "cmd53_write", fn, address + done, count, ret);
+				break;
+			}
+		} else {
+			morse_spi_cmd53_read_prep(mspi, buf, fn, address + done, data + done,
+						  count, block);
+		}
+
+		ret = morse_spi_xfer_async(mspi, buf);
+		if (ret < 0)
+			break;
+
+		if (prev) {
+			ret = morse_spi_cmd53_finish(mspi, prev, fn, write);
+			if (ret < 0)
+				break;
+		}
+
+		prev = buf;
+		done += block ? count * MMC_SPI_BLOCKSIZE : count;
+	}
+
+	if (ret >= 0 && prev)
+		ret = morse_spi_cmd53_finish(mspi, prev, fn, write);
+
+	/* Don't leave a buffer on the bus when bailing out */
+	for (i = 0; i < MORSE_SPI_NUM_BUFS; i++)
+		morse_spi_xfer_wait(mspi, &mspi->bufs[i]);
+
+	return ret < 0 ? ret : size;
+}
+
 static int morse_spi_mem_read(struct morse_spi *mspi, u32 address, u8 *data, u32 size)
 {
 	int ret = 0;
 	struct spi_device *spi = mspi->spi;
 	struct morse *mors = spi_get_drvdata(spi);
-	u32 bytes = size & (MMC_SPI_BLOCKSIZE - 1);
-	u32 blks = (size - bytes) / MMC_SPI_BLOCKSIZE;
-	u32 blks_done = 0;
 	int access = (size & 0x3) ? MORSE_CONFIG_ACCESS_1BYTE : MORSE_CONFIG_ACCESS_4BYTE;
 	int func_to_use;
 
@@ -850,36 +1109,9 @@ static int morse_spi_mem_read(struct morse_spi *mspi, u32 address, u8 *data, u32
 	}
 
 	address &= 0xFFFF;	/* remove base and keep offset */
-	if (blks) {
-		/* we only have 4K per SPI transaction */
-		while (blks - blks_done) {
-			int blk_count = min_t(int, mspi->max_block_count, blks - blks_done);
-			u32 next_addr = address + blks_done * MMC_SPI_BLOCKSIZE;
-
-			ret = morse_spi_cmd53_read(mspi, func_to_use,
-						   next_addr,
-						   data + blks_done * MMC_SPI_BLOCKSIZE,
-						   blk_count, 1);
-			if (ret < 0) {
-				spi_log_err(mspi, "cmd53_read", func_to_use, next_addr, blk_count,
-					    ret);
-				goto exit;
-			}
-
-			blks_done += blk_count;
-		}
-	}
-
-	if (bytes) {
-		u32 next_addr = address + blks_done * MMC_SPI_BLOCKSIZE;
-
-		ret = morse_spi_cmd53_read(mspi, func_to_use, next_addr,
-					   data + blks_done * MMC_SPI_BLOCKSIZE, bytes, 0);
-		if (ret < 0) {
-			spi_log_err(mspi, "cmd53_read", func_to_use, next_addr, bytes, ret);
-			goto exit;
-		}
-	}
+	ret = morse_spi_cmd53_pipeline(mspi, func_to_use, address, data, NULL, 0, size);
+	if (ret < 0)
+		goto exit;
 
 	/* Observed sometimes that SPI read repeats the first 4-bytes word twice,
 	 * overwriting second word (hence, tail will be overwritten with 'sync' byte). When this
@@ -904,12 +1136,10 @@ exit:
 	return ret;
 }
 
-static int morse_spi_mem_write(struct morse_spi *mspi, u32 address, u8 *data, u32 size)
+static int morse_spi_mem_write(struct morse_spi *mspi, u32 address,
+			       const struct morse_spi_wr_src *src, u32 src_offset, u32 size)
 {
 	int ret = 0;
-	u32 bytes = size & (MMC_SPI_BLOCKSIZE - 1);
-	u32 blks = (size - bytes) / MMC_SPI_BLOCKSIZE;
-	u32 blks_done = 0;
 	int access = (size & 0x3) ? MORSE_CONFIG_ACCESS_1BYTE : MORSE_CONFIG_ACCESS_4BYTE;
 	int func_to_use;
 
@@ -922,36 +1152,9 @@ static int morse_spi_mem_write(struct morse_spi *mspi, u32 address, u8 *data, u3
 	}
 
 	address &= 0xFFFF;	/* remove base and keep offset */
-	if (blks) {
-		/* we only have 4K per SPI transaction */
-		while (blks - blks_done) {
-			int blk_count = min_t(int, mspi->max_block_count, blks - blks_done);
-			u32 next_addr = address + blks_done * MMC_SPI_BLOCKSIZE;
-
-			ret = morse_spi_cmd53_write(mspi, func_to_use,
-						    next_addr,
-						    data + blks_done * MMC_SPI_BLOCKSIZE,
-						    blk_count, 1);
-			if (ret < 0) {
-				spi_log_err(mspi, "cmd53_write", func_to_use, next_addr, blk_count,
-					    ret);
-				goto exit;
-			}
-
-			blks_done += blk_count;
-		}
-	}
-
-	if (bytes) {
-		u32 next_addr = address + blks_done * MMC_SPI_BLOCKSIZE;
-
-		ret = morse_spi_cmd53_write(mspi, func_to_use, next_addr,
-					    data + blks_done * MMC_SPI_BLOCKSIZE, bytes, 0);
-		if (ret < 0) {
-			spi_log_err(mspi, "cmd53_write", func_to_use, next_addr, bytes, ret);
-			goto exit;
-		}
-	}
+	ret = morse_spi_cmd53_pipeline(mspi, func_to_use, address, NULL, src, src_offset, size);
+	if (ret < 0)
+		goto exit;
 
 	mutex_unlock(&mspi->lock);
 	return size;
@@ -962,7 +1165,8 @@ exit:
 }
 
 static int morse_spi_write_until_done(struct morse_spi *spi, u32 address,
-				      ssize_t len, const u8 *data)
+				      ssize_t len, const struct morse_spi_wr_src *src,
+				      u32 src_offset)
 {
 	int bytes_written = -1;
 	u32 offset = 0;
@@ -970,7 +1174,7 @@ static int morse_spi_write_until_done(struct morse_spi *spi, u32 address,
 	while (offset < len) {
 		bytes_written = morse_spi_mem_write(spi,
 						    address + offset,
-						    (u8 *)(data + offset),
+						    src, src_offset + offset,
 						    min((ssize_t)(len - offset),
 							(ssize_t)SPI_MAX_TRANSFER_SIZE));
 		if (bytes_written < 0)
@@ -981,7 +1185,8 @@ static int morse_spi_write_until_done(struct morse_spi *spi, u32 address,
 	return bytes_written;
 }
 
-static int morse_spi_dm_write(struct morse *mors, u32 address, const u8 *data, int len)
+static int morse_spi_write_windows(struct morse *mors, u32 address,
+				   const struct morse_spi_wr_src *src, int len)
 {
 	int ret;
 	struct morse_spi *mspi = (struct morse_spi *)mors->drv_priv;
@@ -1000,7 +1205,7 @@ static int morse_spi_dm_write(struct morse *mors, u32 address, const u8 *data, i
 
 		len = min(remaining, (int)(window_end + 1 - address - offset));
 		ret = morse_spi_write_until_done(mspi, address + offset,
-						 (ssize_t)len, (u8 *)(data + offset));
+						 (ssize_t)len, src, offset);
 		if (ret != len)
 			goto err;
 
@@ -1016,6 +1221,24 @@ err:
 	return -EIO;
 }
 
+static int morse_spi_dm_write(struct morse *mors, u32 address, const u8 *data, int len)
+{
+	const struct morse_spi_wr_src src = { .data = data };
+
+	return morse_spi_write_windows(mors, address, &src, len);
+}
+
+static int morse_spi_dm_write_sg(struct morse *mors, u32 address, struct scatterlist *sgl,
+				 int nents, int len)
+{
+	const struct morse_spi_wr_src src = { .sgl = sgl, .nents = nents };
+
+	if (!morse_bus_sg_check(mors, sgl, nents, UINT_MAX))
+		return -EOPNOTSUPP;
+
+	return morse_spi_write_windows(mors, address, &src, len);
+}
+
 static int morse_spi_read_until_done(struct morse_spi *spi, u32 address,
 				     ssize_t len, const u8 *data)
 {
@@ -1075,8 +1298,9 @@ static int morse_spi_reg32_write(struct morse *mors, u32 address, u32 value)
 {
 	int ret = 0;
 	struct morse_spi *mspi = (struct morse_spi *)mors->drv_priv;
+	const struct morse_spi_wr_src src = { .data = (u8 *)&value };
 
-	ret = morse_spi_mem_write(mspi, address, (u8 *)&value, sizeof(value));
+	ret = morse_spi_mem_write(mspi, address, &src, 0, sizeof(value));
 
 	/* Reset base address after software reset */
 	if (address == MORSE_REG_RESET(mors) && value == MORSE_REG_RESET_VALUE(mors)) {
@@ -1234,7 +1458,7 @@ static void morse_spi_remove(struct spi_device *spi)
 		}
 
 		morse_spi_remove_irq(mspi);
-		kfree(mspi->data);
+		morse_spi_free_bufs(mspi);
 #ifdef CONFIG_MORSE_USER_ACCESS
 		uaccess_device_unregister(mors);
 		uaccess_cleanup(morse_spi_uaccess);
@@ -1320,6 +1544,7 @@ static void morse_spi_config_burst_mode(struct morse *mors, bool enable_burst)
 static const struct morse_bus_ops morse_spi_ops = {
 	.dm_read = morse_spi_dm_read,
 	.dm_write = morse_spi_dm_write,
+	.dm_write_sg = morse_spi_dm_write_sg,
 	.reg32_read = morse_spi_reg32_read,
 	.reg32_write = morse_spi_reg32_write,
 	.set_bus_enable = morse_spi_bus_enable,
@@ -1369,12 +1594,15 @@ static int morse_spi_probe(struct spi_device *spi)
 
 	/* preallocate dma buffers */
 	mspi = (struct morse_spi *)mors->drv_priv;
-	mspi->data = kmalloc(MM610X_BUF_SIZE, GFP_KERNEL);
-	if (!mspi->data) {
-		MORSE_SPI_ERR(mors, "%s Failed to allocate DMA buffers (size=%d bytes)\n",
-			      __func__, MM610X_BUF_SIZE);
-		ret = -ENOMEM;
-		goto err_exit;
+	for (i = 0; i < MORSE_SPI_NUM_BUFS; i++) {
+		mspi->bufs[i].data = kmalloc(MM610X_BUF_SIZE, GFP_KERNEL);
+		if (!mspi->bufs[i].data) {
+			MORSE_SPI_ERR(mors, "%s Failed to allocate DMA buffers (size=%d bytes)\n",
+				      __func__, MM610X_BUF_SIZE);
+			morse_spi_free_bufs(mspi);
+			ret = -ENOMEM;
+			goto err_exit;
+		}
 	}
 	mspi_data_allocated = true;
 
@@ -1598,7 +1826,7 @@ err_exit:
 	}
 #endif
 	if (mspi_data_allocated)
-		kfree(mspi->data);
+		morse_spi_free_bufs(mspi);
 	if (mors)
 		morse_mac_destroy(mors);
 	pr_err("%s failed. The driver has not been loaded!\n", __func__);
@@ -5,6 +5,43 @@
  *
  */
 
+#ifndef __MORSE_TRACE_TYPES_H
+#define __MORSE_TRACE_TYPES_H
+
+/* Operations reported by the morse_bus event */
+enum morse_trace_bus_op {
+	MORSE_TRACE_BUS_DM_READ,
+	MORSE_TRACE_BUS_DM_WRITE,
+	MORSE_TRACE_BUS_DM_WRITE_SG,
+	MORSE_TRACE_BUS_REG32_READ,
+	MORSE_TRACE_BUS_REG32_WRITE,
+};
+
+/* Operations reported by the morse_sdio event */
+enum morse_trace_sdio_op {
+	MORSE_TRACE_SDIO_SET_REG_BASE,
+	MORSE_TRACE_SDIO_SET_BULK_BASE,
+	MORSE_TRACE_SDIO_RESET_BASE,
+	MORSE_TRACE_SDIO_EN_IRQ,
+	MORSE_TRACE_SDIO_HANDLE_IRQ,
+	MORSE_TRACE_SDIO_BUS_EN,
+};
+
+/* Operations reported by the morse_page event */
+enum morse_trace_page_op {
+	MORSE_TRACE_PAGE_INIT,
+	MORSE_TRACE_PAGE_CACHE_PUT,
+	MORSE_TRACE_PAGE_POP,
+	MORSE_TRACE_PAGE_CACHE_GET,
+	MORSE_TRACE_PAGE_PUT,
+	MORSE_TRACE_PAGE_STORE_BULK,
+	MORSE_TRACE_PAGE_NOTIFY,
+	MORSE_TRACE_PAGE_WRITE,
+	MORSE_TRACE_PAGE_READ,
+};
+
+#endif /* __MORSE_TRACE_TYPES_H */
+
 #if !defined(__TRACE_MORSE_H) || defined(TRACE_HEADER_MULTI_READ)
 #define __TRACE_MORSE_H
 
@@ -17,6 +54,10 @@
 
 #define MORSE_MSG_MAX 200
 
+/* Elapsed time since @start, or 0 if the event was enabled after @start was sampled */
+#define MORSE_TRACE_ELAPSED_NS(start) \
+	(ktime_to_ns(start) ? ktime_to_ns(ktime_sub(ktime_get(), (start))) : 0)
+
 DECLARE_EVENT_CLASS(morse_log_event,
 	TP_PROTO(const struct morse *mors, struct va_format *vaf),
 	TP_ARGS(mors, vaf),
@@ -69,6 +110,168 @@ DEFINE_EVENT(morse_log_event, morse_dbg_ratelimited,
 	TP_PROTO(const struct morse *mors, struct va_format *vaf), TP_ARGS(mors, vaf)
 );
 
+TRACE_DEFINE_ENUM(MORSE_TRACE_BUS_DM_READ);
+TRACE_DEFINE_ENUM(MORSE_TRACE_BUS_DM_WRITE);
+TRACE_DEFINE_ENUM(MORSE_TRACE_BUS_DM_WRITE_SG);
+TRACE_DEFINE_ENUM(MORSE_TRACE_BUS_REG32_READ);
+TRACE_DEFINE_ENUM(MORSE_TRACE_BUS_REG32_WRITE);
+
+#define show_morse_bus_op(op) __print_symbolic(op, \
+	{ MORSE_TRACE_BUS_DM_READ,	"dm_read" }, \
+	{ MORSE_TRACE_BUS_DM_WRITE,	"dm_write" }, \
+	{ MORSE_TRACE_BUS_DM_WRITE_SG,	"dm_write_sg" }, \
+	{ MORSE_TRACE_BUS_REG32_READ,	"reg32_read" }, \
+	{ MORSE_TRACE_BUS_REG32_WRITE,	"reg32_write" })
+
+TRACE_EVENT(morse_bus,
+	TP_PROTO(u8 op, u32 address, int len, ktime_t start, int ret),
+	TP_ARGS(op, address, len, start, ret),
+	TP_STRUCT__entry(__field(u8, op)
+			 __field(u32, address)
+			 __field(int, len)
+			 __field(s64, duration_ns)
+			 __field(int, ret)),
+	TP_fast_assign(__entry->op = op;
+		       __entry->address = address;
+		       __entry->len = len;
+		       __entry->duration_ns = MORSE_TRACE_ELAPSED_NS(start);
+		       __entry->ret = ret;),
+	TP_printk("%s addr=0x%08x len=%d duration_ns=%lld ret=%d",
+		  show_morse_bus_op(__entry->op), __entry->address, __entry->len,
+		  __entry->duration_ns, __entry->ret)
+);
+
+TRACE_DEFINE_ENUM(MORSE_TRACE_SDIO_SET_REG_BASE);
+TRACE_DEFINE_ENUM(MORSE_TRACE_SDIO_SET_BULK_BASE);
+TRACE_DEFINE_ENUM(MORSE_TRACE_SDIO_RESET_BASE);
+TRACE_DEFINE_ENUM(MORSE_TRACE_SDIO_EN_IRQ);
+TRACE_DEFINE_ENUM(MORSE_TRACE_SDIO_HANDLE_IRQ);
+TRACE_DEFINE_ENUM(MORSE_TRACE_SDIO_BUS_EN);
+
+#define show_morse_sdio_op(op) __print_symbolic(op, \
+	{ MORSE_TRACE_SDIO_SET_REG_BASE,	"set_reg_base" }, \
+	{ MORSE_TRACE_SDIO_SET_BULK_BASE,	"set_bulk_base" }, \
+	{ MORSE_TRACE_SDIO_RESET_BASE,		"reset_base" }, \
+	{ MORSE_TRACE_SDIO_EN_IRQ,		"en_irq" }, \
+	{ MORSE_TRACE_SDIO_HANDLE_IRQ,		"handle_irq" }, \
+	{ MORSE_TRACE_SDIO_BUS_EN,		"bus_en" })
+
+TRACE_EVENT(morse_sdio,
+	TP_PROTO(u8 op, unsigned int fn, u32 value),
+	TP_ARGS(op, fn, value),
+	TP_STRUCT__entry(__field(u8, op)
+			 __field(u8, fn)
+			 __field(u32, value)),
+	TP_fast_assign(__entry->op = op;
+		       __entry->fn = fn;
+		       __entry->value = value;),
+	TP_printk("%s fn=%u value=0x%08x",
+		  show_morse_sdio_op(__entry->op), __entry->fn, __entry->value)
+);
+
+TRACE_DEFINE_ENUM(MORSE_TRACE_PAGE_INIT);
+TRACE_DEFINE_ENUM(MORSE_TRACE_PAGE_CACHE_PUT);
+TRACE_DEFINE_ENUM(MORSE_TRACE_PAGE_POP);
+TRACE_DEFINE_ENUM(MORSE_TRACE_PAGE_CACHE_GET);
+TRACE_DEFINE_ENUM(MORSE_TRACE_PAGE_PUT);
+TRACE_DEFINE_ENUM(MORSE_TRACE_PAGE_STORE_BULK);
+TRACE_DEFINE_ENUM(MORSE_TRACE_PAGE_NOTIFY);
+TRACE_DEFINE_ENUM(MORSE_TRACE_PAGE_WRITE);
+TRACE_DEFINE_ENUM(MORSE_TRACE_PAGE_READ);
+
+#define show_morse_page_op(op) __print_symbolic(op, \
+	{ MORSE_TRACE_PAGE_INIT,	"init" }, \
+	{ MORSE_TRACE_PAGE_CACHE_PUT,	"cache_put" }, \
+	{ MORSE_TRACE_PAGE_POP,		"pop" }, \
+	{ MORSE_TRACE_PAGE_CACHE_GET,	"cache_get" }, \
+	{ MORSE_TRACE_PAGE_PUT,		"put" }, \
+	{ MORSE_TRACE_PAGE_STORE_BULK,	"store_bulk" }, \
+	{ MORSE_TRACE_PAGE_NOTIFY,	"notify" }, \
+	{ MORSE_TRACE_PAGE_WRITE,	"write" }, \
+	{ MORSE_TRACE_PAGE_READ,	"read" })
+
+TRACE_EVENT(morse_page,
+	TP_PROTO(const struct morse_pager *pager, u8 op, u32 arg),
+	TP_ARGS(pager, op, arg),
+	TP_STRUCT__entry(__field(u8, id)
+			 __field(u8, flags)
+			 __field(u8, op)
+			 __field(u32, arg)),
+	TP_fast_assign(__entry->id = pager->id;
+		       __entry->flags = pager->flags;
+		       __entry->op = op;
+		       __entry->arg = arg;),
+	TP_printk("pager=%u flags=0x%02x %s arg=0x%08x", __entry->id, __entry->flags,
+		  show_morse_page_op(__entry->op), __entry->arg)
+);
+
+TRACE_EVENT(morse_yaps_status,
+	TP_PROTO(u32 tc_tx_pool_pages, u32 tc_cmd_pool_pages, u32 fc_rx_pool_pages,
+		 u32 tc_pkts, u32 fc_pkts, u32 fc_done_pkts, u32 fc_rx_bytes,
+		 ktime_t start, int ret),
+	TP_ARGS(tc_tx_pool_pages, tc_cmd_pool_pages, fc_rx_pool_pages, tc_pkts, fc_pkts,
+		fc_done_pkts, fc_rx_bytes, start, ret),
+	TP_STRUCT__entry(__field(u32, tc_tx_pool_pages)
+			 __field(u32, tc_cmd_pool_pages)
+			 __field(u32, fc_rx_pool_pages)
+			 __field(u32, tc_pkts)
+			 __field(u32, fc_pkts)
+			 __field(u32, fc_done_pkts)
+			 __field(u32, fc_rx_bytes)
+			 __field(s64, duration_ns)
+			 __field(int, ret)),
+	TP_fast_assign(__entry->tc_tx_pool_pages = tc_tx_pool_pages;
+		       __entry->tc_cmd_pool_pages = tc_cmd_pool_pages;
+		       __entry->fc_rx_pool_pages = fc_rx_pool_pages;
+		       __entry->tc_pkts = tc_pkts;
+		       __entry->fc_pkts = fc_pkts;
+		       __entry->fc_done_pkts = fc_done_pkts;
+		       __entry->fc_rx_bytes = fc_rx_bytes;
+		       __entry->duration_ns = MORSE_TRACE_ELAPSED_NS(start);
+		       __entry->ret = ret;),
+	TP_printk("tc_tx_pool=%u tc_cmd_pool=%u fc_rx_pool=%u tc_pkts=%u fc_pkts=%u "
+		  "fc_done_pkts=%u fc_rx_bytes=%u duration_ns=%lld ret=%d",
+		  __entry->tc_tx_pool_pages, __entry->tc_cmd_pool_pages,
+		  __entry->fc_rx_pool_pages, __entry->tc_pkts, __entry->fc_pkts,
+		  __entry->fc_done_pkts, __entry->fc_rx_bytes, __entry->duration_ns,
+		  __entry->ret)
+);
+
+TRACE_EVENT(morse_cmd,
+	TP_PROTO(u16 message_id, u16 host_id, int retry, ktime_t start, int ret),
+	TP_ARGS(message_id, host_id, retry, start, ret),
+	TP_STRUCT__entry(__field(u16, message_id)
+			 __field(u16, host_id)
+			 __field(int, retry)
+			 __field(s64, duration_ns)
+			 __field(int, ret)),
+	TP_fast_assign(__entry->message_id = message_id;
+		       __entry->host_id = host_id;
+		       __entry->retry = retry;
+		       __entry->duration_ns = MORSE_TRACE_ELAPSED_NS(start);
+		       __entry->ret = ret;),
+	TP_printk("cmd=0x%04x:%04x try=%d duration_ns=%lld ret=%d",
+		  __entry->message_id, __entry->host_id, __entry->retry,
+		  __entry->duration_ns, __entry->ret)
+);
+
+TRACE_EVENT(morse_tx_status_batch,
+	TP_PROTO(int count, int unmatched, ktime_t start),
+	TP_ARGS(count, unmatched, start),
+	TP_STRUCT__entry(__field(int, count)
+			 __field(int, unmatched)
+			 __field(s64, duration_ns)),
+	TP_fast_assign(__entry->count = count;
+		       __entry->unmatched = unmatched;
+		       __entry->duration_ns = MORSE_TRACE_ELAPSED_NS(start);),
+	TP_printk("count=%d unmatched=%d duration_ns=%lld",
+		  __entry->count, __entry->unmatched, __entry->duration_ns)
+);
+
+/* Sample a start time for an event, only paying for the clock read while it is enabled */
+#define morse_trace_start(event) \
+	(trace_##event##_enabled() ? ktime_get() : ktime_set(0, 0))
+
 #endif
 
 /* we don't want to use include/trace/events */
@@ -19,6 +19,9 @@
 #define TWT_SETUP_CMD_UNKNOWN	(8)
 #define TWT_WAKE_DUR_UNIT_256	(256)
 
+/* Fixed point shift applied to the share of an agreement's service periods that are seen */
+#define MORSE_TWT_TIMELINE_WEIGHT_SHIFT		(10)
+
 #define MORSE_TWT_DBG(_m, _f, _a...)		morse_dbg(FEATURE_ID_TWT, _m, _f, ##_a)
 #define MORSE_TWT_INFO(_m, _f, _a...)		morse_info(FEATURE_ID_TWT, _m, _f, ##_a)
 #define MORSE_TWT_WARN(_m, _f, _a...)		morse_warn(FEATURE_ID_TWT, _m, _f, ##_a)
@@ -29,6 +32,11 @@
 #define MORSE_TWT_ERR_RATELIMITED(_m, _f, _a...)		\
 	morse_err_ratelimited(FEATURE_ID_TWT, _m, _f, ##_a)
 
+static bool twt_timeline_sched = true;
+module_param(twt_timeline_sched, bool, 0644);
+MODULE_PARM_DESC(twt_timeline_sched,
+		 "Place TWT service periods against agreements of every wake interval");
+
 static const char *twt_cmd_strs[TWT_SETUP_CMD_MAX + 1] = {
 	"Request",
 	"Suggest",
@@ -192,6 +200,8 @@ void morse_twt_dump_wake_interval_tree(struct seq_file *file, struct morse_vif *
 	struct morse_twt *twt;
 	struct morse_twt_wake_interval *wi;
 	struct morse_twt_agreement *agr;
+	/* Sum of the service period duty cycles, in tenths of a percent */
+	u64 occupancy = 0;
 
 	if (!file || !mors_vif)
 		return;
@@ -215,8 +225,19 @@ void morse_twt_dump_wake_interval_tree(struct seq_file *file, struct morse_vif *
 			seq_printf(file,
 				   "\tTWT Wake time: %llu us, Wake Duration: %u us, State: %u\n",
 				   agr->data.wake_time_us, agr->data.wake_duration_us, agr->state);
+			if (agr->data.wake_interval_us)
+				occupancy += div64_u64((u64)agr->data.wake_duration_us * 1000,
+						       agr->data.wake_interval_us);
 		}
 	}
+
+	if (twt->responder) {
+		u32 tenths;
+		u64 percent = div_u64_rem(occupancy, 10, &tenths);
+
+		seq_printf(file, "TWT medium occupancy: %llu.%u%%, overlapping agreements: %u\n",
+			   percent, tenths, twt->num_overlapped);
+	}
 	spin_unlock_bh(&twt->lock);
 }
 
@@ -669,22 +690,176 @@ static struct morse_twt_sta *morse_twt_add_sta(struct morse *mors, struct morse_
 	return sta;
 }
 
+static u64 morse_twt_gcd64(u64 a, u64 b)
+{
+	while (b) {
+		u64 rem;
+
+		div64_u64_rem(a, b, &rem);
+		a = b;
+		b = rem;
+	}
+
+	return a;
+}
+
+/**
+ * morse_twt_timeline_add_sp() - Add a service period to the timeline.
+ *
+ * @timeline		Timeline bins
+ * @num_bins		Number of bins covering the wake interval
+ * @bin_us		Length of each bin (us). The last bin may be shorter.
+ * @interval_us		The wake interval the timeline covers (us)
+ * @start_us		Start of the service period within the wake interval (us)
+ * @dur_us		Duration of the service period (us), no longer than the wake interval
+ * @weight		Weight to add for each us of the service period
+ * @remove		Take the service period back out of the timeline instead
+ */
+static void morse_twt_timeline_add_sp(u64 *timeline, u32 num_bins, u64 bin_us,
+				      u64 interval_us, u64 start_us, u64 dur_us, u64 weight,
+				      bool remove)
+{
+	u32 bin = div64_u64(start_us, bin_us);
+	u64 pos_us = start_us;
+
+	while (dur_us) {
+		u64 bin_end_us = (bin == num_bins - 1) ? interval_us : (bin + 1) * bin_us;
+		u64 len_us = min(dur_us, bin_end_us - pos_us);
+
+		if (remove)
+			timeline[bin] -= len_us * weight;
+		else
+			timeline[bin] += len_us * weight;
+		dur_us -= len_us;
+		pos_us += len_us;
+
+		/* Service periods may wrap around the end of the wake interval. */
+		if (++bin == num_bins) {
+			bin = 0;
+			pos_us = 0;
+		}
+	}
+}
+
+/**
+ * morse_twt_timeline_bins() - Get the number of timeline bins covering a wake interval.
+ *
+ * @interval_us		The wake interval (us)
+ * @bin_us		Filled with the length of each bin (us). The last bin may be shorter.
+ *
+ * @return the number of bins, at most MORSE_TWT_TIMELINE_BINS
+ */
+static u32 morse_twt_timeline_bins(u64 interval_us, u64 *bin_us)
+{
+	*bin_us = max_t(u64, DIV_ROUND_UP_ULL(interval_us, MORSE_TWT_TIMELINE_BINS), 1);
+
+	return div64_u64(interval_us + *bin_us - 1, *bin_us);
+}
+
+/**
+ * morse_twt_timeline_fold() - Fold an agreement's service periods onto a wake interval.
+ *
+ * @timeline		Timeline bins covering the wake interval
+ * @interval_us		The wake interval the timeline covers (us)
+ * @data		The agreement to fold
+ * @remove		Take the agreement back out of the timeline instead
+ *
+ * Over the hyperperiod of the two wake intervals, an agreement with wake interval Tj lands at
+ * the same offsets modulo gcd(T, Tj) in the wake interval T, and is seen by gcd(T, Tj) / Tj of
+ * its service periods.
+ */
+static void morse_twt_timeline_fold(u64 *timeline, u64 interval_us,
+				    const struct morse_twt_agreement_data *data, bool remove)
+{
+	u64 bin_us;
+	const u32 num_bins = morse_twt_timeline_bins(interval_us, &bin_us);
+	u64 gcd_us;
+	u64 weight;
+	u64 num_sps;
+	u64 start_us;
+
+	if (!data->wake_interval_us)
+		return;
+
+	gcd_us = morse_twt_gcd64(interval_us, data->wake_interval_us);
+	num_sps = div64_u64(interval_us, gcd_us);
+
+	/* Service periods that cover every offset, or are spread more finely than the bins,
+	 * load all windows evenly and cannot change the choice.
+	 */
+	if (data->wake_duration_us >= gcd_us || num_sps >= num_bins)
+		return;
+
+	/* However rarely they are seen, the service periods must show */
+	weight = max_t(u64, div64_u64(gcd_us << MORSE_TWT_TIMELINE_WEIGHT_SHIFT,
+				      data->wake_interval_us), 1);
+	div64_u64_rem(data->wake_time_us, gcd_us, &start_us);
+
+	for (; num_sps; num_sps--, start_us += gcd_us)
+		morse_twt_timeline_add_sp(timeline, num_bins, bin_us, interval_us, start_us,
+					  data->wake_duration_us, weight, remove);
+}
+
+/**
+ * morse_twt_timeline_build() - Fold every agreement onto a wake interval.
+ *
+ * @twt			The TWT struct
+ * @timeline		Timeline bins covering the wake interval
+ * @interval_us		The wake interval the timeline covers (us)
+ * @skip		An agreement to leave out, or NULL
+ */
+static void morse_twt_timeline_build(struct morse_twt *twt, u64 *timeline, u64 interval_us,
+				     struct morse_twt_agreement *skip)
+{
+	struct morse_twt_wake_interval *wi;
+	struct morse_twt_agreement *agr;
+	u64 bin_us;
+
+	memset(timeline, 0, morse_twt_timeline_bins(interval_us, &bin_us) * sizeof(*timeline));
+
+	list_for_each_entry(wi, &twt->wake_intervals, list)
+		list_for_each_entry(agr, &wi->agreements, list)
+			if (agr != skip)
+				morse_twt_timeline_fold(timeline, interval_us, &agr->data, false);
+}
+
+/**
+ * morse_twt_wake_intervals_fold() - Add an agreement to, or take it out of, the timeline kept
+ *				     by each wake interval.
+ *
+ * @twt		The TWT struct
+ * @agr		The agreement, which must not change while it is folded in
+ * @remove	Take the agreement out instead
+ */
+static void morse_twt_wake_intervals_fold(struct morse_twt *twt, struct morse_twt_agreement *agr,
+					  bool remove)
+{
+	struct morse_twt_wake_interval *wi;
+
+	list_for_each_entry(wi, &twt->wake_intervals, list)
+		if (wi->timeline)
+			morse_twt_timeline_fold(wi->timeline, wi->wake_interval_us, &agr->data,
+						remove);
+}
+
 /**
  * morse_twt_agreement_remove() - Removes an agreement from a wake_interval list. Will also
  *					remove the wake interval list entry if the list becomes
  *					empty.
  *
  * @mors	Morse device
+ * @twt		The TWT struct
  * @agr		The TWT agreement
  *
  * @return 0 on success, else error code
  */
-static int morse_twt_agreement_remove(struct morse *mors, struct morse_twt_agreement *agr)
+static int morse_twt_agreement_remove(struct morse *mors, struct morse_twt *twt,
+				      struct morse_twt_agreement *agr)
 {
 	struct list_head *prev;
 	struct morse_twt_wake_interval *wi;
 
-	if (!mors || !agr)
+	if (!mors || !twt || !agr)
 		return -EINVAL;
 
 	if (list_empty(&agr->list)) {
@@ -692,6 +867,8 @@ static int morse_twt_agreement_remove(struct morse *mors, struct morse_twt_agree
 		return 0;
 	}
 
+	morse_twt_wake_intervals_fold(twt, agr, true);
+
 	prev = agr->list.prev;
 	/* list_del_init() is used so we can use list_empty() afterwards since the STA may still
 	 * exist.
@@ -704,6 +881,7 @@ static int morse_twt_agreement_remove(struct morse *mors, struct morse_twt_agree
 	if (list_empty(prev)) {
 		wi = container_of(prev, struct morse_twt_wake_interval, agreements);
 		list_del(&wi->list);
+		kfree(wi->timeline);
 		kfree(wi);
 	}
 
@@ -737,7 +915,7 @@ static int morse_twt_sta_remove(struct morse *mors,
 	/* Remove each agreement from the wake interval linked list. */
 	for (i = 0; i < MORSE_TWT_AGREEMENTS_MAX_PER_STA; i++) {
 		MORSE_TWT_DBG(mors, "Remove TWT agreement %u\n", i);
-		morse_twt_agreement_remove(mors, &sta->agreements[i]);
+		morse_twt_agreement_remove(mors, twt, &sta->agreements[i]);
 	}
 	/* Clear STA VIF */
 	if (vif->type == NL80211_IFTYPE_STATION) {
@@ -818,7 +996,7 @@ static int morse_twt_sta_agreement_remove(struct morse *mors,
 
 	agr = &sta->agreements[flow_id];
 	WARN_ON_ONCE(agr->state != MORSE_TWT_STATE_NO_AGREEMENT);
-	morse_twt_agreement_remove(mors, agr);
+	morse_twt_agreement_remove(mors, twt, agr);
 
 	/* Check if there are any agreements and remove STA if there aren't any. */
 	for (i = 0; i < MORSE_TWT_AGREEMENTS_MAX_PER_STA; i++) {
@@ -846,6 +1024,41 @@ static int morse_twt_sta_agreement_add(struct morse *mors,
 	return 0;
 }
 
+/**
+ * morse_twt_wake_interval_alloc() - Allocate a wake interval list head.
+ *
+ * @twt			The TWT struct
+ * @wake_interval_us	The wake interval (us)
+ *
+ * When scheduling against the timeline, the wake interval also keeps every agreement folded
+ * onto it, so placing an agreement there only has to search the timeline. Without one, the
+ * shared timeline is built for each placement instead.
+ *
+ * @return A wake interval head struct on success otherwise NULL.
+ */
+static struct morse_twt_wake_interval *morse_twt_wake_interval_alloc(struct morse_twt *twt,
+								     u64 wake_interval_us)
+{
+	struct morse_twt_wake_interval *wi = kmalloc(sizeof(*wi), GFP_ATOMIC);
+	u64 bin_us;
+
+	if (!wi)
+		return NULL;
+
+	INIT_LIST_HEAD(&wi->agreements);
+	wi->wake_interval_us = wake_interval_us;
+	wi->timeline = NULL;
+
+	if (twt_timeline_sched && twt->timeline && wake_interval_us) {
+		wi->timeline = kcalloc(morse_twt_timeline_bins(wake_interval_us, &bin_us),
+				       sizeof(*wi->timeline), GFP_ATOMIC | __GFP_NOWARN);
+		if (wi->timeline)
+			morse_twt_timeline_build(twt, wi->timeline, wake_interval_us, NULL);
+	}
+
+	return wi;
+}
+
 /**
  * morse_twt_agreement_wake_interval_get() -	Get the wake interval list head. Creates one if it
  *						doesn't exits already.
@@ -863,7 +1076,6 @@ static struct morse_twt_wake_interval *morse_twt_agreement_wake_interval_get(str
 	struct list_head *head;
 	struct morse_twt_wake_interval *wi;
 	struct morse_twt_wake_interval *temp;
-	struct morse_twt_agreement *agr;
 
 	if (!twt)
 		return NULL;
@@ -871,33 +1083,24 @@ static struct morse_twt_wake_interval *morse_twt_agreement_wake_interval_get(str
 	head = &twt->wake_intervals;
 
 	if (list_empty(&twt->wake_intervals)) {
-		wi = kmalloc(sizeof(*wi), GFP_ATOMIC);
+		wi = morse_twt_wake_interval_alloc(twt, wake_interval_us);
 		if (!wi)
 			return NULL;
-		INIT_LIST_HEAD(&wi->agreements);
 		list_add(&wi->list, head);
 		return wi;
 	}
 
 	list_for_each_entry(wi, head, list) {
-		u64 wi_us;
-
-		/* Find this wake interval by looking at the first agreement */
-		agr = list_first_entry_or_null(&wi->agreements, struct morse_twt_agreement, list);
-		if (!agr)
-			return NULL;
-
-		wi_us = agr->data.wake_interval_us;
+		u64 wi_us = wi->wake_interval_us;
 
 		/* We found the exact value. */
 		if (wi_us == wake_interval_us) {
 			return wi;
 			/* The exact value doesn't exist but a larger one is in the list. */
 		} else if (wi_us > wake_interval_us) {
-			temp = kmalloc(sizeof(*temp), GFP_ATOMIC);
+			temp = morse_twt_wake_interval_alloc(twt, wake_interval_us);
 			if (!temp)
 				return NULL;
-			INIT_LIST_HEAD(&temp->agreements);
 			if (wi->list.prev == head)
 				list_add(&temp->list, head);
 			else
@@ -906,10 +1109,9 @@ static struct morse_twt_wake_interval *morse_twt_agreement_wake_interval_get(str
 			return temp;
 			/* The exact value is not in the list and there are no larger ones. */
 		} else if (wi->list.next == head) {
-			temp = kmalloc(sizeof(*temp), GFP_ATOMIC);
+			temp = morse_twt_wake_interval_alloc(twt, wake_interval_us);
 			if (!temp)
 				return NULL;
-			INIT_LIST_HEAD(&temp->agreements);
 			list_add_tail(&temp->list, head);
 			return temp;
 		}
@@ -919,7 +1121,141 @@ static struct morse_twt_wake_interval *morse_twt_agreement_wake_interval_get(str
 }
 
 /**
- * morse_twt_agreement_wake_interval_add() -	Adds an agreement to a wake interval list.
+ * morse_twt_sps_overlap() - Check whether the service periods of two agreements ever overlap.
+ *
+ * @a		The first agreement
+ * @b		The second agreement
+ *
+ * The service periods of the two agreements start a whole multiple of gcd(Ta, Tb) apart, plus
+ * the difference of their wake times.
+ *
+ * @return true if the service periods overlap, else false
+ */
+static bool morse_twt_sps_overlap(const struct morse_twt_agreement_data *a,
+				  const struct morse_twt_agreement_data *b)
+{
+	u64 gcd_us = morse_twt_gcd64(a->wake_interval_us, b->wake_interval_us);
+	u64 a_us;
+	u64 b_us;
+	u64 diff_us;
+
+	div64_u64_rem(a->wake_time_us, gcd_us, &a_us);
+	div64_u64_rem(b->wake_time_us, gcd_us, &b_us);
+	diff_us = (a_us >= b_us) ? a_us - b_us : a_us + gcd_us - b_us;
+
+	return diff_us < b->wake_duration_us || gcd_us - diff_us < a->wake_duration_us;
+}
+
+/**
+ * morse_twt_agreement_overlaps() - Check whether an agreement overlaps any other agreement.
+ *
+ * @twt		The TWT struct
+ * @agr		The agreement to check
+ *
+ * @return true if a service period of the agreement overlaps another, else false
+ */
+static bool morse_twt_agreement_overlaps(struct morse_twt *twt, struct morse_twt_agreement *agr)
+{
+	struct morse_twt_wake_interval *iter;
+	struct morse_twt_agreement *ptr;
+
+	list_for_each_entry(iter, &twt->wake_intervals, list) {
+		list_for_each_entry(ptr, &iter->agreements, list) {
+			if (ptr != agr && ptr->data.wake_interval_us &&
+			    morse_twt_sps_overlap(&ptr->data, &agr->data))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * morse_twt_agreement_timeline_add() -	Place an agreement's service period to overlap the
+ *					service periods of the existing agreements as little as
+ *					possible, and add it to its wake interval list.
+ *
+ * @mors	Morse device
+ * @twt		The TWT struct
+ * @wi		The wake interval list for the agreement
+ * @agr		The agreement to place
+ *
+ * Every existing agreement is folded onto the wake interval T of the new agreement, see
+ * morse_twt_timeline_fold(). The wake interval keeps that timeline up to date as agreements
+ * come and go, so it is only built here if the wake interval has none. The wake time is then
+ * chosen at the start of the least occupied window of the wake duration, earliest first,
+ * which packs agreements together while free time remains.
+ *
+ * @return 0 on success, else error code
+ */
+static int morse_twt_agreement_timeline_add(struct morse *mors,
+					    struct morse_twt *twt,
+					    struct morse_twt_wake_interval *wi,
+					    struct morse_twt_agreement *agr)
+{
+	u64 *timeline = wi->timeline;
+	const u64 interval_us = agr->data.wake_interval_us;
+	u64 bin_us;
+	const u32 num_bins = morse_twt_timeline_bins(interval_us, &bin_us);
+	/* Windows that take in the shorter last bin must still cover the wake duration. */
+	const u64 win_us = agr->data.wake_duration_us + num_bins * bin_us - interval_us;
+	const u32 win_bins = clamp_t(u64, div64_u64(win_us + bin_us - 1, bin_us), 1, num_bins);
+	struct morse_twt_agreement *ptr;
+	u64 best_cost;
+	u64 cost = 0;
+	u64 offset_us;
+	u32 best = 0;
+	u32 i;
+
+	if (!timeline) {
+		timeline = twt->timeline;
+		morse_twt_timeline_build(twt, timeline, interval_us, agr);
+	}
+
+	/* Slide a window of the wake duration around the wake interval. */
+	for (i = 0; i < win_bins; i++)
+		cost += timeline[i];
+
+	best_cost = cost;
+	for (i = 1; i < num_bins && best_cost; i++) {
+		cost += timeline[(i + win_bins - 1) % num_bins];
+		cost -= timeline[i - 1];
+
+		if (cost < best_cost) {
+			best_cost = cost;
+			best = i;
+		}
+	}
+
+	offset_us = best * bin_us;
+	agr->data.wake_time_us = offset_us;
+
+	/* The timeline leaves out service periods it cannot resolve, so check the choice exactly. */
+	if (morse_twt_agreement_overlaps(twt, agr)) {
+		twt->num_overlapped++;
+		MORSE_TWT_DBG(mors, "No free TWT service period for wake interval %lluus\n",
+			      interval_us);
+	}
+
+	/* Keep the wake interval list ordered by offset. */
+	list_for_each_entry(ptr, &wi->agreements, list) {
+		u64 ptr_offset_us;
+
+		div64_u64_rem(ptr->data.wake_time_us, ptr->data.wake_interval_us, &ptr_offset_us);
+		if (ptr_offset_us > offset_us)
+			break;
+	}
+	list_add_tail(&agr->list, &ptr->list);
+
+	MORSE_TWT_DBG(mors, "Placed TWT entry for wake interval %lluus at wake time %lluus\n",
+		      interval_us, agr->data.wake_time_us);
+
+	return 0;
+}
+
+/**
+ * morse_twt_agreement_wake_interval_place() -	Places an agreement and adds it to its wake
+ *						interval list.
  *
  * @mors	Morse device
  * @twt		The TWT struct
@@ -927,9 +1263,9 @@ static struct morse_twt_wake_interval *morse_twt_agreement_wake_interval_get(str
  *
  * @return 0 on success, else error code
  */
-static int morse_twt_agreement_wake_interval_add(struct morse *mors,
-						 struct morse_twt *twt,
-						 struct morse_twt_agreement *agr)
+static int morse_twt_agreement_wake_interval_place(struct morse *mors,
+						   struct morse_twt *twt,
+						   struct morse_twt_agreement *agr)
 {
 	struct morse_twt_wake_interval *wi;
 	struct morse_twt_agreement *ptr;
@@ -947,6 +1283,10 @@ static int morse_twt_agreement_wake_interval_add(struct morse *mors,
 	if (!wi)
 		return -EINVAL;
 
+	if (twt_timeline_sched && twt->timeline && agr->data.wake_interval_us &&
+	    morse_twt_get_command(agr->data.params.req_type) != TWT_SETUP_CMD_DEMAND)
+		return morse_twt_agreement_timeline_add(mors, twt, wi, agr);
+
 	if (list_empty(&wi->agreements)) {
 		agr->data.wake_time_us = 0;
 		list_add(&agr->list, &wi->agreements);
@@ -1014,6 +1354,44 @@ static int morse_twt_agreement_wake_interval_add(struct morse *mors,
 	return -EBADSLT;
 }
 
+/**
+ * morse_twt_agreement_wake_interval_add() -	Adds an agreement to a wake interval list.
+ *
+ * @mors	Morse device
+ * @twt		The TWT struct
+ * @agr		The agreement to insert
+ *
+ * @return 0 on success, else error code
+ */
+static int morse_twt_agreement_wake_interval_add(struct morse *mors,
+						 struct morse_twt *twt,
+						 struct morse_twt_agreement *agr)
+{
+	int ret = morse_twt_agreement_wake_interval_place(mors, twt, agr);
+
+	if (!ret)
+		morse_twt_wake_intervals_fold(twt, agr, false);
+
+	return ret;
+}
+
+/* The TWT timeline KUnit tests are built as a module of their own */
+#ifdef CONFIG_MORSE_TWT_KUNIT_TEST
+int morse_twt_test_agreement_add(struct morse *mors, struct morse_twt *twt,
+				 struct morse_twt_agreement *agr)
+{
+	return morse_twt_agreement_wake_interval_add(mors, twt, agr);
+}
+EXPORT_SYMBOL(morse_twt_test_agreement_add);
+
+int morse_twt_test_agreement_remove(struct morse *mors, struct morse_twt *twt,
+				    struct morse_twt_agreement *agr)
+{
+	return morse_twt_agreement_remove(mors, twt, agr);
+}
+EXPORT_SYMBOL(morse_twt_test_agreement_remove);
+#endif
+
 /**
  * morse_twt_send_accept() -	Adds an accept message to the tx queue. During this process the
  *				agreement from the event is copied to the TWT station list entry and
@@ -2078,6 +2456,11 @@ void morse_twt_init_vif(struct morse *mors, struct morse_vif *mors_vif,
 	INIT_LIST_HEAD(&twt->sta_vif.to_install_uninstall);
 
 	if (responder) {
+		/* Without the timeline, agreements fall back to first fit within a wake interval */
+		if (!twt->timeline)
+			twt->timeline = kcalloc(MORSE_TWT_TIMELINE_BINS, sizeof(*twt->timeline),
+						GFP_KERNEL);
+		twt->num_overlapped = 0;
 		twt->responder = true;
 		MORSE_TWT_INFO(mors, "TWT responder mode is enabled\n");
 	} else {
@@ -2105,6 +2488,9 @@ void morse_twt_finish_vif(struct morse *mors, struct morse_vif *mors_vif)
 	spin_unlock_bh(&twt->lock);
 
 	morse_twt_event_queue_purge(mors, mors_vif, NULL);
+
+	kfree(twt->timeline);
+	twt->timeline = NULL;
 }
 
 static int twt_calculate_wake_duration(int wake_duration)
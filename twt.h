@@ -28,6 +28,12 @@
 #define TWT_AGREEMENT_WAKE_INTERVAL_MANTISSA_OFFSET	(12)
 #define TWT_TEARDOWN_FLOW_ID_MASK GENMASK(2, 0)
 
+/*
+ * Number of bins the wake interval being scheduled is divided into. Every placed agreement takes
+ * at least one bin, so this also bounds how many agreements can be placed without overlapping.
+ */
+#define MORSE_TWT_TIMELINE_BINS				(4096)
+
 enum morse_twt_state {
 	MORSE_TWT_STATE_NO_AGREEMENT,
 	MORSE_TWT_STATE_CONSIDER_REQUEST,
@@ -117,6 +123,9 @@ struct morse_twt_sta {
 struct morse_twt_wake_interval {
 	struct list_head list;
 	struct list_head agreements;
+	u64 wake_interval_us;
+	/* Service periods of every agreement folded onto the wake interval, or NULL */
+	u64 *timeline;
 };
 
 static inline struct morse_vif *morse_twt_to_morse_vif(struct morse_twt *twt)
@@ -327,6 +336,34 @@ int morse_twt_initialise_agreement(struct morse_twt_agreement_data *twt_data, u8
 int morse_process_twt_cmd(struct morse *mors, struct morse_vif *mors_vif,
 			  struct morse_cmd_req *cmd);
 
+#ifdef CONFIG_MORSE_TWT_KUNIT_TEST
+/**
+ * morse_twt_test_agreement_add() - Place an agreement and add it to its wake interval list,
+ *				    for the KUnit tests
+ *
+ * @mors	Morse device
+ * @twt		The TWT struct, with a timeline of MORSE_TWT_TIMELINE_BINS bins
+ * @agr		The agreement to place
+ *
+ * @return 0 on success, else error code
+ */
+int morse_twt_test_agreement_add(struct morse *mors, struct morse_twt *twt,
+				 struct morse_twt_agreement *agr);
+
+/**
+ * morse_twt_test_agreement_remove() - Remove an agreement from its wake interval list, for the
+ *				       KUnit tests
+ *
+ * @mors	Morse device
+ * @twt		The TWT struct
+ * @agr		The agreement to remove
+ *
+ * @return 0 on success, else error code
+ */
+int morse_twt_test_agreement_remove(struct morse *mors, struct morse_twt *twt,
+				    struct morse_twt_agreement *agr);
+#endif
+
  /**
   * morse_dot11_is_twt_setup_action_frame() - Checks if TWT setup action frame
   *
@@ -0,0 +1,393 @@
+/*
+ * Copyright 2025 Morse Micro
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * KUnit tests for the TWT service period scheduler. Each test places synthetic agreements through
+ * their wake interval lists, which keep the timeline of every agreement folded onto them, and
+ * checks their service periods, over the hyperperiod of the wake intervals, against an exact
+ * model of when two periodic service periods meet.
+ */
+
+#include <kunit/test.h>
+#include <linux/device.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/random.h>
+#include <linux/sort.h>
+
+#include "twt.h"
+
+/* A beacon interval of 100 TU */
+#define TWT_TEST_BASE_INTERVAL_US	(102400)
+
+#define TWT_TEST_HARMONIC_AGREEMENTS	(2048)
+#define TWT_TEST_HARMONIC_INTERVALS	(4)
+
+#define TWT_TEST_FOLDING_AGREEMENTS	(96)
+/* Wake intervals whose pairwise greatest common divisor is 60 ms */
+static const u64 twt_test_folding_intervals_us[] = { 120000, 180000, 300000, 420000 };
+#define TWT_TEST_FOLDING_HYPERPERIOD_US	(12600000)
+
+#define TWT_TEST_MAX_AGREEMENTS		TWT_TEST_HARMONIC_AGREEMENTS
+
+struct twt_test_sp {
+	u64 start_us;
+	u64 end_us;
+};
+
+struct twt_test_ctx {
+	struct device *dev;
+	struct morse *mors;
+	struct morse_twt twt;
+	struct morse_twt_agreement *agrs;
+	u32 num_agrs;
+	struct rnd_state rnd;
+};
+
+static int twt_test_init(struct kunit *test)
+{
+	struct twt_test_ctx *ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+	struct device *dev;
+
+	if (!ctx)
+		return -ENOMEM;
+
+	ctx->mors = kunit_kzalloc(test, sizeof(*ctx->mors), GFP_KERNEL);
+	ctx->twt.timeline = kunit_kcalloc(test, MORSE_TWT_TIMELINE_BINS,
+					  sizeof(*ctx->twt.timeline), GFP_KERNEL);
+	ctx->agrs = kunit_kcalloc(test, TWT_TEST_MAX_AGREEMENTS, sizeof(*ctx->agrs),
+				  GFP_KERNEL);
+	if (!ctx->mors || !ctx->twt.timeline || !ctx->agrs)
+		return -ENOMEM;
+
+	/* The scheduler logs against the device */
+	dev = root_device_register("morse_twt_test");
+	if (IS_ERR(dev))
+		return PTR_ERR(dev);
+	ctx->dev = dev;
+	ctx->mors->dev = dev;
+
+	INIT_LIST_HEAD(&ctx->twt.wake_intervals);
+
+	prandom_seed_state(&ctx->rnd, 0x7177);
+	test->priv = ctx;
+	return 0;
+}
+
+static void twt_test_exit(struct kunit *test)
+{
+	struct twt_test_ctx *ctx = test->priv;
+	u32 i;
+
+	if (!ctx)
+		return;
+
+	/* The wake interval lists and their timelines are not managed by KUnit */
+	for (i = 0; i < ctx->num_agrs; i++)
+		morse_twt_test_agreement_remove(ctx->mors, &ctx->twt, &ctx->agrs[i]);
+
+	if (!IS_ERR_OR_NULL(ctx->dev))
+		root_device_unregister(ctx->dev);
+}
+
+static u64 twt_test_gcd64(u64 a, u64 b)
+{
+	while (b) {
+		u64 rem;
+
+		div64_u64_rem(a, b, &rem);
+		a = b;
+		b = rem;
+	}
+
+	return a;
+}
+
+/*
+ * The service periods of two agreements start a whole multiple of gcd(Ta, Tb) apart, plus the
+ * difference of their wake times. They meet if any of those distances is shorter than the
+ * service period that starts first.
+ */
+static bool twt_test_overlap(const struct morse_twt_agreement_data *a,
+			     const struct morse_twt_agreement_data *b)
+{
+	u64 gcd_us = twt_test_gcd64(a->wake_interval_us, b->wake_interval_us);
+	u64 a_us;
+	u64 b_us;
+	u64 diff_us;
+
+	div64_u64_rem(a->wake_time_us, gcd_us, &a_us);
+	div64_u64_rem(b->wake_time_us, gcd_us, &b_us);
+	diff_us = (a_us >= b_us) ? a_us - b_us : a_us + gcd_us - b_us;
+
+	return diff_us < b->wake_duration_us || gcd_us - diff_us < a->wake_duration_us;
+}
+
+static struct morse_twt_agreement *twt_test_add(struct kunit *test, u64 interval_us,
+						u32 duration_us)
+{
+	struct twt_test_ctx *ctx = test->priv;
+	struct morse_twt_agreement *agr = &ctx->agrs[ctx->num_agrs++];
+
+	INIT_LIST_HEAD(&agr->list);
+	agr->state = MORSE_TWT_STATE_CONSIDER_REQUEST;
+	agr->data.wake_interval_us = interval_us;
+	agr->data.wake_duration_us = duration_us;
+	KUNIT_EXPECT_EQ(test, morse_twt_test_agreement_add(ctx->mors, &ctx->twt, agr), 0);
+	KUNIT_EXPECT_LT(test, agr->data.wake_time_us, interval_us);
+
+	return agr;
+}
+
+/* Check every pair of agreements, and that each wake interval list is ordered by wake time */
+static void twt_test_check_pairs(struct kunit *test)
+{
+	struct twt_test_ctx *ctx = test->priv;
+	struct morse_twt_wake_interval *wi;
+	u32 overlaps = 0;
+	u32 i;
+	u32 j;
+
+	for (i = 0; i < ctx->num_agrs; i++) {
+		if (list_empty(&ctx->agrs[i].list))
+			continue;
+
+		for (j = i + 1; j < ctx->num_agrs; j++) {
+			if (list_empty(&ctx->agrs[j].list))
+				continue;
+
+			if (twt_test_overlap(&ctx->agrs[i].data, &ctx->agrs[j].data) &&
+			    overlaps++ < 8)
+				KUNIT_FAIL(test, "%lluus/%uus at %lluus overlaps %lluus/%uus at %lluus",
+					   ctx->agrs[i].data.wake_interval_us,
+					   ctx->agrs[i].data.wake_duration_us,
+					   ctx->agrs[i].data.wake_time_us,
+					   ctx->agrs[j].data.wake_interval_us,
+					   ctx->agrs[j].data.wake_duration_us,
+					   ctx->agrs[j].data.wake_time_us);
+		}
+	}
+	KUNIT_EXPECT_EQ(test, overlaps, (u32)0);
+
+	list_for_each_entry(wi, &ctx->twt.wake_intervals, list) {
+		struct morse_twt_agreement *agr;
+		u64 prev_us = 0;
+
+		list_for_each_entry(agr, &wi->agreements, list) {
+			KUNIT_EXPECT_GE(test, agr->data.wake_time_us, prev_us);
+			prev_us = agr->data.wake_time_us;
+		}
+	}
+}
+
+/*
+ * Wake intervals that are powers of two multiples of one another, as a beacon aligned
+ * configuration has, fold exactly onto each other. Thousands of agreements must pack without
+ * a single overlap while free time remains.
+ */
+static void twt_test_harmonic(struct kunit *test)
+{
+	struct twt_test_ctx *ctx = test->priv;
+	u32 i;
+
+	for (i = 0; i < TWT_TEST_HARMONIC_AGREEMENTS; i++) {
+		u32 wi = prandom_u32_state(&ctx->rnd) % TWT_TEST_HARMONIC_INTERVALS;
+		u32 duration_us = TWT_WAKE_DURATION_UNIT * (1 + prandom_u32_state(&ctx->rnd) % 2);
+
+		twt_test_add(test, (u64)TWT_TEST_BASE_INTERVAL_US << (4 + 2 * wi), duration_us);
+	}
+
+	KUNIT_EXPECT_EQ(test, ctx->twt.num_overlapped, (u32)0);
+	twt_test_check_pairs(test);
+}
+
+static int twt_test_sp_cmp(const void *a, const void *b)
+{
+	const struct twt_test_sp *sp_a = a;
+	const struct twt_test_sp *sp_b = b;
+
+	if (sp_a->start_us == sp_b->start_us)
+		return 0;
+
+	return sp_a->start_us < sp_b->start_us ? -1 : 1;
+}
+
+/*
+ * Wake intervals that are not multiples of one another only meet over the hyperperiod of
+ * their least common multiple. Lay out every service period of that hyperperiod and check that
+ * they follow one another, which checks the folding independently of the pairwise model.
+ */
+static void twt_test_folding(struct kunit *test)
+{
+	struct twt_test_ctx *ctx = test->priv;
+	struct twt_test_sp *sps;
+	u32 num_sps = 0;
+	u32 max_sps = 0;
+	u32 i;
+
+	for (i = 0; i < ARRAY_SIZE(twt_test_folding_intervals_us); i++) {
+		u64 rem_us;
+
+		div64_u64_rem(TWT_TEST_FOLDING_HYPERPERIOD_US, twt_test_folding_intervals_us[i],
+			      &rem_us);
+		KUNIT_ASSERT_EQ(test, rem_us, (u64)0);
+	}
+
+	for (i = 0; i < TWT_TEST_FOLDING_AGREEMENTS; i++) {
+		u32 wi = prandom_u32_state(&ctx->rnd) % ARRAY_SIZE(twt_test_folding_intervals_us);
+		u32 duration_us = TWT_WAKE_DURATION_UNIT * (2 + prandom_u32_state(&ctx->rnd) % 4);
+		u64 interval_us = twt_test_folding_intervals_us[wi];
+
+		twt_test_add(test, interval_us, duration_us);
+		max_sps += div64_u64(TWT_TEST_FOLDING_HYPERPERIOD_US, interval_us);
+	}
+
+	KUNIT_EXPECT_EQ(test, ctx->twt.num_overlapped, (u32)0);
+	twt_test_check_pairs(test);
+
+	sps = kunit_kcalloc(test, max_sps, sizeof(*sps), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, sps);
+
+	for (i = 0; i < ctx->num_agrs; i++) {
+		const struct morse_twt_agreement_data *data = &ctx->agrs[i].data;
+		u64 start_us;
+
+		for (start_us = data->wake_time_us; start_us < TWT_TEST_FOLDING_HYPERPERIOD_US;
+		     start_us += data->wake_interval_us) {
+			sps[num_sps].start_us = start_us;
+			sps[num_sps].end_us = start_us + data->wake_duration_us;
+			num_sps++;
+		}
+	}
+	KUNIT_ASSERT_EQ(test, num_sps, max_sps);
+
+	sort(sps, num_sps, sizeof(*sps), twt_test_sp_cmp, NULL);
+
+	for (i = 1; i < num_sps; i++)
+		KUNIT_EXPECT_LE(test, sps[i - 1].end_us, sps[i].start_us);
+
+	/* The hyperperiod repeats, so the last service period must end before the first */
+	KUNIT_EXPECT_LE(test, sps[num_sps - 1].end_us,
+			sps[0].start_us + TWT_TEST_FOLDING_HYPERPERIOD_US);
+}
+
+/*
+ * An agreement with a wake interval over a thousand times longer is seen by less than one
+ * in a thousand of the new agreement's service periods, but must still be avoided.
+ */
+static void twt_test_rare_sps(struct kunit *test)
+{
+	struct twt_test_ctx *ctx = test->priv;
+	struct morse_twt_agreement *rare;
+	struct morse_twt_agreement *agr;
+
+	rare = twt_test_add(test, (u64)TWT_TEST_BASE_INTERVAL_US * 2048,
+			    TWT_WAKE_DURATION_UNIT * 4);
+	agr = twt_test_add(test, TWT_TEST_BASE_INTERVAL_US, TWT_WAKE_DURATION_UNIT);
+
+	KUNIT_EXPECT_FALSE(test, twt_test_overlap(&rare->data, &agr->data));
+	KUNIT_EXPECT_EQ(test, ctx->twt.num_overlapped, (u32)0);
+}
+
+/*
+ * A wake interval of 136250us is divided into 4008 bins of 34us, the last of them only 12us
+ * long. A window of 10 bins that takes it in holds 318us, so a service period of 340us placed
+ * there runs into the first service period of the next wake interval, and is overlapped.
+ */
+static void twt_test_last_bin(struct kunit *test)
+{
+	struct twt_test_ctx *ctx = test->priv;
+	struct morse_twt_agreement *agr;
+
+	/* Leave only the last 10 bins free */
+	twt_test_add(test, 136250, 1920 * 34);
+	twt_test_add(test, 136250, 1920 * 34);
+	agr = twt_test_add(test, 136250, 158 * 34);
+	KUNIT_EXPECT_EQ(test, agr->data.wake_time_us, (u64)3840 * 34);
+	KUNIT_EXPECT_EQ(test, ctx->twt.num_overlapped, (u32)0);
+
+	twt_test_add(test, 136250, 10 * 34);
+	KUNIT_EXPECT_EQ(test, ctx->twt.num_overlapped, (u32)1);
+}
+
+/*
+ * Agreements that fill the wake interval exactly take consecutive service periods, earliest
+ * first. Every agreement after that, or one that comes round more often than its service
+ * period fits, is counted as overlapped.
+ */
+static void twt_test_saturation(struct kunit *test)
+{
+	struct twt_test_ctx *ctx = test->priv;
+	const u32 duration_us = TWT_TEST_BASE_INTERVAL_US / 8;
+	struct morse_twt_agreement *agr;
+	u32 i;
+
+	for (i = 0; i < 8; i++) {
+		agr = twt_test_add(test, TWT_TEST_BASE_INTERVAL_US, duration_us);
+		KUNIT_EXPECT_EQ(test, agr->data.wake_time_us, (u64)i * duration_us);
+	}
+	KUNIT_EXPECT_EQ(test, ctx->twt.num_overlapped, (u32)0);
+	twt_test_check_pairs(test);
+
+	twt_test_add(test, TWT_TEST_BASE_INTERVAL_US, TWT_WAKE_DURATION_UNIT);
+	KUNIT_EXPECT_EQ(test, ctx->twt.num_overlapped, (u32)1);
+
+	/* Its service periods are 100us apart against the others, so none can be avoided */
+	twt_test_add(test, TWT_TEST_BASE_INTERVAL_US + 100, TWT_WAKE_DURATION_UNIT);
+	KUNIT_EXPECT_EQ(test, ctx->twt.num_overlapped, (u32)2);
+}
+
+/*
+ * An agreement leaving takes its service periods out of the timeline of every wake interval,
+ * so a later agreement of another wake interval can take the time it freed.
+ */
+static void twt_test_remove(struct kunit *test)
+{
+	struct twt_test_ctx *ctx = test->priv;
+	const u32 duration_us = TWT_TEST_BASE_INTERVAL_US / 8;
+	struct morse_twt_agreement *removed = NULL;
+	struct morse_twt_agreement *agr;
+	u32 i;
+
+	for (i = 0; i < 7; i++) {
+		agr = twt_test_add(test, TWT_TEST_BASE_INTERVAL_US, duration_us);
+		if (i == 3)
+			removed = agr;
+	}
+
+	/* Only the last eighth is free, in both halves of the longer wake interval */
+	agr = twt_test_add(test, 2 * TWT_TEST_BASE_INTERVAL_US, duration_us);
+	KUNIT_EXPECT_EQ(test, agr->data.wake_time_us, (u64)7 * duration_us);
+
+	KUNIT_ASSERT_EQ(test, morse_twt_test_agreement_remove(ctx->mors, &ctx->twt, removed), 0);
+	KUNIT_EXPECT_TRUE(test, list_empty(&removed->list));
+
+	agr = twt_test_add(test, 2 * TWT_TEST_BASE_INTERVAL_US, duration_us);
+	KUNIT_EXPECT_EQ(test, agr->data.wake_time_us, (u64)3 * duration_us);
+	KUNIT_EXPECT_EQ(test, ctx->twt.num_overlapped, (u32)0);
+	twt_test_check_pairs(test);
+}
+
+static struct kunit_case twt_test_cases[] = {
+	KUNIT_CASE(twt_test_harmonic),
+	KUNIT_CASE(twt_test_folding),
+	KUNIT_CASE(twt_test_rare_sps),
+	KUNIT_CASE(twt_test_last_bin),
+	KUNIT_CASE(twt_test_saturation),
+	KUNIT_CASE(twt_test_remove),
+	{}
+};
+
+static struct kunit_suite twt_test_suite = {
+	.name = "morse_twt_timeline",
+	.init = twt_test_init,
+	.exit = twt_test_exit,
+	.test_cases = twt_test_cases,
+};
+
+kunit_test_suite(twt_test_suite);
+
+MODULE_AUTHOR("Morse Micro");
+MODULE_DESCRIPTION("KUnit tests for the Morse Micro TWT service period scheduler");
+MODULE_LICENSE("Dual BSD/GPL");
@@ -7,6 +7,13 @@
 #include "linux/jiffies.h"
 #include <linux/module.h>
 #include <linux/usb.h>
+#include <linux/scatterlist.h>
+#include <linux/dma-mapping.h>
+#if KERNEL_VERSION(4, 11, 0) <= LINUX_VERSION_CODE
+#include <linux/sched/task_stack.h>
+#else
+#include <linux/sched.h>
+#endif
 
 #include "morse.h"
 #include "mac.h"
@@ -34,6 +41,14 @@
  */
 #define URB_TIMEOUT_MS                  250
 
+/** Number of command + bulk transfer pairs kept in flight by the pipelined engine */
+#define MORSE_USB_XFER_DEPTH		4
+
+static bool usb_pipelined_xfer;
+module_param(usb_pipelined_xfer, bool, 0644);
+MODULE_PARM_DESC(usb_pipelined_xfer,
+	"Keep several bulk transfers in flight rather than waiting for each one to complete");
+
 #define MORSE_USB_DBG(_m, _f, _a...)		morse_dbg(FEATURE_ID_USB, _m, _f, ##_a)
 #define MORSE_USB_INFO(_m, _f, _a...)		morse_info(FEATURE_ID_USB, _m, _f, ##_a)
 #define MORSE_USB_WARN(_m, _f, _a...)		morse_warn(FEATURE_ID_USB, _m, _f, ##_a)
@@ -56,6 +71,35 @@ struct morse_usb_endpoint {
 	int size;		/* Size of endpoint */
 };
 
+struct morse_usb;
+
+/**
+ * struct morse_usb_xfer - one command + bulk transfer pair of the pipelined engine
+ *
+ * @musb: owning USB instance.
+ * @cmd_urb: URB sending @cmd on the memory write endpoint.
+ * @data_urb: URB moving the data on the memory read or write endpoint.
+ * @cmd: command announcing the bulk transfer, coherent memory.
+ * @bounce: buffer used when the caller's buffer can't be mapped for DMA.
+ * @copy_to: where to copy @bounce once a bounced read completes, otherwise NULL.
+ * @len: length of the bulk transfer.
+ * @sg_slice: scatterlist describing the portion of a gathered write sent by @data_urb.
+ * @done: completed when @data_urb finishes.
+ * @in_use: set while the slot has URBs submitted.
+ */
+struct morse_usb_xfer {
+	struct morse_usb *musb;
+	struct urb *cmd_urb;
+	struct urb *data_urb;
+	struct morse_usb_command *cmd;
+	u8 *bounce;
+	u8 *copy_to;
+	int len;
+	struct scatterlist sg_slice[MORSE_BUS_SG_MAX_ENTS];
+	struct completion done;
+	bool in_use;
+};
+
 enum morse_usb_flags {
 	MORSE_USB_FLAG_ATTACHED,
 	MORSE_USB_FLAG_SUSPENDED
@@ -86,6 +130,17 @@ struct morse_usb {
 
 	/* Bitmask of flags for state of USB device */
 	unsigned long flags;
+
+	/* Scratch table describing the portion of a gathered write sent by one URB */
+	struct scatterlist sg_slice[MORSE_BUS_SG_MAX_ENTS];
+
+	/* Pipelined transfer engine. Every URB it submits is anchored here */
+	struct usb_anchor xfer_anchor;
+	struct morse_usb_xfer xfers[MORSE_USB_XFER_DEPTH];
+	/* First error reported by a pipelined URB since the engine was last started */
+	atomic_t xfer_error;
+	/* Selects the pipelined engine for bulk transfers */
+	bool pipelined;
 };
 
 /*
@@ -442,11 +497,32 @@ error:
 	return ret;
 }
 
-static int morse_usb_mem_write(struct morse_usb *musb, u32 address, u8 *data, ssize_t size)
+/*
+ * Whether the host controller can take a scatterlist URB with arbitrary segment lengths.
+ * Otherwise every segment but the last would need to be a multiple of the max packet size.
+ */
+static bool morse_usb_can_sg(struct morse_usb *musb, int nents)
+{
+#if KERNEL_VERSION(3, 15, 0) <= LINUX_VERSION_CODE
+	return musb->udev->bus->no_sg_constraint && nents <= musb->udev->bus->sg_tablesize;
+#else
+	return false;
+#endif
+}
+
+/*
+ * Write to chip memory from either a linear buffer (sgl is NULL) or a scatterlist. Scatterlists
+ * are handed to the host controller directly where it supports it, otherwise they are gathered
+ * into the endpoint buffer in a single pass.
+ */
+static int __morse_usb_mem_write(struct morse_usb *musb, u32 address, const u8 *data,
+				 struct scatterlist *sgl, int nents, ssize_t size)
 {
 	int ret;
 	struct morse_usb_command cmd;
 	struct morse *mors = usb_get_intfdata(musb->interface);
+	struct urb *urb = musb->endpoints[MORSE_EP_MEM_WR].urb;
+	bool use_sg = sgl && morse_usb_can_sg(musb, nents);
 
 	if (!test_bit(MORSE_USB_FLAG_ATTACHED, &musb->flags))
 		return -ENODEV;
@@ -466,20 +542,27 @@ static int morse_usb_mem_write(struct morse_usb *musb, u32 address, u8 *data, ss
 		goto error;
 	}
 
-	morse_usb_buff_log(mors, (const char *)data, size, "WR-DATA: ");
-
-	memcpy(musb->endpoints[MORSE_EP_MEM_WR].buffer, data, size);
+	if (!sgl) {
+		morse_usb_buff_log(mors, (const char *)data, size, "WR-DATA: ");
+		memcpy(musb->endpoints[MORSE_EP_MEM_WR].buffer, data, size);
+	} else if (!use_sg) {
+		sg_copy_to_buffer(sgl, nents, musb->endpoints[MORSE_EP_MEM_WR].buffer, size);
+	}
 
 	/* prepare a read */
-	usb_fill_bulk_urb(musb->endpoints[MORSE_EP_MEM_WR].urb,
+	usb_fill_bulk_urb(urb,
 			  musb->udev,
 			  usb_sndbulkpipe(musb->udev,
 					  musb->endpoints[MORSE_EP_MEM_WR].addr),
-			  musb->endpoints[MORSE_EP_MEM_WR].buffer,
+			  use_sg ? NULL : musb->endpoints[MORSE_EP_MEM_WR].buffer,
 			  size, morse_usb_mem_rw_callback, mors);
+	if (use_sg) {
+		urb->sg = sgl;
+		urb->num_sgs = nents;
+	}
 
 	/* do it */
-	ret = usb_submit_urb(musb->endpoints[MORSE_EP_MEM_WR].urb, GFP_ATOMIC);
+	ret = usb_submit_urb(urb, GFP_ATOMIC);
 	if (ret < 0) {
 		MORSE_USB_ERR(mors, "%s - failed submitting write urb, error %d\n",
 			      __func__, ret);
@@ -494,7 +577,7 @@ static int morse_usb_mem_write(struct morse_usb *musb, u32 address, u8 *data, ss
 		goto error;
 	} else if (ret == 0) {
 		/* Timed out. */
-		usb_kill_urb(musb->endpoints[MORSE_EP_MEM_WR].urb);
+		usb_kill_urb(urb);
 	}
 
 	if (musb->errors) {
@@ -506,11 +589,297 @@ static int morse_usb_mem_write(struct morse_usb *musb, u32 address, u8 *data, ss
 	ret = size;
 
 error:
+	/* The URB is shared with linear writes, don't leave the scatterlist attached */
+	urb->sg = NULL;
+	urb->num_sgs = 0;
 	musb->ongoing_rw = 0;
 	mutex_unlock(&musb->lock);
 	return ret;
 }
 
+static int morse_usb_mem_write(struct morse_usb *musb, u32 address, u8 *data, ssize_t size)
+{
+	return __morse_usb_mem_write(musb, address, data, NULL, 0, size);
+}
+
+static void morse_usb_xfer_cmd_callback(struct urb *urb)
+{
+	struct morse_usb_xfer *xfer = urb->context;
+
+	if (urb->status)
+		atomic_cmpxchg(&xfer->musb->xfer_error, 0, urb->status);
+}
+
+static void morse_usb_xfer_data_callback(struct urb *urb)
+{
+	struct morse_usb_xfer *xfer = urb->context;
+
+	if (urb->status)
+		atomic_cmpxchg(&xfer->musb->xfer_error, 0, urb->status);
+
+	complete(&xfer->done);
+}
+
+/*
+ * Whether a caller's buffer can be handed to the host controller without bouncing. Reads
+ * also need the buffer to own whole cache lines, so invalidating them for DMA can't discard
+ * neighbouring data.
+ */
+static bool morse_usb_buf_can_map(const void *buf, int len, bool is_read)
+{
+	if (!virt_addr_valid(buf) || object_is_on_stack(buf))
+		return false;
+
+	if (is_read)
+		return IS_ALIGNED((uintptr_t)buf | len, dma_get_cache_alignment());
+
+	return true;
+}
+
+/* Wait for a slot's transfer to complete and finish off a bounced read */
+static int morse_usb_xfer_reap(struct morse_usb *musb, struct morse_usb_xfer *xfer)
+{
+	int err;
+
+	if (!xfer->in_use)
+		return 0;
+
+	if (!wait_for_completion_timeout(&xfer->done, msecs_to_jiffies(URB_TIMEOUT_MS)))
+		return -ETIMEDOUT;
+
+	xfer->in_use = false;
+	xfer->data_urb->sg = NULL;
+	xfer->data_urb->num_sgs = 0;
+
+	err = atomic_read(&musb->xfer_error);
+	if (err)
+		return err;
+
+	if (xfer->copy_to)
+		memcpy(xfer->copy_to, xfer->bounce, xfer->len);
+
+	return 0;
+}
+
+static int morse_usb_xfer_submit(struct morse_usb *musb, struct morse_usb_xfer *xfer,
+				 bool is_read, u32 address, u8 *data,
+				 struct scatterlist *sgl, int nents, int len)
+{
+	int ret;
+	bool use_sg = sgl && morse_usb_can_sg(musb, nents);
+	void *buf = NULL;
+	unsigned int pipe;
+
+	xfer->cmd->dir = cpu_to_le32(is_read ? MORSE_USB_READ : MORSE_USB_WRITE);
+	xfer->cmd->address = cpu_to_le32(address);
+	xfer->cmd->length = cpu_to_le32(len);
+	xfer->len = len;
+	xfer->copy_to = NULL;
+
+	if (sgl) {
+		if (!use_sg) {
+			sg_copy_to_buffer(sgl, nents, xfer->bounce, len);
+			buf = xfer->bounce;
+		}
+	} else if (morse_usb_buf_can_map(data, len, is_read)) {
+		buf = data;
+	} else {
+		buf = xfer->bounce;
+		if (is_read)
+			xfer->copy_to = data;
+		else
+			memcpy(xfer->bounce, data, len);
+	}
+
+	usb_fill_bulk_urb(xfer->cmd_urb, musb->udev,
+			  usb_sndbulkpipe(musb->udev, musb->endpoints[MORSE_EP_CMD].addr),
+			  xfer->cmd, sizeof(*xfer->cmd), morse_usb_xfer_cmd_callback, xfer);
+	xfer->cmd_urb->transfer_flags |= URB_NO_TRANSFER_DMA_MAP;
+
+	if (is_read)
+		pipe = usb_rcvbulkpipe(musb->udev, musb->endpoints[MORSE_EP_MEM_RD].addr);
+	else
+		pipe = usb_sndbulkpipe(musb->udev, musb->endpoints[MORSE_EP_MEM_WR].addr);
+	usb_fill_bulk_urb(xfer->data_urb, musb->udev, pipe, buf, len,
+			  morse_usb_xfer_data_callback, xfer);
+	if (use_sg) {
+		xfer->data_urb->sg = sgl;
+		xfer->data_urb->num_sgs = nents;
+	}
+
+	reinit_completion(&xfer->done);
+
+	usb_anchor_urb(xfer->cmd_urb, &musb->xfer_anchor);
+	ret = usb_submit_urb(xfer->cmd_urb, GFP_KERNEL);
+	if (ret) {
+		usb_unanchor_urb(xfer->cmd_urb);
+		return ret;
+	}
+
+	usb_anchor_urb(xfer->data_urb, &musb->xfer_anchor);
+	ret = usb_submit_urb(xfer->data_urb, GFP_KERNEL);
+	if (ret) {
+		usb_unanchor_urb(xfer->data_urb);
+		xfer->data_urb->sg = NULL;
+		xfer->data_urb->num_sgs = 0;
+		return ret;
+	}
+
+	xfer->in_use = true;
+	return 0;
+}
+
+/*
+ * Pipelined bulk transfer. The transfer is split into USB_MAX_TRANSFER_SIZE chunks, each
+ * announced by its own command, and up to MORSE_USB_XFER_DEPTH chunks are kept in flight.
+ * Commands share the memory write endpoint with written data, so the device sees every
+ * command and its data in the order they were issued, and chunks complete in that order.
+ *
+ * The source or destination is either a linear buffer (@sgl is NULL) or, for writes only,
+ * a scatterlist.
+ */
+static int morse_usb_xfer_run(struct morse_usb *musb, bool is_read, u32 address, u8 *data,
+			      struct scatterlist *sgl, int nents, int len)
+{
+	struct morse *mors = usb_get_intfdata(musb->interface);
+	unsigned int slot = 0;
+	int offset = 0;
+	int ret = 0;
+	int i;
+
+	if (!test_bit(MORSE_USB_FLAG_ATTACHED, &musb->flags))
+		return -ENODEV;
+
+	mutex_lock(&musb->lock);
+	atomic_set(&musb->xfer_error, 0);
+
+	while (offset < len) {
+		struct morse_usb_xfer *xfer = &musb->xfers[slot++ % MORSE_USB_XFER_DEPTH];
+		int size = min(len - offset, USB_MAX_TRANSFER_SIZE);
+		struct scatterlist *chunk_sg = NULL;
+		int chunk_nents = 0;
+
+		/* The slot's previous chunk is the oldest in flight */
+		ret = morse_usb_xfer_reap(musb, xfer);
+		if (ret)
+			goto error;
+
+		if (sgl) {
+			chunk_nents = morse_bus_sg_slice(sgl, nents, offset, size, xfer->sg_slice,
+							 ARRAY_SIZE(xfer->sg_slice));
+			if (chunk_nents < 0) {
+				ret = chunk_nents;
+				goto error;
+			}
+			chunk_sg = xfer->sg_slice;
+		}
+
+		ret = morse_usb_xfer_submit(musb, xfer, is_read, address + offset,
+					    sgl ? NULL : data + offset, chunk_sg, chunk_nents, size);
+		if (ret)
+			goto error;
+
+		offset += size;
+	}
+
+	/* Drain the pipeline, oldest chunk first */
+	for (i = 0; i < MORSE_USB_XFER_DEPTH; i++) {
+		ret = morse_usb_xfer_reap(musb, &musb->xfers[slot++ % MORSE_USB_XFER_DEPTH]);
+		if (ret)
+			goto error;
+	}
+
+	/* Command URBs finish ahead of their data, this only catches a misbehaving HCD */
+	if (!usb_wait_anchor_empty_timeout(&musb->xfer_anchor, URB_TIMEOUT_MS)) {
+		ret = -ETIMEDOUT;
+		goto error;
+	}
+
+	mutex_unlock(&musb->lock);
+	return 0;
+
+error:
+	MORSE_USB_ERR(mors, "%s: %s 0x%08x (%d bytes) failed %d\n", __func__,
+		      is_read ? "read" : "write", address + offset, len, ret);
+	usb_kill_anchored_urbs(&musb->xfer_anchor);
+	for (i = 0; i < MORSE_USB_XFER_DEPTH; i++) {
+		musb->xfers[i].in_use = false;
+		musb->xfers[i].data_urb->sg = NULL;
+		musb->xfers[i].data_urb->num_sgs = 0;
+	}
+	mutex_unlock(&musb->lock);
+	return ret;
+}
+
+static void morse_usb_xfer_free(struct morse_usb *musb)
+{
+	int i;
+
+	usb_kill_anchored_urbs(&musb->xfer_anchor);
+	musb->pipelined = false;
+
+	for (i = 0; i < MORSE_USB_XFER_DEPTH; i++) {
+		struct morse_usb_xfer *xfer = &musb->xfers[i];
+
+		if (xfer->cmd)
+			usb_free_coherent(musb->udev, sizeof(*xfer->cmd), xfer->cmd,
+					  xfer->cmd_urb->transfer_dma);
+		xfer->cmd = NULL;
+		kfree(xfer->bounce);
+		xfer->bounce = NULL;
+		usb_free_urb(xfer->data_urb);
+		xfer->data_urb = NULL;
+		usb_free_urb(xfer->cmd_urb);
+		xfer->cmd_urb = NULL;
+	}
+}
+
+static int morse_usb_xfer_init(struct morse_usb *musb)
+{
+	int i;
+
+	init_usb_anchor(&musb->xfer_anchor);
+
+	for (i = 0; i < MORSE_USB_XFER_DEPTH; i++) {
+		struct morse_usb_xfer *xfer = &musb->xfers[i];
+
+		xfer->musb = musb;
+		init_completion(&xfer->done);
+
+		xfer->cmd_urb = usb_alloc_urb(0, GFP_KERNEL);
+		xfer->data_urb = usb_alloc_urb(0, GFP_KERNEL);
+		if (!xfer->cmd_urb || !xfer->data_urb)
+			goto err;
+
+		xfer->cmd = usb_alloc_coherent(musb->udev, sizeof(*xfer->cmd), GFP_KERNEL,
+					       &xfer->cmd_urb->transfer_dma);
+		xfer->bounce = kmalloc(USB_MAX_TRANSFER_SIZE, GFP_KERNEL);
+		if (!xfer->cmd || !xfer->bounce)
+			goto err;
+	}
+
+	musb->pipelined = usb_pipelined_xfer;
+	return 0;
+
+err:
+	morse_usb_xfer_free(musb);
+	return -ENOMEM;
+}
+
+static bool morse_usb_set_pipelined(struct morse *mors, bool enable)
+{
+	struct morse_usb *musb = (struct morse_usb *)mors->drv_priv;
+	bool was_enabled;
+
+	mutex_lock(&musb->lock);
+	was_enabled = musb->pipelined;
+	/* The engine is unavailable if its transfers couldn't be allocated */
+	musb->pipelined = enable && musb->xfers[0].cmd;
+	mutex_unlock(&musb->lock);
+
+	return was_enabled;
+}
+
 static int morse_usb_dm_write(struct morse *mors, u32 address, const u8 *data, int len)
 {
 	ssize_t offset = 0;
@@ -520,6 +889,9 @@ static int morse_usb_dm_write(struct morse *mors, u32 address, const u8 *data, i
 	if (WARN_ON(len < 0))
 		return -EINVAL;
 
+	if (musb->pipelined)
+		return morse_usb_xfer_run(musb, false, address, (u8 *)data, NULL, 0, len);
+
 	while (offset < len) {
 		/* cast to ssize_t is so x64 build doesn't complain. */
 		ret = morse_usb_mem_write(musb, address + offset, (u8 *)(data + offset),
@@ -535,6 +907,41 @@ static int morse_usb_dm_write(struct morse *mors, u32 address, const u8 *data, i
 	return 0;
 }
 
+static int morse_usb_dm_write_sg(struct morse *mors, u32 address, struct scatterlist *sgl,
+				 int nents, int len)
+{
+	ssize_t offset = 0;
+	int ret;
+	struct morse_usb *musb = (struct morse_usb *)mors->drv_priv;
+
+	if (WARN_ON(len < 0))
+		return -EINVAL;
+
+	if (!morse_bus_sg_check(mors, sgl, nents, UINT_MAX))
+		return -EOPNOTSUPP;
+
+	if (musb->pipelined)
+		return morse_usb_xfer_run(musb, false, address, NULL, sgl, nents, len);
+
+	while (offset < len) {
+		ssize_t size = min((ssize_t)(len - offset), (ssize_t)USB_MAX_TRANSFER_SIZE);
+		int n = morse_bus_sg_slice(sgl, nents, offset, size,
+					   musb->sg_slice, ARRAY_SIZE(musb->sg_slice));
+
+		if (n < 0)
+			return n;
+
+		ret = __morse_usb_mem_write(musb, address + offset, NULL, musb->sg_slice, n, size);
+		if (ret < 0) {
+			MORSE_USB_ERR(mors, "%s failed (errno=%d)\n", __func__, ret);
+			return ret;
+		}
+		offset += ret;
+	}
+
+	return 0;
+}
+
 static int morse_usb_dm_read(struct morse *mors, u32 address, u8 *data, int len)
 {
 	ssize_t offset = 0;
@@ -544,6 +951,9 @@ static int morse_usb_dm_read(struct morse *mors, u32 address, u8 *data, int len)
 	if (WARN_ON(len < 0))
 		return -EINVAL;
 
+	if (musb->pipelined)
+		return morse_usb_xfer_run(musb, true, address, data, NULL, 0, len);
+
 	while (offset < len) {
 		/* cast to ssize_t is so x64 build doesn't complain. */
 		ret = morse_usb_mem_read(musb, address + offset, (u8 *)(data + offset),
@@ -627,6 +1037,7 @@ static void morse_usb_set_irq(struct morse *mors, bool enable)
 static const struct morse_bus_ops morse_usb_ops = {
 	.dm_read = morse_usb_dm_read,
 	.dm_write = morse_usb_dm_write,
+	.dm_write_sg = morse_usb_dm_write_sg,
 	.reg32_read = morse_usb_reg32_read,
 	.reg32_write = morse_usb_reg32_write,
 	.set_bus_enable = morse_usb_bus_enable,
@@ -634,6 +1045,7 @@ static const struct morse_bus_ops morse_usb_ops = {
 	.release = morse_usb_release_bus,
 	.reset = morse_usb_reset_bus,
 	.set_irq = morse_usb_set_irq,
+	.set_pipelined = morse_usb_set_pipelined,
 	.bulk_alignment = MORSE_DEFAULT_BULK_ALIGNMENT,
 };
 
@@ -803,6 +1215,10 @@ static int morse_usb_probe(struct usb_interface *interface, const struct usb_dev
 
 	set_bit(MORSE_USB_FLAG_ATTACHED, &musb->flags);
 
+	/* Not fatal, bulk transfers are then made one at a time */
+	if (morse_usb_xfer_init(musb))
+		MORSE_USB_WARN(mors, "Failed to allocate pipelined transfers\n");
+
 	ret = morse_chip_cfg_detect_and_init(mors, mors_chip_series);
 	if (ret < 0) {
 		MORSE_USB_ERR(mors, "morse_chip_cfg_detect_and_init failed: %d\n", ret);
@@ -817,6 +1233,11 @@ static int morse_usb_probe(struct usb_interface *interface, const struct usb_dev
 		morse_bus_test(mors, "USB");
 		goto usb_test_fin;
 	}
+
+	if (test_mode == MORSE_CONFIG_TEST_MODE_BUS_PROFILE) {
+		morse_bus_engine_profiler(mors);
+		goto usb_test_fin;
+	}
 #endif
 
 	mors->board_serial = serial;
@@ -935,10 +1356,13 @@ static void morse_urb_cleanup(struct morse *mors)
 	usb_kill_urb(rd_ep->urb);
 	usb_kill_urb(wr_ep->urb);
 	usb_kill_urb(cmd_ep->urb);
+	usb_kill_anchored_urbs(&musb->xfer_anchor);
 
 	/* Locking the bus. No USB communication after this point */
 	mutex_lock(&musb->lock);
 
+	morse_usb_xfer_free(musb);
+
 	if (int_ep->urb)
 		usb_free_coherent(musb->udev, MORSE_EP_INT_BUFFER_SIZE,
 				  int_ep->buffer, int_ep->urb->transfer_dma);
@@ -65,6 +65,9 @@ static int morse_vendor_ie_add_to_ie_list(struct morse_vif *mors_vif, u16 mgmt_t
 	list_add_tail(&item->list, &mors_vif->vendor_ie.ie_list);
 	spin_unlock_bh(&mors_vif->vendor_ie.lock);
 
+	if (mgmt_type_mask & MORSE_VENDOR_IE_TYPE_BEACON)
+		morse_beacon_template_invalidate(mors_vif);
+
 	return 0;
 }
 
@@ -92,6 +95,9 @@ static int morse_vendor_ie_clear_ie_list(struct morse_vif *mors_vif, u16 mgmt_ty
 	}
 	spin_unlock_bh(&mors_vif->vendor_ie.lock);
 
+	if (mgmt_type_mask & MORSE_VENDOR_IE_TYPE_BEACON)
+		morse_beacon_template_invalidate(mors_vif);
+
 	return 0;
 }
 
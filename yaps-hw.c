@@ -6,6 +6,8 @@
  */
 
 #include "linux/crc7.h"
+#include <linux/mm.h>
+#include <linux/scatterlist.h>
 
 #include "yaps-hw.h"
 #include "bus.h"
@@ -13,6 +15,8 @@
 #include "chip_if.h"
 #include "utils.h"
 #include "yaps.h"
+#include "skbq.h"
+#include "trace.h"
 
 #define YAPS_HW_WINDOW_SIZE_BYTES	32768
 #define YAPS_MAX_PKT_SIZE_BYTES		16128
@@ -27,6 +31,23 @@
 #define YAPS_PAGE_SIZE	256
 #define SDIO_BLOCKSIZE	512
 
+/* Number of page blocks the RX window is read into, recycled once their skbs are freed */
+#define YAPS_RX_PAGE_POOL_SIZE		4
+#define YAPS_RX_PAGE_ORDER		get_order(YAPS_HW_WINDOW_SIZE_BYTES)
+#define YAPS_RX_PAGE_BYTES		(PAGE_SIZE << YAPS_RX_PAGE_ORDER)
+/* Smallest read whose packets are attached as page fragments rather than copied. A block is
+ * only freed with the last skb holding a fragment of it, so each fragment is charged its
+ * share of the block by the bytes read into it. This bounds that to 4 times its length.
+ */
+#define YAPS_RX_FRAG_MIN_READ_BYTES	(YAPS_RX_PAGE_BYTES / 4)
+/* Bytes past the skb header copied into the linear area of a fragmented RX skb.
+ * Covers the largest 802.11 header plus CCMP and LLC/SNAP headers.
+ */
+#define YAPS_RX_COPYBREAK_BYTES		128
+
+/* A gathered write takes one entry for the delimiter and one for the data of each packet */
+#define YAPS_TX_SG_MAX_PKTS		(MORSE_BUS_SG_MAX_ENTS / 2)
+
 /* Calculate padding required for yaps transaction */
 #define YAPS_CALC_PADDING(_bytes) ((_bytes) & 0x3 ? (4 - ((_bytes) & 0x3)) : 0)
 
@@ -135,6 +156,19 @@ struct morse_yaps_hw_aux_data {
 	char *to_chip_buffer;
 	char *from_chip_buffer;
 
+	/* Gathered writes to chip. The scatterlist alternates delimiter and skb data entries,
+	 * delimiters are kept in their own allocation so they can be DMA'd from.
+	 */
+	struct scatterlist to_chip_sg[MORSE_BUS_SG_MAX_ENTS];
+	__le32 *to_chip_delims;
+
+	/* Page blocks the RX window is read into. Received data packets are attached to their
+	 * skbs as fragments of these pages, so a block is only reused once it is no longer
+	 * referenced by any skb. from_chip_buffer is used if no block can be allocated.
+	 */
+	struct page *rx_pages[YAPS_RX_PAGE_POOL_SIZE];
+	u8 rx_page_idx;
+
 	/* Status registers for queues and aloc pools on chip
 	 * This structure is filled directly by bus reads, so it is aligned to 8 bytes to support
 	 * MORSE_SDIO_ALIGNMENT of 1, 2, 4 or 8. Stricter alignment requirements will trigger a
@@ -143,16 +177,26 @@ struct morse_yaps_hw_aux_data {
 	struct morse_yaps_status_registers status_regs __aligned(8);
 };
 
-static int yaps_hw_lock(struct morse_yaps *yaps)
+/*
+ * Bits of access_lock. The RX and TX paths run in separate contexts, so each guards its own
+ * buffers. The status registers they share are only read and used with the bus claimed.
+ */
+enum yaps_hw_lock_bit {
+	YAPS_HW_LOCK_STATUS,
+	YAPS_HW_LOCK_TX,
+	YAPS_HW_LOCK_RX,
+};
+
+static int yaps_hw_lock(struct morse_yaps *yaps, enum yaps_hw_lock_bit bit)
 {
-	if (test_and_set_bit_lock(0, &yaps->aux_data->access_lock))
+	if (test_and_set_bit_lock(bit, &yaps->aux_data->access_lock))
 		return -1;
 	return 0;
 }
 
-static void yaps_hw_unlock(struct morse_yaps *yaps)
+static void yaps_hw_unlock(struct morse_yaps *yaps, enum yaps_hw_lock_bit bit)
 {
-	clear_bit_unlock(0, &yaps->aux_data->access_lock);
+	clear_bit_unlock(bit, &yaps->aux_data->access_lock);
 }
 
 static void morse_yaps_fill_aux_data_from_hw_tbl(struct morse_yaps_hw_aux_data *aux_data,
@@ -281,6 +325,42 @@ static bool morse_yaps_will_fit(struct morse_yaps *yaps, struct morse_yaps_pkt *
 	return will_fit;
 }
 
+static int morse_yaps_hw_tx_capacity(struct morse_yaps *yaps, enum morse_yaps_to_chip_q tc_queue,
+				     unsigned int pkt_len)
+{
+	struct morse_yaps_status_registers *status_regs = &yaps->aux_data->status_regs;
+	const int pages_required = morse_yaps_pages_required(yaps, pkt_len);
+	int pool_pages_avail;
+	int queue_pkts_avail;
+
+	switch (tc_queue) {
+	case MORSE_YAPS_TX_Q:
+		pool_pages_avail = status_regs->tc_tx_pool_num_pages;
+		queue_pkts_avail = yaps->aux_data->tc_tx_q_size - status_regs->tc_tx_num_pkts;
+		break;
+	case MORSE_YAPS_CMD_Q:
+		pool_pages_avail = status_regs->tc_cmd_pool_num_pages;
+		queue_pkts_avail = yaps->aux_data->tc_cmd_q_size - status_regs->tc_cmd_num_pkts;
+		break;
+	case MORSE_YAPS_BEACON_Q:
+		pool_pages_avail = status_regs->tc_beacon_pool_num_pages;
+		queue_pkts_avail = yaps->aux_data->tc_beacon_q_size -
+				   status_regs->tc_beacon_num_pkts;
+		break;
+	case MORSE_YAPS_MGMT_Q:
+		pool_pages_avail = status_regs->tc_mgmt_pool_num_pages;
+		queue_pkts_avail = yaps->aux_data->tc_mgmt_q_size - status_regs->tc_mgmt_num_pkts;
+		break;
+	default:
+		return 0;
+	}
+
+	/* Matches morse_yaps_will_fit() for the first packet, so this never reports 0 when
+	 * a packet of pkt_len would actually be accepted.
+	 */
+	return max(0, min(queue_pkts_avail, pool_pages_avail / pages_required));
+}
+
 static int morse_yaps_hw_write_pkt_err_check(struct morse_yaps *yaps, struct morse_yaps_pkt *pkt)
 {
 	if (pkt->skb->len + yaps->aux_data->reserved_yaps_page_size > YAPS_MAX_PKT_SIZE_BYTES)
@@ -293,6 +373,26 @@ static int morse_yaps_hw_write_pkt_err_check(struct morse_yaps *yaps, struct mor
 	return 0;
 }
 
+/*
+ * Write a batch of packets described by to_chip_sg. If the bus can't send the list as is, the
+ * batch is gathered into to_chip_buffer and written with a plain bulk write instead.
+ */
+static int morse_yaps_hw_write_sg(struct morse_yaps *yaps, int nents, int len)
+{
+	int ret;
+	struct morse_yaps_hw_aux_data *aux_data = yaps->aux_data;
+	char *to_chip_buffer_aligned = PTR_ALIGN(aux_data->to_chip_buffer,
+						  yaps->mors->bus_ops->bulk_alignment);
+
+	sg_mark_end(&aux_data->to_chip_sg[nents - 1]);
+	ret = morse_dm_write_sg(yaps->mors, aux_data->yds_addr, aux_data->to_chip_sg, nents, len);
+	if (ret != -EOPNOTSUPP)
+		return ret;
+
+	sg_copy_to_buffer(aux_data->to_chip_sg, nents, to_chip_buffer_aligned, len);
+	return morse_dm_write(yaps->mors, aux_data->yds_addr, to_chip_buffer_aligned, len);
+}
+
 static int morse_yaps_hw_write_pkts(struct morse_yaps *yaps,
 				    struct morse_yaps_pkt pkts[], int num_pkts, int *num_pkts_sent)
 {
@@ -302,12 +402,14 @@ static int morse_yaps_hw_write_pkts(struct morse_yaps *yaps,
 	char *to_chip_buffer_aligned = PTR_ALIGN(yaps->aux_data->to_chip_buffer,
 						  yaps->mors->bus_ops->bulk_alignment);
 	char *write_buf = to_chip_buffer_aligned;
+	struct scatterlist *sg = yaps->aux_data->to_chip_sg;
+	const bool use_sg = morse_bus_has_dm_write_sg(yaps->mors);
 	int tx_len;
 	int batch_txn_len = 0;
 	int pkts_pending = 0;
 	bool delim_irq = false;
 
-	ret = yaps_hw_lock(yaps);
+	ret = yaps_hw_lock(yaps, YAPS_HW_LOCK_TX);
 	if (ret) {
 		MORSE_YAPS_DBG(yaps->mors, "%s yaps lock failed %d\n", __func__, ret);
 		return ret;
@@ -320,6 +422,9 @@ static int morse_yaps_hw_write_pkts(struct morse_yaps *yaps,
 	if (ret)
 		goto exit;
 
+	if (use_sg)
+		sg_init_table(sg, MORSE_BUS_SG_MAX_ENTS);
+
 	/* Batch packets into larger transactions. Send as many as we have space for. */
 	for (i = 0; i < num_pkts; ++i) {
 		/* packets are padded with skb_pad.
@@ -330,9 +435,13 @@ static int morse_yaps_hw_write_pkts(struct morse_yaps *yaps,
 		tx_len = pkt_size + sizeof(delim);
 
 		/* Send when we have reached window size, don't split pkt over boundary */
-		if ((batch_txn_len + tx_len) > YAPS_HW_WINDOW_SIZE_BYTES) {
-			ret = morse_dm_write(yaps->mors, yaps->aux_data->yds_addr,
-					     to_chip_buffer_aligned, batch_txn_len);
+		if ((batch_txn_len + tx_len) > YAPS_HW_WINDOW_SIZE_BYTES ||
+		    (use_sg && pkts_pending == YAPS_TX_SG_MAX_PKTS)) {
+			if (use_sg)
+				ret = morse_yaps_hw_write_sg(yaps, pkts_pending * 2, batch_txn_len);
+			else
+				ret = morse_dm_write(yaps->mors, yaps->aux_data->yds_addr,
+						     to_chip_buffer_aligned, batch_txn_len);
 
 			batch_txn_len = 0;
 			if (ret)
@@ -340,6 +449,8 @@ static int morse_yaps_hw_write_pkts(struct morse_yaps *yaps,
 			write_buf = to_chip_buffer_aligned;
 			*num_pkts_sent += pkts_pending;
 			pkts_pending = 0;
+			if (use_sg)
+				sg_init_table(sg, MORSE_BUS_SG_MAX_ENTS);
 		}
 
 		if ((i + 1) == num_pkts) {
@@ -358,10 +469,19 @@ static int morse_yaps_hw_write_pkts(struct morse_yaps *yaps,
 		/* Build stream header */
 		/* Always set IRQ for the last packet so the chip doesn't miss it */
 		delim = morse_yaps_delimiter(yaps, pkt_size, pkts[i].tc_queue, delim_irq);
-		*((__le32 *)write_buf) = cpu_to_le32(delim);
-		memcpy(write_buf + sizeof(delim), pkts[i].skb->data, pkts[i].skb->len);
+		if (use_sg) {
+			/* The padding was zeroed in the skb tailroom by skb_pad() */
+			__le32 *sg_delim = &yaps->aux_data->to_chip_delims[pkts_pending];
+
+			*sg_delim = cpu_to_le32(delim);
+			sg_set_buf(&sg[pkts_pending * 2], sg_delim, sizeof(*sg_delim));
+			sg_set_buf(&sg[pkts_pending * 2 + 1], pkts[i].skb->data, pkt_size);
+		} else {
+			*((__le32 *)write_buf) = cpu_to_le32(delim);
+			memcpy(write_buf + sizeof(delim), pkts[i].skb->data, pkts[i].skb->len);
+			write_buf += tx_len;
+		}
 
-		write_buf += tx_len;
 		batch_txn_len += tx_len;
 		pkts_pending++;
 
@@ -371,12 +491,15 @@ static int morse_yaps_hw_write_pkts(struct morse_yaps *yaps,
 
 exit:
 	if (batch_txn_len > 0) {
-		ret = morse_dm_write(yaps->mors, yaps->aux_data->yds_addr,
-				     to_chip_buffer_aligned, batch_txn_len);
+		if (use_sg)
+			ret = morse_yaps_hw_write_sg(yaps, pkts_pending * 2, batch_txn_len);
+		else
+			ret = morse_dm_write(yaps->mors, yaps->aux_data->yds_addr,
+					     to_chip_buffer_aligned, batch_txn_len);
 		*num_pkts_sent += pkts_pending;
 	}
 
-	yaps_hw_unlock(yaps);
+	yaps_hw_unlock(yaps, YAPS_HW_LOCK_TX);
 	return ret;
 }
 
@@ -418,6 +541,101 @@ static int morse_calc_bytes_remaining(struct morse_yaps *yaps)
 	return (int)bytes_in_queue;
 }
 
+/* Returns a page block no longer referenced by any skb, or NULL if one can't be allocated */
+static struct page *morse_yaps_hw_get_rx_page(struct morse_yaps_hw_aux_data *aux_data)
+{
+	struct page *page;
+	int idx;
+	int i;
+
+	for (i = 0; i < YAPS_RX_PAGE_POOL_SIZE; i++) {
+		idx = (aux_data->rx_page_idx + i) % YAPS_RX_PAGE_POOL_SIZE;
+		page = aux_data->rx_pages[idx];
+
+		if (page && page_ref_count(page) == 1) {
+			aux_data->rx_page_idx = idx;
+			return page;
+		}
+	}
+
+	/* Every block is still held by in-flight skbs (or not yet allocated). Hand the next
+	 * one over to its skbs and replace it.
+	 */
+	idx = (aux_data->rx_page_idx + 1) % YAPS_RX_PAGE_POOL_SIZE;
+	if (aux_data->rx_pages[idx])
+		put_page(aux_data->rx_pages[idx]);
+
+	aux_data->rx_pages[idx] = alloc_pages(GFP_KERNEL | __GFP_COMP | __GFP_NOWARN,
+					      YAPS_RX_PAGE_ORDER);
+	aux_data->rx_page_idx = idx;
+
+	return aux_data->rx_pages[idx];
+}
+
+static void morse_yaps_hw_free_rx_pages(struct morse_yaps_hw_aux_data *aux_data)
+{
+	int i;
+
+	for (i = 0; i < YAPS_RX_PAGE_POOL_SIZE; i++) {
+		if (aux_data->rx_pages[i])
+			put_page(aux_data->rx_pages[i]);
+		aux_data->rx_pages[i] = NULL;
+	}
+}
+
+/*
+ * Build the skb for a packet that lies entirely in the RX window, @read_len bytes of which
+ * were read. Large data packets read into a page block only have their headers copied; the
+ * payload is attached as a page fragment. Everything else is copied into a linear skb,
+ * validating the checksum in the same pass.
+ */
+static struct sk_buff *morse_yaps_hw_rx_skb(struct morse_yaps *yaps, struct page *rx_page,
+					    char *window, int read_len, char *data, int pkt_size,
+					    enum morse_yaps_csum *csum)
+{
+	struct morse_buff_skb_header *hdr = (struct morse_buff_skb_header *)data;
+	bool validate = yaps->mors->chip_if->validate_skb_checksum;
+	int copy_len = pkt_size;
+	struct sk_buff *skb;
+
+	*csum = MORSE_YAPS_CSUM_UNCHECKED;
+
+	/* Checksum is validated in place, as the skb will not be linear */
+	if (rx_page && read_len >= YAPS_RX_FRAG_MIN_READ_BYTES &&
+	    pkt_size > (int)(sizeof(*hdr) + YAPS_RX_COPYBREAK_BYTES) &&
+	    hdr->channel == MORSE_SKB_CHAN_DATA &&
+	    (!validate || morse_validate_skb_checksum(data))) {
+		copy_len = min_t(int, pkt_size,
+				 sizeof(*hdr) + hdr->offset + YAPS_RX_COPYBREAK_BYTES);
+		if (validate)
+			*csum = MORSE_YAPS_CSUM_VALID;
+	}
+
+	skb = dev_alloc_skb(copy_len);
+	if (!skb)
+		return NULL;
+
+	if (validate && copy_len == pkt_size && *csum == MORSE_YAPS_CSUM_UNCHECKED) {
+		if (morse_copy_and_validate_skb_checksum(skb_put(skb, copy_len), data, copy_len))
+			*csum = MORSE_YAPS_CSUM_VALID;
+		else
+			*csum = MORSE_YAPS_CSUM_INVALID;
+		return skb;
+	}
+
+	memcpy(skb_put(skb, copy_len), data, copy_len);
+
+	if (copy_len < pkt_size) {
+		int frag_len = pkt_size - copy_len;
+
+		get_page(rx_page);
+		skb_add_rx_frag(skb, 0, rx_page, (data - window) + copy_len, frag_len,
+				DIV_ROUND_UP(frag_len * YAPS_RX_PAGE_BYTES, read_len));
+	}
+
+	return skb;
+}
+
 static int morse_yaps_hw_read_pkts(struct morse_yaps *yaps,
 				   struct morse_yaps_pkt pkts[],
 				   int num_pkts_max, int *num_pkts_received)
@@ -426,7 +644,10 @@ static int morse_yaps_hw_read_pkts(struct morse_yaps *yaps,
 	int i = 0;
 	char *from_chip_buffer_aligned = PTR_ALIGN(yaps->aux_data->from_chip_buffer,
 						 yaps->mors->bus_ops->bulk_alignment);
-	char *read_ptr = from_chip_buffer_aligned;
+	struct page *rx_page;
+	char *window;
+	char *read_ptr;
+	int read_len;
 	int bytes_remaining = morse_calc_bytes_remaining(yaps);
 	bool again = false;
 
@@ -442,20 +663,21 @@ static int morse_yaps_hw_read_pkts(struct morse_yaps *yaps,
 		again = true;
 	}
 
-	/* This is more coarse-grained than it needs to be -
-	 * once the data is read into a local buffer the lock can be released,
-	 * however access to from_chip_buffer will need to be protected with
-	 * its own lock
-	 */
-	ret = yaps_hw_lock(yaps);
+	/* Guards from_chip_buffer and the RX page pool. TX takes its own lock */
+	ret = yaps_hw_lock(yaps, YAPS_HW_LOCK_RX);
 	if (ret) {
 		MORSE_YAPS_DBG(yaps->mors, "%s yaps lock failed %d\n", __func__, ret);
 		return ret;
 	}
 
+	rx_page = morse_yaps_hw_get_rx_page(yaps->aux_data);
+	window = rx_page ? page_address(rx_page) : from_chip_buffer_aligned;
+	read_ptr = window;
+
+	read_len = bytes_remaining;
+
 	/* Read all available packets to the buffer */
-	ret = morse_dm_read(yaps->mors, yaps->aux_data->ysl_addr,
-			    from_chip_buffer_aligned, bytes_remaining);
+	ret = morse_dm_read(yaps->mors, yaps->aux_data->ysl_addr, window, bytes_remaining);
 
 	if (ret)
 		goto exit;
@@ -490,18 +712,17 @@ static int morse_yaps_hw_read_pkts(struct morse_yaps *yaps,
 		if (pkts[i].skb)
 			MORSE_YAPS_ERR(yaps->mors, "yaps packet leak\n");
 
-		/* SKB doesn't want padding */
-		pkts[i].skb = dev_alloc_skb(pkt_size);
-		if (!pkts[i].skb) {
-			ret = -ENOMEM;
-			MORSE_YAPS_ERR(yaps->mors, "yaps no mem for skb\n");
-			goto exit;
-		}
-		skb_put(pkts[i].skb, pkt_size);
-
 		if (total_len <= bytes_remaining) {
-			/* Case where entire packet fits in the remaining window */
-			memcpy(pkts[i].skb->data, read_ptr, pkt_size);
+			/* Case where entire packet fits in the remaining window.
+			 * SKB doesn't want padding.
+			 */
+			pkts[i].skb = morse_yaps_hw_rx_skb(yaps, rx_page, window, read_len,
+							   read_ptr, pkt_size, &pkts[i].csum);
+			if (!pkts[i].skb) {
+				ret = -ENOMEM;
+				MORSE_YAPS_ERR(yaps->mors, "yaps no mem for skb\n");
+				goto exit;
+			}
 			read_ptr += total_len;
 			bytes_remaining -= total_len;
 		} else {
@@ -509,10 +730,23 @@ static int morse_yaps_hw_read_pkts(struct morse_yaps *yaps,
 			const int read_overhang_len = total_len - bytes_remaining;
 			const int pkt_overhang_len = pkt_size - bytes_remaining;
 
-			yaps->mors->debug.page_stats.rx_split++;
+			/* SKB doesn't want padding */
+			pkts[i].skb = dev_alloc_skb(pkt_size);
+			if (!pkts[i].skb) {
+				ret = -ENOMEM;
+				MORSE_YAPS_ERR(yaps->mors, "yaps no mem for skb\n");
+				goto exit;
+			}
+			skb_put(pkts[i].skb, pkt_size);
+			pkts[i].csum = MORSE_YAPS_CSUM_UNCHECKED;
+
+			MORSE_PAGE_STAT_INC(yaps->mors, rx_split);
 			/* TODO remove the warning, this is not a kernel bug */
 			MORSE_DBG_RATELIMITED(yaps->mors, "yaps split pkt\n");
 			memcpy(pkts[i].skb->data, read_ptr, bytes_remaining);
+			/* Earlier packets may still reference the window, so never read the
+			 * overhang over it.
+			 */
 			read_ptr = from_chip_buffer_aligned;
 
 			ret = morse_dm_read(yaps->mors,
@@ -536,19 +770,20 @@ static int morse_yaps_hw_read_pkts(struct morse_yaps *yaps,
 		ret = -EAGAIN;
 
 exit:
-	yaps_hw_unlock(yaps);
+	yaps_hw_unlock(yaps, YAPS_HW_LOCK_RX);
 	return ret;
 }
 
 static int morse_yaps_hw_update_status(struct morse_yaps *yaps)
 {
 	int ret;
-	int tc_total_pkt_count;
+	int tc_total_pkt_count = 0;
 	unsigned long reg_read_timeout;
+	ktime_t start = morse_trace_start(morse_yaps_status);
 
 	struct morse_yaps_status_registers *status_regs = &yaps->aux_data->status_regs;
 
-	ret = yaps_hw_lock(yaps);
+	ret = yaps_hw_lock(yaps, YAPS_HW_LOCK_STATUS);
 	if (ret) {
 		MORSE_YAPS_DBG(yaps->mors, "%s yaps lock failed %d\n", __func__, ret);
 		return ret;
@@ -642,8 +877,13 @@ static int morse_yaps_hw_update_status(struct morse_yaps *yaps)
 	}
 
 exit_unlock:
-	yaps_hw_unlock(yaps);
+	yaps_hw_unlock(yaps, YAPS_HW_LOCK_STATUS);
 
+	trace_morse_yaps_status(status_regs->tc_tx_pool_num_pages,
+				status_regs->tc_cmd_pool_num_pages,
+				status_regs->fc_rx_pool_num_pages, tc_total_pkt_count,
+				status_regs->fc_num_pkts, status_regs->fc_done_num_pkts,
+				status_regs->fc_rx_bytes_in_queue, start, ret);
 	return ret;
 }
 
@@ -681,6 +921,7 @@ const struct morse_yaps_ops morse_yaps_hw_ops = {
 	.write_pkts = morse_yaps_hw_write_pkts,
 	.read_pkts = morse_yaps_hw_read_pkts,
 	.update_status = morse_yaps_hw_update_status,
+	.tx_capacity = morse_yaps_hw_tx_capacity,
 	.show = morse_yaps_hw_show
 };
 
@@ -727,6 +968,14 @@ int morse_yaps_hw_init(struct morse *mors)
 		goto err_exit;
 	}
 
+	yaps->aux_data->to_chip_delims = kcalloc(YAPS_TX_SG_MAX_PKTS,
+						 sizeof(*yaps->aux_data->to_chip_delims),
+						 GFP_KERNEL);
+	if (!yaps->aux_data->to_chip_delims) {
+		ret = -ENOMEM;
+		goto err_exit;
+	}
+
 	if (!IS_ALIGNED((uintptr_t)&yaps->aux_data->status_regs, alignment)) {
 		MORSE_YAPS_WARN(mors, "%s: Status registers are not aligned to %d bytes\n",
 				__func__, alignment);
@@ -772,14 +1021,19 @@ void morse_yaps_hw_finish(struct morse *mors)
 
 	yaps = mors->chip_if->yaps;
 	morse_yaps_hw_enable_irqs(mors, false);
-	morse_yaps_finish(yaps);
+	/* Stop the TX work, which can kick RX, before morse_yaps_finish() tears RX down. */
+	yaps->finish = true;
 	cancel_work_sync(&mors->chip_if_work);
 	cancel_work_sync(&mors->tx_stale_work);
+	morse_yaps_finish(yaps);
 	if (yaps->aux_data) {
+		morse_yaps_hw_free_rx_pages(yaps->aux_data);
 		kfree(yaps->aux_data->from_chip_buffer);
 		yaps->aux_data->from_chip_buffer = NULL;
 		kfree(yaps->aux_data->to_chip_buffer);
 		yaps->aux_data->to_chip_buffer = NULL;
+		kfree(yaps->aux_data->to_chip_delims);
+		yaps->aux_data->to_chip_delims = NULL;
 		kfree(yaps->aux_data);
 		yaps->aux_data = NULL;
 	}
@@ -7,6 +7,8 @@
 #include <linux/gpio.h>
 #include <linux/random.h>
 #include <linux/timer.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 
 #include "morse.h"
 #include "debug.h"
@@ -24,11 +26,23 @@
 /* This is a fail safe timeout */
 #define CHIP_FULL_RECOVERY_TIMEOUT_MS 30
 
-/* Defined as the most number of MPDUs per AMPDU */
+/* Upper bound for the adaptive TX batch size. Two full AMPDUs */
 #ifndef MAX_PKTS_PER_TX_TXN
-#define MAX_PKTS_PER_TX_TXN	16
+#define MAX_PKTS_PER_TX_TXN	32
 #endif
 
+/* Smallest batch the bus time budget may cut a transaction down to */
+#define YAPS_TX_BATCH_MIN		4
+
+/* Chip capacity a data AC leaves for each AC served after it that has frames waiting */
+#define YAPS_TX_BATCH_AC_RESERVE	YAPS_TX_BATCH_MIN
+
+/* Target bus time for a single TX transaction, so RX and other queues are not held off */
+#define YAPS_TX_BATCH_BUS_BUDGET_NS	(2 * NSEC_PER_MSEC)
+
+/* Weight of the newest sample in the bus time moving average, as a power of 2 */
+#define YAPS_TX_BATCH_EWMA_SHIFT	3
+
 /* 2 full AMPDUs (and also more than the number of RX pages in chip) */
 #ifndef MAX_PKTS_PER_RX_TXN
 #define MAX_PKTS_PER_RX_TXN	32
@@ -79,8 +93,10 @@ static struct morse_skbq *skbq_yaps_cmd_q(struct morse *mors)
 
 static int yaps_irq_handler(struct morse *mors, u32 status)
 {
-	if (test_bit(MORSE_INT_YAPS_FC_PKT_WAITING_IRQN, (unsigned long *)&status))
+	if (test_bit(MORSE_INT_YAPS_FC_PKT_WAITING_IRQN, (unsigned long *)&status)) {
 		set_bit(MORSE_RX_PEND, &mors->chip_if->event_flags);
+		morse_yaps_rx_kick(mors->chip_if->yaps);
+	}
 
 	if (test_bit(MORSE_INT_YAPS_FC_PACKET_FREED_UP_IRQN, (unsigned long *)&status)) {
 		/* No need for the timer anymore */
@@ -157,7 +173,8 @@ const struct chip_if_ops morse_yaps_ops = {
 	.chip_if_handle_irq = yaps_irq_handler
 };
 
-static int morse_yaps_read_pkt(struct morse_yaps *yaps, struct sk_buff *skb)
+static int morse_yaps_read_pkt(struct morse_yaps *yaps, struct sk_buff *skb,
+			       enum morse_yaps_csum csum)
 {
 	struct morse *mors = yaps->mors;
 	struct sk_buff_head skbq;
@@ -184,8 +201,14 @@ static int morse_yaps_read_pkt(struct morse_yaps *yaps, struct sk_buff *skb)
 		goto exit_return_page;
 	}
 
-	if (yaps->mors->chip_if->validate_skb_checksum && !morse_validate_skb_checksum(skb->data)) {
-		mors->debug.page_stats.invalid_checksum++;
+	/* Fragmented skbs, and most linear ones, have already been validated by the hw layer */
+	if (csum == MORSE_YAPS_CSUM_UNCHECKED && yaps->mors->chip_if->validate_skb_checksum &&
+	    !skb_is_nonlinear(skb))
+		csum = morse_validate_skb_checksum(skb->data) ?
+			MORSE_YAPS_CSUM_VALID : MORSE_YAPS_CSUM_INVALID;
+
+	if (csum == MORSE_YAPS_CSUM_INVALID) {
+		MORSE_PAGE_STAT_INC(mors, invalid_checksum);
 		MORSE_YAPS_DBG(yaps->mors, "SKB checksum is invalid hdr:[c:%02X s:%02X len:%d]",
 			       hdr->channel, hdr->sync, hdr->len);
 
@@ -196,7 +219,7 @@ static int morse_yaps_read_pkt(struct morse_yaps *yaps, struct sk_buff *skb)
 			ret = -EIO;
 			goto exit;
 		}
-		mors->debug.page_stats.invalid_tx_status_checksum++;
+		MORSE_PAGE_STAT_INC(mors, invalid_tx_status_checksum);
 	}
 
 	/* Get correct skbq for the data based on the declared channel */
@@ -235,18 +258,21 @@ static int morse_yaps_read_pkt(struct morse_yaps *yaps, struct sk_buff *skb)
 			       skb_len, skb_bytes_remaining);
 		ret = -ENOMEM;
 		/* Queue work to clear backlog */
-		queue_work(mors->net_wq, &mq->dispatch_work);
+		morse_skbq_rx_schedule(mq);
 		goto exit_return_page;
 	}
 
-	skb_trim(skb, skb_len);
+	if (pskb_trim(skb, skb_len)) {
+		ret = -ENOMEM;
+		goto exit;
+	}
 	__skb_queue_tail(&skbq, skb);
 
 	if (skbq.qlen)
 		morse_skbq_enq(mq, &skbq);
 
 	/* push packets up in a different context */
-	queue_work(mors->net_wq, &mq->dispatch_work);
+	morse_skbq_rx_schedule(mq);
 
 	goto exit;
 
@@ -264,6 +290,131 @@ exit:
 	return ret;
 }
 
+static enum morse_yaps_to_chip_q morse_yaps_tc_q_from_channel(u8 channel)
+{
+	switch (channel) {
+	case MORSE_SKB_CHAN_COMMAND:
+		return MORSE_YAPS_CMD_Q;
+	case MORSE_SKB_CHAN_BEACON:
+		return MORSE_YAPS_BEACON_Q;
+	case MORSE_SKB_CHAN_MGMT:
+		return MORSE_YAPS_MGMT_Q;
+	default:
+		return MORSE_YAPS_TX_Q;
+	}
+}
+
+/* Record that a context has been left with work to do, if it was not already */
+static void morse_yaps_ctx_pending(struct morse_yaps_ctx_stats *ctx)
+{
+	if (!ktime_to_ns(ctx->pending_since))
+		ctx->pending_since = ktime_get();
+}
+
+static void morse_yaps_ctx_run(struct morse_yaps_ctx_stats *ctx)
+{
+	s64 waited_us;
+
+	ctx->runs++;
+	if (!ktime_to_ns(ctx->pending_since))
+		return;
+
+	waited_us = ktime_us_delta(ktime_get(), ctx->pending_since);
+	ctx->pending_since = ktime_set(0, 0);
+	ctx->starved++;
+	ctx->starved_us_total += waited_us;
+	ctx->starved_us_max = max_t(u32, ctx->starved_us_max, waited_us);
+}
+
+/*
+ * The RX and TX contexts only hold the bus for their transactions with the chip, so one can
+ * prepare or deliver packets while the other is using the bus.
+ */
+static void morse_yaps_claim_bus(struct morse_yaps *yaps, struct morse_yaps_ctx_stats *ctx)
+{
+	ktime_t start = ktime_get();
+	s64 waited_us;
+
+	morse_claim_bus(yaps->mors);
+
+	waited_us = ktime_us_delta(ktime_get(), start);
+	ctx->bus_claims++;
+	ctx->bus_wait_us_total += waited_us;
+	ctx->bus_wait_us_max = max_t(u32, ctx->bus_wait_us_max, waited_us);
+}
+
+/*
+ * Chip capacity left to a data AC once YAPS_TX_BATCH_AC_RESERVE packets are set aside for
+ * each AC with frames waiting that morse_yaps_tx_data_handler() serves after it. Those ACs
+ * share the chip's TX pool, so a deep queue on one AC cannot take all of it for a pass.
+ */
+static int morse_yaps_tx_ac_capacity(struct morse_yaps *yaps, struct morse_skbq *mq,
+				     int capacity)
+{
+	int reserve = 0;
+	int aci;
+
+	if (mq < yaps->data_tx_qs || mq >= yaps->data_tx_qs + YAPS_TX_SKBQ_MAX)
+		return capacity;
+
+	for (aci = mq - yaps->data_tx_qs - 1; aci >= 0; aci--)
+		if (morse_skbq_count(&yaps->data_tx_qs[aci]))
+			reserve += YAPS_TX_BATCH_AC_RESERVE;
+
+	return max(capacity - reserve, min(capacity, YAPS_TX_BATCH_MIN));
+}
+
+/*
+ * Pick how many packets to dequeue for one transaction. This is bounded by the number
+ * of packets waiting on the AC's queue, so under light load frames are flushed as soon as
+ * they arrive, and by what the chip reported it can accept, so packets are not pulled
+ * off the queue only to be requeued. A data AC leaves some of that for the other ACs
+ * waiting, see morse_yaps_tx_ac_capacity(). Under heavy load the transaction is filled up
+ * to the amount the bus can move within YAPS_TX_BATCH_BUS_BUDGET_NS, going by the
+ * measured time of previous transactions.
+ *
+ * Returns 0 if the chip has no room for the packet at the head of the queue.
+ */
+static int morse_yaps_tx_batch_size(struct morse_yaps *yaps, struct morse_skbq *mq,
+				    enum morse_yaps_to_chip_q tc_queue, unsigned int head_len)
+{
+	int budget = min_t(int, morse_skbq_count(mq), MAX_PKTS_PER_TX_TXN);
+
+	if (yaps->ops->tx_capacity) {
+		int capacity = yaps->ops->tx_capacity(yaps, tc_queue, head_len);
+
+		budget = min(budget, morse_yaps_tx_ac_capacity(yaps, mq, capacity));
+	}
+
+	if (budget > YAPS_TX_BATCH_MIN && yaps->tx_batch.ns_per_pkt) {
+		int bus_pkts = YAPS_TX_BATCH_BUS_BUDGET_NS / yaps->tx_batch.ns_per_pkt;
+
+		budget = min(budget, max(bus_pkts, YAPS_TX_BATCH_MIN));
+	}
+
+	yaps->tx_batch.last_budget = budget;
+	return budget;
+}
+
+static void morse_yaps_tx_batch_update(struct morse_yaps *yaps, int num_pkts_sent, s64 bus_ns)
+{
+	u32 sample;
+	int bin;
+
+	if (num_pkts_sent <= 0)
+		return;
+
+	bin = min(fls(num_pkts_sent - 1), YAPS_TX_BATCH_HIST_BINS - 1);
+	yaps->tx_batch.hist[bin]++;
+
+	sample = (u32)min_t(s64, div_s64(bus_ns, num_pkts_sent), U32_MAX);
+	if (!yaps->tx_batch.ns_per_pkt)
+		yaps->tx_batch.ns_per_pkt = sample;
+	else
+		yaps->tx_batch.ns_per_pkt += ((s32)(sample - yaps->tx_batch.ns_per_pkt)) >>
+					     YAPS_TX_BATCH_EWMA_SHIFT;
+}
+
 static int morse_yaps_tx(struct morse_yaps *yaps, struct morse_skbq *mq)
 {
 	int ret = 0;
@@ -278,10 +429,18 @@ static int morse_yaps_tx(struct morse_yaps *yaps, struct morse_skbq *mq)
 	struct sk_buff *pfirst, *pnext;
 	struct morse *mors = yaps->mors;
 	struct morse_buff_skb_header *hdr;
+	enum morse_yaps_to_chip_q head_tc_queue = MORSE_YAPS_TX_Q;
+	unsigned int head_len = 0;
+	ktime_t start;
 
 	/* Check there is something on the queue */
 	spin_lock_bh(&mq->lock);
 	skb = skb_peek(&mq->skbq);
+	if (skb) {
+		hdr = (struct morse_buff_skb_header *)skb->data;
+		head_tc_queue = morse_yaps_tc_q_from_channel(hdr->channel);
+		head_len = skb->len;
+	}
 	spin_unlock_bh(&mq->lock);
 	if (!skb)
 		return 0;
@@ -290,62 +449,59 @@ static int morse_yaps_tx(struct morse_yaps *yaps, struct morse_skbq *mq)
 	__skb_queue_head_init(&skbq_sent);
 	__skb_queue_head_init(&skbq_failed);
 
-	if (mq == &yaps->cmd_q)
-		/* Purge timed-out commands (this should not happen) */
-		morse_skbq_purge(mq, &mq->pending);
-	else if (mq == &yaps->mgmt_q && mq->skbq.qlen > 0)
+	/*
+	 * Commands left on the pending queue belong to other outstanding requests, which
+	 * morse_cmd_tx() finishes itself on response or timeout, so they are not purged here.
+	 */
+	if (mq == &yaps->mgmt_q && mq->skbq.qlen > 0)
 		/* Purge old mgmt frames that have not been sent due to congestion */
 		morse_skbq_purge_aged(mors, mq);
 
-	/* We should replace MAX_PKTS_PER_TX_TXN with some heuristic that takes
-	 * into account free space in the queue and free pages in the pool
-	 */
-	num_items = morse_skbq_deq_num_items(mq, &skbq_to_send, MAX_PKTS_PER_TX_TXN);
+	morse_yaps_claim_bus(yaps, &yaps->tx_ctx);
 
-	skb_queue_walk_safe(&skbq_to_send, pfirst, pnext) {
-		enum morse_yaps_to_chip_q tc_queue;
+	/* Read the chip's free space before choosing how much to send */
+	ret = yaps->ops->update_status(yaps);
+	if (ret) {
+		morse_release_bus(mors);
+		return ret;
+	}
 
+	num_items = morse_yaps_tx_batch_size(yaps, mq, head_tc_queue, head_len);
+	if (!num_items) {
+		morse_release_bus(mors);
+		MORSE_PAGE_STAT_INC(mors, no_page);
+		return -EAGAIN;
+	}
+
+	num_items = morse_skbq_deq_num_items(mq, &skbq_to_send, num_items);
+
+	skb_queue_walk_safe(&skbq_to_send, pfirst, pnext) {
 		hdr = (struct morse_buff_skb_header *)pfirst->data;
-		switch (hdr->channel) {
-		case MORSE_SKB_CHAN_COMMAND:
-			tc_queue = MORSE_YAPS_CMD_Q;
-			break;
-		case MORSE_SKB_CHAN_BEACON:
-			tc_queue = MORSE_YAPS_BEACON_Q;
-			break;
-		case MORSE_SKB_CHAN_MGMT:
-			tc_queue = MORSE_YAPS_MGMT_Q;
-			break;
-		default:
-			tc_queue = MORSE_YAPS_TX_Q;
-			break;
-		}
-		to_chip_pkts[tc_pkt_idx].tc_queue = tc_queue;
+		to_chip_pkts[tc_pkt_idx].tc_queue = morse_yaps_tc_q_from_channel(hdr->channel);
 		to_chip_pkts[tc_pkt_idx].skb = pfirst;
 		tc_pkt_idx++;
 	}
 
 	/* Send queued packets to chip */
-	ret = yaps->ops->update_status(yaps);
-	if (ret)
-		return ret;
-
+	start = ktime_get();
 	ret = yaps->ops->write_pkts(yaps, to_chip_pkts, tc_pkt_idx, &num_pkts_sent);
+	morse_yaps_tx_batch_update(yaps, num_pkts_sent, ktime_to_ns(ktime_sub(ktime_get(), start)));
+	morse_release_bus(mors);
 
 	/* Move sent packets to done queue and update stats */
 	for (i = 0; i < num_pkts_sent; ++i) {
 		switch (to_chip_pkts[i].tc_queue) {
 		case MORSE_YAPS_CMD_Q:
-			mors->debug.page_stats.cmd_tx++;
+			MORSE_PAGE_STAT_INC(mors, cmd_tx);
 			break;
 		case MORSE_YAPS_BEACON_Q:
-			mors->debug.page_stats.bcn_tx++;
+			MORSE_PAGE_STAT_INC(mors, bcn_tx);
 			break;
 		case MORSE_YAPS_MGMT_Q:
-			mors->debug.page_stats.mgmt_tx++;
+			MORSE_PAGE_STAT_INC(mors, mgmt_tx);
 			break;
 		default:
-			mors->debug.page_stats.data_tx++;
+			MORSE_PAGE_STAT_INC(mors, data_tx);
 			break;
 		}
 		pfirst = __skb_dequeue(&skbq_to_send);
@@ -358,7 +514,7 @@ static int morse_yaps_tx(struct morse_yaps *yaps, struct morse_skbq *mq)
 	}
 
 	for (i = num_pkts_sent; i < num_items; ++i) {
-		mors->debug.page_stats.no_page++;
+		MORSE_PAGE_STAT_INC(mors, no_page);
 		pfirst = __skb_dequeue(&skbq_to_send);
 		__skb_queue_tail(&skbq_failed, pfirst);
 	}
@@ -367,7 +523,7 @@ static int morse_yaps_tx(struct morse_yaps *yaps, struct morse_skbq *mq)
 		morse_skbq_enq_prepend(mq, &skbq_failed);
 
 		/* queue full, cant requeue */
-		mors->debug.page_stats.write_fail += skbq_failed.qlen;
+		MORSE_PAGE_STAT_ADD(mors, write_fail, skbq_failed.qlen);
 		if (skbq_failed.qlen > 0) {
 			MORSE_YAPS_WARN(mors, "cant requeue failed pkts, skbq full, purging\n");
 			__skb_queue_purge(&skbq_failed);
@@ -448,25 +604,32 @@ static bool morse_yaps_rx_handler(struct morse_yaps *yaps)
 {
 	int ret = 0;
 	int i;
-	int num_pks_received;
+	int num_pks_received = 0;
+
+	morse_yaps_claim_bus(yaps, &yaps->rx_ctx);
 
 	ret = yaps->ops->update_status(yaps);
-	if (ret)
+	if (ret) {
+		morse_release_bus(yaps->mors);
 		goto exit;
+	}
+
+	ret = yaps->ops->read_pkts(yaps, from_chip_pkts, ARRAY_SIZE(from_chip_pkts),
+				   &num_pks_received);
+
+	/* The packets are delivered without holding the bus, so TX can carry on meanwhile */
+	morse_release_bus(yaps->mors);
 
-	ret =
-	    yaps->ops->read_pkts(yaps, from_chip_pkts, ARRAY_SIZE(from_chip_pkts),
-				 &num_pks_received);
 	if (ret && ret != -EAGAIN) {
 		MORSE_YAPS_ERR(yaps->mors, "YAPS read_pkts fail: %d", ret);
 		goto exit;
 	}
 
 	if (num_pks_received == 0)
-		yaps->mors->debug.page_stats.rx_empty++;
+		MORSE_PAGE_STAT_INC(yaps->mors, rx_empty);
 
 	for (i = 0; i < num_pks_received; ++i) {
-		morse_yaps_read_pkt(yaps, from_chip_pkts[i].skb);
+		morse_yaps_read_pkt(yaps, from_chip_pkts[i].skb, from_chip_pkts[i].csum);
 		from_chip_pkts[i].skb = NULL;
 	}
 
@@ -505,6 +668,52 @@ void morse_yaps_stale_tx_work(struct work_struct *work)
 	}
 }
 
+void morse_yaps_rx_kick(struct morse_yaps *yaps)
+{
+	if (yaps->finish)
+		return;
+
+	morse_yaps_ctx_pending(&yaps->rx_ctx);
+	queue_work(yaps->rx_wq, &yaps->rx_work);
+}
+
+/*
+ * Reads packets from the chip. This runs alongside morse_yaps_work(), so a burst of RX does
+ * not hold off TX or the reverse. The two only contend for the bus while talking to the chip.
+ */
+static void morse_yaps_rx_work(struct work_struct *work)
+{
+	struct morse_yaps *yaps = container_of(work, struct morse_yaps, rx_work);
+	struct morse *mors = yaps->mors;
+	unsigned long *flags = &mors->chip_if->event_flags;
+	int buffered;
+
+	/* Don't attempt to interact with device once it becomes unresponsive */
+	if (test_bit(MORSE_STATE_FLAG_CHIP_UNRESPONSIVE, &mors->state_flags))
+		return;
+
+	if (!test_and_clear_bit(MORSE_RX_PEND, flags))
+		return;
+
+	morse_yaps_ctx_run(&yaps->rx_ctx);
+
+	/* Disable power save in case it is running */
+	morse_ps_disable(mors);
+
+	/* Check if all pages were removed, set event flags if not */
+	buffered = yaps->data_rx_q.skbq.qlen;
+	if (morse_yaps_rx_handler(yaps))
+		set_bit(MORSE_RX_PEND, flags);
+
+	if (yaps->data_rx_q.skbq.qlen > buffered)
+		morse_ps_bus_activity(mors, NETWORK_BUS_TIMEOUT_MS);
+
+	morse_ps_enable(mors);
+
+	if (test_bit(MORSE_RX_PEND, flags))
+		morse_yaps_rx_kick(yaps);
+}
+
 void morse_yaps_work(struct work_struct *work)
 {
 	struct morse *mors = container_of(work,
@@ -517,26 +726,17 @@ void morse_yaps_work(struct work_struct *work)
 	if (test_bit(MORSE_STATE_FLAG_CHIP_UNRESPONSIVE, &mors->state_flags))
 		return;
 
-	if (!*flags)
+	/* RX is handled by its own context */
+	if (test_bit(MORSE_RX_PEND, flags))
+		morse_yaps_rx_kick(yaps);
+
+	if (!(*flags & ~BIT(MORSE_RX_PEND)))
 		return;
 
+	morse_yaps_ctx_run(&yaps->tx_ctx);
+
 	/* Disable power save in case it is running */
 	morse_ps_disable(mors);
-	morse_claim_bus(mors);
-
-	/* Handle any populated RX pages from chip first to
-	 * avoid dropping pkts due to full on-chip buffers.
-	 * Check if all pages were removed, set event flags if not.
-	 */
-	if (test_and_clear_bit(MORSE_RX_PEND, flags)) {
-		int buffered = yaps->data_rx_q.skbq.qlen;
-
-		if (morse_yaps_rx_handler(yaps))
-			set_bit(MORSE_RX_PEND, flags);
-
-		if (yaps->data_rx_q.skbq.qlen > buffered)
-			ps_bus_timeout_ms = max(ps_bus_timeout_ms, NETWORK_BUS_TIMEOUT_MS);
-	}
 
 	/* TX any commands before considering data */
 	if (test_and_clear_bit(MORSE_TX_COMMAND_PEND, flags)) {
@@ -599,26 +799,31 @@ void morse_yaps_work(struct work_struct *work)
 		}
 	}
 
-	if (test_and_clear_bit(MORSE_UPDATE_HW_CLOCK_REFERENCE, flags))
+	if (test_and_clear_bit(MORSE_UPDATE_HW_CLOCK_REFERENCE, flags)) {
+		morse_yaps_claim_bus(yaps, &yaps->tx_ctx);
 		morse_hw_clock_update(mors);
+		morse_release_bus(mors);
+	}
 
 exit:
 	if (ps_bus_timeout_ms)
 		morse_ps_bus_activity(mors, ps_bus_timeout_ms);
 
 	/* Disable power save in case it is running */
-	morse_release_bus(mors);
 	morse_ps_enable(mors);
 
 	/* Don't requeue work if we are shutting down. */
 	if (yaps->finish)
 		return;
 	/* Evaluate all events except MORSE_TX_DATA_PEND in case data tx queue is full */
-	if ((*flags) & ~(1 << MORSE_TX_DATA_PEND))
+	if ((*flags) & ~(BIT(MORSE_TX_DATA_PEND) | BIT(MORSE_RX_PEND))) {
+		morse_yaps_ctx_pending(&yaps->tx_ctx);
 		queue_work(mors->chip_wq, &mors->chip_if_work);
 	/* if data tx queue is not full and the work hasn't been queued let's queue it */
-	else if (!yaps->chip_queue_full.is_full && *flags)
+	} else if (!yaps->chip_queue_full.is_full && (*flags & ~BIT(MORSE_RX_PEND))) {
+		morse_yaps_ctx_pending(&yaps->tx_ctx);
 		queue_work(mors->chip_wq, &mors->chip_if_work);
+	}
 }
 
 int morse_yaps_get_tx_status_pending_count(struct morse *mors)
@@ -703,11 +908,14 @@ static int morse_tx_chip_full_timer_finish(struct morse_yaps *yaps)
 int morse_yaps_init(struct morse *mors, struct morse_yaps *yaps, u8 flags)
 {
 	int i;
+	int ret;
 
 	yaps->mors = mors;
 	yaps->flags = flags;
 	mors->chip_if->active_chip_if = MORSE_CHIP_IF_YAPS;
 
+	morse_tx_chip_full_timer_init(yaps);
+
 	if (yaps->flags & MORSE_CHIP_IF_FLAGS_DATA) {
 		/* YAPS is bi-directional */
 		morse_skbq_init(mors, &yaps->data_rx_q,
@@ -719,6 +927,10 @@ int morse_yaps_init(struct morse *mors, struct morse_yaps *yaps, u8 flags)
 		for (i = 0; i < ARRAY_SIZE(yaps->data_tx_qs); i++)
 			morse_skbq_init(mors, &yaps->data_tx_qs[i],
 					MORSE_CHIP_IF_FLAGS_DATA | MORSE_CHIP_IF_FLAGS_DIR_TO_CHIP);
+
+		ret = morse_skbq_napi_init(&yaps->data_rx_q);
+		if (ret)
+			return ret;
 	}
 
 	if (yaps->flags & MORSE_CHIP_IF_FLAGS_COMMAND) {
@@ -729,7 +941,10 @@ int morse_yaps_init(struct morse *mors, struct morse_yaps *yaps, u8 flags)
 				MORSE_CHIP_IF_FLAGS_COMMAND | MORSE_CHIP_IF_FLAGS_DIR_TO_HOST);
 	}
 
-	morse_tx_chip_full_timer_init(yaps);
+	yaps->rx_wq = create_singlethread_workqueue("MorseYapsRxWorkQ");
+	if (!yaps->rx_wq)
+		return -ENOMEM;
+	INIT_WORK(&yaps->rx_work, morse_yaps_rx_work);
 
 	return 0;
 }
@@ -740,6 +955,9 @@ void morse_yaps_finish(struct morse_yaps *yaps)
 
 	yaps->finish = true;
 
+	if (yaps->rx_wq)
+		cancel_work_sync(&yaps->rx_work);
+
 	if (yaps->flags & MORSE_CHIP_IF_FLAGS_DATA) {
 		morse_skbq_finish(&yaps->data_rx_q);
 		morse_skbq_finish(&yaps->beacon_q);
@@ -754,6 +972,14 @@ void morse_yaps_finish(struct morse_yaps *yaps)
 	}
 
 	morse_tx_chip_full_timer_finish(yaps);
+
+	/* Destroyed last, as TX work that was already running may still kick RX. Callers must
+	 * have cancelled the TX work before getting here.
+	 */
+	if (yaps->rx_wq) {
+		destroy_workqueue(yaps->rx_wq);
+		yaps->rx_wq = NULL;
+	}
 }
 
 void morse_yaps_show(struct morse_yaps *yaps, struct seq_file *file)
@@ -771,6 +997,44 @@ void morse_yaps_show(struct morse_yaps *yaps, struct seq_file *file)
 	yaps->ops->show(yaps, file);
 }
 
+static void morse_yaps_ctx_stats_show(const char *name, struct morse_yaps_ctx_stats *ctx,
+				      struct seq_file *file)
+{
+	seq_printf(file, "%s:\n", name);
+	seq_printf(file, "\truns: %u\n", ctx->runs);
+	seq_printf(file, "\tstarved: %u\n", ctx->starved);
+	seq_printf(file, "\tstarved us avg: %llu\n",
+		   ctx->starved ? div_u64(ctx->starved_us_total, ctx->starved) : 0);
+	seq_printf(file, "\tstarved us max: %u\n", ctx->starved_us_max);
+	seq_printf(file, "\tbus wait us avg: %llu\n",
+		   ctx->bus_claims ? div_u64(ctx->bus_wait_us_total, ctx->bus_claims) : 0);
+	seq_printf(file, "\tbus wait us max: %u\n", ctx->bus_wait_us_max);
+}
+
+void morse_yaps_ctx_show(struct morse_yaps *yaps, struct seq_file *file)
+{
+	morse_yaps_ctx_stats_show("rx", &yaps->rx_ctx, file);
+	morse_yaps_ctx_stats_show("tx", &yaps->tx_ctx, file);
+}
+
+void morse_yaps_tx_batch_show(struct morse_yaps *yaps, struct seq_file *file)
+{
+	int i;
+
+	seq_printf(file, "bus ns/pkt: %u\n", yaps->tx_batch.ns_per_pkt);
+	seq_printf(file, "last budget: %u\n", yaps->tx_batch.last_budget);
+	seq_puts(file, "pkts per txn:\n");
+	for (i = 0; i < YAPS_TX_BATCH_HIST_BINS; i++) {
+		int lo = (i == 0) ? 1 : (1 << (i - 1)) + 1;
+		int hi = 1 << i;
+
+		if (i == YAPS_TX_BATCH_HIST_BINS - 1)
+			seq_printf(file, "\t%3d+    : %u\n", lo, yaps->tx_batch.hist[i]);
+		else
+			seq_printf(file, "\t%3d-%-3d : %u\n", lo, hi, yaps->tx_batch.hist[i]);
+	}
+}
+
 #ifdef MORSE_YAPS_SUPPORTS_BENCHMARK
 int morse_yaps_benchmark(struct morse *mors, struct seq_file *file)
 {
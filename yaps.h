@@ -20,6 +20,9 @@
  */
 #define YAPS_TX_SKBQ_MAX			4
 
+/** Number of log2 sized bins in the histogram of packets written per TX transaction */
+#define YAPS_TX_BATCH_HIST_BINS			7
+
 /* Enable to support benchmarking the interface */
 
 #define MORSE_YAPS_SUPPORTS_BENCHMARK
@@ -45,6 +48,14 @@ enum morse_yaps_from_chip_q {
 	MORSE_YAPS_NUM_FC_Q
 };
 
+/* Checksum state of a from chip packet, as left by the yaps implementation */
+enum morse_yaps_csum {
+	/* Not checked yet, the packet is validated before it is queued */
+	MORSE_YAPS_CSUM_UNCHECKED = 0,
+	MORSE_YAPS_CSUM_VALID,
+	MORSE_YAPS_CSUM_INVALID,
+};
+
 struct morse_yaps_pkt {
 	/* For to-chip transfers the skb will be initialised by the caller.
 	 * For from-chip transfers the skb will be initialised by the callee.
@@ -56,6 +67,25 @@ struct morse_yaps_pkt {
 		/* Which queue a packet was received for from chip packets */
 		enum morse_yaps_from_chip_q fc_queue;
 	};
+	/* Checksum state for from chip packets */
+	enum morse_yaps_csum csum;
+};
+
+/* Starvation stats of one YAPS execution context (RX or TX) */
+struct morse_yaps_ctx_stats {
+	/* Number of times the context has run */
+	u32 runs;
+	/* Runs that found work left waiting since the context was last kicked or requeued */
+	u32 starved;
+	/* Time work was left waiting for the context to run (us) */
+	u64 starved_us_total;
+	u32 starved_us_max;
+	/* Bus claims made, and time spent waiting for the other context to release it (us) */
+	u32 bus_claims;
+	u64 bus_wait_us_total;
+	u32 bus_wait_us_max;
+	/* When work was first left waiting, zero if the context is idle */
+	ktime_t pending_since;
 };
 
 struct morse_yaps {
@@ -81,6 +111,22 @@ struct morse_yaps {
 		bool is_full;
 	} chip_queue_full;
 
+	/* State of the adaptive TX batch sizing, see morse_yaps_tx_batch_size() */
+	struct {
+		/* Moving average of bus time spent per packet written (ns) */
+		u32 ns_per_pkt;
+		/* Batch size chosen for the last transaction */
+		u16 last_budget;
+		/* Transactions by number of packets written: 1, 2, 3-4, 5-8, ... */
+		u32 hist[YAPS_TX_BATCH_HIST_BINS];
+	} tx_batch;
+
+	/* RX runs in its own context so it can overlap with TX, which runs as chip_if_work */
+	struct workqueue_struct *rx_wq;
+	struct work_struct rx_work;
+	struct morse_yaps_ctx_stats rx_ctx;
+	struct morse_yaps_ctx_stats tx_ctx;
+
 	u8 flags;
 
 	/**
@@ -134,6 +180,19 @@ struct morse_yaps_ops {
 	 */
 	int (*update_status)(struct morse_yaps *yaps);
 
+	/**
+	 * Estimates how many packets the chip can accept on a to chip queue, based on
+	 * the status registers from the last call to update_status. Optional.
+	 *
+	 * @yaps: Pointer to yaps instance
+	 * @tc_queue: To chip queue the packets are destined for
+	 * @pkt_len: Typical length of the packets, including the skb header
+	 *
+	 * Return: number of packets that will fit.
+	 */
+	int (*tx_capacity)(struct morse_yaps *yaps, enum morse_yaps_to_chip_q tc_queue,
+			   unsigned int pkt_len);
+
 	/**
 	 * Print debugging info to file
 	 *
@@ -165,19 +224,46 @@ int morse_yaps_init(struct morse *mors, struct morse_yaps *yaps, u8 flags);
 void morse_yaps_show(struct morse_yaps *yaps, struct seq_file *file);
 
 /**
- * Cleans up memory used by yaps instance.
+ * Prints the state of the adaptive TX batch sizing and a histogram of the
+ * number of packets written per transaction.
+ *
+ * @yaps: Pointer to yaps struct to print
+ * @file: Pointer to file to print to
+ */
+void morse_yaps_tx_batch_show(struct morse_yaps *yaps, struct seq_file *file);
+
+/**
+ * Prints the starvation stats of the RX and TX execution contexts.
+ *
+ * @yaps: Pointer to yaps struct to print
+ * @file: Pointer to file to print to
+ */
+void morse_yaps_ctx_show(struct morse_yaps *yaps, struct seq_file *file);
+
+/**
+ * Cleans up memory used by yaps instance. The chip interface work must already have been
+ * cancelled, as it may kick RX.
  *
  * @yaps: Pointer to yaps struct to delete.
  */
 void morse_yaps_finish(struct morse_yaps *yaps);
 
 /**
- * Work function executed to perform yaps operations
+ * Work function executed to perform yaps operations, except for RX which is handed to
+ * the RX context.
  *
  * @work: Pointer to work struct.
  */
 void morse_yaps_work(struct work_struct *work);
 
+/**
+ * Schedule the RX context to read packets from the chip. Callers must have set
+ * MORSE_RX_PEND.
+ *
+ * @yaps: Pointer to yaps struct
+ */
+void morse_yaps_rx_kick(struct morse_yaps *yaps);
+
 /**
  * Work function to remove stale pending tx SKBs
  *